@@ -8,13 +8,29 @@ namespace torch_ipex {
 namespace cpu {
 
 IPEX_DEFINE_DISPATCH(all_reduce_add_kernel_stub);
+IPEX_DEFINE_DISPATCH(all_reduce_add_async_kernel_stub);
+IPEX_DEFINE_DISPATCH(all_reduce_wait_kernel_stub);
 IPEX_DEFINE_DISPATCH(allgather_kernel_stub);
+IPEX_DEFINE_DISPATCH(broadcast_kernel_stub);
 
 at::Tensor all_reduce_add(at::Tensor t_in) {
   RECORD_FUNCTION("ipex::all_reduce_add", c10::ArrayRef<c10::IValue>({}));
   return all_reduce_add_kernel_stub(kCPU, t_in);
 }
 
+// Starts the all-reduce of t_in and returns a handle for all_reduce_wait,
+// t_in must not be accessed until the handle is waited.
+int64_t all_reduce_add_async(at::Tensor t_in) {
+  RECORD_FUNCTION(
+      "ipex::all_reduce_add_async", c10::ArrayRef<c10::IValue>({}));
+  return all_reduce_add_async_kernel_stub(kCPU, t_in);
+}
+
+void all_reduce_wait(int64_t handle) {
+  RECORD_FUNCTION("ipex::all_reduce_wait", c10::ArrayRef<c10::IValue>({}));
+  all_reduce_wait_kernel_stub(kCPU, handle);
+}
+
 at::Tensor allgather(
     at::Tensor t_in,
     std::vector<int64_t> cols_per_rank,
@@ -23,6 +39,11 @@ at::Tensor allgather(
   return allgather_kernel_stub(kCPU, t_in, cols_per_rank, world_size);
 }
 
+at::Tensor broadcast(at::Tensor t_in, int64_t root) {
+  RECORD_FUNCTION("ipex::broadcast", c10::ArrayRef<c10::IValue>({}));
+  return broadcast_kernel_stub(kCPU, t_in, root);
+}
+
 } // namespace cpu
 } // namespace torch_ipex
 
@@ -32,8 +53,17 @@ TORCH_LIBRARY_FRAGMENT(torch_ipex, m) {
   m.def("all_reduce_add(Tensor(a!) t_in)-> (Tensor)");
   m.impl(
       "all_reduce_add", c10::DispatchKey::CPU, torch_ipex::cpu::all_reduce_add);
+  m.def("all_reduce_add_async(Tensor(a!) t_in)-> int");
+  m.impl(
+      "all_reduce_add_async",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::all_reduce_add_async);
+  m.def("all_reduce_wait(int handle)-> ()");
+  m.impl("all_reduce_wait", torch_ipex::cpu::all_reduce_wait);
   m.def("allgather(Tensor input, int[] output, int world_size) -> (Tensor)");
   m.impl("allgather", c10::DispatchKey::CPU, torch_ipex::cpu::allgather);
+  m.def("broadcast(Tensor(a!) t_in, int root)-> (Tensor)");
+  m.impl("broadcast", c10::DispatchKey::CPU, torch_ipex::cpu::broadcast);
 }
 } // namespace
 #endif
\ No newline at end of file
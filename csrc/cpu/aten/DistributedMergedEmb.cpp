@@ -62,6 +62,7 @@ void mergedemb_distribute_forward_merge_cpu(
 
 IPEX_DEFINE_DISPATCH(mergedemb_distribute_backward_local_kernel_stub);
 IPEX_DEFINE_DISPATCH(mergedemb_distribute_backward_merge_adagrad_update_stub);
+IPEX_DEFINE_DISPATCH(mergedemb_distribute_backward_merge_adam_update_stub);
 /**
  * mergedemb_distribute_backward_local_cpu -> sparse_all_to_all ->
  * mergedemb_distribute_backward_merge_adagrad_update_cpu. Will serve the
@@ -115,6 +116,44 @@ void mergedemb_distribute_backward_merge_adagrad_update_cpu(
   return mergedemb_distribute_backward_merge_adagrad_update_stub(
       kCPU, idx, val, ofs, weight, weight_trail, hessian, lr, eps);
 }
+
+void mergedemb_distribute_backward_merge_adam_update_cpu(
+    const TensorList& idx,
+    const TensorList& val,
+    const TensorList& ofs,
+    Tensor& weight,
+    Tensor& weight_trail,
+    Tensor& exp_avg,
+    Tensor& exp_avg_sq,
+    const int64_t step,
+    const double lr,
+    const double beta1,
+    const double beta2,
+    const double eps,
+    const double weight_decay,
+    const bool use_lamb) {
+  // return None
+  RECORD_FUNCTION(
+      "ipex::mergedemb_distribute_backward_merge_adam_update_cpu",
+      c10::ArrayRef<c10::IValue>({}));
+  TORCH_CHECK(step > 0, "expect step to be positive, but got ", step);
+  return mergedemb_distribute_backward_merge_adam_update_stub(
+      kCPU,
+      idx,
+      val,
+      ofs,
+      weight,
+      weight_trail,
+      exp_avg,
+      exp_avg_sq,
+      step,
+      lr,
+      beta1,
+      beta2,
+      eps,
+      weight_decay,
+      use_lamb);
+}
 } // namespace cpu
 } // namespace torch_ipex
 
@@ -151,5 +190,13 @@ TORCH_LIBRARY_FRAGMENT(torch_ipex, m) {
       "mergedemb_distribute_backward_merge_adagrad_update",
       c10::DispatchKey::CPU,
       torch_ipex::cpu::mergedemb_distribute_backward_merge_adagrad_update_cpu);
+
+  // backward merge and row-wise adam/lamb update
+  m.def(
+      "mergedemb_distribute_backward_merge_adam_update(Tensor []idx, Tensor []val, Tensor []ofs, Tensor wgt, Tensor trail, Tensor exp_avg, Tensor exp_avg_sq, int step, float lr, float beta1, float beta2, float eps, float weight_decay, bool use_lamb) -> ()");
+  m.impl(
+      "mergedemb_distribute_backward_merge_adam_update",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::mergedemb_distribute_backward_merge_adam_update_cpu);
 }
 } // namespace
@@ -2,6 +2,7 @@
 #include "autocast/autocast_mode.h"
 #include "cpu/kernels/Embeddingbag.h"
 #include "utils/rw_lock.h"
+#include "vec/rowwise_quant_utils.hpp"
 
 #include <ATen/Parallel.h>
 #include <ATen/Tensor.h>
@@ -20,6 +21,10 @@ namespace cpu {
 IPEX_DEFINE_DISPATCH(embedding_bag_kernel_stub);
 IPEX_DEFINE_DISPATCH(embedding_bag_backward_kernel_stub);
 IPEX_DEFINE_DISPATCH(embedding_bag_int8_kernel_stub);
+IPEX_DEFINE_DISPATCH(embedding_bag_build_hot_cache_kernel_stub);
+IPEX_DEFINE_DISPATCH(embedding_bag_hot_cache_kernel_stub);
+IPEX_DEFINE_DISPATCH(rowwise_quantized_embedding_pack_kernel_stub);
+IPEX_DEFINE_DISPATCH(rowwise_quantized_embedding_bag_kernel_stub);
 
 class NewEmbeddingBagOp : public torch::autograd::Function<NewEmbeddingBagOp> {
  public:
@@ -120,6 +125,142 @@ at::Tensor dil_qembeddingbag(
       kCPU, weight, indices, offsets, o_scale, include_last_offset);
 }
 
+std::tuple<at::Tensor, at::Tensor> embedding_bag_build_hot_cache(
+    const at::Tensor& weight,
+    const at::Tensor& sample_indices,
+    int64_t capacity) {
+  RECORD_FUNCTION(
+      "embedding_bag_build_hot_cache", c10::ArrayRef<c10::IValue>({}));
+  TORCH_CHECK(
+      weight.dim() == 2 && weight.is_contiguous(),
+      "embedding_bag_build_hot_cache: expect a contiguous 2D weight");
+  TORCH_CHECK(
+      sample_indices.scalar_type() == at::kLong,
+      "embedding_bag_build_hot_cache: expect int64 sample_indices");
+  TORCH_CHECK(
+      capacity >= 0, "embedding_bag_build_hot_cache: negative capacity");
+  /*
+  pointer to torch_ipex::cpu::embedding_bag_build_hot_cache_kernel_impl(
+      weight, sample_indices, capacity);
+  */
+  return embedding_bag_build_hot_cache_kernel_stub(
+      kCPU, weight, sample_indices, capacity);
+}
+
+at::Tensor embedding_bag_hot_cache(
+    const at::Tensor& weight,
+    const at::Tensor& hot_weight,
+    const at::Tensor& hot_map,
+    const at::Tensor& indices,
+    const at::Tensor& offsets,
+    at::Tensor& stats,
+    bool include_last_offset) {
+  RECORD_FUNCTION("embedding_bag_hot_cache", c10::ArrayRef<c10::IValue>({}));
+  TORCH_CHECK(
+      !(at::GradMode::is_enabled() && weight.requires_grad()),
+      "embedding_bag_hot_cache: only supports inference");
+  TORCH_CHECK(
+      weight.dim() == 2 && weight.is_contiguous() &&
+          (weight.scalar_type() == at::kFloat ||
+           weight.scalar_type() == at::kBFloat16),
+      "embedding_bag_hot_cache: expect a contiguous 2D fp32/bf16 weight");
+  TORCH_CHECK(
+      hot_weight.is_contiguous() &&
+          hot_weight.scalar_type() == weight.scalar_type() &&
+          hot_weight.size(-1) == weight.size(1),
+      "embedding_bag_hot_cache: hot_weight doesn't match weight");
+  int64_t map_size = hot_map.size(0);
+  TORCH_CHECK(
+      hot_map.is_contiguous() && hot_map.scalar_type() == at::kLong &&
+          hot_map.dim() == 2 && hot_map.size(1) == 2 && map_size > 0 &&
+          (map_size & (map_size - 1)) == 0,
+      "embedding_bag_hot_cache: expect the hot_map built by "
+      "embedding_bag_build_hot_cache");
+  TORCH_CHECK(
+      indices.scalar_type() == at::kLong && offsets.scalar_type() == at::kLong,
+      "embedding_bag_hot_cache: expect int64 indices and offsets");
+  TORCH_CHECK(
+      stats.is_contiguous() && stats.scalar_type() == at::kLong &&
+          stats.numel() == 2,
+      "embedding_bag_hot_cache: expect int64 stats of 2 elements");
+  /*
+  pointer to torch_ipex::cpu::embedding_bag_hot_cache_kernel_impl(
+      weight, hot_weight, hot_map, indices, offsets, stats,
+      include_last_offset);
+  */
+  return embedding_bag_hot_cache_kernel_stub(
+      kCPU,
+      weight,
+      hot_weight,
+      hot_map,
+      indices,
+      offsets,
+      stats,
+      include_last_offset);
+}
+
+at::Tensor rowwise_quantized_embedding_pack(
+    const at::Tensor& weight,
+    at::ScalarType qtype) {
+  RECORD_FUNCTION(
+      "rowwise_quantized_embedding_pack", c10::ArrayRef<c10::IValue>({}));
+  TORCH_CHECK(
+      qtype == at::kQUInt4x2 || qtype == at::kFloat8_e4m3fn,
+      "rowwise_quantized_embedding_pack: only supports quint4x2 and "
+      "float8_e4m3fn");
+  TORCH_CHECK(
+      weight.dim() == 2,
+      "rowwise_quantized_embedding_pack: expect a 2D weight");
+  /*
+  pointer to torch_ipex::cpu::rowwise_quantized_embedding_pack_kernel_impl(
+      weight, qtype);
+  */
+  return rowwise_quantized_embedding_pack_kernel_stub(kCPU, weight, qtype);
+}
+
+at::Tensor rowwise_quantized_embedding_bag(
+    const at::Tensor& qweight,
+    const at::Tensor& indices,
+    const at::Tensor& offsets,
+    at::ScalarType qtype,
+    int64_t dim,
+    int64_t pooling_mode,
+    bool include_last_offset) {
+  RECORD_FUNCTION(
+      "rowwise_quantized_embedding_bag", c10::ArrayRef<c10::IValue>({}));
+  TORCH_CHECK(
+      qtype == at::kQUInt4x2 || qtype == at::kFloat8_e4m3fn,
+      "rowwise_quantized_embedding_bag: only supports quint4x2 and "
+      "float8_e4m3fn");
+  TORCH_CHECK(
+      qweight.dim() == 2 && qweight.is_contiguous() &&
+          qweight.scalar_type() == at::kByte &&
+          qweight.size(1) == rowwise_quant_row_bytes(qtype, dim),
+      "rowwise_quantized_embedding_bag: expect the qweight packed by "
+      "rowwise_quantized_embedding_pack");
+  TORCH_CHECK(
+      indices.scalar_type() == at::kLong && offsets.scalar_type() == at::kLong,
+      "rowwise_quantized_embedding_bag: expect int64 indices and offsets");
+  TORCH_CHECK(
+      pooling_mode == 0 || pooling_mode == 1,
+      "rowwise_quantized_embedding_bag: pooling_mode should be 0 (sum) or 1 "
+      "(mean)");
+  /*
+  pointer to torch_ipex::cpu::rowwise_quantized_embedding_bag_kernel_impl(
+      qweight, indices, offsets, qtype, dim, pooling_mode == 1,
+      include_last_offset);
+  */
+  return rowwise_quantized_embedding_bag_kernel_stub(
+      kCPU,
+      qweight,
+      indices,
+      offsets,
+      qtype,
+      dim,
+      pooling_mode == 1,
+      include_last_offset);
+}
+
 } // namespace cpu
 } // namespace torch_ipex
 
@@ -176,5 +317,35 @@ TORCH_LIBRARY_FRAGMENT(torch_ipex, m) {
       "embedding_bag",
       c10::DispatchKey::AutocastCPU,
       torch_ipex::autocast::embedding_bag);
+  m.def(
+      "embedding_bag_build_hot_cache(Tensor weight, Tensor sample_indices, "
+      "int capacity) -> (Tensor, Tensor)");
+  m.impl(
+      "embedding_bag_build_hot_cache",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::embedding_bag_build_hot_cache);
+  m.def(
+      "embedding_bag_hot_cache(Tensor weight, Tensor hot_weight, "
+      "Tensor hot_map, Tensor indices, Tensor offsets, Tensor(a!) stats, "
+      "bool include_last_offset) -> Tensor");
+  m.impl(
+      "embedding_bag_hot_cache",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::embedding_bag_hot_cache);
+  m.def(
+      "rowwise_quantized_embedding_pack(Tensor weight, ScalarType qtype) "
+      "-> Tensor");
+  m.impl(
+      "rowwise_quantized_embedding_pack",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::rowwise_quantized_embedding_pack);
+  m.def(
+      "rowwise_quantized_embedding_bag(Tensor qweight, Tensor indices, "
+      "Tensor offsets, ScalarType qtype, int dim, int pooling_mode, "
+      "bool include_last_offset) -> Tensor");
+  m.impl(
+      "rowwise_quantized_embedding_bag",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::rowwise_quantized_embedding_bag);
 }
 } // namespace
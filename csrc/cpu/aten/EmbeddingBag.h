@@ -38,6 +38,33 @@ at::Tensor embedding_bag_int8_kernel_impl(
     double o_scale,
     bool include_last_offset);
 
+std::tuple<at::Tensor, at::Tensor> embedding_bag_build_hot_cache_kernel_impl(
+    const at::Tensor& weight,
+    const at::Tensor& sample_indices,
+    int64_t capacity);
+
+at::Tensor embedding_bag_hot_cache_kernel_impl(
+    const at::Tensor& weight,
+    const at::Tensor& hot_weight,
+    const at::Tensor& hot_map,
+    const at::Tensor& indices,
+    const at::Tensor& offsets,
+    at::Tensor& stats,
+    bool include_last_offset);
+
+at::Tensor rowwise_quantized_embedding_pack_kernel_impl(
+    const at::Tensor& weight,
+    at::ScalarType qtype);
+
+at::Tensor rowwise_quantized_embedding_bag_kernel_impl(
+    const at::Tensor& qweight,
+    const at::Tensor& indices,
+    const at::Tensor& offsets,
+    at::ScalarType qtype,
+    int64_t dim,
+    bool mean,
+    bool include_last_offset);
+
 } // namespace
 
 using embedding_bag_kernel_fn = at::Tensor (*)(
@@ -67,5 +94,44 @@ IPEX_DECLARE_DISPATCH(
     embedding_bag_int8_kernel_fn,
     embedding_bag_int8_kernel_stub);
 
+using embedding_bag_build_hot_cache_kernel_fn =
+    std::tuple<at::Tensor, at::Tensor> (*)(
+        const at::Tensor&,
+        const at::Tensor&,
+        int64_t);
+IPEX_DECLARE_DISPATCH(
+    embedding_bag_build_hot_cache_kernel_fn,
+    embedding_bag_build_hot_cache_kernel_stub);
+
+using embedding_bag_hot_cache_kernel_fn = at::Tensor (*)(
+    const at::Tensor&,
+    const at::Tensor&,
+    const at::Tensor&,
+    const at::Tensor&,
+    const at::Tensor&,
+    at::Tensor&,
+    bool);
+IPEX_DECLARE_DISPATCH(
+    embedding_bag_hot_cache_kernel_fn,
+    embedding_bag_hot_cache_kernel_stub);
+
+using rowwise_quantized_embedding_pack_kernel_fn =
+    at::Tensor (*)(const at::Tensor&, at::ScalarType);
+IPEX_DECLARE_DISPATCH(
+    rowwise_quantized_embedding_pack_kernel_fn,
+    rowwise_quantized_embedding_pack_kernel_stub);
+
+using rowwise_quantized_embedding_bag_kernel_fn = at::Tensor (*)(
+    const at::Tensor&,
+    const at::Tensor&,
+    const at::Tensor&,
+    at::ScalarType,
+    int64_t,
+    bool,
+    bool);
+IPEX_DECLARE_DISPATCH(
+    rowwise_quantized_embedding_bag_kernel_fn,
+    rowwise_quantized_embedding_bag_kernel_stub);
+
 } // namespace cpu
 } // namespace torch_ipex
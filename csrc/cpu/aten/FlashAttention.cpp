@@ -1,11 +1,16 @@
 #include "FlashAttention.h"
+#include <ATen/CPUGeneratorImpl.h>
+#include <ATen/NativeFunctions.h>
 #include <torch/all.h>
+#include <torch/csrc/autograd/custom_function.h>
 #include <torch/csrc/autograd/function.h>
+#include "utils/library.h"
 
 namespace torch_ipex {
 namespace cpu {
 
 IPEX_DEFINE_DISPATCH(flash_attention_kernel_stub);
+IPEX_DEFINE_DISPATCH(flash_attention_backward_kernel_stub);
 
 // When stride=0, MKL gemm causes error.
 // Fallback to flash attention in PT.
@@ -19,6 +24,48 @@ bool use_ipex_flash_attention(
   return ((qStrideM >= 1) && (kStrideN >= 1) && (vStrideN >= 1));
 }
 
+// The flash attention of PT expects Q/K/V with the same number of heads,
+// expand K/V of grouped-query attention for it.
+at::Tensor expand_kv_heads(const at::Tensor& kv, int64_t num_head) {
+  int64_t num_kv_head = kv.size(1);
+  if (num_kv_head == num_head) {
+    return kv;
+  }
+  TORCH_CHECK(
+      num_kv_head > 0 && num_head % num_kv_head == 0,
+      "flash_attention: the number of query heads should be a multiple of the key/value heads");
+  return kv.repeat_interleave(num_head / num_kv_head, 1);
+}
+
+// Sum the gradients of the expanded K/V back over the query heads of each
+// kv group.
+at::Tensor reduce_kv_heads(const at::Tensor& grad, int64_t num_kv_head) {
+  if (grad.size(1) == num_kv_head) {
+    return grad;
+  }
+  return grad
+      .view(
+          {grad.size(0),
+           num_kv_head,
+           grad.size(1) / num_kv_head,
+           grad.size(2),
+           grad.size(3)})
+      .sum(2);
+}
+
+// Draw the attention dropout seed from the default CPU generator when the
+// caller doesn't pass one, so that torch.manual_seed makes it reproducible.
+c10::optional<int64_t> resolve_dropout_seed(
+    double dropout_p,
+    c10::optional<int64_t> dropout_seed) {
+  if (dropout_p == 0.0 || dropout_seed.has_value()) {
+    return dropout_seed;
+  }
+  auto gen = at::detail::getDefaultCPUGenerator();
+  std::lock_guard<std::mutex> lock(gen.mutex());
+  return static_cast<int64_t>(gen.get<at::CPUGeneratorImpl>()->random64());
+}
+
 /*
  *Caculate the flash attention SDPA with attention mask.
  */
@@ -29,13 +76,354 @@ std::tuple<at::Tensor, at::Tensor> flash_attention_forward_cpu(
     double dropout_p,
     bool is_causal,
     const c10::optional<at::Tensor>& attention_mask,
-    c10::optional<double> scale) {
+    c10::optional<double> scale,
+    c10::optional<int64_t> dropout_seed,
+    int64_t window_size,
+    const c10::optional<at::Tensor>& block_mask,
+    int64_t block_size) {
   if (use_ipex_flash_attention(query, key, value)) {
     return flash_attention_kernel_stub(
-        kCPU, query, key, value, dropout_p, is_causal, attention_mask, scale);
+        kCPU,
+        query,
+        key,
+        value,
+        dropout_p,
+        is_causal,
+        attention_mask,
+        scale,
+        resolve_dropout_seed(dropout_p, dropout_seed),
+        window_size,
+        block_mask,
+        block_size);
   }
+  TORCH_CHECK(
+      window_size <= 0 && !block_mask.has_value(),
+      "flash_attention: sliding window and block-sparse layout need Q/K/V with non-zero strides");
   return at::native::_scaled_dot_product_flash_attention_cpu(
-      query, key, value, dropout_p, is_causal, attention_mask, scale);
+      query,
+      expand_kv_heads(key, query.size(1)),
+      expand_kv_heads(value, query.size(1)),
+      dropout_p,
+      is_causal,
+      attention_mask,
+      scale);
+}
+
+/*
+ *Caculate the gradients of the flash attention SDPA from the output and
+ *logsumexp of the forward.
+ */
+std::tuple<at::Tensor, at::Tensor, at::Tensor> flash_attention_backward_cpu(
+    const at::Tensor& grad_out,
+    const at::Tensor& query,
+    const at::Tensor& key,
+    const at::Tensor& value,
+    const at::Tensor& out,
+    const at::Tensor& logsumexp,
+    double dropout_p,
+    bool is_causal,
+    const c10::optional<at::Tensor>& attention_mask,
+    c10::optional<double> scale,
+    c10::optional<int64_t> dropout_seed,
+    int64_t window_size,
+    const c10::optional<at::Tensor>& block_mask,
+    int64_t block_size) {
+  if (use_ipex_flash_attention(query, key, value)) {
+    return flash_attention_backward_kernel_stub(
+        kCPU,
+        grad_out,
+        query,
+        key,
+        value,
+        out,
+        logsumexp,
+        dropout_p,
+        is_causal,
+        attention_mask,
+        scale,
+        dropout_seed,
+        window_size,
+        block_mask,
+        block_size);
+  }
+  TORCH_CHECK(
+      window_size <= 0 && !block_mask.has_value(),
+      "flash_attention: sliding window and block-sparse layout need Q/K/V with non-zero strides");
+  auto grads = at::native::_scaled_dot_product_flash_attention_cpu_backward(
+      grad_out,
+      query,
+      expand_kv_heads(key, query.size(1)),
+      expand_kv_heads(value, query.size(1)),
+      out,
+      logsumexp,
+      dropout_p,
+      is_causal,
+      attention_mask,
+      scale);
+  return std::make_tuple(
+      std::get<0>(grads),
+      reduce_kv_heads(std::get<1>(grads), key.size(1)),
+      reduce_kv_heads(std::get<2>(grads), value.size(1)));
+}
+
+// The flash attention SDPA of PT doesn't carry a dropout seed from the
+// forward to the backward, the SDPA with dropout is routed to
+// IPEXFlashAttentionOp by sdpa_cpu instead.
+std::tuple<at::Tensor, at::Tensor> sdpa_flash_attention_forward_cpu(
+    const at::Tensor& query,
+    const at::Tensor& key,
+    const at::Tensor& value,
+    double dropout_p,
+    bool is_causal,
+    const c10::optional<at::Tensor>& attention_mask,
+    c10::optional<double> scale) {
+  return flash_attention_forward_cpu(
+      query,
+      key,
+      value,
+      dropout_p,
+      is_causal,
+      attention_mask,
+      scale,
+      c10::nullopt,
+      /* window_size */ -1,
+      /* block_mask */ c10::nullopt,
+      /* block_size */ 0);
+}
+
+std::tuple<at::Tensor, at::Tensor, at::Tensor>
+sdpa_flash_attention_backward_cpu(
+    const at::Tensor& grad_out,
+    const at::Tensor& query,
+    const at::Tensor& key,
+    const at::Tensor& value,
+    const at::Tensor& out,
+    const at::Tensor& logsumexp,
+    double dropout_p,
+    bool is_causal,
+    const c10::optional<at::Tensor>& attention_mask,
+    c10::optional<double> scale) {
+  return flash_attention_backward_cpu(
+      grad_out,
+      query,
+      key,
+      value,
+      out,
+      logsumexp,
+      dropout_p,
+      is_causal,
+      attention_mask,
+      scale,
+      c10::nullopt,
+      /* window_size */ -1,
+      /* block_mask */ c10::nullopt,
+      /* block_size */ 0);
+}
+
+// Autograd of the IPEX flash attention. The dropout seed is resolved once in
+// the forward and saved, so the backward regenerates the same dropout mask.
+class IPEXFlashAttentionOp
+    : public torch::autograd::Function<IPEXFlashAttentionOp> {
+ public:
+  static torch::autograd::variable_list forward(
+      torch::autograd::AutogradContext* ctx,
+      const at::Tensor& query,
+      const at::Tensor& key,
+      const at::Tensor& value,
+      double dropout_p,
+      bool is_causal,
+      const c10::optional<at::Tensor>& attention_mask,
+      c10::optional<double> scale,
+      c10::optional<int64_t> dropout_seed,
+      int64_t window_size,
+      const c10::optional<at::Tensor>& block_mask,
+      int64_t block_size) {
+    RECORD_FUNCTION(
+        "IPEXFlashAttentionOp::forward", c10::ArrayRef<c10::IValue>({}));
+
+    at::AutoDispatchBelowADInplaceOrView g;
+    auto seed = resolve_dropout_seed(dropout_p, dropout_seed);
+    auto outputs = flash_attention_forward_cpu(
+        query,
+        key,
+        value,
+        dropout_p,
+        is_causal,
+        attention_mask,
+        scale,
+        seed,
+        window_size,
+        block_mask,
+        block_size);
+    at::Tensor out = std::get<0>(outputs);
+    at::Tensor logsumexp = std::get<1>(outputs);
+    ctx->saved_data["dropout_p"] = dropout_p;
+    ctx->saved_data["is_causal"] = is_causal;
+    ctx->saved_data["scale"] = scale;
+    ctx->saved_data["dropout_seed"] = seed;
+    ctx->saved_data["window_size"] = window_size;
+    ctx->saved_data["block_size"] = block_size;
+    ctx->save_for_backward(
+        {query,
+         key,
+         value,
+         out,
+         logsumexp,
+         attention_mask.value_or(at::Tensor()),
+         block_mask.value_or(at::Tensor())});
+    ctx->mark_non_differentiable({logsumexp});
+    return {out, logsumexp};
+  }
+
+  static torch::autograd::variable_list backward(
+      torch::autograd::AutogradContext* ctx,
+      torch::autograd::variable_list grad_outputs) {
+    RECORD_FUNCTION(
+        "IPEXFlashAttentionOp::backward", c10::ArrayRef<c10::IValue>({}));
+
+    at::AutoDispatchBelowADInplaceOrView g;
+    auto saved = ctx->get_saved_variables();
+    auto optional_tensor = [](const at::Tensor& t) {
+      return t.defined() ? c10::optional<at::Tensor>(t) : c10::nullopt;
+    };
+    auto grads = flash_attention_backward_cpu(
+        grad_outputs[0].contiguous(),
+        saved[0],
+        saved[1],
+        saved[2],
+        saved[3],
+        saved[4],
+        ctx->saved_data["dropout_p"].toDouble(),
+        ctx->saved_data["is_causal"].toBool(),
+        optional_tensor(saved[5]),
+        ctx->saved_data["scale"].toOptional<double>(),
+        ctx->saved_data["dropout_seed"].toOptional<int64_t>(),
+        ctx->saved_data["window_size"].toInt(),
+        optional_tensor(saved[6]),
+        ctx->saved_data["block_size"].toInt());
+    return {
+        std::get<0>(grads),
+        std::get<1>(grads),
+        std::get<2>(grads),
+        at::Tensor(),
+        at::Tensor(),
+        at::Tensor(),
+        at::Tensor(),
+        at::Tensor(),
+        at::Tensor(),
+        at::Tensor(),
+        at::Tensor()};
+  }
+};
+
+std::tuple<at::Tensor, at::Tensor> flash_attention_autograd_cpu(
+    const at::Tensor& query,
+    const at::Tensor& key,
+    const at::Tensor& value,
+    double dropout_p,
+    bool is_causal,
+    const c10::optional<at::Tensor>& attention_mask,
+    c10::optional<double> scale,
+    c10::optional<int64_t> dropout_seed,
+    int64_t window_size,
+    const c10::optional<at::Tensor>& block_mask,
+    int64_t block_size) {
+  if (at::GradMode::is_enabled() &&
+      (query.requires_grad() || key.requires_grad() ||
+       value.requires_grad())) {
+    auto outputs = IPEXFlashAttentionOp::apply(
+        query,
+        key,
+        value,
+        dropout_p,
+        is_causal,
+        attention_mask,
+        scale,
+        dropout_seed,
+        window_size,
+        block_mask,
+        block_size);
+    return std::make_tuple(outputs[0], outputs[1]);
+  }
+  at::AutoDispatchBelowADInplaceOrView g;
+  return flash_attention_forward_cpu(
+      query,
+      key,
+      value,
+      dropout_p,
+      is_causal,
+      attention_mask,
+      scale,
+      dropout_seed,
+      window_size,
+      block_mask,
+      block_size);
+}
+
+// The SDPA of PT falls back to the math implementation for dropout on CPU.
+// Run it with the IPEX flash attention instead, whose dropout mask is
+// regenerated in the backward rather than stored.
+bool use_ipex_flash_attention_dropout(
+    const at::Tensor& query,
+    const at::Tensor& key,
+    const at::Tensor& value,
+    const c10::optional<at::Tensor>& attn_mask,
+    double dropout_p,
+    bool is_causal) {
+  if (dropout_p <= 0.0 || !query.device().is_cpu() || query.is_nested() ||
+      query.dim() != 4 || key.dim() != 4 || value.dim() != 4) {
+    return false;
+  }
+  auto dtype = query.scalar_type();
+  if ((dtype != at::kFloat && dtype != at::kDouble && dtype != at::kBFloat16) ||
+      key.scalar_type() != dtype || value.scalar_type() != dtype) {
+    return false;
+  }
+  if (key.size(0) != query.size(0) || key.size(1) != query.size(1) ||
+      !value.sizes().equals(key.sizes()) || key.size(3) != query.size(3) ||
+      query.stride(3) != 1 || key.stride(3) != 1 || value.stride(3) != 1 ||
+      !use_ipex_flash_attention(query, key, value)) {
+    return false;
+  }
+  if (attn_mask.has_value()) {
+    const auto& mask = attn_mask.value();
+    if (is_causal || mask.dim() != 4 || mask.size(2) != query.size(2) ||
+        mask.size(3) != key.size(2) || mask.stride(3) != 1 ||
+        (mask.scalar_type() != dtype && mask.scalar_type() != at::kBool)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+at::Tensor sdpa_cpu(
+    const at::Tensor& query,
+    const at::Tensor& key,
+    const at::Tensor& value,
+    const c10::optional<at::Tensor>& attn_mask,
+    double dropout_p,
+    bool is_causal,
+    c10::optional<double> scale) {
+  if (use_ipex_flash_attention_dropout(
+          query, key, value, attn_mask, dropout_p, is_causal)) {
+    static auto op = torch::Dispatcher::singleton()
+                         .findSchemaOrThrow("torch_ipex::flash_attention", "")
+                         .typed<decltype(flash_attention_autograd_cpu)>();
+    return std::get<0>(op.call(
+        query,
+        key,
+        value,
+        dropout_p,
+        is_causal,
+        attn_mask,
+        scale,
+        /* dropout_seed */ c10::nullopt,
+        /* window_size */ -1,
+        /* block_mask */ c10::nullopt,
+        /* block_size */ 0));
+  }
+  return at::native::scaled_dot_product_attention(
+      query, key, value, attn_mask, dropout_p, is_causal, scale);
 }
 
 /*
@@ -46,19 +434,45 @@ std::tuple<at::Tensor, at::Tensor> flash_attention_forward_cpu(
 TORCH_LIBRARY_IMPL(aten, CPU, m) {
   m.impl(
       TORCH_SELECTIVE_NAME("aten::_scaled_dot_product_flash_attention_for_cpu"),
-      TORCH_FN((&torch_ipex::cpu::flash_attention_forward_cpu)));
+      TORCH_FN((&torch_ipex::cpu::sdpa_flash_attention_forward_cpu)));
+  m.impl(
+      TORCH_SELECTIVE_NAME(
+          "aten::_scaled_dot_product_flash_attention_for_cpu_backward"),
+      TORCH_FN((&torch_ipex::cpu::sdpa_flash_attention_backward_cpu)));
+}
+
+IPEX_TORCH_LIBRARY_IMPL(aten, CompositeImplicitAutograd, m) {
+  m.impl(
+      TORCH_SELECTIVE_NAME("aten::scaled_dot_product_attention"),
+      TORCH_FN((&torch_ipex::cpu::sdpa_cpu)));
 }
 
 TORCH_LIBRARY_FRAGMENT(torch_ipex, m) {
   m.def(
       "flash_attention(Tensor query, Tensor key, Tensor value, \
        float dropout_p=0.0, bool is_causal=False, \
-       *, Tensor? attention_mask=None, float? scale=None) -> \
-       (Tensor, Tensor)");
+       *, Tensor? attention_mask=None, float? scale=None, \
+       int? dropout_seed=None, int window_size=-1, \
+       Tensor? block_mask=None, int block_size=0) -> (Tensor, Tensor)");
   m.impl(
       "flash_attention",
       c10::DispatchKey::CPU,
       torch_ipex::cpu::flash_attention_forward_cpu);
+  m.impl(
+      "flash_attention",
+      c10::DispatchKey::AutogradCPU,
+      torch_ipex::cpu::flash_attention_autograd_cpu);
+  m.def(
+      "flash_attention_backward(Tensor grad_out, Tensor query, Tensor key, \
+       Tensor value, Tensor out, Tensor logsumexp, float dropout_p=0.0, \
+       bool is_causal=False, *, Tensor? attention_mask=None, \
+       float? scale=None, int? dropout_seed=None, int window_size=-1, \
+       Tensor? block_mask=None, int block_size=0) -> \
+       (Tensor, Tensor, Tensor)");
+  m.impl(
+      "flash_attention_backward",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::flash_attention_backward_cpu);
 }
 
 } // namespace cpu
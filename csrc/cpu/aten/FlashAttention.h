@@ -15,7 +15,27 @@ std::tuple<at::Tensor, at::Tensor> flash_attention(
     double dropout_p,
     bool is_causal,
     c10::optional<at::Tensor> attention_mask,
-    c10::optional<double> scale);
+    c10::optional<double> scale,
+    c10::optional<int64_t> dropout_seed,
+    int64_t window_size,
+    c10::optional<at::Tensor> block_mask,
+    int64_t block_size);
+
+std::tuple<at::Tensor, at::Tensor, at::Tensor> flash_attention_backward(
+    const at::Tensor& grad_out,
+    const at::Tensor& query,
+    const at::Tensor& key,
+    const at::Tensor& value,
+    const at::Tensor& out,
+    const at::Tensor& logsumexp,
+    double dropout_p,
+    bool is_causal,
+    c10::optional<at::Tensor> attention_mask,
+    c10::optional<double> scale,
+    c10::optional<int64_t> dropout_seed,
+    int64_t window_size,
+    c10::optional<at::Tensor> block_mask,
+    int64_t block_size);
 } // namespace
 
 using flash_attention_kernel_fn = std::tuple<at::Tensor, at::Tensor> (*)(
@@ -25,9 +45,34 @@ using flash_attention_kernel_fn = std::tuple<at::Tensor, at::Tensor> (*)(
     double dropout_p,
     bool is_causal,
     c10::optional<at::Tensor> attention_mask,
-    c10::optional<double> scale);
+    c10::optional<double> scale,
+    c10::optional<int64_t> dropout_seed,
+    int64_t window_size,
+    c10::optional<at::Tensor> block_mask,
+    int64_t block_size);
 
 IPEX_DECLARE_DISPATCH(flash_attention_kernel_fn, flash_attention_kernel_stub);
 
+using flash_attention_backward_kernel_fn =
+    std::tuple<at::Tensor, at::Tensor, at::Tensor> (*)(
+        const at::Tensor& grad_out,
+        const at::Tensor& query,
+        const at::Tensor& key,
+        const at::Tensor& value,
+        const at::Tensor& out,
+        const at::Tensor& logsumexp,
+        double dropout_p,
+        bool is_causal,
+        c10::optional<at::Tensor> attention_mask,
+        c10::optional<double> scale,
+        c10::optional<int64_t> dropout_seed,
+        int64_t window_size,
+        c10::optional<at::Tensor> block_mask,
+        int64_t block_size);
+
+IPEX_DECLARE_DISPATCH(
+    flash_attention_backward_kernel_fn,
+    flash_attention_backward_kernel_stub);
+
 } // namespace cpu
 } // namespace torch_ipex
@@ -1,6 +1,7 @@
 #include "MergedEmbCat.h"
 #include <ATen/Tensor.h>
 #include <torch/all.h>
+#include "vec/rowwise_quant_utils.hpp"
 
 namespace torch_ipex {
 namespace cpu {
@@ -9,6 +10,7 @@ using namespace at;
 
 IPEX_DEFINE_DISPATCH(merged_embeddingbag_cat_fw_stub);
 IPEX_DEFINE_DISPATCH(qmerged_embeddingbag_cat_fw_stub);
+IPEX_DEFINE_DISPATCH(rowwise_qmerged_embeddingbag_cat_fw_stub);
 
 Tensor merged_embeddingbag_cat_forward(
     const TensorList& weights,
@@ -30,6 +32,47 @@ Tensor dil_qmerged_embeddingbag_cat(
   return qmerged_embeddingbag_cat_fw_stub(
       kCPU, qweights, indices, offsets, qdense, o_scale);
 }
+
+Tensor rowwise_quantized_merged_embeddingbag_cat(
+    const TensorList& qweights,
+    const TensorList& indices,
+    const TensorList& offsets,
+    const Tensor& dense,
+    ScalarType qtype) {
+  TORCH_CHECK(
+      qtype == kQUInt4x2 || qtype == kFloat8_e4m3fn,
+      "rowwise_quantized_merged_embeddingbag_cat: only supports quint4x2 and "
+      "float8_e4m3fn");
+  TORCH_CHECK(
+      dense.dim() == 2 && dense.is_contiguous() &&
+          dense.scalar_type() == kFloat,
+      "rowwise_quantized_merged_embeddingbag_cat: expect a contiguous 2D "
+      "fp32 dense");
+  int64_t num_emb = qweights.size();
+  TORCH_CHECK(
+      num_emb > 0 && indices.size() == num_emb && offsets.size() == num_emb,
+      "rowwise_quantized_merged_embeddingbag_cat: expect the same number of "
+      "qweights, indices and offsets");
+  int64_t row_bytes = rowwise_quant_row_bytes(qtype, dense.size(1));
+  auto index_type = indices[0].scalar_type();
+  for (int64_t i = 0; i < num_emb; i++) {
+    TORCH_CHECK(
+        qweights[i].dim() == 2 && qweights[i].is_contiguous() &&
+            qweights[i].scalar_type() == kByte &&
+            qweights[i].size(1) == row_bytes,
+        "rowwise_quantized_merged_embeddingbag_cat: expect the qweights "
+        "packed by rowwise_quantized_embedding_pack");
+    TORCH_CHECK(
+        indices[i].is_contiguous() && indices[i].scalar_type() == index_type &&
+            offsets[i].is_contiguous() &&
+            offsets[i].scalar_type() == index_type,
+        "rowwise_quantized_merged_embeddingbag_cat: expect contiguous "
+        "indices and offsets of the same type");
+  }
+  return rowwise_qmerged_embeddingbag_cat_fw_stub(
+      kCPU, qweights, indices, offsets, dense, qtype);
+}
+
 } // namespace cpu
 } // namespace torch_ipex
 
@@ -42,6 +85,14 @@ TORCH_LIBRARY_FRAGMENT(torch_ipex, m) {
       "merged_embeddingbag_cat_forward",
       c10::DispatchKey::CPU,
       torch_ipex::cpu::merged_embeddingbag_cat_forward);
+  m.def(
+      "rowwise_quantized_merged_embeddingbag_cat(Tensor[] qweights, "
+      "Tensor[] indices, Tensor[] offsets, Tensor dense, ScalarType qtype) "
+      "-> Tensor");
+  m.impl(
+      "rowwise_quantized_merged_embeddingbag_cat",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::rowwise_quantized_merged_embeddingbag_cat);
 }
 
 } // namespace
\ No newline at end of file
@@ -32,6 +32,13 @@ Tensor qmerged_embedding_cat_fw_impl(
     const Tensor& qdense,
     double o_scale);
 
+Tensor rowwise_qmerged_embedding_cat_fw_impl(
+    const TensorList& qweights,
+    const TensorList& indices,
+    const TensorList& offsets,
+    const Tensor& dense,
+    ScalarType qtype);
+
 } // namespace
 
 using merged_embeddingbag_cat_fw_fn = Tensor (*)(
@@ -55,5 +62,16 @@ IPEX_DECLARE_DISPATCH(
     qmerged_embeddingbag_cat_fw_fn,
     qmerged_embeddingbag_cat_fw_stub);
 
+using rowwise_qmerged_embeddingbag_cat_fw_fn = Tensor (*)(
+    const TensorList&,
+    const TensorList&,
+    const TensorList&,
+    const Tensor&,
+    ScalarType);
+
+IPEX_DECLARE_DISPATCH(
+    rowwise_qmerged_embeddingbag_cat_fw_fn,
+    rowwise_qmerged_embeddingbag_cat_fw_stub);
+
 } // namespace cpu
 } // namespace torch_ipex
\ No newline at end of file
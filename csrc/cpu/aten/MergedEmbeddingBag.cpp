@@ -1,4 +1,5 @@
 #include "MergedEmbeddingBag.h"
+#include "MmapEmbeddingTable.h"
 #include <ATen/AccumulateType.h>
 #include <ATen/Tensor.h>
 #include <torch/all.h>
@@ -15,6 +16,11 @@ std::vector<Tensor> merged_embeddingbag_forward_cpu(
     const TensorList& offsets,
     const int64_t pooling_mode,
     const bool include_last_offsets) {
+  // Read the rows of this batch of the memory-mapped tables opted in to
+  // readahead from the files ahead of the lookups.
+  for (size_t i = 0; i < weights.size(); i++) {
+    embedding_table_readahead(weights[i], indices[i]);
+  }
   /*
   pointer to merged_embeddingbag_forward_cpu_kernel_impl(
       weights, indices, offsets, pooling_mode, include_last_offsets);
@@ -159,6 +159,44 @@ struct AdaGradArgs {
   float lr;
 };
 
+// Row-wise (lazy) Adam: only the rows with a gradient update their moments.
+// With use_lamb, the step of each row is scaled by the LAMB trust ratio
+// ||w|| / ||update|| of that row.
+struct AdamArgs {
+  AdamArgs(
+      const TensorList& bf16_trail_,
+      const TensorList& exp_avg_,
+      const TensorList& exp_avg_sq_,
+      int64_t step_,
+      float lr_,
+      float beta1_,
+      float beta2_,
+      float eps_,
+      float weight_decay_,
+      bool use_lamb_)
+      : bf16_trail(bf16_trail_),
+        exp_avg(exp_avg_),
+        exp_avg_sq(exp_avg_sq_),
+        step(step_),
+        lr(lr_),
+        beta1(beta1_),
+        beta2(beta2_),
+        eps(eps_),
+        weight_decay(weight_decay_),
+        use_lamb(use_lamb_) {}
+
+  TensorList bf16_trail;
+  TensorList exp_avg;
+  TensorList exp_avg_sq;
+  int64_t step;
+  float lr;
+  float beta1;
+  float beta2;
+  float eps;
+  float weight_decay;
+  bool use_lamb;
+};
+
 template <typename data_t, typename acc_t, typename optimizer_args_t>
 class EmbeddingGradUpdate {};
 
@@ -184,6 +222,17 @@ class EmbeddingGradUpdate<data_t, acc_t, AdaGradArgs> {
       const int64_t emb_dim);
 };
 
+template <typename data_t, typename acc_t>
+class EmbeddingGradUpdate<data_t, acc_t, AdamArgs> {
+ public:
+  static void update(
+      data_t* weight,
+      const EmbeddingRowCache<acc_t>& ewc,
+      const AdamArgs& args,
+      const int32_t table_id,
+      const int64_t emb_dim);
+};
+
 std::vector<Tensor> merged_embeddingbag_forward_cpu_kernel_impl(
     const std::vector<Tensor>& weights,
     const TensorList& indices,
@@ -259,6 +308,22 @@ void mergedemb_distribute_backward_merge_adagrad_update_cpu(
     const float lr,
     const float eps);
 
+void mergedemb_distribute_backward_merge_adam_update_cpu(
+    const TensorList& idx,
+    const TensorList& val,
+    const TensorList& ofs,
+    Tensor& weight,
+    Tensor& weight_trail,
+    Tensor& exp_avg,
+    Tensor& exp_avg_sq,
+    const int64_t step,
+    const double lr,
+    const double beta1,
+    const double beta2,
+    const double eps,
+    const double weight_decay,
+    const bool use_lamb);
+
 } // namespace
 
 using merged_embeddingbag_forward_cpu_kernel_fn = std::vector<Tensor> (*)(
@@ -360,6 +425,25 @@ IPEX_DECLARE_DISPATCH(
     mergedemb_distribute_backward_merge_adagrad_update_fn,
     mergedemb_distribute_backward_merge_adagrad_update_stub);
 
+using mergedemb_distribute_backward_merge_adam_update_fn = void (*)(
+    const TensorList&,
+    const TensorList&,
+    const TensorList&,
+    Tensor&,
+    Tensor&,
+    Tensor&,
+    Tensor&,
+    const int64_t,
+    const double,
+    const double,
+    const double,
+    const double,
+    const double,
+    const bool);
+IPEX_DECLARE_DISPATCH(
+    mergedemb_distribute_backward_merge_adam_update_fn,
+    mergedemb_distribute_backward_merge_adam_update_stub);
+
 } // namespace cpu
 } // namespace torch_ipex
 
@@ -0,0 +1,245 @@
+#include "MmapEmbeddingTable.h"
+
+#include <ATen/Parallel.h>
+#include <c10/core/Storage.h>
+#include <c10/util/Exception.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <torch/all.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+namespace torch_ipex {
+namespace cpu {
+
+namespace {
+
+struct MmapRegion {
+  void* base;
+  size_t length;
+  bool readahead;
+};
+
+// Deleter of the storages of mmap_embedding_table, which also identifies them.
+void delete_mmap_region(void* ctx) {
+  auto region = static_cast<MmapRegion*>(ctx);
+  munmap(region->base, region->length);
+  delete region;
+}
+
+// Returns the mapping of a table of mmap_embedding_table, nullptr for other
+// weights.
+MmapRegion* mmap_region(const at::Tensor& weight) {
+  if (!weight.defined() || !weight.has_storage())
+    return nullptr;
+  const auto& data_ptr = weight.storage().data_ptr();
+  if (data_ptr.get_deleter() != &delete_mmap_region)
+    return nullptr;
+  return static_cast<MmapRegion*>(data_ptr.get_context());
+}
+
+// Calls fn(begin, length) for the runs of consecutive pages holding the rows
+// rows[0, num_rows) of weight, in address order, until fn returns false.
+template <typename F>
+void for_each_row_page_run(
+    const at::Tensor& weight,
+    const int64_t* rows,
+    int64_t num_rows,
+    const F& fn) {
+  uintptr_t page_size = sysconf(_SC_PAGESIZE);
+  size_t row_bytes = weight.stride(0) * weight.element_size();
+  size_t row_length = weight.size(1) * weight.element_size();
+  uintptr_t data = reinterpret_cast<uintptr_t>(weight.data_ptr());
+
+  std::vector<uintptr_t> pages;
+  pages.reserve(num_rows);
+  for (int64_t i = 0; i < num_rows; i++) {
+    // out of range rows are reported by the lookups
+    if (rows[i] < 0 || rows[i] >= weight.size(0))
+      continue;
+    uintptr_t begin = data + rows[i] * row_bytes;
+    uintptr_t end = begin + row_length;
+    for (uintptr_t p = begin & ~(page_size - 1); p < end; p += page_size)
+      pages.push_back(p);
+  }
+  std::sort(pages.begin(), pages.end());
+  pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+
+  for (size_t i = 0; i < pages.size();) {
+    size_t j = i + 1;
+    while (j < pages.size() && pages[j] == pages[j - 1] + page_size)
+      j++;
+    if (!fn(reinterpret_cast<void*>(pages[i]), (j - i) * page_size))
+      return;
+    i = j;
+  }
+}
+
+// Rows per thread of embedding_table_readahead, below which a single thread
+// advises all the pages.
+constexpr int64_t kReadaheadGrainSize = 4096;
+
+} // namespace
+
+at::Tensor mmap_embedding_table(
+    const std::string& path,
+    int64_t num_rows,
+    int64_t emb_dim,
+    at::ScalarType dtype,
+    int64_t offset,
+    bool readahead) {
+  TORCH_CHECK(
+      dtype == at::kFloat || dtype == at::kBFloat16 || dtype == at::kHalf,
+      "mmap_embedding_table: only supports fp32/bf16/fp16 tables");
+  TORCH_CHECK(
+      num_rows > 0 && emb_dim > 0 && offset >= 0,
+      "mmap_embedding_table: invalid table shape or offset");
+  size_t nbytes = num_rows * emb_dim * c10::elementSize(dtype);
+
+  int fd = open(path.c_str(), O_RDONLY);
+  TORCH_CHECK(
+      fd != -1,
+      "mmap_embedding_table: failed to open ",
+      path,
+      ": ",
+      strerror(errno));
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < offset + nbytes) {
+    close(fd);
+    TORCH_CHECK(
+        false,
+        "mmap_embedding_table: ",
+        path,
+        " is smaller than the table of ",
+        nbytes,
+        " bytes at offset ",
+        offset);
+  }
+  // mmap offsets must be page aligned
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t map_offset = offset & ~(page_size - 1);
+  size_t length = offset - map_offset + nbytes;
+  void* base = mmap(
+      nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, map_offset);
+  close(fd);
+  TORCH_CHECK(
+      base != MAP_FAILED,
+      "mmap_embedding_table: failed to map ",
+      path,
+      ": ",
+      strerror(errno));
+  // Lookups are random, the kernel readahead would only read unused rows.
+  madvise(base, length, MADV_RANDOM);
+
+  void* data = static_cast<char*>(base) + (offset - map_offset);
+  c10::DataPtr data_ptr(
+      data,
+      new MmapRegion{base, length, readahead},
+      &delete_mmap_region,
+      at::kCPU);
+  c10::Storage storage(
+      c10::Storage::use_byte_size_t(),
+      nbytes,
+      std::move(data_ptr),
+      /*allocator=*/nullptr,
+      /*resizable=*/false);
+  return at::empty({0}, at::TensorOptions().dtype(dtype))
+      .set_(storage, 0, {num_rows, emb_dim}, {emb_dim, 1});
+}
+
+bool is_mmap_embedding_table(const at::Tensor& weight) {
+  return mmap_region(weight) != nullptr;
+}
+
+void embedding_table_readahead(
+    const at::Tensor& weight,
+    const at::Tensor& indices) {
+  auto region = mmap_region(weight);
+  if (region == nullptr || !region->readahead || indices.numel() == 0)
+    return;
+  RECORD_FUNCTION("embedding_table_readahead", c10::ArrayRef<c10::IValue>({}));
+  auto rows = indices.to(at::kLong).contiguous();
+  const int64_t* rows_data = rows.data_ptr<int64_t>();
+  // Every thread collects and advises the pages of its share of the rows. A
+  // page shared by the rows of several threads is only advised again, which
+  // is cheaper than merging the pages of all the threads.
+  at::parallel_for(
+      0, rows.numel(), kReadaheadGrainSize, [&](int64_t begin, int64_t end) {
+        for_each_row_page_run(
+            weight,
+            rows_data + begin,
+            end - begin,
+            [](void* page_begin, size_t length) {
+              madvise(page_begin, length, MADV_WILLNEED);
+              return true;
+            });
+      });
+}
+
+int64_t embedding_table_pin_hot_rows(
+    const at::Tensor& weight,
+    const at::Tensor& sample_indices,
+    int64_t capacity) {
+  TORCH_CHECK(
+      is_mmap_embedding_table(weight),
+      "embedding_table_pin_hot_rows: expect a table of mmap_embedding_table");
+  TORCH_CHECK(
+      capacity >= 0, "embedding_table_pin_hot_rows: negative capacity");
+  int64_t num_rows = weight.size(0);
+  auto counts =
+      at::bincount(sample_indices.reshape(-1).to(at::kLong), {}, num_rows)
+          .narrow(0, 0, num_rows);
+  auto top = counts.topk(std::min(capacity, num_rows));
+  auto hot_rows = std::get<1>(top).masked_select(std::get<0>(top) > 0);
+  // Lock the rows in decreasing frequency, so that the most frequent rows are
+  // locked when RLIMIT_MEMLOCK is reached.
+  const int64_t* hot_rows_data = hot_rows.data_ptr<int64_t>();
+  int64_t pinned = 0;
+  for (; pinned < hot_rows.numel(); pinned++) {
+    int error = 0;
+    for_each_row_page_run(
+        weight, hot_rows_data + pinned, 1, [&](void* begin, size_t length) {
+          error = mlock(begin, length) == 0 ? 0 : errno;
+          return error == 0;
+        });
+    if (error != 0) {
+      TORCH_WARN(
+          "embedding_table_pin_hot_rows: pinned ",
+          pinned,
+          " of ",
+          hot_rows.numel(),
+          " rows: ",
+          strerror(error));
+      break;
+    }
+  }
+  return pinned;
+}
+
+} // namespace cpu
+} // namespace torch_ipex
+
+namespace {
+
+TORCH_LIBRARY_FRAGMENT(torch_ipex, m) {
+  m.def(
+      "mmap_embedding_table(str path, int num_rows, int emb_dim, "
+      "ScalarType dtype, int offset=0, bool readahead=False) -> Tensor");
+  m.impl(
+      "mmap_embedding_table",
+      c10::DispatchKey::CatchAll,
+      torch_ipex::cpu::mmap_embedding_table);
+  m.def(
+      "embedding_table_pin_hot_rows(Tensor weight, Tensor sample_indices, "
+      "int capacity) -> int");
+  m.impl(
+      "embedding_table_pin_hot_rows",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::embedding_table_pin_hot_rows);
+}
+
+} // namespace
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <ATen/ATen.h>
+
+#include <string>
+
+namespace torch_ipex {
+namespace cpu {
+
+// Maps the row-major [num_rows, emb_dim] table of dtype stored at byte offset
+// of the file path. The pages of the table are read from the file on their
+// first access, so that tables larger than the memory of an instance can be
+// served without loading them first. The mapping is private: writes to the
+// returned tensor are never written back to the file. With readahead, the
+// rows of every lookup are read ahead by embedding_table_readahead.
+at::Tensor mmap_embedding_table(
+    const std::string& path,
+    int64_t num_rows,
+    int64_t emb_dim,
+    at::ScalarType dtype,
+    int64_t offset,
+    bool readahead);
+
+// Returns whether weight is (a view of) a table of mmap_embedding_table.
+bool is_mmap_embedding_table(const at::Tensor& weight);
+
+// Starts reading the pages of the rows indices of a memory-mapped weight from
+// the file asynchronously (madvise(MADV_WILLNEED)), if the table was mapped
+// with readahead. No-op for other weights.
+void embedding_table_readahead(
+    const at::Tensor& weight,
+    const at::Tensor& indices);
+
+// Locks in memory the pages of the capacity rows of a memory-mapped weight
+// most frequently accessed in sample_indices, so that the hot rows are never
+// read from the file again. Returns the number of rows locked, which is less
+// than requested if RLIMIT_MEMLOCK is reached.
+int64_t embedding_table_pin_hot_rows(
+    const at::Tensor& weight,
+    const at::Tensor& sample_indices,
+    int64_t capacity);
+
+} // namespace cpu
+} // namespace torch_ipex
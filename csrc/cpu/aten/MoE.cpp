@@ -8,6 +8,8 @@ namespace cpu {
 IPEX_DEFINE_DISPATCH(mixtral_moe_tpp_kernel_stub);
 IPEX_DEFINE_DISPATCH(mixtral_moe_woq_kernel_stub);
 IPEX_DEFINE_DISPATCH(mixtral_moe_kernel_stub);
+IPEX_DEFINE_DISPATCH(fused_moe_kernel_stub);
+IPEX_DEFINE_DISPATCH(fused_moe_ep_kernel_stub);
 
 at::Tensor mixtral_moe_tpp(
     const at::Tensor& hidden_states,
@@ -98,6 +100,124 @@ at::Tensor mixtral_moe_woq(
       output,
       is_distributed);
 }
+
+namespace {
+
+void check_fused_moe_inputs(
+    const at::Tensor& hidden_states,
+    const at::Tensor& topk_ids,
+    const at::Tensor& topk_weights,
+    const std::vector<at::Tensor>& gate_wei,
+    const std::vector<at::Tensor>& up_wei,
+    const std::vector<at::Tensor>& down_wei,
+    const std::vector<at::Tensor>& gate_op_ctx,
+    const std::vector<at::Tensor>& up_op_ctx,
+    const std::vector<at::Tensor>& down_op_ctx,
+    int64_t backend) {
+  TORCH_CHECK(
+      hidden_states.dim() == 2,
+      "fused_moe: expect hidden_states of shape [num_tokens, hidden_size]");
+  TORCH_CHECK(
+      topk_ids.dim() == 2 && topk_ids.size(0) == hidden_states.size(0) &&
+          topk_weights.sizes() == topk_ids.sizes(),
+      "fused_moe: expect topk_ids and topk_weights of shape [num_tokens, top_k]");
+  TORCH_CHECK(
+      up_wei.size() == gate_wei.size() && down_wei.size() == gate_wei.size(),
+      "fused_moe: expect the same number of gate, up and down weights");
+  TORCH_CHECK(
+      backend >= MOE_BACKEND_TPP && backend <= MOE_BACKEND_WOQ,
+      "fused_moe: unknown backend ",
+      backend);
+  if (backend == MOE_BACKEND_DNNL || backend == MOE_BACKEND_MKL) {
+    TORCH_CHECK(
+        gate_op_ctx.size() == gate_wei.size() &&
+            up_op_ctx.size() == gate_wei.size() &&
+            down_op_ctx.size() == gate_wei.size(),
+        "fused_moe: expect an op context for every expert weight");
+  }
+}
+
+} // namespace
+
+at::Tensor fused_moe(
+    const at::Tensor& hidden_states,
+    const at::Tensor& topk_ids,
+    const at::Tensor& topk_weights,
+    const std::vector<at::Tensor>& gate_wei,
+    const std::vector<at::Tensor>& up_wei,
+    const std::vector<at::Tensor>& down_wei,
+    const std::vector<at::Tensor>& gate_op_ctx,
+    const std::vector<at::Tensor>& up_op_ctx,
+    const std::vector<at::Tensor>& down_op_ctx,
+    int64_t backend,
+    bool is_distributed) {
+  RECORD_FUNCTION("ipex::fused_moe", c10::ArrayRef<c10::IValue>({}));
+
+  check_fused_moe_inputs(
+      hidden_states,
+      topk_ids,
+      topk_weights,
+      gate_wei,
+      up_wei,
+      down_wei,
+      gate_op_ctx,
+      up_op_ctx,
+      down_op_ctx,
+      backend);
+  return fused_moe_kernel_stub(
+      kCPU,
+      hidden_states,
+      topk_ids,
+      topk_weights,
+      gate_wei,
+      up_wei,
+      down_wei,
+      gate_op_ctx,
+      up_op_ctx,
+      down_op_ctx,
+      backend,
+      is_distributed);
+}
+
+at::Tensor fused_moe_ep(
+    const at::Tensor& hidden_states,
+    const at::Tensor& topk_ids,
+    const at::Tensor& topk_weights,
+    const std::vector<at::Tensor>& gate_wei,
+    const std::vector<at::Tensor>& up_wei,
+    const std::vector<at::Tensor>& down_wei,
+    const std::vector<at::Tensor>& gate_op_ctx,
+    const std::vector<at::Tensor>& up_op_ctx,
+    const std::vector<at::Tensor>& down_op_ctx,
+    int64_t backend,
+    int64_t num_experts) {
+  RECORD_FUNCTION("ipex::fused_moe_ep", c10::ArrayRef<c10::IValue>({}));
+
+  check_fused_moe_inputs(
+      hidden_states,
+      topk_ids,
+      topk_weights,
+      gate_wei,
+      up_wei,
+      down_wei,
+      gate_op_ctx,
+      up_op_ctx,
+      down_op_ctx,
+      backend);
+  return fused_moe_ep_kernel_stub(
+      kCPU,
+      hidden_states,
+      topk_ids,
+      topk_weights,
+      gate_wei,
+      up_wei,
+      down_wei,
+      gate_op_ctx,
+      up_op_ctx,
+      down_op_ctx,
+      backend,
+      num_experts);
+}
 } // namespace cpu
 } // namespace torch_ipex
 
@@ -124,5 +244,16 @@ TORCH_LIBRARY_FRAGMENT(torch_ipex, m) {
       "mixtral_moe_woq",
       c10::DispatchKey::CPU,
       torch_ipex::cpu::mixtral_moe_woq);
+  m.def(
+      "fused_moe(Tensor hidden_states, Tensor topk_ids, Tensor topk_weights, \
+      Tensor[] gate_wei, Tensor[] up_wei, Tensor[] down_wei, Tensor[] gate_op_ctx, \
+      Tensor[] up_op_ctx, Tensor[] down_op_ctx, int backend, bool is_distributed) -> Tensor");
+  m.impl("fused_moe", c10::DispatchKey::CPU, torch_ipex::cpu::fused_moe);
+  m.def(
+      "fused_moe_ep(Tensor hidden_states, Tensor topk_ids, Tensor topk_weights, \
+      Tensor[] gate_wei, Tensor[] up_wei, Tensor[] down_wei, Tensor[] gate_op_ctx, \
+      Tensor[] up_op_ctx, Tensor[] down_op_ctx, int backend, int num_experts) -> Tensor");
+  m.impl(
+      "fused_moe_ep", c10::DispatchKey::CPU, torch_ipex::cpu::fused_moe_ep);
 }
 } // namespace
\ No newline at end of file
@@ -5,6 +5,16 @@
 
 namespace torch_ipex {
 namespace cpu {
+
+// Expert GEMM implementations of fused_moe, the same as used by the
+// per-expert mixtral_moe_tpp (tpp_fallback or not), mixtral_moe (use_dnnl or
+// not) and mixtral_moe_woq ops.
+#define MOE_BACKEND_TPP 0
+#define MOE_BACKEND_TPP_FALLBACK 1
+#define MOE_BACKEND_DNNL 2
+#define MOE_BACKEND_MKL 3
+#define MOE_BACKEND_WOQ 4
+
 at::Tensor mixtral_moe_tpp(
     const at::Tensor&,
     const at::Tensor&,
@@ -40,6 +50,30 @@ at::Tensor mixtral_moe(
     const at::Tensor&,
     at::Tensor&,
     bool);
+at::Tensor fused_moe(
+    const at::Tensor&,
+    const at::Tensor&,
+    const at::Tensor&,
+    const std::vector<at::Tensor>&,
+    const std::vector<at::Tensor>&,
+    const std::vector<at::Tensor>&,
+    const std::vector<at::Tensor>&,
+    const std::vector<at::Tensor>&,
+    const std::vector<at::Tensor>&,
+    int64_t,
+    bool);
+at::Tensor fused_moe_ep(
+    const at::Tensor&,
+    const at::Tensor&,
+    const at::Tensor&,
+    const std::vector<at::Tensor>&,
+    const std::vector<at::Tensor>&,
+    const std::vector<at::Tensor>&,
+    const std::vector<at::Tensor>&,
+    const std::vector<at::Tensor>&,
+    const std::vector<at::Tensor>&,
+    int64_t,
+    int64_t);
 using mixtral_moe_tpp_kernel_fn = at::Tensor (*)(
     const at::Tensor& hidden_states,
     const at::Tensor& top_x,
@@ -75,8 +109,34 @@ using mixtral_moe_kernel_fn = at::Tensor (*)(
     const at::Tensor& routing_weights,
     at::Tensor& output,
     bool is_distributed);
+using fused_moe_kernel_fn = at::Tensor (*)(
+    const at::Tensor& hidden_states,
+    const at::Tensor& topk_ids,
+    const at::Tensor& topk_weights,
+    const std::vector<at::Tensor>& gate_wei,
+    const std::vector<at::Tensor>& up_wei,
+    const std::vector<at::Tensor>& down_wei,
+    const std::vector<at::Tensor>& gate_op_ctx,
+    const std::vector<at::Tensor>& up_op_ctx,
+    const std::vector<at::Tensor>& down_op_ctx,
+    int64_t backend,
+    bool is_distributed);
+using fused_moe_ep_kernel_fn = at::Tensor (*)(
+    const at::Tensor& hidden_states,
+    const at::Tensor& topk_ids,
+    const at::Tensor& topk_weights,
+    const std::vector<at::Tensor>& gate_wei,
+    const std::vector<at::Tensor>& up_wei,
+    const std::vector<at::Tensor>& down_wei,
+    const std::vector<at::Tensor>& gate_op_ctx,
+    const std::vector<at::Tensor>& up_op_ctx,
+    const std::vector<at::Tensor>& down_op_ctx,
+    int64_t backend,
+    int64_t num_experts);
 IPEX_DECLARE_DISPATCH(mixtral_moe_tpp_kernel_fn, mixtral_moe_tpp_kernel_stub);
 IPEX_DECLARE_DISPATCH(mixtral_moe_woq_kernel_fn, mixtral_moe_woq_kernel_stub);
 IPEX_DECLARE_DISPATCH(mixtral_moe_kernel_fn, mixtral_moe_kernel_stub);
+IPEX_DECLARE_DISPATCH(fused_moe_kernel_fn, fused_moe_kernel_stub);
+IPEX_DECLARE_DISPATCH(fused_moe_ep_kernel_fn, fused_moe_ep_kernel_stub);
 } // namespace cpu
 } // namespace torch_ipex
@@ -6,7 +6,10 @@ namespace torch_ipex {
 namespace cpu {
 
 IPEX_DEFINE_DISPATCH(single_query_cached_kv_attention_kernel_stub);
+IPEX_DEFINE_DISPATCH(paged_attention_varlen_kernel_stub);
 IPEX_DEFINE_DISPATCH(reshape_and_cache_kernel_stub);
+IPEX_DEFINE_DISPATCH(copy_blocks_kernel_stub);
+IPEX_DEFINE_DISPATCH(swap_blocks_kernel_stub);
 
 /*
  *Caculate the masked multihead attention for decoder layer in decoder only
@@ -22,7 +25,10 @@ void single_query_cached_kv_attention_forward_cpu(
     at::Tensor& context_lens, // [num_seqs]
     int64_t block_size,
     int64_t max_context_len,
-    const c10::optional<at::Tensor>& alibi_slopes) {
+    const c10::optional<at::Tensor>& alibi_slopes,
+    const c10::optional<at::Tensor>& k_scale, // [num_blocks, num_kv_heads]
+    const c10::optional<at::Tensor>& v_scale, // [num_blocks, num_kv_heads]
+    int64_t window_size) {
   return single_query_cached_kv_attention_kernel_stub(
       kCPU,
       out,
@@ -35,7 +41,51 @@ void single_query_cached_kv_attention_forward_cpu(
       context_lens,
       block_size,
       max_context_len,
-      alibi_slopes);
+      alibi_slopes,
+      k_scale,
+      v_scale,
+      window_size);
+}
+
+/*
+ *Caculate the paged attention for several query tokens per sequence, e.g. the
+ *mixed batch of chunked prefill and decode
+ */
+void paged_attention_varlen_cpu(
+    at::Tensor& out, // [num_tokens, num_heads, head_size]
+    at::Tensor& query, // [num_tokens, num_heads, head_size]
+    at::Tensor& key_cache, // [num_blocks,  block_size, num_heads, head_size]
+    at::Tensor& value_cache, // [num_blocks,  block_size, num_heads, head_size]
+    at::Tensor& head_mapping, // [num_heads]
+    const double scale,
+    at::Tensor& block_tables, // [num_seqs, max_num_blocks_per_seq]
+    at::Tensor& cu_seqlens_q, // [num_seqs + 1]
+    at::Tensor& context_lens, // [num_seqs]
+    int64_t block_size,
+    int64_t max_context_len,
+    bool is_causal,
+    const c10::optional<at::Tensor>& alibi_slopes,
+    const c10::optional<at::Tensor>& k_scale, // [num_blocks, num_kv_heads]
+    const c10::optional<at::Tensor>& v_scale, // [num_blocks, num_kv_heads]
+    int64_t window_size) {
+  return paged_attention_varlen_kernel_stub(
+      kCPU,
+      out,
+      query,
+      key_cache,
+      value_cache,
+      head_mapping,
+      scale,
+      block_tables,
+      cu_seqlens_q,
+      context_lens,
+      block_size,
+      max_context_len,
+      is_causal,
+      alibi_slopes,
+      k_scale,
+      v_scale,
+      window_size);
 }
 
 void reshape_and_cache_cpu(
@@ -43,9 +93,32 @@ void reshape_and_cache_cpu(
     at::Tensor& value,
     at::Tensor& key_cache,
     at::Tensor& value_cache,
-    at::Tensor& slot_mapping) {
+    at::Tensor& slot_mapping,
+    const c10::optional<at::Tensor>& k_scale,
+    const c10::optional<at::Tensor>& v_scale) {
   return reshape_and_cache_kernel_stub(
-      kCPU, key, value, key_cache, value_cache, slot_mapping);
+      kCPU,
+      key,
+      value,
+      key_cache,
+      value_cache,
+      slot_mapping,
+      k_scale,
+      v_scale);
+}
+
+void copy_blocks_cpu(
+    at::TensorList key_caches,
+    at::TensorList value_caches,
+    const at::Tensor& block_mapping) {
+  return copy_blocks_kernel_stub(kCPU, key_caches, value_caches, block_mapping);
+}
+
+void swap_blocks_cpu(
+    const at::Tensor& src,
+    at::Tensor& dst,
+    const at::Tensor& block_mapping) {
+  return swap_blocks_kernel_stub(kCPU, src, dst, block_mapping);
 }
 
 } // namespace cpu
@@ -57,16 +130,34 @@ TORCH_LIBRARY_FRAGMENT(torch_ipex, m) {
   m.def(
       "single_query_cached_kv_attention(Tensor (a!)out, Tensor (a!)query, Tensor (a!)key_cache, Tensor (a!)value_cache,\
        Tensor(a!) head_mapping, float scale, Tensor(a!) block_tables, Tensor(a!) context_lens, int block_size, int max_context_len,\
-       Tensor? alibi_slopes)-> ()");
+       Tensor? alibi_slopes, Tensor? k_scale=None, Tensor? v_scale=None,\
+       int window_size=-1)-> ()");
   m.impl(
       "single_query_cached_kv_attention",
       c10::DispatchKey::CPU,
       torch_ipex::cpu::single_query_cached_kv_attention_forward_cpu);
   m.def(
-      "reshape_and_cache(Tensor (a!)key, Tensor (a!)value, Tensor (a!)key_cache, Tensor (a!)value_cache, Tensor(a!) slot_mapping)-> ()");
+      "paged_attention_varlen(Tensor (a!)out, Tensor (a!)query, Tensor (a!)key_cache, Tensor (a!)value_cache,\
+       Tensor(a!) head_mapping, float scale, Tensor(a!) block_tables, Tensor(a!) cu_seqlens_q, Tensor(a!) context_lens,\
+       int block_size, int max_context_len, bool is_causal, Tensor? alibi_slopes, Tensor? k_scale=None,\
+       Tensor? v_scale=None, int window_size=-1)-> ()");
+  m.impl(
+      "paged_attention_varlen",
+      c10::DispatchKey::CPU,
+      torch_ipex::cpu::paged_attention_varlen_cpu);
+  m.def(
+      "reshape_and_cache(Tensor (a!)key, Tensor (a!)value, Tensor (a!)key_cache, Tensor (a!)value_cache, Tensor(a!) slot_mapping,\
+       Tensor? k_scale=None, Tensor? v_scale=None)-> ()");
   m.impl(
       "reshape_and_cache",
       c10::DispatchKey::CPU,
       torch_ipex::cpu::reshape_and_cache_cpu);
+  m.def(
+      "copy_blocks(Tensor(a!)[] key_caches, Tensor(a!)[] value_caches, Tensor block_mapping)-> ()");
+  m.impl(
+      "copy_blocks", c10::DispatchKey::CPU, torch_ipex::cpu::copy_blocks_cpu);
+  m.def("swap_blocks(Tensor src, Tensor(a!) dst, Tensor block_mapping)-> ()");
+  m.impl(
+      "swap_blocks", c10::DispatchKey::CPU, torch_ipex::cpu::swap_blocks_cpu);
 }
 } // namespace
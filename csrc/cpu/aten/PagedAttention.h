@@ -19,7 +19,10 @@ void single_query_cached_kv_attention(
     at::Tensor& context_lens, // [num_seqs]
     int64_t block_size,
     int64_t max_context_len,
-    const c10::optional<at::Tensor>& alibi_slopes);
+    const c10::optional<at::Tensor>& alibi_slopes,
+    const c10::optional<at::Tensor>& k_scale, // [num_blocks, num_kv_heads]
+    const c10::optional<at::Tensor>& v_scale, // [num_blocks, num_kv_heads]
+    int64_t window_size);
 }
 
 void reshape_and_cache(
@@ -27,7 +30,9 @@ void reshape_and_cache(
     at::Tensor& value,
     at::Tensor& key_cache,
     at::Tensor& value_cache,
-    at::Tensor& slot_mapping);
+    at::Tensor& slot_mapping,
+    const c10::optional<at::Tensor>& k_scale,
+    const c10::optional<at::Tensor>& v_scale);
 
 using single_query_cached_kv_attention_fn = void (*)(
     at::Tensor& out, // [num_seqs, num_heads, head_size]
@@ -40,19 +45,57 @@ using single_query_cached_kv_attention_fn = void (*)(
     at::Tensor& context_lens, // [num_seqs]
     int64_t block_size,
     int64_t max_context_len,
-    const c10::optional<at::Tensor>& alibi_slopes);
+    const c10::optional<at::Tensor>& alibi_slopes,
+    const c10::optional<at::Tensor>& k_scale, // [num_blocks, num_kv_heads]
+    const c10::optional<at::Tensor>& v_scale, // [num_blocks, num_kv_heads]
+    int64_t window_size);
+
+using paged_attention_varlen_fn = void (*)(
+    at::Tensor& out, // [num_tokens, num_heads, head_size]
+    at::Tensor& query, // [num_tokens, num_heads, head_size]
+    at::Tensor& key_cache, // [num_blocks,  block_size, num_heads, head_size]
+    at::Tensor& value_cache, // [num_blocks,  block_size, num_heads, head_size]
+    at::Tensor& head_mapping, // [num_heads]
+    const double scale,
+    at::Tensor& block_tables, // [num_seqs, max_num_blocks_per_seq]
+    at::Tensor& cu_seqlens_q, // [num_seqs + 1]
+    at::Tensor& context_lens, // [num_seqs]
+    int64_t block_size,
+    int64_t max_context_len,
+    bool is_causal,
+    const c10::optional<at::Tensor>& alibi_slopes,
+    const c10::optional<at::Tensor>& k_scale, // [num_blocks, num_kv_heads]
+    const c10::optional<at::Tensor>& v_scale, // [num_blocks, num_kv_heads]
+    int64_t window_size);
 
 using reshape_and_cache_fn = void (*)(
     at::Tensor& key,
     at::Tensor& value,
     at::Tensor& key_cache,
     at::Tensor& value_cache,
-    at::Tensor& slot_mapping);
+    at::Tensor& slot_mapping,
+    const c10::optional<at::Tensor>& k_scale,
+    const c10::optional<at::Tensor>& v_scale);
+
+using copy_blocks_fn = void (*)(
+    at::TensorList key_caches,
+    at::TensorList value_caches,
+    const at::Tensor& block_mapping); // [num_pairs, 2]
+
+using swap_blocks_fn = void (*)(
+    const at::Tensor& src,
+    at::Tensor& dst,
+    const at::Tensor& block_mapping); // [num_pairs, 2]
 
 IPEX_DECLARE_DISPATCH(
     single_query_cached_kv_attention_fn,
     single_query_cached_kv_attention_kernel_stub);
+IPEX_DECLARE_DISPATCH(
+    paged_attention_varlen_fn,
+    paged_attention_varlen_kernel_stub);
 IPEX_DECLARE_DISPATCH(reshape_and_cache_fn, reshape_and_cache_kernel_stub);
+IPEX_DECLARE_DISPATCH(copy_blocks_fn, copy_blocks_kernel_stub);
+IPEX_DECLARE_DISPATCH(swap_blocks_fn, swap_blocks_kernel_stub);
 
 } // namespace cpu
 } // namespace torch_ipex
@@ -17,6 +17,18 @@ rotary_position_embedding_kernel_impl(
     int64_t H,
     int64_t offset,
     int64_t rotary_ndims);
+
+at::Tensor rotary_position_embedding_paged_cache_kernel_impl(
+    at::Tensor& t_in,
+    at::Tensor& t_emb_pos,
+    at::Tensor& t_pos,
+    int64_t N,
+    int64_t H,
+    int64_t offset,
+    int64_t rotary_ndims,
+    at::Tensor& key_cache, // [num_blocks, block_size, num_kv_heads, H]
+    at::Tensor& value_cache, // [num_blocks, block_size, num_kv_heads, H]
+    at::Tensor& slot_mapping); // [B * S]
 }
 
 using rotary_position_embedding_kernel_fn =
@@ -29,9 +41,24 @@ using rotary_position_embedding_kernel_fn =
         int64_t offset,
         int64_t rotary_ndims);
 
+using rotary_position_embedding_paged_cache_kernel_fn = at::Tensor (*)(
+    at::Tensor& t_in,
+    at::Tensor& t_emb_pos,
+    at::Tensor& t_pos,
+    int64_t N,
+    int64_t H,
+    int64_t offset,
+    int64_t rotary_ndims,
+    at::Tensor& key_cache, // [num_blocks, block_size, num_kv_heads, H]
+    at::Tensor& value_cache, // [num_blocks, block_size, num_kv_heads, H]
+    at::Tensor& slot_mapping); // [B * S]
+
 IPEX_DECLARE_DISPATCH(
     rotary_position_embedding_kernel_fn,
     rotary_position_embedding_kernel_stub);
+IPEX_DECLARE_DISPATCH(
+    rotary_position_embedding_paged_cache_kernel_fn,
+    rotary_position_embedding_paged_cache_kernel_stub);
 
 } // namespace cpu
 } // namespace torch_ipex
@@ -8,6 +8,9 @@ namespace torch_ipex {
 namespace cpu {
 
 IPEX_DEFINE_DISPATCH(shm_all_reduce_add_kernel_stub);
+IPEX_DEFINE_DISPATCH(shm_all_to_all_kernel_stub);
+IPEX_DEFINE_DISPATCH(shm_all_gather_kernel_stub);
+IPEX_DEFINE_DISPATCH(shm_broadcast_kernel_stub);
 
 at::Tensor shm_all_reduce_add_forward_cpu(
     at::Tensor& t_in,
@@ -16,7 +19,8 @@ at::Tensor shm_all_reduce_add_forward_cpu(
     at::Tensor& t_blockState,
     int64_t shm_block_size,
     int64_t rank,
-    int64_t world_size) {
+    int64_t world_size,
+    bool reduce_scatter) {
   return shm_all_reduce_add_kernel_stub(
       kCPU,
       t_in,
@@ -25,7 +29,8 @@ at::Tensor shm_all_reduce_add_forward_cpu(
       t_blockState,
       shm_block_size,
       rank,
-      world_size);
+      world_size,
+      reduce_scatter);
 }
 
 } // namespace cpu
@@ -16,7 +16,8 @@ at::Tensor shm_all_reduce_add(
     at::Tensor& t_blockState,
     int64_t shm_block_size,
     int64_t rank,
-    int64_t world_size);
+    int64_t world_size,
+    bool reduce_scatter);
 }
 
 using shm_all_reduce_add_kernel_fn = at::Tensor (*)(
@@ -26,11 +27,50 @@ using shm_all_reduce_add_kernel_fn = at::Tensor (*)(
     at::Tensor& t_blockState,
     int64_t shm_block_size,
     int64_t rank,
+    int64_t world_size,
+    bool reduce_scatter);
+
+// Exchanges the rows of t_in between the ranks through the shared memory
+// buffer, see Messenger::alltoallv. Fills recv_splits in any case, but
+// returns an undefined tensor if the messages of some rank don't fit into
+// its share of the buffer, which all the ranks agree on.
+using shm_all_to_all_kernel_fn = at::Tensor (*)(
+    const at::Tensor& t_in,
+    const std::vector<int64_t>& send_splits,
+    std::vector<int64_t>& recv_splits,
+    at::Tensor& t_address,
+    at::Tensor& t_state,
+    int64_t rank,
+    int64_t world_size);
+
+// Gathers t_in of every rank along the last dimension into t_out through
+// the shared memory buffer, the columns of rank r being
+// [cols_per_rank[r], cols_per_rank[r + 1]). t_out must fit into the buffer.
+using shm_all_gather_kernel_fn = void (*)(
+    const at::Tensor& t_in,
+    at::Tensor& t_out,
+    const std::vector<int64_t>& cols_per_rank,
+    at::Tensor& t_address,
+    at::Tensor& t_state,
+    int64_t rank,
+    int64_t world_size);
+
+// Broadcasts t_in of rank root to the other ranks in place through the
+// shared memory buffer. t_in must fit into the buffer.
+using shm_broadcast_kernel_fn = void (*)(
+    at::Tensor& t_in,
+    int64_t root,
+    at::Tensor& t_address,
+    at::Tensor& t_state,
+    int64_t rank,
     int64_t world_size);
 
 IPEX_DECLARE_DISPATCH(
     shm_all_reduce_add_kernel_fn,
     shm_all_reduce_add_kernel_stub);
+IPEX_DECLARE_DISPATCH(shm_all_to_all_kernel_fn, shm_all_to_all_kernel_stub);
+IPEX_DECLARE_DISPATCH(shm_all_gather_kernel_fn, shm_all_gather_kernel_stub);
+IPEX_DECLARE_DISPATCH(shm_broadcast_kernel_fn, shm_broadcast_kernel_stub);
 
 } // namespace cpu
 } // namespace torch_ipex
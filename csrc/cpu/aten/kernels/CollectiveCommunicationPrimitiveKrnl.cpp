@@ -14,27 +14,47 @@ at::Tensor all_reduce_add_kernel_impl(at::Tensor& t_in) {
   return t_in;
 }
 
+int64_t all_reduce_add_async_kernel_impl(at::Tensor& t_in) {
+  TORCH_CHECK(
+      t_in.is_contiguous(), "all_reduce_add_async: expect a contiguous tensor");
+  return Messenger::getInstance().reduceAddAsync(t_in);
+}
+
+void all_reduce_wait_kernel_impl(int64_t handle) {
+  Messenger::getInstance().wait(handle);
+}
+
 at::Tensor allgather_kernel_impl(
     at::Tensor t_in,
     std::vector<int64_t> cols_per_rank,
     int64_t world_size) {
-  std::vector<at::Tensor> output_tensors;
-  auto shape = t_in.contiguous().sizes();
-  for (int64_t rank = 0; rank < world_size; rank++) {
-    std::vector<int64_t> t_out_shape(shape.begin(), shape.end() - 1);
-    t_out_shape.push_back(cols_per_rank[rank + 1] - cols_per_rank[rank]);
-    output_tensors.push_back(at::empty(t_out_shape, t_in.options()));
-  }
-
-  return Messenger::getInstance().allgather(t_in, output_tensors);
+  TORCH_CHECK(
+      (int64_t)cols_per_rank.size() == world_size + 1,
+      "allgather: expect world_size + 1 column offsets");
+  return Messenger::getInstance().allgather(t_in, cols_per_rank);
+}
+
+at::Tensor broadcast_kernel_impl(at::Tensor& t_in, int64_t root) {
+  Messenger::getInstance().broadcast(t_in, root);
+  return t_in;
 }
 
 } // anonymous namespace
 
 IPEX_REGISTER_DISPATCH(all_reduce_add_kernel_stub, &all_reduce_add_kernel_impl);
 
+IPEX_REGISTER_DISPATCH(
+    all_reduce_add_async_kernel_stub,
+    &all_reduce_add_async_kernel_impl);
+
+IPEX_REGISTER_DISPATCH(
+    all_reduce_wait_kernel_stub,
+    &all_reduce_wait_kernel_impl);
+
 IPEX_REGISTER_DISPATCH(allgather_kernel_stub, &allgather_kernel_impl);
 
+IPEX_REGISTER_DISPATCH(broadcast_kernel_stub, &broadcast_kernel_impl);
+
 } // namespace cpu
 } // namespace torch_ipex
 #endif
\ No newline at end of file
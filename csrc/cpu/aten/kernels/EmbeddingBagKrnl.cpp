@@ -8,11 +8,14 @@
 #include <torch/csrc/autograd/custom_function.h>
 #include <torch/csrc/autograd/function.h>
 #include <torch/csrc/autograd/variable.h>
+#include <immintrin.h>
 #include <torch/script.h>
 #include <algorithm>
+#include <numeric>
 
 #include "autocast/autocast_mode.h"
 #include "cpu/kernels/Embeddingbag.h"
+#include "vec/rowwise_quant_utils.hpp"
 #include "vec/vec.h"
 
 namespace torch_ipex {
@@ -43,6 +46,47 @@ static inline bool is_bfloat16_tensor(const Tensor tensor_) {
   return false;
 }
 
+// Number of indices the pooling loop prefetches the rows ahead. Rows of
+// tables larger than the LLC miss on nearly every lookup, the prefetches keep
+// several of these misses in flight.
+constexpr int64_t kRowPrefetchDistance = 8;
+
+template <typename T>
+static inline void prefetch_row(const T* row, int64_t ddim) {
+  const char* begin = reinterpret_cast<const char*>(row);
+  const char* end = reinterpret_cast<const char*>(row + ddim);
+  for (const char* p = begin; p < end; p += 64) {
+    _mm_prefetch(p, _MM_HINT_T0);
+  }
+}
+
+// Sums the rows row(s) of indices s in [begin, end) into out. The row of
+// index s + kRowPrefetchDistance is prefetched while it's below limit.
+template <typename T, typename RowFn>
+static inline void _embedding_bag_pool(
+    T* out,
+    int64_t begin,
+    int64_t end,
+    int64_t limit,
+    int64_t ddim,
+    const RowFn& row) {
+  if (end - begin == 1) {
+    if (begin + kRowPrefetchDistance < limit)
+      prefetch_row(row(begin + kRowPrefetchDistance), ddim);
+    move_ker(out, row(begin), ddim);
+    return;
+  }
+  using acc_t = acc_type<T, true>;
+  acc_t temp_out[ddim];
+  zero_ker(temp_out, ddim);
+  for (int64_t s = begin; s < end; s++) {
+    if (s + kRowPrefetchDistance < limit)
+      prefetch_row(row(s + kRowPrefetchDistance), ddim);
+    add_ker(temp_out, row(s), ddim);
+  }
+  move_ker(out, temp_out, ddim);
+}
+
 template <typename T>
 static inline Tensor _embedding_bag_index_add_select_fast(
     const Tensor indices,
@@ -62,30 +106,164 @@ static inline Tensor _embedding_bag_index_add_select_fast(
 
   Tensor output = empty({output_size, src.size(1)}, src.options());
   auto* output_data = output.data_ptr<T>();
+  auto row = [&](int64_t s) { return &src_data[indices_accessor[s] * ddim]; };
   parallel_for(0, output_size, 16, [&](int64_t start, int64_t end) {
+    int64_t limit = end - 1 == last_offset ? last_index : offsets_data[end];
     for (int64_t i = start; i < end; i++) {
-      auto* out_data_ptr = &output_data[i * ddim];
       auto inputs_start = offsets_data[i];
       auto inputs_end = i == last_offset ? last_index : offsets_data[i + 1];
-      if (inputs_end - inputs_start == 1) {
-        T* select_data_ptr = &src_data[indices_accessor[inputs_start] * ddim];
-        move_ker(out_data_ptr, select_data_ptr, ddim);
+      _embedding_bag_pool(
+          &output_data[i * ddim], inputs_start, inputs_end, limit, ddim, row);
+    }
+  });
+
+  return output;
+}
+
+// The hot rows of a table are looked up in an open-addressing hash map with
+// linear probing: hot_map is a [map_size, 2] tensor of (row, slot) pairs,
+// where slot is the row of the copy in hot_weight and row is -1 for empty
+// entries. map_size is a power of 2 and at least twice the number of hot rows,
+// so that the map stays small enough for the LLC next to the hot rows.
+static inline int64_t hot_row_hash(int64_t row, int64_t mask) {
+  return (int64_t)(((uint64_t)row * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+static inline int64_t find_hot_slot(
+    const int64_t* hot_map,
+    int64_t mask,
+    int64_t row) {
+  for (int64_t h = hot_row_hash(row, mask);; h = (h + 1) & mask) {
+    if (hot_map[2 * h] == row)
+      return hot_map[2 * h + 1];
+    if (hot_map[2 * h] == -1)
+      return -1;
+  }
+}
+
+std::tuple<Tensor, Tensor> embedding_bag_build_hot_cache_kernel_impl(
+    const Tensor& weight,
+    const Tensor& sample_indices,
+    int64_t capacity) {
+  int64_t num_rows = weight.size(0);
+  auto counts = bincount(sample_indices.reshape(-1), {}, num_rows);
+  auto top = counts.topk(std::min(capacity, num_rows));
+  auto hot_rows = std::get<1>(top).masked_select(std::get<0>(top) > 0);
+  int64_t num_hot = hot_rows.numel();
+  // most frequent rows first, so that they are the closest to each other
+  Tensor hot_weight = weight.index_select(0, hot_rows).contiguous();
+
+  int64_t map_size = 2;
+  while (map_size < 2 * num_hot)
+    map_size <<= 1;
+  Tensor hot_map = full({map_size, 2}, -1, weight.options().dtype(kLong));
+  int64_t* hot_map_data = hot_map.data_ptr<int64_t>();
+  const int64_t* hot_rows_data = hot_rows.data_ptr<int64_t>();
+  for (int64_t slot = 0; slot < num_hot; slot++) {
+    int64_t h = hot_row_hash(hot_rows_data[slot], map_size - 1);
+    while (hot_map_data[2 * h] != -1)
+      h = (h + 1) & (map_size - 1);
+    hot_map_data[2 * h] = hot_rows_data[slot];
+    hot_map_data[2 * h + 1] = slot;
+  }
+  return std::make_tuple(hot_weight, hot_map);
+}
+
+template <typename T>
+static inline Tensor _embedding_bag_hot_cache_fast(
+    const Tensor& weight,
+    const Tensor& hot_weight,
+    const Tensor& hot_map,
+    const Tensor& indices,
+    const Tensor& offsets,
+    Tensor& stats,
+    bool include_last_offset) {
+  int64_t ddim = weight.size(1);
+  T* weight_data = weight.data_ptr<T>();
+  T* hot_weight_data = hot_weight.data_ptr<T>();
+  const int64_t* hot_map_data = hot_map.data_ptr<int64_t>();
+  int64_t mask = hot_map.size(0) - 1;
+  int64_t output_size = offsets.numel();
+  if (include_last_offset) {
+    output_size -= 1;
+  }
+  int64_t* offsets_data = offsets.data_ptr<int64_t>();
+  const int64_t* indices_data = indices.data_ptr<int64_t>();
+  // As in ATen, the last offset ends the last bag if include_last_offset,
+  // the indices after it are ignored.
+  int64_t last_index =
+      include_last_offset ? offsets_data[output_size] : indices.numel();
+  int64_t last_offset = output_size - 1;
+
+  Tensor output = empty({output_size, ddim}, weight.options());
+  auto* output_data = output.data_ptr<T>();
+  std::vector<int64_t> thread_hits(get_num_threads(), 0);
+  parallel_for(0, output_size, 16, [&](int64_t start, int64_t end) {
+    // Resolve the rows of the whole chunk first: the hash map lookups are
+    // independent, and the pooling below can prefetch the cold rows ahead.
+    int64_t base = offsets_data[start];
+    int64_t limit = end - 1 == last_offset ? last_index : offsets_data[end];
+    std::vector<T*> rows(limit - base);
+    int64_t hits = 0;
+    for (int64_t s = base; s < limit; s++) {
+      int64_t slot = find_hot_slot(hot_map_data, mask, indices_data[s]);
+      if (slot >= 0) {
+        rows[s - base] = &hot_weight_data[slot * ddim];
+        hits++;
       } else {
-        using acc_t = acc_type<T, true>;
-        acc_t temp_out[ddim];
-        zero_ker(temp_out, ddim);
-        for (int64_t s = inputs_start; s < inputs_end; s++) {
-          T* select_data_ptr = &src_data[indices_accessor[s] * ddim];
-          add_ker(temp_out, select_data_ptr, ddim);
-        }
-        move_ker(out_data_ptr, temp_out, ddim);
+        rows[s - base] = &weight_data[indices_data[s] * ddim];
       }
     }
+    thread_hits[get_thread_num()] += hits;
+
+    auto row = [&](int64_t s) { return rows[s - base]; };
+    for (int64_t i = start; i < end; i++) {
+      auto inputs_start = offsets_data[i];
+      auto inputs_end = i == last_offset ? last_index : offsets_data[i + 1];
+      _embedding_bag_pool(
+          &output_data[i * ddim], inputs_start, inputs_end, limit, ddim, row);
+    }
   });
 
+  int64_t hits = std::accumulate(
+      thread_hits.begin(), thread_hits.end(), (int64_t)0);
+  int64_t lookups = output_size > 0 ? last_index - offsets_data[0] : 0;
+  int64_t* stats_data = stats.data_ptr<int64_t>();
+  stats_data[0] += hits;
+  stats_data[1] += lookups - hits;
   return output;
 }
 
+Tensor embedding_bag_hot_cache_kernel_impl(
+    const Tensor& weight,
+    const Tensor& hot_weight,
+    const Tensor& hot_map,
+    const Tensor& indices,
+    const Tensor& offsets,
+    Tensor& stats,
+    bool include_last_offset) {
+  Tensor offsets_ = offsets.is_contiguous() ? offsets : offsets.contiguous();
+  Tensor indices_ = indices.is_contiguous() ? indices : indices.contiguous();
+  if (is_bfloat16_tensor(weight)) {
+    return _embedding_bag_hot_cache_fast<BFloat16>(
+        weight,
+        hot_weight,
+        hot_map,
+        indices_,
+        offsets_,
+        stats,
+        include_last_offset);
+  }
+  return _embedding_bag_hot_cache_fast<float>(
+      weight,
+      hot_weight,
+      hot_map,
+      indices_,
+      offsets_,
+      stats,
+      include_last_offset);
+}
+
 Tensor embedding_bag_kernel_impl(
     const Tensor& weight,
     const Tensor& indices,
@@ -363,6 +541,108 @@ Tensor embedding_bag_int8_kernel_impl(
   return output;
 }
 
+template <ScalarType qtype, typename T>
+static inline void _rowwise_quantized_pack(
+    const Tensor& weight,
+    Tensor& qweight) {
+  int64_t dim = weight.size(1);
+  int64_t row_bytes = qweight.size(1);
+  const T* weight_data = weight.data_ptr<T>();
+  uint8_t* qweight_data = qweight.data_ptr<uint8_t>();
+  parallel_for(0, weight.size(0), 64, [&](int64_t start, int64_t end) {
+    for (int64_t r = start; r < end; r++) {
+      rowwise_quant_row<qtype>(
+          &qweight_data[r * row_bytes], &weight_data[r * dim], dim);
+    }
+  });
+}
+
+Tensor rowwise_quantized_embedding_pack_kernel_impl(
+    const Tensor& weight,
+    ScalarType qtype) {
+  auto weight_ = weight.contiguous();
+  int64_t dim = weight_.size(1);
+  Tensor qweight = empty(
+      {weight_.size(0), rowwise_quant_row_bytes(qtype, dim)},
+      weight_.options().dtype(kByte));
+  AT_DISPATCH_FLOATING_TYPES_AND2(
+      kBFloat16, kHalf, weight_.scalar_type(), "rowwise_quant_pack", [&] {
+        if (qtype == kQUInt4x2) {
+          _rowwise_quantized_pack<kQUInt4x2, scalar_t>(weight_, qweight);
+        } else {
+          _rowwise_quantized_pack<kFloat8_e4m3fn, scalar_t>(weight_, qweight);
+        }
+      });
+  return qweight;
+}
+
+// Sum or mean pooling of the row-wise quantized rows, dequantized into the
+// fp32 output rows directly.
+template <ScalarType qtype>
+static inline Tensor _rowwise_quantized_embedding_bag(
+    const Tensor& qweight,
+    const Tensor& indices,
+    const Tensor& offsets,
+    int64_t dim,
+    bool mean,
+    bool include_last_offset) {
+  int64_t row_bytes = qweight.size(1);
+  const uint8_t* qweight_data = qweight.data_ptr<uint8_t>();
+  int64_t output_size = offsets.numel();
+  if (include_last_offset) {
+    output_size -= 1;
+  }
+  int64_t* offsets_data = offsets.data_ptr<int64_t>();
+  const int64_t* indices_data = indices.data_ptr<int64_t>();
+  int64_t last_index = indices.numel();
+  int64_t last_offset = output_size - 1;
+
+  Tensor output = empty({output_size, dim}, qweight.options().dtype(kFloat));
+  float* output_data = output.data_ptr<float>();
+  parallel_for(0, output_size, 16, [&](int64_t start, int64_t end) {
+    int64_t limit = end - 1 == last_offset ? last_index : offsets_data[end];
+    for (int64_t i = start; i < end; i++) {
+      float* out = &output_data[i * dim];
+      auto inputs_start = offsets_data[i];
+      auto inputs_end = i == last_offset ? last_index : offsets_data[i + 1];
+      zero_ker(out, dim);
+      for (int64_t s = inputs_start; s < inputs_end; s++) {
+        if (s + kRowPrefetchDistance < limit) {
+          int64_t next = indices_data[s + kRowPrefetchDistance];
+          prefetch_row(&qweight_data[next * row_bytes], row_bytes);
+        }
+        rowwise_dequant_add_ker<qtype>(
+            out, &qweight_data[indices_data[s] * row_bytes], dim);
+      }
+      if (mean && inputs_end - inputs_start > 1) {
+        float inv_size = 1.f / (inputs_end - inputs_start);
+        for (int64_t d = 0; d < dim; d++) {
+          out[d] *= inv_size;
+        }
+      }
+    }
+  });
+  return output;
+}
+
+Tensor rowwise_quantized_embedding_bag_kernel_impl(
+    const Tensor& qweight,
+    const Tensor& indices,
+    const Tensor& offsets,
+    ScalarType qtype,
+    int64_t dim,
+    bool mean,
+    bool include_last_offset) {
+  Tensor offsets_ = offsets.is_contiguous() ? offsets : offsets.contiguous();
+  Tensor indices_ = indices.is_contiguous() ? indices : indices.contiguous();
+  if (qtype == kQUInt4x2) {
+    return _rowwise_quantized_embedding_bag<kQUInt4x2>(
+        qweight, indices_, offsets_, dim, mean, include_last_offset);
+  }
+  return _rowwise_quantized_embedding_bag<kFloat8_e4m3fn>(
+      qweight, indices_, offsets_, dim, mean, include_last_offset);
+}
+
 } // anonymous namespace
 
 IPEX_REGISTER_DISPATCH(embedding_bag_kernel_stub, &embedding_bag_kernel_impl);
@@ -372,6 +652,18 @@ IPEX_REGISTER_DISPATCH(
 IPEX_REGISTER_DISPATCH(
     embedding_bag_int8_kernel_stub,
     &embedding_bag_int8_kernel_impl);
+IPEX_REGISTER_DISPATCH(
+    embedding_bag_build_hot_cache_kernel_stub,
+    &embedding_bag_build_hot_cache_kernel_impl);
+IPEX_REGISTER_DISPATCH(
+    embedding_bag_hot_cache_kernel_stub,
+    &embedding_bag_hot_cache_kernel_impl);
+IPEX_REGISTER_DISPATCH(
+    rowwise_quantized_embedding_pack_kernel_stub,
+    &rowwise_quantized_embedding_pack_kernel_impl);
+IPEX_REGISTER_DISPATCH(
+    rowwise_quantized_embedding_bag_kernel_stub,
+    &rowwise_quantized_embedding_bag_kernel_impl);
 
 } // namespace cpu
 } // namespace torch_ipex
@@ -10,6 +10,7 @@
 #include <aten/FlashAttention.h>
 #include <torch/all.h>
 #include <torch/csrc/autograd/function.h>
+#include <algorithm>
 #include <limits>
 #include "../cpu/utils/isa_utils.h"
 #include "csrc/cpu/tpp/woq/tla.h"
@@ -351,6 +352,181 @@ inline void _mul_reduce_max_fusion_kernel(
           vec_tmp_max));
 }
 
+// Philox4x32-10 counter-based RNG: ctr is replaced by 4 random numbers
+// that only depend on (ctr, key).
+inline void _philox4x32_10(uint32_t* ctr, uint64_t key) {
+  uint32_t k0 = static_cast<uint32_t>(key);
+  uint32_t k1 = static_cast<uint32_t>(key >> 32);
+  for (int round = 0; round < 10; round++) {
+    uint64_t prod0 = static_cast<uint64_t>(0xD2511F53) * ctr[0];
+    uint64_t prod1 = static_cast<uint64_t>(0xCD9E8D57) * ctr[2];
+    uint32_t c1 = ctr[1], c3 = ctr[3];
+    ctr[0] = static_cast<uint32_t>(prod1 >> 32) ^ c1 ^ k0;
+    ctr[1] = static_cast<uint32_t>(prod1);
+    ctr[2] = static_cast<uint32_t>(prod0 >> 32) ^ c3 ^ k1;
+    ctr[3] = static_cast<uint32_t>(prod0);
+    k0 += 0x9E3779B9;
+    k1 += 0xBB67AE85;
+  }
+}
+
+// Attention dropout keyed by (seed, batch * num_head + head, q, k). The keep
+// mask of an attention weight doesn't depend on the tiling or the thread
+// that computes it, so the backward regenerates it instead of storing it.
+struct AttentionDropout {
+  AttentionDropout(double p, c10::optional<int64_t> seed)
+      : enabled(p > 0.0),
+        seed(seed.has_value() ? static_cast<uint64_t>(seed.value()) : 0),
+        threshold(static_cast<uint64_t>(p * 4294967296.0)),
+        scale(p < 1.0 ? 1.0 / (1.0 - p) : 0.0) {}
+
+  // data[col] <- keep(q, k + col) ? data[col] / (1 - p) : 0
+  template <typename T>
+  void apply(T* data, int64_t size, int64_t head, int64_t q, int64_t k)
+      const {
+    uint32_t rand[4];
+    for (int64_t col = 0; col < size; col++) {
+      int64_t key_idx = k + col;
+      if (col == 0 || (key_idx & 3) == 0) {
+        rand[0] = static_cast<uint32_t>(key_idx >> 2);
+        rand[1] = static_cast<uint32_t>(q);
+        rand[2] = static_cast<uint32_t>(head);
+        rand[3] = static_cast<uint32_t>(head >> 32);
+        _philox4x32_10(rand, seed);
+      }
+      bool keep = rand[key_idx & 3] >= threshold;
+      data[col] = keep ? static_cast<T>(static_cast<double>(data[col]) * scale)
+                       : static_cast<T>(0);
+    }
+  }
+
+  bool enabled;
+  uint64_t seed;
+  uint64_t threshold;
+  double scale;
+};
+
+// Sliding window and block-sparse layout of the attention. Key k is visible
+// to query q if |q - k| < window and the block_mask entry of
+// (q / block_size, k / block_size) is set, causal masking applies on top of
+// it. The kernels skip the tiles without any visible key and only mask the
+// keys of the partially visible ones, so hidden tiles cost nothing.
+struct AttentionLayout {
+  enum TileState { kHidden, kPartial, kVisible };
+
+  AttentionLayout(
+      int64_t window_size,
+      const c10::optional<at::Tensor>& block_mask,
+      int64_t block_size)
+      : window(window_size > 0 ? window_size : 0), block_size(block_size) {
+    if (block_mask.has_value()) {
+      // [num_heads or 1, num_q_blocks, num_kv_blocks]
+      mask = block_mask.value().to(at::kBool).contiguous();
+      if (mask.dim() == 2) {
+        mask = mask.unsqueeze(0);
+      }
+      mask_data = mask.data_ptr<bool>();
+      num_kv_blocks = mask.size(2);
+      mStrideH = mask.size(0) > 1 ? mask.size(1) * num_kv_blocks : 0;
+    }
+  }
+
+  // First key of the kv tiles that can be visible to the queries from m
+  int64_t kv_begin(int64_t m, int64_t kv_split_size) const {
+    if (window == 0) {
+      return 0;
+    }
+    return std::max<int64_t>(m - window + 1, 0) / kv_split_size *
+        kv_split_size;
+  }
+
+  // One past the last key visible to the queries [m, m + q_block_size)
+  int64_t kv_end(int64_t m, int64_t q_block_size, int64_t num_keys) const {
+    return window == 0 ? num_keys
+                       : std::min(num_keys, m + q_block_size - 1 + window);
+  }
+
+  // The window is symmetric, so the queries that can see the keys from n
+  // are bounded like the keys visible to the queries from m.
+  int64_t q_begin(int64_t n, int64_t q_split_size) const {
+    return kv_begin(n, q_split_size);
+  }
+
+  int64_t q_end(int64_t n, int64_t kv_block_size, int64_t num_queries) const {
+    return kv_end(n, kv_block_size, num_queries);
+  }
+
+  TileState tile_state(
+      int64_t head,
+      int64_t m,
+      int64_t q_block_size,
+      int64_t n,
+      int64_t kv_block_size) const {
+    int64_t q_last = m + q_block_size - 1;
+    int64_t k_last = n + kv_block_size - 1;
+    TileState state = kVisible;
+    if (window > 0) {
+      if (m - k_last >= window || n - q_last >= window) {
+        return kHidden;
+      }
+      if (q_last - n >= window || k_last - m >= window) {
+        state = kPartial;
+      }
+    }
+    if (mask_data != nullptr) {
+      const bool* mask_ptr = mask_data + head * mStrideH;
+      bool any = false, all = true;
+      for (int64_t qb = m / block_size; qb <= q_last / block_size; qb++) {
+        for (int64_t kb = n / block_size; kb <= k_last / block_size; kb++) {
+          bool set = mask_ptr[qb * num_kv_blocks + kb];
+          any = any || set;
+          all = all && set;
+        }
+      }
+      if (!any) {
+        return kHidden;
+      }
+      if (!all) {
+        state = kPartial;
+      }
+    }
+    return state;
+  }
+
+  // row[col] <- -inf for the keys of [n, n + size) hidden to query q
+  template <typename T>
+  void mask_row(T* row, int64_t head, int64_t q, int64_t n, int64_t size)
+      const {
+    auto neg_inf = -std::numeric_limits<T>::infinity();
+    int64_t begin = 0, end = size;
+    if (window > 0) {
+      begin = std::clamp<int64_t>(q - window + 1 - n, 0, size);
+      end = std::clamp<int64_t>(q + window - n, begin, size);
+      torch_ipex::cpu::kernel::fill_stub(row, neg_inf, begin);
+      torch_ipex::cpu::kernel::fill_stub(row + end, neg_inf, size - end);
+    }
+    if (mask_data != nullptr) {
+      const bool* mask_ptr =
+          mask_data + head * mStrideH + q / block_size * num_kv_blocks;
+      for (int64_t col = begin; col < end;) {
+        int64_t kb = (n + col) / block_size;
+        int64_t next = std::min(end, (kb + 1) * block_size - n);
+        if (!mask_ptr[kb]) {
+          torch_ipex::cpu::kernel::fill_stub(row + col, neg_inf, next - col);
+        }
+        col = next;
+      }
+    }
+  }
+
+  int64_t window;
+  int64_t block_size;
+  at::Tensor mask;
+  const bool* mask_data = nullptr;
+  int64_t num_kv_blocks = 0;
+  int64_t mStrideH = 0;
+};
+
 /*
  *Caculate the flash attention SDPA.
  *@template scalar_t: q/k/v data type
@@ -365,6 +541,10 @@ inline void _mul_reduce_max_fusion_kernel(
  *@param is_causal: assume causal attention masking if true
  *@param attention_mask: attention mask
  *@param scale: scaling factor applied prior to softmax
+ *@param dropout_seed: seed of the attention dropout
+ *@param window_size: sliding window size, disabled if <= 0
+ *@param block_mask: block-sparse layout of the attention
+ *@param block_size: block size of the block-sparse layout
  */
 template <typename scalar_t, int64_t q_split_size, int64_t kv_split_size>
 inline typename std::enable_if_t<!is_reduced_floating_point_v<scalar_t>, void>
@@ -377,7 +557,11 @@ cpu_flash_attention(
     double dropout_p,
     bool is_causal,
     c10::optional<at::Tensor> attention_mask,
-    c10::optional<double> scale) {
+    c10::optional<double> scale,
+    c10::optional<int64_t> dropout_seed,
+    int64_t window_size,
+    c10::optional<at::Tensor> block_mask,
+    int64_t block_size) {
   // Query (Batch x Num_heads  x Q_seq_len  x Dim_per_head)
   //    -> (Batch x Q_seq_len  x Num_heads  x Dim_per_head)
   // Key   (Batch x Num_heads  x KV_seq_len x Dim_per_head)
@@ -393,8 +577,11 @@ cpu_flash_attention(
   using accum_t = at::opmath_type<scalar_t>;
   using Vec = at::vec::Vectorized<accum_t>;
   accum_t scaling_factor = calculate_scale(query, scale).as_float_unchecked();
+  AttentionDropout dropout(dropout_p, dropout_seed);
+  AttentionLayout layout(window_size, block_mask, block_size);
   if (attention_mask.has_value() && is_bool_mask) {
-    attention_mask.value() = attention_mask.value().to(at::kFloat);
+    attention_mask.value() =
+        attention_mask.value().to(at::toOpMathType(q.scalar_type()));
   }
 
   // Sizes
@@ -405,6 +592,8 @@ cpu_flash_attention(
   int64_t qSize = query.size(1);
   int64_t kvSize = value.size(1);
   int64_t num_head = query.size(2);
+  int64_t num_kv_head = key.size(2);
+  int64_t group_size = num_head / num_kv_head;
   int64_t headSize = query.size(3);
 
   // Strides
@@ -448,9 +637,9 @@ cpu_flash_attention(
   // allocate per thread temp buf (accumulate type)
   int64_t size_per_thread =
       /* qk     */ qSplitSize * kvSplitSize +
-      /* qk_max */ qSplitSize +
-      /* qk_sum */ qSplitSize +
-      /* dst    */ qSplitSize * headSize;
+      /* qk_max */ group_size * qSplitSize +
+      /* qk_sum */ group_size * qSplitSize +
+      /* dst    */ group_size * qSplitSize * headSize;
 
   at::Tensor buf = at::empty(
       {num_thread, size_per_thread}, query.options().dtype(accumulate_dtype));
@@ -466,169 +655,223 @@ cpu_flash_attention(
   accum_t* buf_data = buf.data_ptr<accum_t>();
 
   at::parallel_for(
-      0, batchSize * num_head * qSlice, 1, [&](int64_t begin, int64_t end) {
-        int64_t i = 0, j = 0, k = 0;
+      0, batchSize * num_kv_head * qSlice, 1, [&](int64_t begin, int64_t end) {
+        int64_t i = 0, kv_j = 0, k = 0;
         at::native::data_index_init(
-            begin, i, batchSize, j, num_head, k, qSlice);
+            begin, i, batchSize, kv_j, num_kv_head, k, qSlice);
         int ompIdx = at::get_thread_num();
         accum_t* buf_ptr = buf_data + ompIdx * size_per_thread;
         accum_t* qk_data = buf_ptr;
-        accum_t* qk_max_data = qk_data + qSplitSize * kvSplitSize;
-        accum_t* qk_sum_data = qk_max_data + qSplitSize;
-        accum_t* dst_data = qk_sum_data + qSplitSize;
+        // qk is reused by the query heads of a kv group, which keep their
+        // own max/sum/dst
+        accum_t* qk_max_buf = qk_data + qSplitSize * kvSplitSize;
+        accum_t* qk_sum_buf = qk_max_buf + group_size * qSplitSize;
+        accum_t* dst_buf = qk_sum_buf + group_size * qSplitSize;
 
         for (const auto z : c10::irange(begin, end)) {
           (void)z; // Suppress unused variable
           int64_t m = k * qSplitSize;
           int64_t qBlockSize = std::min(qSplitSize, qSize - m);
-          // Initialize max and sum
+          // Initialize max, sum and dst of the query heads of the group
           torch_ipex::cpu::kernel::fill_stub(
-              qk_max_data,
+              qk_max_buf,
               -std::numeric_limits<accum_t>::infinity(),
-              qBlockSize);
+              group_size * qSplitSize);
           torch_ipex::cpu::kernel::fill_stub(
-              qk_sum_data, static_cast<accum_t>(0), qBlockSize);
+              qk_sum_buf, static_cast<accum_t>(0), group_size * qSplitSize);
+          torch_ipex::cpu::kernel::fill_stub(
+              dst_buf,
+              static_cast<accum_t>(0),
+              group_size * qSplitSize * headSize);
           int64_t num_keys =
               is_causal ? std::min(m + qBlockSize, kvSize) : kvSize;
-          for (int64_t n = 0; n < num_keys; n += kvSplitSize) {
+          num_keys = layout.kv_end(m, qBlockSize, num_keys);
+          for (int64_t n = layout.kv_begin(m, kvSplitSize); n < num_keys;
+               n += kvSplitSize) {
             int64_t kvBlockSize = std::min(kvSplitSize, kvSize - n);
-            // Calculate scale * q @ k.T
-            _mkl_gemm(
-                CblasColMajor,
-                CblasTrans,
-                CblasNoTrans,
-                kvBlockSize,
-                qBlockSize,
-                headSize,
-                static_cast<accum_t>(1),
-                k_data + i * kStrideB + j * kStrideH + n * kStrideN,
-                kStrideN,
-                q_data + i * qStrideB + j * qStrideH + m * qStrideM,
-                qStrideM,
-                static_cast<accum_t>(0),
-                qk_data,
-                kvBlockSize);
-            // Apply causal mask, fill unused with -inf
-            if (is_causal && num_keys - n <= kvSplitSize) {
-              for (const auto row : c10::irange(qBlockSize)) {
-                int64_t last_col = m + row - n;
-                accum_t* row_ptr = qk_data + row * kvBlockSize;
-                torch_ipex::cpu::kernel::fill_stub(
-                    row_ptr + last_col + 1,
-                    -std::numeric_limits<accum_t>::infinity(),
-                    kvBlockSize - last_col - 1);
+            // The kv tile is shared by the query heads of the group
+            for (int64_t g = 0; g < group_size; g++) {
+              int64_t j = kv_j * group_size + g;
+              auto tile_state =
+                  layout.tile_state(j, m, qBlockSize, n, kvBlockSize);
+              if (tile_state == AttentionLayout::kHidden) {
+                continue;
               }
-            }
-            // Update attention weights with attention mask
-            // And apply scaling factor
-            if (attention_mask.has_value()) {
+              accum_t* qk_max_data = qk_max_buf + g * qSplitSize;
+              accum_t* qk_sum_data = qk_sum_buf + g * qSplitSize;
+              accum_t* dst_data = dst_buf + g * qSplitSize * headSize;
+              // Calculate scale * q @ k.T
+              _mkl_gemm(
+                  CblasColMajor,
+                  CblasTrans,
+                  CblasNoTrans,
+                  kvBlockSize,
+                  qBlockSize,
+                  headSize,
+                  static_cast<accum_t>(1),
+                  k_data + i * kStrideB + kv_j * kStrideH + n * kStrideN,
+                  kStrideN,
+                  q_data + i * qStrideB + j * qStrideH + m * qStrideM,
+                  qStrideM,
+                  static_cast<accum_t>(0),
+                  qk_data,
+                  kvBlockSize);
+              // Apply causal mask, fill unused with -inf
+              if (is_causal && num_keys - n <= kvSplitSize) {
+                for (const auto row : c10::irange(qBlockSize)) {
+                  int64_t last_col = m + row - n;
+                  accum_t* row_ptr = qk_data + row * kvBlockSize;
+                  torch_ipex::cpu::kernel::fill_stub(
+                      row_ptr + last_col + 1,
+                      -std::numeric_limits<accum_t>::infinity(),
+                      kvBlockSize - last_col - 1);
+                }
+              }
+              // Apply sliding window and block-sparse layout
+              if (tile_state == AttentionLayout::kPartial) {
+                for (const auto row : c10::irange(qBlockSize)) {
+                  layout.mask_row(
+                      qk_data + row * kvBlockSize, j, m + row, n, kvBlockSize);
+                }
+              }
+              // Update attention weights with attention mask
+              // And apply scaling factor
+              if (attention_mask.has_value()) {
+                for (int64_t row = 0; row < qBlockSize; ++row) {
+                  if (is_bool_mask) {
+                    // qk <- attn_mask ? qk : -inf
+                    auto neg_inf = -std::numeric_limits<accum_t>::infinity();
+                    at::vec::map2<accum_t>(
+                        [neg_inf, scaling_factor](Vec x, Vec m) {
+                          return Vec::blendv(
+                              Vec(neg_inf),
+                              x * Vec(scaling_factor),
+                              m != Vec(0));
+                        },
+                        qk_data + row * kvBlockSize,
+                        qk_data + row * kvBlockSize,
+                        mask_data + i * mStrideB + j * mStrideH +
+                            (m + row) * mStrideM + n,
+                        kvBlockSize);
+                  } else {
+                    // qk <- qk + attn_mask
+                    at::vec::map2<accum_t>(
+                        [scaling_factor](Vec x, Vec y) {
+                          return x * Vec(scaling_factor) + y;
+                        },
+                        qk_data + row * kvBlockSize,
+                        qk_data + row * kvBlockSize,
+                        mask_data + i * mStrideB + j * mStrideH +
+                            (m + row) * mStrideM + n,
+                        kvBlockSize);
+                  }
+                }
+              }
+              // Update coefficients with Softmax
+              accum_t tmp_max = 0, tmp_sum = 0, sum_old = 0, exp_tmp = 0;
               for (int64_t row = 0; row < qBlockSize; ++row) {
-                if (is_bool_mask) {
-                  // qk <- attn_mask ? qk : -inf
-                  auto neg_inf = -std::numeric_limits<accum_t>::infinity();
-                  at::vec::map2<accum_t>(
-                      [neg_inf, scaling_factor](Vec x, Vec m) {
-                        return Vec::blendv(
-                            Vec(neg_inf), x * Vec(scaling_factor), m);
-                      },
-                      qk_data + row * kvBlockSize,
+                sum_old = qk_sum_data[row];
+                if (attention_mask.has_value()) {
+                  // max per row
+                  tmp_max = at::vec::reduce_all<accum_t>(
+                      [](Vec& x, Vec& y) { return at::vec::maximum(x, y); },
                       qk_data + row * kvBlockSize,
-                      mask_data + i * mStrideB + j * mStrideH +
-                          (m + row) * mStrideM + n,
                       kvBlockSize);
                 } else {
-                  // qk <- qk + attn_mask
-                  at::vec::map2<accum_t>(
-                      [scaling_factor](Vec x, Vec y) {
-                        return x * Vec(scaling_factor) + y;
-                      },
+                  // apply scaling factor and max per row in fusion
+                  _mul_reduce_max_fusion_kernel(
                       qk_data + row * kvBlockSize,
+                      scaling_factor,
+                      kvBlockSize,
                       qk_data + row * kvBlockSize,
-                      mask_data + i * mStrideB + j * mStrideH +
-                          (m + row) * mStrideM + n,
+                      tmp_max);
+                }
+                tmp_max =
+                    qk_max_data[row] > tmp_max ? qk_max_data[row] : tmp_max;
+                if (tmp_max == -std::numeric_limits<accum_t>::infinity()) {
+                  // No visible key for the row so far, qk <- 0
+                  torch_ipex::cpu::kernel::fill_stub(
+                      qk_data + row * kvBlockSize,
+                      static_cast<accum_t>(0),
                       kvBlockSize);
+                  continue;
                 }
-              }
-            }
-            // Update coefficients with Softmax
-            accum_t tmp_max = 0, tmp_sum = 0, sum_old = 0, exp_tmp = 0;
-            for (int64_t row = 0; row < qBlockSize; ++row) {
-              sum_old = qk_sum_data[row];
-              if (attention_mask.has_value()) {
-                // max per row
-                tmp_max = at::vec::reduce_all<accum_t>(
-                    [](Vec& x, Vec& y) { return at::vec::maximum(x, y); },
+                // qk <- exp(qk - max) and sum per row
+                tmp_sum = tmp_max;
+                _exp_reduce_sum_fusion_kernel(
                     qk_data + row * kvBlockSize,
-                    kvBlockSize);
-              } else {
-                // apply scaling factor and max per row in fusion
-                _mul_reduce_max_fusion_kernel(
-                    qk_data + row * kvBlockSize,
-                    scaling_factor,
                     kvBlockSize,
                     qk_data + row * kvBlockSize,
-                    tmp_max);
-              }
-              tmp_max = qk_max_data[row] > tmp_max ? qk_max_data[row] : tmp_max;
-              // qk <- exp(qk - max) and sum per row
-              tmp_sum = tmp_max;
-              _exp_reduce_sum_fusion_kernel(
-                  qk_data + row * kvBlockSize,
-                  kvBlockSize,
-                  qk_data + row * kvBlockSize,
-                  tmp_sum);
-              // exp_tmp <- exp(max[row] - max)
-              exp_tmp = std::exp(qk_max_data[row] - tmp_max);
-              // sum[row] <- sum + exp_tmp * sum[row]
-              qk_sum_data[row] = tmp_sum + exp_tmp * qk_sum_data[row];
-              // max[row] <- max
-              qk_max_data[row] = tmp_max;
-              // dst <- dst * exp_tmp
-              if (n > 0) {
+                    tmp_sum);
+                // qk <- dropout(qk), the sum is taken before the dropout
+                if (dropout.enabled) {
+                  dropout.apply(
+                      qk_data + row * kvBlockSize,
+                      kvBlockSize,
+                      i * num_head + j,
+                      m + row,
+                      n);
+                }
+                // exp_tmp <- exp(max[row] - max)
+                exp_tmp = std::exp(qk_max_data[row] - tmp_max);
+                // sum[row] <- sum + exp_tmp * sum[row]
+                qk_sum_data[row] = tmp_sum + exp_tmp * qk_sum_data[row];
+                // max[row] <- max
+                qk_max_data[row] = tmp_max;
+                // dst <- dst * exp_tmp
                 at::vec::map<accum_t>(
                     [exp_tmp](Vec x) { return x * Vec(exp_tmp); },
                     dst_data + row * headSize,
                     dst_data + row * headSize,
                     headSize);
               }
+              // Calculate Softmax(q @ k.T) @ v
+              _mkl_gemm(
+                  CblasColMajor,
+                  CblasNoTrans,
+                  CblasNoTrans,
+                  headSize,
+                  qBlockSize,
+                  kvBlockSize,
+                  static_cast<accum_t>(1),
+                  v_data + i * vStrideB + kv_j * vStrideH + n * vStrideN,
+                  vStrideN,
+                  qk_data,
+                  kvBlockSize,
+                  static_cast<accum_t>(1),
+                  dst_data,
+                  headSize);
             }
-            // Calculate Softmax(q @ k.T) @ v
-            _mkl_gemm(
-                CblasColMajor,
-                CblasNoTrans,
-                CblasNoTrans,
-                headSize,
-                qBlockSize,
-                kvBlockSize,
-                static_cast<accum_t>(1),
-                v_data + i * vStrideB + j * vStrideH + n * vStrideN,
-                vStrideN,
-                qk_data,
-                kvBlockSize,
-                n == 0 ? static_cast<accum_t>(0) : static_cast<accum_t>(1),
-                dst_data,
-                headSize);
           }
-          // dst <- dst / sum[row]
-          // reorder MHA output with strides
-          for (int64_t row = 0; row < qBlockSize; ++row) {
-            accum_t sum_reciprocal = 1 / qk_sum_data[row];
-            at::vec::map<scalar_t>(
-                [sum_reciprocal](Vec x) { return x * Vec(sum_reciprocal); },
-                out_data + i * oStrideB + j * oStrideH + m * oStrideM +
-                    row * oStrideM,
-                dst_data + row * headSize,
-                headSize);
-          }
-          // Store logsumexp for backward
-          accum_t* lse_ptr =
-              lse_data + i * lStrideB + j * lStrideH + m * lStrideM;
-          for (const auto row : c10::irange(qBlockSize)) {
-            lse_ptr[row * lStrideM] =
-                qk_max_data[row] + std::log(qk_sum_data[row]);
+          for (int64_t g = 0; g < group_size; g++) {
+            int64_t j = kv_j * group_size + g;
+            accum_t* qk_max_data = qk_max_buf + g * qSplitSize;
+            accum_t* qk_sum_data = qk_sum_buf + g * qSplitSize;
+            accum_t* dst_data = dst_buf + g * qSplitSize * headSize;
+            // dst <- dst / sum[row]
+            // reorder MHA output with strides
+            for (int64_t row = 0; row < qBlockSize; ++row) {
+              // A row without any visible key outputs 0
+              accum_t sum_reciprocal =
+                  qk_sum_data[row] == 0 ? 0 : 1 / qk_sum_data[row];
+              at::vec::map<scalar_t>(
+                  [sum_reciprocal](Vec x) { return x * Vec(sum_reciprocal); },
+                  out_data + i * oStrideB + j * oStrideH + m * oStrideM +
+                      row * oStrideM,
+                  dst_data + row * headSize,
+                  headSize);
+            }
+            // Store logsumexp for backward
+            accum_t* lse_ptr =
+                lse_data + i * lStrideB + j * lStrideH + m * lStrideM;
+            for (const auto row : c10::irange(qBlockSize)) {
+              lse_ptr[row * lStrideM] =
+                  qk_max_data[row] + std::log(qk_sum_data[row]);
+            }
           }
           // Move to the next query
-          at::native::data_index_step(i, batchSize, j, num_head, k, qSlice);
+          at::native::data_index_step(
+              i, batchSize, kv_j, num_kv_head, k, qSlice);
         }
       });
 }
@@ -645,7 +888,11 @@ cpu_flash_attention(
     double dropout_p,
     bool is_causal,
     c10::optional<at::Tensor> attention_mask,
-    c10::optional<double> scale) {
+    c10::optional<double> scale,
+    c10::optional<int64_t> dropout_seed,
+    int64_t window_size,
+    c10::optional<at::Tensor> block_mask,
+    int64_t block_size) {
   // Query (Batch x Num_heads  x Q_seq_len  x Dim_per_head)
   //    -> (Batch x Q_seq_len  x Num_heads  x Dim_per_head)
   // Key   (Batch x Num_heads  x KV_seq_len x Dim_per_head)
@@ -668,6 +915,8 @@ cpu_flash_attention(
   using accum_t = at::opmath_type<scalar_t>;
   using Vec = at::vec::Vectorized<accum_t>;
   accum_t scaling_factor = calculate_scale(query, scale).as_float_unchecked();
+  AttentionDropout dropout(dropout_p, dropout_seed);
+  AttentionLayout layout(window_size, block_mask, block_size);
   if (attention_mask.has_value()) {
     attention_mask.value() = attention_mask.value().to(at::kFloat);
   }
@@ -680,6 +929,8 @@ cpu_flash_attention(
   int64_t qSize = query.size(1);
   int64_t kvSize = value.size(1);
   int64_t num_head = query.size(2);
+  int64_t num_kv_head = key.size(2);
+  int64_t group_size = num_head / num_kv_head;
   int64_t headSize = query.size(3);
 
   // Strides
@@ -720,9 +971,9 @@ cpu_flash_attention(
   // allocate per thread temp buf (accumulate type)
   int64_t size_per_thread =
       /* qk     */ qSplitSize * kvSplitSize +
-      /* qk_max */ qSplitSize +
-      /* qk_sum */ qSplitSize +
-      /* dst    */ qSplitSize * headSize;
+      /* qk_max */ group_size * qSplitSize +
+      /* qk_sum */ group_size * qSplitSize +
+      /* dst    */ group_size * qSplitSize * headSize;
 
   at::Tensor buf = at::empty(
       {num_thread, size_per_thread}, query.options().dtype(accumulate_dtype));
@@ -806,30 +1057,6 @@ cpu_flash_attention(
   int av_gemm_K_tail = av_gemm_K_tail_even ? kvTail : kvTail + 1;
 
   // [qSplitSize,kvSplitSize] x [kvSplitSize,headSize] -> [qSplitSize,headSize]
-  auto av_gemm = SCOPEITGEMM((BrgemmTPP<scalar_t, float>(
-      /*M*/ qSplitSize,
-      /*N*/ headSize,
-      /*K*/ av_gemm_K,
-      /*str_a*/ 1,
-      /*str_b*/ 1,
-      /*lda*/ av_gemm_K,
-      /*ldb*/ headSize,
-      /*ldc*/ headSize,
-      /*beta*/ 0.0,
-      /*a_trans*/ 0,
-      /*unroll_hint*/ 1)));
-  auto av_gemm_tail = SCOPEITGEMM((BrgemmTPP<scalar_t, float>(
-      /*M*/ qSplitSize,
-      /*N*/ headSize,
-      /*K*/ av_gemm_K_tail,
-      /*str_a*/ 1,
-      /*str_b*/ 1,
-      /*lda*/ av_gemm_K_tail,
-      /*ldb*/ headSize,
-      /*ldc*/ headSize,
-      /*beta*/ 0.0,
-      /*a_trans*/ 0,
-      /*unroll_hint*/ 1)));
   auto av_gemm_bias = SCOPEITGEMM((BrgemmTPP<scalar_t, float>(
       /*M*/ qSplitSize,
       /*N*/ headSize,
@@ -858,7 +1085,7 @@ cpu_flash_attention(
   // Buffer to store Key and Value after transforms
   at::Tensor key_t_reorder = at::empty(
       {batchSize,
-       num_head,
+       num_kv_head,
        (!headSize_even && is_fp16) ? qk_gemm_K : headSize,
        kvSize},
       c10::CppTypeToScalarType<scalar_t>::value);
@@ -869,10 +1096,10 @@ cpu_flash_attention(
   std::unique_ptr<unsigned short[]> query_padding_data;
   if (!headSize_even && is_fp16) {
     query_padding_data = std::make_unique<unsigned short[]>(
-        num_thread * (qSlice * qSplitSize) * qk_gemm_K);
+        num_thread * group_size * qSplitSize * qk_gemm_K);
     query_padding_ptr = reinterpret_cast<scalar_t*>(query_padding_data.get());
     key_padding_data = std::make_unique<unsigned short[]>(
-        batchSize * num_head * kvSize * qk_gemm_K);
+        batchSize * num_kv_head * kvSize * qk_gemm_K);
     key_padding_ptr = reinterpret_cast<scalar_t*>(key_padding_data.get());
   }
 
@@ -883,11 +1110,11 @@ cpu_flash_attention(
   std::unique_ptr<unsigned short[]> value_padding_data;
   if (!av_gemm_K_even || !av_gemm_K_tail_even) {
     value_padding_data = std::make_unique<unsigned short[]>(
-        batchSize * num_head * kv_padding_size * headSize);
+        batchSize * num_kv_head * kv_padding_size * headSize);
     value_padding_ptr = reinterpret_cast<scalar_t*>(value_padding_data.get());
   }
   at::Tensor value_t_reorder = at::empty(
-      {batchSize, num_head, kv_padding_size, headSize},
+      {batchSize, num_kv_head, kv_padding_size, headSize},
       c10::CppTypeToScalarType<scalar_t>::value);
   auto value_reorder_ptr = value_t_reorder.data_ptr<scalar_t>();
 
@@ -940,10 +1167,10 @@ cpu_flash_attention(
 
   // Reorder K, V
   at::parallel_for(
-      0, batchSize * num_head * kvSlice, 1, [&](int64_t begin, int64_t end) {
+      0, batchSize * num_kv_head * kvSlice, 1, [&](int64_t begin, int64_t end) {
         int64_t i = 0, j = 0, l = 0, n = 0;
         at::native::data_index_init(
-            begin, i, batchSize, j, num_head, l, kvSlice);
+            begin, i, batchSize, j, num_kv_head, l, kvSlice);
         for (const auto z : c10::irange(begin, end)) {
           (void)z; // Suppress unused variable
           n = l * kvSplitSize;
@@ -953,22 +1180,22 @@ cpu_flash_attention(
               // main
               k_xform(
                   k_data + i * kStrideB + j * kStrideH + n * kStrideN,
-                  key_reorder_ptr + i * num_head * headSize * kvSize +
+                  key_reorder_ptr + i * num_kv_head * headSize * kvSize +
                       j * headSize * kvSize + n * headSize);
             } else if (!headSize_even && is_fp16) {
               // padding
               // [kvSplitSize, headSize] -> [kvSplitSize, headSize + 1]
               pad_col_zero(
                   k_data + i * kStrideB + j * kStrideH + n * kStrideN,
-                  key_padding_ptr + i * num_head * qk_gemm_K * kvSize +
+                  key_padding_ptr + i * num_kv_head * qk_gemm_K * kvSize +
                       j * qk_gemm_K * kvSize + n * qk_gemm_K,
                   kvSplitSize,
                   headSize + 1,
                   kStrideN);
               k_xform(
-                  key_padding_ptr + i * num_head * qk_gemm_K * kvSize +
+                  key_padding_ptr + i * num_kv_head * qk_gemm_K * kvSize +
                       j * qk_gemm_K * kvSize + n * qk_gemm_K,
-                  key_reorder_ptr + i * num_head * qk_gemm_K * kvSize +
+                  key_reorder_ptr + i * num_kv_head * qk_gemm_K * kvSize +
                       j * qk_gemm_K * kvSize + n * qk_gemm_K);
             }
             if (!av_gemm_K_even) {
@@ -977,23 +1204,23 @@ cpu_flash_attention(
               pad_row_zero(
                   v_data + i * vStrideB + j * vStrideH + n * vStrideN,
                   value_padding_ptr +
-                      i * num_head * kv_padding_size * headSize +
+                      i * num_kv_head * kv_padding_size * headSize +
                       j * kv_padding_size * headSize + psize * headSize,
                   av_gemm_K,
                   headSize,
                   vStrideN);
               v_xform(
                   value_padding_ptr +
-                      i * num_head * kv_padding_size * headSize +
+                      i * num_kv_head * kv_padding_size * headSize +
                       j * kv_padding_size * headSize + psize * headSize,
                   value_reorder_ptr +
-                      i * num_head * kv_padding_size * headSize +
+                      i * num_kv_head * kv_padding_size * headSize +
                       j * kv_padding_size * headSize + psize * headSize);
             } else {
               v_xform(
                   v_data + i * vStrideB + j * vStrideH + n * vStrideN,
                   value_reorder_ptr +
-                      i * num_head * kv_padding_size * headSize +
+                      i * num_kv_head * kv_padding_size * headSize +
                       j * kv_padding_size * headSize + n * headSize);
             }
           } else {
@@ -1001,22 +1228,22 @@ cpu_flash_attention(
             if (headSize_even) {
               k_xform_tail(
                   k_data + i * kStrideB + j * kStrideH + n * kStrideN,
-                  key_reorder_ptr + i * num_head * headSize * kvSize +
+                  key_reorder_ptr + i * num_kv_head * headSize * kvSize +
                       j * headSize * kvSize + n * headSize);
             } else if (!headSize_even && is_fp16) {
               // padding
               // [kvtail, headSize] -> [kvtail, headSize + 1]
               pad_col_zero(
                   k_data + i * kStrideB + j * kStrideH + n * kStrideN,
-                  key_padding_ptr + i * num_head * qk_gemm_K * kvSize +
+                  key_padding_ptr + i * num_kv_head * qk_gemm_K * kvSize +
                       j * qk_gemm_K * kvSize + n * qk_gemm_K,
                   kvTail,
                   headSize + 1,
                   kStrideN);
               k_xform_tail(
-                  key_padding_ptr + i * num_head * qk_gemm_K * kvSize +
+                  key_padding_ptr + i * num_kv_head * qk_gemm_K * kvSize +
                       j * qk_gemm_K * kvSize + n * qk_gemm_K,
-                  key_reorder_ptr + i * num_head * qk_gemm_K * kvSize +
+                  key_reorder_ptr + i * num_kv_head * qk_gemm_K * kvSize +
                       j * qk_gemm_K * kvSize + n * qk_gemm_K);
             }
             if (!av_gemm_K_tail_even) {
@@ -1025,315 +1252,948 @@ cpu_flash_attention(
               pad_row_zero(
                   v_data + i * vStrideB + j * vStrideH + n * vStrideN,
                   value_padding_ptr +
-                      i * num_head * kv_padding_size * headSize +
+                      i * num_kv_head * kv_padding_size * headSize +
                       j * kv_padding_size * headSize + psize * headSize,
                   av_gemm_K_tail,
                   headSize,
                   vStrideN);
               v_xform_tail(
                   value_padding_ptr +
-                      i * num_head * kv_padding_size * headSize +
+                      i * num_kv_head * kv_padding_size * headSize +
                       j * kv_padding_size * headSize + psize * headSize,
                   value_reorder_ptr +
-                      i * num_head * kv_padding_size * headSize +
+                      i * num_kv_head * kv_padding_size * headSize +
                       j * kv_padding_size * headSize + psize * headSize);
             } else {
               v_xform_tail(
                   v_data + i * vStrideB + j * vStrideH + n * vStrideN,
                   value_reorder_ptr +
-                      i * num_head * kv_padding_size * headSize +
+                      i * num_kv_head * kv_padding_size * headSize +
                       j * kv_padding_size * headSize + n * headSize);
             }
           }
           // Move to the next query
-          at::native::data_index_step(i, batchSize, j, num_head, l, kvSlice);
+          at::native::data_index_step(i, batchSize, j, num_kv_head, l, kvSlice);
         }
       });
 
   at::parallel_for(
-      0, batchSize * num_head * qSlice, 1, [&](int64_t begin, int64_t end) {
-        int64_t i = 0, j = 0, k = 0;
+      0, batchSize * num_kv_head * qSlice, 1, [&](int64_t begin, int64_t end) {
+        int64_t i = 0, kv_j = 0, k = 0;
         at::native::data_index_init(
-            begin, i, batchSize, j, num_head, k, qSlice);
+            begin, i, batchSize, kv_j, num_kv_head, k, qSlice);
         int ompIdx = at::get_thread_num();
         accum_t* buf_ptr = buf_data + ompIdx * size_per_thread;
         accum_t* qk_data = buf_ptr;
-        accum_t* qk_max_data = qk_data + qSplitSize * kvSplitSize;
-        accum_t* qk_sum_data = qk_max_data + qSplitSize;
-        accum_t* dst_data = qk_sum_data + qSplitSize;
+        // qk is reused by the query heads of a kv group, which keep their
+        // own max/sum/dst
+        accum_t* qk_max_buf = qk_data + qSplitSize * kvSplitSize;
+        accum_t* qk_sum_buf = qk_max_buf + group_size * qSplitSize;
+        accum_t* dst_buf = qk_sum_buf + group_size * qSplitSize;
         scalar_t* qk_reduced_data =
             buf_reduced_data + ompIdx * qSplitSize * av_gemm_K;
         scalar_t* query_t_padding_ptr = (is_fp16 && !headSize_even)
-            ? query_padding_ptr + ompIdx * qSplitSize * qk_gemm_K
+            ? query_padding_ptr + ompIdx * group_size * qSplitSize * qk_gemm_K
             : nullptr;
 
         for (const auto z : c10::irange(begin, end)) {
           (void)z; // Suppress unused variable
           int64_t m = k * qSplitSize;
           int64_t qBlockSize = std::min(qSplitSize, qSize - m);
-          // Initialize max and sum
+          // Initialize max, sum and dst of the query heads of the group
           torch_ipex::cpu::kernel::fill_stub(
-              qk_max_data,
+              qk_max_buf,
               -std::numeric_limits<accum_t>::infinity(),
-              qBlockSize);
+              group_size * qSplitSize);
+          torch_ipex::cpu::kernel::fill_stub(
+              qk_sum_buf, static_cast<accum_t>(0), group_size * qSplitSize);
           torch_ipex::cpu::kernel::fill_stub(
-              qk_sum_data, static_cast<accum_t>(0), qBlockSize);
+              dst_buf,
+              static_cast<accum_t>(0),
+              group_size * qSplitSize * headSize);
           int64_t num_keys =
               is_causal ? std::min(m + qBlockSize, kvSize) : kvSize;
+          num_keys = layout.kv_end(m, qBlockSize, num_keys);
           if (is_fp16 && !headSize_even) {
             // pad query if headSize is not even for fp16
             // [qBlockSize, headSize] -> [qBlockSize, headSize + 1]
-            pad_col_zero(
-                q_data + i * qStrideB + j * qStrideH + m * qStrideM,
-                query_t_padding_ptr,
-                qBlockSize,
-                headSize + 1,
-                qStrideM);
+            for (int64_t g = 0; g < group_size; g++) {
+              int64_t j = kv_j * group_size + g;
+              pad_col_zero(
+                  q_data + i * qStrideB + j * qStrideH + m * qStrideM,
+                  query_t_padding_ptr + g * qSplitSize * qk_gemm_K,
+                  qBlockSize,
+                  headSize + 1,
+                  qStrideM);
+            }
           }
-          for (int64_t n = 0; n < num_keys; n += kvSplitSize) {
+          for (int64_t n = layout.kv_begin(m, kvSplitSize); n < num_keys;
+               n += kvSplitSize) {
             int64_t kvBlockSize = std::min(kvSplitSize, kvSize - n);
-            // Calculate scale * q @ k.T
-            if ((!is_fp16 && headSize_even) || is_fp16) {
-              if (qBlockSize == qSplitSize) {
-                // q main
-                if (n + kvSplitSize < kvSize) {
-                  // k main
-                  qk_gemm(
-                      (is_fp16 && !headSize_even)
-                          ? query_t_padding_ptr
-                          : q_data + i * qStrideB + j * qStrideH + m * qStrideM,
-                      key_reorder_ptr + i * num_head * qk_gemm_K * kvSize +
-                          j * qk_gemm_K * kvSize + n * qk_gemm_K,
-                      qk_data,
-                      1);
+            // The kv tile is shared by the query heads of the group
+            for (int64_t g = 0; g < group_size; g++) {
+              int64_t j = kv_j * group_size + g;
+              auto tile_state =
+                  layout.tile_state(j, m, qBlockSize, n, kvBlockSize);
+              if (tile_state == AttentionLayout::kHidden) {
+                continue;
+              }
+              accum_t* qk_max_data = qk_max_buf + g * qSplitSize;
+              accum_t* qk_sum_data = qk_sum_buf + g * qSplitSize;
+              accum_t* dst_data = dst_buf + g * qSplitSize * headSize;
+              scalar_t* q_ptr = (is_fp16 && !headSize_even)
+                  ? query_t_padding_ptr + g * qSplitSize * qk_gemm_K
+                  : q_data + i * qStrideB + j * qStrideH + m * qStrideM;
+              scalar_t* k_reorder = key_reorder_ptr +
+                  (i * num_kv_head + kv_j) * qk_gemm_K * kvSize +
+                  n * qk_gemm_K;
+              // Calculate scale * q @ k.T
+              if ((!is_fp16 && headSize_even) || is_fp16) {
+                if (qBlockSize == qSplitSize) {
+                  // q main
+                  if (n + kvSplitSize < kvSize) {
+                    // k main
+                    qk_gemm(
+                        q_ptr,
+                        k_reorder,
+                        qk_data,
+                        1);
+                  } else {
+                    // k tail
+                    qk_gemm_ktail(
+                        q_ptr,
+                        k_reorder,
+                        qk_data,
+                        1);
+                  }
                 } else {
-                  // k tail
-                  qk_gemm_ktail(
-                      (is_fp16 && !headSize_even)
-                          ? query_t_padding_ptr
-                          : q_data + i * qStrideB + j * qStrideH + m * qStrideM,
-                      key_reorder_ptr + i * num_head * qk_gemm_K * kvSize +
-                          j * qk_gemm_K * kvSize + n * qk_gemm_K,
-                      qk_data,
-                      1);
+                  if (n + kvSplitSize < kvSize) {
+                    // k main
+                    qk_gemm_qtail(
+                        q_ptr,
+                        k_reorder,
+                        qk_data,
+                        1);
+                  } else {
+                    // k tail
+                    qk_gemm_qktail(
+                        q_ptr,
+                        k_reorder,
+                        qk_data,
+                        1);
+                  }
                 }
               } else {
-                if (n + kvSplitSize < kvSize) {
-                  // k main
-                  qk_gemm_qtail(
-                      (is_fp16 && !headSize_even)
-                          ? query_t_padding_ptr
-                          : q_data + i * qStrideB + j * qStrideH + m * qStrideM,
-                      key_reorder_ptr + i * num_head * qk_gemm_K * kvSize +
-                          j * qk_gemm_K * kvSize + n * qk_gemm_K,
-                      qk_data,
-                      1);
-                } else {
-                  // k tail
-                  qk_gemm_qktail(
-                      (is_fp16 && !headSize_even)
-                          ? query_t_padding_ptr
-                          : q_data + i * qStrideB + j * qStrideH + m * qStrideM,
-                      key_reorder_ptr + i * num_head * qk_gemm_K * kvSize +
-                          j * qk_gemm_K * kvSize + n * qk_gemm_K,
-                      qk_data,
-                      1);
+                _mkl_gemm(
+                    CblasColMajor,
+                    CblasTrans,
+                    CblasNoTrans,
+                    kvBlockSize,
+                    qBlockSize,
+                    headSize,
+                    static_cast<accum_t>(1),
+                    k_data + i * kStrideB + kv_j * kStrideH + n * kStrideN,
+                    kStrideN,
+                    q_data + i * qStrideB + j * qStrideH + m * qStrideM,
+                    qStrideM,
+                    static_cast<accum_t>(0),
+                    qk_data,
+                    kvBlockSize);
+              }
+              // Apply causal mask, fill unused with -inf
+              if (is_causal && num_keys - n <= kvSplitSize) {
+                for (const auto row : c10::irange(qBlockSize)) {
+                  int64_t last_col = m + row - n;
+                  accum_t* row_ptr = qk_data + row * kvBlockSize;
+                  torch_ipex::cpu::kernel::fill_stub(
+                      row_ptr + last_col + 1,
+                      -std::numeric_limits<accum_t>::infinity(),
+                      kvBlockSize - last_col - 1);
                 }
               }
-            } else {
-              _mkl_gemm(
-                  CblasColMajor,
-                  CblasTrans,
-                  CblasNoTrans,
-                  kvBlockSize,
-                  qBlockSize,
-                  headSize,
-                  static_cast<accum_t>(1),
-                  k_data + i * kStrideB + j * kStrideH + n * kStrideN,
-                  kStrideN,
-                  q_data + i * qStrideB + j * qStrideH + m * qStrideM,
-                  qStrideM,
-                  static_cast<accum_t>(0),
-                  qk_data,
-                  kvBlockSize);
-            }
-            // Apply causal mask, fill unused with -inf
-            if (is_causal && num_keys - n <= kvSplitSize) {
-              for (const auto row : c10::irange(qBlockSize)) {
-                int64_t last_col = m + row - n;
-                accum_t* row_ptr = qk_data + row * kvBlockSize;
-                torch_ipex::cpu::kernel::fill_stub(
-                    row_ptr + last_col + 1,
-                    -std::numeric_limits<accum_t>::infinity(),
-                    kvBlockSize - last_col - 1);
+              // Apply sliding window and block-sparse layout
+              if (tile_state == AttentionLayout::kPartial) {
+                for (const auto row : c10::irange(qBlockSize)) {
+                  layout.mask_row(
+                      qk_data + row * kvBlockSize, j, m + row, n, kvBlockSize);
+                }
               }
-            }
-            // Update attention weights with attention mask
-            // And apply scaling factor
-            if (attention_mask.has_value()) {
+              // Update attention weights with attention mask
+              // And apply scaling factor
+              if (attention_mask.has_value()) {
+                for (int64_t row = 0; row < qBlockSize; ++row) {
+                  if (is_bool_mask) {
+                    // qk <- attn_mask ? qk : -inf
+                    auto neg_inf = -std::numeric_limits<accum_t>::infinity();
+                    at::vec::map2<accum_t>(
+                        [neg_inf, scaling_factor](Vec x, Vec m) {
+                          return Vec::blendv(
+                              Vec(neg_inf),
+                              x * Vec(scaling_factor),
+                              m != Vec(0));
+                        },
+                        qk_data + row * kvBlockSize,
+                        qk_data + row * kvBlockSize,
+                        mask_data + i * mStrideB + j * mStrideH +
+                            (m + row) * mStrideM + n,
+                        kvBlockSize);
+                  } else {
+                    // qk <- qk + attn_mask
+                    at::vec::map2<accum_t>(
+                        [scaling_factor](Vec x, Vec y) {
+                          return x * Vec(scaling_factor) + y;
+                        },
+                        qk_data + row * kvBlockSize,
+                        qk_data + row * kvBlockSize,
+                        mask_data + i * mStrideB + j * mStrideH +
+                            (m + row) * mStrideM + n,
+                        kvBlockSize);
+                  }
+                }
+              }
+              // Update coefficients with Softmax
+              accum_t tmp_max = 0, tmp_sum = 0, sum_old = 0, exp_tmp = 0;
               for (int64_t row = 0; row < qBlockSize; ++row) {
-                if (is_bool_mask) {
-                  // qk <- attn_mask ? qk : -inf
-                  auto neg_inf = -std::numeric_limits<accum_t>::infinity();
-                  at::vec::map2<accum_t>(
-                      [neg_inf, scaling_factor](Vec x, Vec m) {
-                        return Vec::blendv(
-                            Vec(neg_inf), x * Vec(scaling_factor), m);
-                      },
+                sum_old = qk_sum_data[row];
+                if (attention_mask.has_value()) {
+                  // max per row
+                  tmp_max = at::vec::reduce_all<accum_t>(
+                      [](Vec& x, Vec& y) { return at::vec::maximum(x, y); },
                       qk_data + row * kvBlockSize,
-                      qk_data + row * kvBlockSize,
-                      mask_data + i * mStrideB + j * mStrideH +
-                          (m + row) * mStrideM + n,
                       kvBlockSize);
                 } else {
-                  // qk <- qk + attn_mask
-                  at::vec::map2<accum_t>(
-                      [scaling_factor](Vec x, Vec y) {
-                        return x * Vec(scaling_factor) + y;
-                      },
+                  // apply scaling factor and max per row in fusion
+                  _mul_reduce_max_fusion_kernel(
                       qk_data + row * kvBlockSize,
+                      scaling_factor,
+                      kvBlockSize,
                       qk_data + row * kvBlockSize,
-                      mask_data + i * mStrideB + j * mStrideH +
-                          (m + row) * mStrideM + n,
-                      kvBlockSize);
+                      tmp_max);
                 }
-              }
-            }
-            // Update coefficients with Softmax
-            accum_t tmp_max = 0, tmp_sum = 0, sum_old = 0, exp_tmp = 0;
-            for (int64_t row = 0; row < qBlockSize; ++row) {
-              sum_old = qk_sum_data[row];
-              if (attention_mask.has_value()) {
-                // max per row
-                tmp_max = at::vec::reduce_all<accum_t>(
-                    [](Vec& x, Vec& y) { return at::vec::maximum(x, y); },
-                    qk_data + row * kvBlockSize,
-                    kvBlockSize);
-              } else {
-                // apply scaling factor and max per row in fusion
-                _mul_reduce_max_fusion_kernel(
+                tmp_max =
+                    qk_max_data[row] > tmp_max ? qk_max_data[row] : tmp_max;
+                if (tmp_max == -std::numeric_limits<accum_t>::infinity()) {
+                  // No visible key for the row so far, qk <- 0
+                  torch_ipex::cpu::kernel::fill_stub(
+                      qk_reduced_data +
+                          row *
+                              ((kvBlockSize % 2) != 0 ? 1 + kvBlockSize
+                                                      : kvBlockSize),
+                      scalar_t(0),
+                      (kvBlockSize % 2) != 0 ? 1 + kvBlockSize : kvBlockSize);
+                  continue;
+                }
+                // qk <- exp(qk - max) and sum per row
+                tmp_sum = tmp_max;
+                _exp_reduce_sum_fusion_kernel(
                     qk_data + row * kvBlockSize,
-                    scaling_factor,
                     kvBlockSize,
-                    qk_data + row * kvBlockSize,
-                    tmp_max);
-              }
-              tmp_max = qk_max_data[row] > tmp_max ? qk_max_data[row] : tmp_max;
-              // qk <- exp(qk - max) and sum per row
-              tmp_sum = tmp_max;
-              _exp_reduce_sum_fusion_kernel(
-                  qk_data + row * kvBlockSize,
-                  kvBlockSize,
-                  qk_reduced_data +
-                      row *
-                          ((kvBlockSize % 2) != 0 ? 1 + kvBlockSize
-                                                  : kvBlockSize),
-                  tmp_sum);
-              // exp_tmp <- exp(max[row] - max)
-              exp_tmp = std::exp(qk_max_data[row] - tmp_max);
-              // sum[row] <- sum + exp_tmp * sum[row]
-              qk_sum_data[row] = tmp_sum + exp_tmp * qk_sum_data[row];
-              // max[row] <- max
-              qk_max_data[row] = tmp_max;
-              // dst <- dst * exp_tmp
-              if (n > 0) {
+                    qk_reduced_data +
+                        row *
+                            ((kvBlockSize % 2) != 0 ? 1 + kvBlockSize
+                                                    : kvBlockSize),
+                    tmp_sum);
+                // qk <- dropout(qk), the sum is taken before the dropout
+                if (dropout.enabled) {
+                  dropout.apply(
+                      qk_reduced_data +
+                          row *
+                              ((kvBlockSize % 2) != 0 ? 1 + kvBlockSize
+                                                      : kvBlockSize),
+                      kvBlockSize,
+                      i * num_head + j,
+                      m + row,
+                      n);
+                }
+                // exp_tmp <- exp(max[row] - max)
+                exp_tmp = std::exp(qk_max_data[row] - tmp_max);
+                // sum[row] <- sum + exp_tmp * sum[row]
+                qk_sum_data[row] = tmp_sum + exp_tmp * qk_sum_data[row];
+                // max[row] <- max
+                qk_max_data[row] = tmp_max;
+                // dst <- dst * exp_tmp
                 at::vec::map<accum_t>(
                     [exp_tmp](Vec x) { return x * Vec(exp_tmp); },
                     dst_data + row * headSize,
                     dst_data + row * headSize,
                     headSize);
+                // Zero padding: [qSplitSize,kvSplitSize] ->
+                // [qSplitSize,kvSplitSize + 1]
+                if (kvBlockSize % 2 != 0) {
+                  *(qk_reduced_data + row * (1 + kvBlockSize) + kvBlockSize) =
+                      scalar_t(0);
+                }
               }
-              // Zero padding: [qSplitSize,kvSplitSize] ->
-              // [qSplitSize,kvSplitSize + 1]
-              if (kvBlockSize % 2 != 0) {
-                *(qk_reduced_data + row * (1 + kvBlockSize) + kvBlockSize) =
-                    scalar_t(0);
-              }
-            }
 
-            // Calculate Softmax(q @ k.T) @ v
-            if (((!is_fp16 && av_gemm_K_even && av_gemm_K_tail_even) ||
-                 is_fp16)) {
-              int64_t psize = n / kvSplitSize * av_gemm_K;
-              if (n + kvSplitSize < kvSize) {
-                // main
-                if (n == 0) {
-                  av_gemm(
-                      qk_reduced_data,
-                      value_reorder_ptr +
-                          i * num_head * kv_padding_size * headSize +
-                          j * kv_padding_size * headSize + psize * headSize,
-                      dst_data,
-                      1);
-                } else {
-                  // bias
-                  av_gemm_bias(
-                      qk_reduced_data,
-                      value_reorder_ptr +
-                          i * num_head * kv_padding_size * headSize +
-                          j * kv_padding_size * headSize + psize * headSize,
-                      dst_data,
-                      1);
-                }
-              } else if (n + kvSplitSize >= kvSize) {
-                // tail
-                if (n == 0) {
-                  av_gemm_tail(
-                      qk_reduced_data,
-                      value_reorder_ptr +
-                          i * num_head * kv_padding_size * headSize +
-                          j * kv_padding_size * headSize + psize * headSize,
-                      dst_data,
-                      1);
+              // Calculate Softmax(q @ k.T) @ v
+              if (((!is_fp16 && av_gemm_K_even && av_gemm_K_tail_even) ||
+                   is_fp16)) {
+                int64_t psize = n / kvSplitSize * av_gemm_K;
+                scalar_t* v_reorder = value_reorder_ptr +
+                    i * num_kv_head * kv_padding_size * headSize +
+                    kv_j * kv_padding_size * headSize + psize * headSize;
+                // dst <- dst + qk @ v
+                if (n + kvSplitSize < kvSize) {
+                  // main
+                  av_gemm_bias(qk_reduced_data, v_reorder, dst_data, 1);
                 } else {
-                  // bias
-                  av_gemm_bias_tail(
-                      qk_reduced_data,
-                      value_reorder_ptr +
-                          i * num_head * kv_padding_size * headSize +
-                          j * kv_padding_size * headSize + psize * headSize,
-                      dst_data,
-                      1);
+                  // tail
+                  av_gemm_bias_tail(qk_reduced_data, v_reorder, dst_data, 1);
                 }
+              } else {
+                _mkl_gemm(
+                    CblasColMajor,
+                    CblasNoTrans,
+                    CblasNoTrans,
+                    headSize,
+                    qBlockSize,
+                    kvBlockSize,
+                    static_cast<accum_t>(1),
+                    v_data + i * vStrideB + kv_j * vStrideH + n * vStrideN,
+                    vStrideN,
+                    qk_reduced_data,
+                    kvBlockSize % 2 == 0 ? kvBlockSize : kvBlockSize + 1,
+                    static_cast<accum_t>(1),
+                    dst_data,
+                    headSize);
               }
-            } else {
-              _mkl_gemm(
-                  CblasColMajor,
-                  CblasNoTrans,
-                  CblasNoTrans,
+            }
+          }
+          for (int64_t g = 0; g < group_size; g++) {
+            int64_t j = kv_j * group_size + g;
+            accum_t* qk_max_data = qk_max_buf + g * qSplitSize;
+            accum_t* qk_sum_data = qk_sum_buf + g * qSplitSize;
+            accum_t* dst_data = dst_buf + g * qSplitSize * headSize;
+            // dst <- dst / sum[row]
+            // reorder MHA output with strides
+            for (int64_t row = 0; row < qBlockSize; ++row) {
+              // A row without any visible key outputs 0
+              accum_t sum_reciprocal =
+                  qk_sum_data[row] == 0 ? 0 : 1 / qk_sum_data[row];
+              at::vec::map<scalar_t>(
+                  [sum_reciprocal](Vec x) { return x * Vec(sum_reciprocal); },
+                  out_data + i * oStrideB + j * oStrideH + m * oStrideM +
+                      row * oStrideM,
+                  dst_data + row * headSize,
+                  headSize);
+            }
+            // Store logsumexp for backward
+            accum_t* lse_ptr =
+                lse_data + i * lStrideB + j * lStrideH + m * lStrideM;
+            for (const auto row : c10::irange(qBlockSize)) {
+              lse_ptr[row * lStrideM] =
+                  qk_max_data[row] + std::log(qk_sum_data[row]);
+            }
+          }
+          // Move to the next query
+          at::native::data_index_step(
+              i, batchSize, kv_j, num_kv_head, k, qSlice);
+        }
+      });
+}
+
+/*
+ *Caculate the gradients of the flash attention SDPA.
+ *The attention weights are recomputed block by block from logsumexp, so
+ *[qSplitSize, kvSplitSize] is the largest attention block materialized. The
+ *first pass computes grad_q in parallel over the (batch, head, q block), the
+ *second one grad_k/grad_v over the (batch, kv head, kv block), summing the
+ *query heads of the kv group. The scratch of every thread is bounded by the
+ *block sizes, whatever the sequence lengths.
+ *@template scalar_t: q/k/v data type
+ *@template q_split_size: q block size
+ *@template kv_split_size: kv block size
+ *@param grad_q: gradient of query
+ *@param grad_k: gradient of key
+ *@param grad_v: gradient of value
+ *@param grad_out: gradient of output
+ *@param q: query
+ *@param k: key
+ *@param v: value
+ *@param out: output of the forward
+ *@param logsumexp: logsumexp of the forward
+ *@param dropout_p: dropout probability
+ *@param is_causal: assume causal attention masking if true
+ *@param attention_mask: attention mask
+ *@param scale: scaling factor applied prior to softmax
+ *@param dropout_seed: seed of the attention dropout of the forward
+ *@param window_size: sliding window size, disabled if <= 0
+ *@param block_mask: block-sparse layout of the attention
+ *@param block_size: block size of the block-sparse layout
+ */
+template <typename scalar_t, int64_t q_split_size, int64_t kv_split_size>
+void cpu_flash_attention_backward(
+    const at::Tensor& grad_q,
+    const at::Tensor& grad_k,
+    const at::Tensor& grad_v,
+    const at::Tensor& grad_out,
+    const at::Tensor& q,
+    const at::Tensor& k,
+    const at::Tensor& v,
+    const at::Tensor& out,
+    const at::Tensor& logsumexp,
+    double dropout_p,
+    bool is_causal,
+    c10::optional<at::Tensor> attention_mask,
+    c10::optional<double> scale,
+    c10::optional<int64_t> dropout_seed,
+    int64_t window_size,
+    c10::optional<at::Tensor> block_mask,
+    int64_t block_size) {
+  // Query, Key, Value, Out and their grads
+  //       (Batch x Num_heads x Seq_len x Dim_per_head)
+  //    -> (Batch x Seq_len x Num_heads x Dim_per_head)
+  // Logsumexp (Batch x Num_heads x Q_seq_len)
+  //    -> (Batch x Q_seq_len x Num_heads)
+  at::Tensor query = q.transpose(1, 2);
+  at::Tensor key = k.transpose(1, 2);
+  at::Tensor value = v.transpose(1, 2);
+  at::Tensor output = out.transpose(1, 2);
+  at::Tensor grad_output = grad_out.transpose(1, 2);
+  at::Tensor lse = logsumexp.transpose(1, 2);
+
+  constexpr bool is_reduced_type = is_reduced_floating_point_v<scalar_t>;
+  bool is_bool_mask = attention_mask.has_value() &&
+      attention_mask.value().scalar_type() == ScalarType::Bool;
+  using accum_t = at::opmath_type<scalar_t>;
+  using Vec = at::vec::Vectorized<accum_t>;
+  accum_t scaling_factor = calculate_scale(query, scale).as_float_unchecked();
+  AttentionDropout dropout(dropout_p, dropout_seed);
+  AttentionLayout layout(window_size, block_mask, block_size);
+  const auto dtype = query.scalar_type();
+  const auto accumulate_dtype = at::toOpMathType(dtype);
+  if (attention_mask.has_value()) {
+    attention_mask.value() = attention_mask.value().to(accumulate_dtype);
+  }
+
+  // Sizes
+  int64_t batchSize = query.size(0);
+  int64_t qSize = query.size(1);
+  int64_t kvSize = value.size(1);
+  int64_t num_head = query.size(2);
+  int64_t num_kv_head = key.size(2);
+  int64_t group_size = num_head / num_kv_head;
+  int64_t headSize = query.size(3);
+
+  // Strides
+  int64_t qStrideB = query.stride(0);
+  int64_t qStrideM = query.stride(1);
+  int64_t qStrideH = query.stride(2);
+  int64_t kStrideB = key.stride(0);
+  int64_t kStrideN = key.stride(1);
+  int64_t kStrideH = key.stride(2);
+  int64_t vStrideB = value.stride(0);
+  int64_t vStrideN = value.stride(1);
+  int64_t vStrideH = value.stride(2);
+  int64_t oStrideB = output.stride(0);
+  int64_t oStrideM = output.stride(1);
+  int64_t oStrideH = output.stride(2);
+  int64_t goStrideB = grad_output.stride(0);
+  int64_t goStrideM = grad_output.stride(1);
+  int64_t goStrideH = grad_output.stride(2);
+  int64_t lStrideB = lse.stride(0);
+  int64_t lStrideM = lse.stride(1);
+  int64_t lStrideH = lse.stride(2);
+  // grad_q/grad_k/grad_v are allocated in (B x T x H x D)
+  int64_t gqStrideB = grad_q.stride(0);
+  int64_t gqStrideM = grad_q.stride(1);
+  int64_t gqStrideH = grad_q.stride(2);
+  int64_t gkStrideB = grad_k.stride(0);
+  int64_t gkStrideN = grad_k.stride(1);
+  int64_t gkStrideH = grad_k.stride(2);
+  int64_t gvStrideB = grad_v.stride(0);
+  int64_t gvStrideN = grad_v.stride(1);
+  int64_t gvStrideH = grad_v.stride(2);
+  int64_t mStrideB =
+      (attention_mask.has_value() && attention_mask.value().size(0) > 1)
+      ? attention_mask.value().stride(0)
+      : 0;
+  int64_t mStrideH =
+      (attention_mask.has_value() && attention_mask.value().size(1) > 1)
+      ? attention_mask.value().stride(1)
+      : 0;
+  int64_t mStrideM =
+      attention_mask.has_value() ? attention_mask.value().stride(2) : 0;
+
+  int64_t qSplitSize = q_split_size > qSize ? qSize : q_split_size;
+  int64_t kvSplitSize = kv_split_size > kvSize ? kvSize : kv_split_size;
+  int64_t qSlice = (qSize - 1) / qSplitSize + 1;
+  int64_t num_thread = at::get_num_threads();
+  // Split the keys of the grad_k/grad_v pass as finely as the queries when
+  // the kv blocks can't keep all the threads busy, e.g. MQA with a small
+  // batch.
+  int64_t kvTileSize = kvSplitSize;
+  if (batchSize * num_kv_head * ((kvSize - 1) / kvSplitSize + 1) <
+      num_thread) {
+    kvTileSize = std::min(kvSplitSize, qSplitSize);
+  }
+  int64_t kvSlice = (kvSize - 1) / kvTileSize + 1;
+
+  // allocate per thread temp buf (accumulate type)
+  int64_t size_per_thread =
+      /* attn      */ qSplitSize * kvSplitSize +
+      /* grad_attn */ qSplitSize * kvSplitSize +
+      /* grad_q    */ qSplitSize * headSize +
+      /* grad_k    */ kvTileSize * headSize +
+      /* grad_v    */ kvTileSize * headSize;
+  at::Tensor buf = at::empty(
+      {num_thread, size_per_thread}, query.options().dtype(accumulate_dtype));
+  // attn/grad_attn in q/k/v data type for the gemms of the reduced types
+  at::Tensor buf_reduced = at::empty(
+      {num_thread, is_reduced_type ? 2 * qSplitSize * kvSplitSize : 0},
+      query.options());
+  // sum(grad_out * out) of every query row (Batch x Q_seq_len x Num_heads)
+  at::Tensor dsum = at::empty(
+      {batchSize, qSize, num_head}, query.options().dtype(accumulate_dtype));
+
+  // Data ptrs
+  scalar_t* q_data = query.data_ptr<scalar_t>();
+  scalar_t* k_data = key.data_ptr<scalar_t>();
+  scalar_t* v_data = value.data_ptr<scalar_t>();
+  scalar_t* out_data = output.data_ptr<scalar_t>();
+  scalar_t* grad_out_data = grad_output.data_ptr<scalar_t>();
+  accum_t* lse_data = lse.data_ptr<accum_t>();
+  accum_t* mask_data = attention_mask.has_value()
+      ? attention_mask.value().data_ptr<accum_t>()
+      : nullptr;
+  scalar_t* grad_q_data = grad_q.data_ptr<scalar_t>();
+  scalar_t* grad_k_data = grad_k.data_ptr<scalar_t>();
+  scalar_t* grad_v_data = grad_v.data_ptr<scalar_t>();
+  accum_t* buf_data = buf.data_ptr<accum_t>();
+  scalar_t* buf_reduced_data =
+      is_reduced_type ? buf_reduced.data_ptr<scalar_t>() : nullptr;
+  accum_t* dsum_data = dsum.data_ptr<accum_t>();
+
+  using at::native::TransposeType;
+  // Recompute the attention block of query head j, queries [m, m +
+  // qBlockSize) and keys [n, n + kvBlockSize):
+  //   grad_attn <- attn * (dropout(grad_out @ v.T) - dsum), the grad of
+  //                scale * q @ k.T
+  //   attn <- softmax(scale * q @ k.T + mask), then dropout(attn), the
+  //           weights applied to v, if with_dropped_attn
+  auto attention_block = [&](int64_t i,
+                             int64_t j,
+                             int64_t m,
+                             int64_t qBlockSize,
+                             int64_t n,
+                             int64_t kvBlockSize,
+                             AttentionLayout::TileState tile_state,
+                             accum_t* attn_data,
+                             accum_t* grad_attn_data,
+                             bool with_dropped_attn) {
+    int64_t kv_j = j / group_size;
+    // attn <- q @ k.T
+    at::native::cpublas::gemm(
+        TransposeType::Transpose,
+        TransposeType::NoTranspose,
+        kvBlockSize,
+        qBlockSize,
+        headSize,
+        static_cast<accum_t>(1),
+        k_data + i * kStrideB + kv_j * kStrideH + n * kStrideN,
+        kStrideN,
+        q_data + i * qStrideB + j * qStrideH + m * qStrideM,
+        qStrideM,
+        static_cast<accum_t>(0),
+        attn_data,
+        kvBlockSize);
+    // attn <- exp(scale * attn + mask - logsumexp), i.e. the softmax of the
+    // forward
+    auto neg_inf = -std::numeric_limits<accum_t>::infinity();
+    accum_t* lse_ptr = lse_data + i * lStrideB + j * lStrideH + m * lStrideM;
+    for (const auto row : c10::irange(qBlockSize)) {
+      accum_t* row_ptr = attn_data + row * kvBlockSize;
+      if (attention_mask.has_value()) {
+        accum_t* mask_ptr = mask_data + i * mStrideB + j * mStrideH +
+            (m + row) * mStrideM + n;
+        if (is_bool_mask) {
+          // attn <- mask ? attn : -inf
+          at::vec::map2<accum_t>(
+              [neg_inf, scaling_factor](Vec x, Vec y) {
+                return Vec::blendv(
+                    Vec(neg_inf), x * Vec(scaling_factor), y != Vec(0));
+              },
+              row_ptr,
+              row_ptr,
+              mask_ptr,
+              kvBlockSize);
+        } else {
+          // attn <- attn + mask
+          at::vec::map2<accum_t>(
+              [scaling_factor](Vec x, Vec y) {
+                return x * Vec(scaling_factor) + y;
+              },
+              row_ptr,
+              row_ptr,
+              mask_ptr,
+              kvBlockSize);
+        }
+      } else {
+        at::vec::map<accum_t>(
+            [scaling_factor](Vec x) { return x * Vec(scaling_factor); },
+            row_ptr,
+            row_ptr,
+            kvBlockSize);
+      }
+      // Apply causal mask, fill unused with -inf
+      if (is_causal) {
+        int64_t first_hidden =
+            std::clamp<int64_t>(m + row - n + 1, 0, kvBlockSize);
+        torch_ipex::cpu::kernel::fill_stub(
+            row_ptr + first_hidden, neg_inf, kvBlockSize - first_hidden);
+      }
+      // Apply sliding window and block-sparse layout
+      if (tile_state == AttentionLayout::kPartial) {
+        layout.mask_row(row_ptr, j, m + row, n, kvBlockSize);
+      }
+      // A fully masked row has no gradient
+      accum_t row_lse = lse_ptr[row * lStrideM];
+      if (row_lse == neg_inf) {
+        row_lse = std::numeric_limits<accum_t>::infinity();
+      }
+      at::vec::map<accum_t>(
+          [row_lse](Vec x) { return exp_u20(x - Vec(row_lse)); },
+          row_ptr,
+          row_ptr,
+          kvBlockSize);
+    }
+    // grad_attn <- grad_out @ v.T
+    at::native::cpublas::gemm(
+        TransposeType::Transpose,
+        TransposeType::NoTranspose,
+        kvBlockSize,
+        qBlockSize,
+        headSize,
+        static_cast<accum_t>(1),
+        v_data + i * vStrideB + kv_j * vStrideH + n * vStrideN,
+        vStrideN,
+        grad_out_data + i * goStrideB + j * goStrideH + m * goStrideM,
+        goStrideM,
+        static_cast<accum_t>(0),
+        grad_attn_data,
+        kvBlockSize);
+    for (const auto row : c10::irange(qBlockSize)) {
+      // grad_attn <- dropout(grad_attn)
+      if (dropout.enabled) {
+        dropout.apply(
+            grad_attn_data + row * kvBlockSize,
+            kvBlockSize,
+            i * num_head + j,
+            m + row,
+            n);
+      }
+      // grad_attn <- attn * (grad_attn - dsum)
+      accum_t row_dsum = dsum_data[(i * qSize + m + row) * num_head + j];
+      at::vec::map2<accum_t>(
+          [row_dsum](Vec x, Vec y) { return y * (x - Vec(row_dsum)); },
+          grad_attn_data + row * kvBlockSize,
+          grad_attn_data + row * kvBlockSize,
+          attn_data + row * kvBlockSize,
+          kvBlockSize);
+      // attn <- dropout(attn)
+      if (with_dropped_attn && dropout.enabled) {
+        dropout.apply(
+            attn_data + row * kvBlockSize,
+            kvBlockSize,
+            i * num_head + j,
+            m + row,
+            n);
+      }
+    }
+  };
+
+  // grad_q <- scale * grad_attn @ k, summed over the kv blocks
+  at::parallel_for(
+      0, batchSize * num_head * qSlice, 1, [&](int64_t begin, int64_t end) {
+        int64_t i = 0, j = 0, k = 0;
+        at::native::data_index_init(
+            begin, i, batchSize, j, num_head, k, qSlice);
+        int ompIdx = at::get_thread_num();
+        accum_t* buf_ptr = buf_data + ompIdx * size_per_thread;
+        accum_t* attn_data = buf_ptr;
+        accum_t* grad_attn_data = attn_data + qSplitSize * kvSplitSize;
+        accum_t* grad_q_acc = grad_attn_data + qSplitSize * kvSplitSize;
+        scalar_t* grad_attn_reduced = is_reduced_type
+            ? buf_reduced_data + ompIdx * 2 * qSplitSize * kvSplitSize
+            : nullptr;
+
+        for (const auto z : c10::irange(begin, end)) {
+          (void)z; // Suppress unused variable
+          int64_t m = k * qSplitSize;
+          int64_t qBlockSize = std::min(qSplitSize, qSize - m);
+          int64_t kv_j = j / group_size;
+          // dsum <- sum(grad_out * out) per row, also read by the grad_k/
+          // grad_v pass
+          for (const auto row : c10::irange(qBlockSize)) {
+            dsum_data[(i * qSize + m + row) * num_head + j] =
+                at::vec::map2_reduce_all<scalar_t>(
+                    [](Vec x, Vec y) { return x * y; },
+                    [](Vec x, Vec y) { return x + y; },
+                    grad_out_data + i * goStrideB + j * goStrideH +
+                        (m + row) * goStrideM,
+                    out_data + i * oStrideB + j * oStrideH +
+                        (m + row) * oStrideM,
+                    headSize);
+          }
+          torch_ipex::cpu::kernel::fill_stub(
+              grad_q_acc, static_cast<accum_t>(0), qBlockSize * headSize);
+          int64_t num_keys =
+              is_causal ? std::min(m + qBlockSize, kvSize) : kvSize;
+          num_keys = layout.kv_end(m, qBlockSize, num_keys);
+          for (int64_t n = layout.kv_begin(m, kvSplitSize); n < num_keys;
+               n += kvSplitSize) {
+            int64_t kvBlockSize = std::min(kvSplitSize, kvSize - n);
+            auto tile_state =
+                layout.tile_state(j, m, qBlockSize, n, kvBlockSize);
+            if (tile_state == AttentionLayout::kHidden) {
+              continue;
+            }
+            attention_block(
+                i,
+                j,
+                m,
+                qBlockSize,
+                n,
+                kvBlockSize,
+                tile_state,
+                attn_data,
+                grad_attn_data,
+                /* with_dropped_attn */ false);
+            if constexpr (is_reduced_type) {
+              at::vec::convert<accum_t, scalar_t>(
+                  grad_attn_data,
+                  grad_attn_reduced,
+                  qBlockSize * kvBlockSize);
+            }
+            // grad_q <- grad_q + scale * grad_attn @ k
+            at::native::cpublas::gemm(
+                TransposeType::NoTranspose,
+                TransposeType::NoTranspose,
+                headSize,
+                qBlockSize,
+                kvBlockSize,
+                scaling_factor,
+                k_data + i * kStrideB + kv_j * kStrideH + n * kStrideN,
+                kStrideN,
+                conditional_data_ptr(grad_attn_data, grad_attn_reduced),
+                kvBlockSize,
+                static_cast<accum_t>(1),
+                grad_q_acc,
+                headSize);
+          }
+          // reorder grad_q with strides
+          for (const auto row : c10::irange(qBlockSize)) {
+            at::vec::map<scalar_t>(
+                [](Vec x) { return x; },
+                grad_q_data + i * gqStrideB + j * gqStrideH +
+                    (m + row) * gqStrideM,
+                grad_q_acc + row * headSize,
+                headSize);
+          }
+          // Move to the next query
+          at::native::data_index_step(i, batchSize, j, num_head, k, qSlice);
+        }
+      });
+
+  // grad_v <- attn.T @ grad_out and grad_k <- scale * grad_attn.T @ q,
+  // summed over the q blocks of all the query heads of the kv group
+  at::parallel_for(
+      0, batchSize * num_kv_head * kvSlice, 1, [&](int64_t begin, int64_t end) {
+        int64_t i = 0, kv_j = 0, l = 0;
+        at::native::data_index_init(
+            begin, i, batchSize, kv_j, num_kv_head, l, kvSlice);
+        int ompIdx = at::get_thread_num();
+        accum_t* buf_ptr = buf_data + ompIdx * size_per_thread;
+        accum_t* attn_data = buf_ptr;
+        accum_t* grad_attn_data = attn_data + qSplitSize * kvSplitSize;
+        accum_t* grad_k_acc = grad_attn_data + qSplitSize * kvSplitSize +
+            qSplitSize * headSize;
+        accum_t* grad_v_acc = grad_k_acc + kvTileSize * headSize;
+        scalar_t* attn_reduced = is_reduced_type
+            ? buf_reduced_data + ompIdx * 2 * qSplitSize * kvSplitSize
+            : nullptr;
+        scalar_t* grad_attn_reduced = is_reduced_type
+            ? attn_reduced + qSplitSize * kvSplitSize
+            : nullptr;
+
+        for (const auto z : c10::irange(begin, end)) {
+          (void)z; // Suppress unused variable
+          int64_t n = l * kvTileSize;
+          int64_t kvBlockSize = std::min(kvTileSize, kvSize - n);
+          torch_ipex::cpu::kernel::fill_stub(
+              grad_k_acc, static_cast<accum_t>(0), kvBlockSize * headSize);
+          torch_ipex::cpu::kernel::fill_stub(
+              grad_v_acc, static_cast<accum_t>(0), kvBlockSize * headSize);
+          // The q blocks that can see the keys [n, n + kvBlockSize)
+          int64_t q_begin = layout.q_begin(n, qSplitSize);
+          if (is_causal) {
+            q_begin = std::max(q_begin, n / qSplitSize * qSplitSize);
+          }
+          int64_t q_end = layout.q_end(n, kvBlockSize, qSize);
+          for (int64_t g = 0; g < group_size; g++) {
+            int64_t j = kv_j * group_size + g;
+            scalar_t* q_ptr = q_data + i * qStrideB + j * qStrideH;
+            scalar_t* grad_out_ptr =
+                grad_out_data + i * goStrideB + j * goStrideH;
+            for (int64_t m = q_begin; m < q_end; m += qSplitSize) {
+              int64_t qBlockSize = std::min(qSplitSize, qSize - m);
+              auto tile_state =
+                  layout.tile_state(j, m, qBlockSize, n, kvBlockSize);
+              if (tile_state == AttentionLayout::kHidden) {
+                continue;
+              }
+              attention_block(
+                  i,
+                  j,
+                  m,
+                  qBlockSize,
+                  n,
+                  kvBlockSize,
+                  tile_state,
+                  attn_data,
+                  grad_attn_data,
+                  /* with_dropped_attn */ true);
+              if constexpr (is_reduced_type) {
+                at::vec::convert<accum_t, scalar_t>(
+                    attn_data, attn_reduced, qBlockSize * kvBlockSize);
+                at::vec::convert<accum_t, scalar_t>(
+                    grad_attn_data,
+                    grad_attn_reduced,
+                    qBlockSize * kvBlockSize);
+              }
+              // grad_v <- grad_v + attn.T @ grad_out
+              at::native::cpublas::gemm(
+                  TransposeType::NoTranspose,
+                  TransposeType::Transpose,
                   headSize,
+                  kvBlockSize,
                   qBlockSize,
+                  static_cast<accum_t>(1),
+                  grad_out_ptr + m * goStrideM,
+                  goStrideM,
+                  conditional_data_ptr(attn_data, attn_reduced),
                   kvBlockSize,
                   static_cast<accum_t>(1),
-                  v_data + i * vStrideB + j * vStrideH + n * vStrideN,
-                  vStrideN,
-                  qk_reduced_data,
-                  kvBlockSize % 2 == 0 ? kvBlockSize : kvBlockSize + 1,
-                  n == 0 ? static_cast<accum_t>(0) : static_cast<accum_t>(1),
-                  dst_data,
+                  grad_v_acc,
+                  headSize);
+              // grad_k <- grad_k + scale * grad_attn.T @ q
+              at::native::cpublas::gemm(
+                  TransposeType::NoTranspose,
+                  TransposeType::Transpose,
+                  headSize,
+                  kvBlockSize,
+                  qBlockSize,
+                  scaling_factor,
+                  q_ptr + m * qStrideM,
+                  qStrideM,
+                  conditional_data_ptr(grad_attn_data, grad_attn_reduced),
+                  kvBlockSize,
+                  static_cast<accum_t>(1),
+                  grad_k_acc,
                   headSize);
             }
           }
-          // dst <- dst / sum[row]
-          // reorder MHA output with strides
-          for (int64_t row = 0; row < qBlockSize; ++row) {
-            accum_t sum_reciprocal = 1 / qk_sum_data[row];
+          // reorder grad_k/grad_v with strides
+          for (const auto row : c10::irange(kvBlockSize)) {
             at::vec::map<scalar_t>(
-                [sum_reciprocal](Vec x) { return x * Vec(sum_reciprocal); },
-                out_data + i * oStrideB + j * oStrideH + m * oStrideM +
-                    row * oStrideM,
-                dst_data + row * headSize,
+                [](Vec x) { return x; },
+                grad_k_data + i * gkStrideB + kv_j * gkStrideH +
+                    (n + row) * gkStrideN,
+                grad_k_acc + row * headSize,
+                headSize);
+            at::vec::map<scalar_t>(
+                [](Vec x) { return x; },
+                grad_v_data + i * gvStrideB + kv_j * gvStrideH +
+                    (n + row) * gvStrideN,
+                grad_v_acc + row * headSize,
                 headSize);
           }
-          // Store logsumexp for backward
-          accum_t* lse_ptr =
-              lse_data + i * lStrideB + j * lStrideH + m * lStrideM;
-          for (const auto row : c10::irange(qBlockSize)) {
-            lse_ptr[row * lStrideM] =
-                qk_max_data[row] + std::log(qk_sum_data[row]);
-          }
-          // Move to the next query
-          at::native::data_index_step(i, batchSize, j, num_head, k, qSlice);
+          // Move to the next kv block
+          at::native::data_index_step(
+              i, batchSize, kv_j, num_kv_head, l, kvSlice);
+        }
+      });
+}
+
+void flash_attention_backward_kernel_impl(
+    const at::Tensor& grad_q,
+    const at::Tensor& grad_k,
+    const at::Tensor& grad_v,
+    const at::Tensor& grad_out,
+    const at::Tensor& query,
+    const at::Tensor& key,
+    const at::Tensor& value,
+    const at::Tensor& out,
+    const at::Tensor& logsumexp,
+    double dropout_p,
+    bool is_causal,
+    c10::optional<at::Tensor> attention_mask,
+    c10::optional<double> scale,
+    c10::optional<int64_t> dropout_seed,
+    int64_t window_size,
+    c10::optional<at::Tensor> block_mask,
+    int64_t block_size) {
+  auto q_seq_len = query.size(2);
+
+  AT_DISPATCH_FLOATING_TYPES_AND2(
+      kBFloat16, kHalf, query.scalar_type(), "flash_attention_backward", [&] {
+        if (q_seq_len >= 768) {
+          cpu_flash_attention_backward<scalar_t, 256, 512>(
+              grad_q,
+              grad_k,
+              grad_v,
+              grad_out,
+              query,
+              key,
+              value,
+              out,
+              logsumexp,
+              dropout_p,
+              is_causal,
+              attention_mask,
+              scale,
+              dropout_seed,
+              window_size,
+              block_mask,
+              block_size);
+        } else if (q_seq_len >= 192) {
+          cpu_flash_attention_backward<scalar_t, 64, 512>(
+              grad_q,
+              grad_k,
+              grad_v,
+              grad_out,
+              query,
+              key,
+              value,
+              out,
+              logsumexp,
+              dropout_p,
+              is_causal,
+              attention_mask,
+              scale,
+              dropout_seed,
+              window_size,
+              block_mask,
+              block_size);
+        } else {
+          cpu_flash_attention_backward<scalar_t, 32, 512>(
+              grad_q,
+              grad_k,
+              grad_v,
+              grad_out,
+              query,
+              key,
+              value,
+              out,
+              logsumexp,
+              dropout_p,
+              is_causal,
+              attention_mask,
+              scale,
+              dropout_seed,
+              window_size,
+              block_mask,
+              block_size);
         }
       });
 }
@@ -1347,7 +2207,11 @@ void flash_attention_kernel_impl(
     double dropout_p,
     bool is_causal,
     c10::optional<at::Tensor> attention_mask,
-    c10::optional<double> scale) {
+    c10::optional<double> scale,
+    c10::optional<int64_t> dropout_seed,
+    int64_t window_size,
+    c10::optional<at::Tensor> block_mask,
+    int64_t block_size) {
   auto q_seq_len = query.size(2);
 
   AT_DISPATCH_FLOATING_TYPES_AND2(
@@ -1362,7 +2226,11 @@ void flash_attention_kernel_impl(
               dropout_p,
               is_causal,
               attention_mask,
-              scale);
+              scale,
+              dropout_seed,
+              window_size,
+              block_mask,
+              block_size);
         } else if (q_seq_len >= 192) {
           cpu_flash_attention<scalar_t, 64, 512>(
               output,
@@ -1373,7 +2241,11 @@ void flash_attention_kernel_impl(
               dropout_p,
               is_causal,
               attention_mask,
-              scale);
+              scale,
+              dropout_seed,
+              window_size,
+              block_mask,
+              block_size);
         } else {
           cpu_flash_attention<scalar_t, 32, 512>(
               output,
@@ -1384,11 +2256,44 @@ void flash_attention_kernel_impl(
               dropout_p,
               is_causal,
               attention_mask,
-              scale);
+              scale,
+              dropout_seed,
+              window_size,
+              block_mask,
+              block_size);
         }
       });
 }
 
+// Check the block-sparse layout of query [B, H, T, K] and key [B, H, S, K]
+void check_attention_layout(
+    const char* name,
+    const at::Tensor& query,
+    const at::Tensor& key,
+    const c10::optional<at::Tensor>& block_mask,
+    int64_t block_size) {
+  if (!block_mask.has_value()) {
+    return;
+  }
+  const auto& mask = block_mask.value();
+  TORCH_CHECK(
+      block_size > 0,
+      name,
+      ": block_size should be positive with block_mask, but got ",
+      block_size);
+  TORCH_CHECK(
+      mask.dim() == 2 ||
+          (mask.dim() == 3 &&
+           (mask.size(0) == 1 || mask.size(0) == query.size(1))),
+      name,
+      ": block_mask should be in shape of {num_q_blocks, num_kv_blocks} or {H, num_q_blocks, num_kv_blocks}");
+  TORCH_CHECK(
+      mask.size(-2) * block_size >= query.size(2) &&
+          mask.size(-1) * block_size >= key.size(2),
+      name,
+      ": block_mask doesn't cover the query/key sequence length");
+}
+
 std::tuple<at::Tensor, at::Tensor> flash_attention_kernel(
     const at::Tensor& query,
     const at::Tensor& key,
@@ -1396,7 +2301,11 @@ std::tuple<at::Tensor, at::Tensor> flash_attention_kernel(
     double dropout_p,
     bool is_causal,
     c10::optional<at::Tensor> attention_mask,
-    c10::optional<double> scale) {
+    c10::optional<double> scale,
+    c10::optional<int64_t> dropout_seed,
+    int64_t window_size,
+    c10::optional<at::Tensor> block_mask,
+    int64_t block_size) {
   RECORD_FUNCTION(
       "torch_ipex::flash_attention_kernel", c10::ArrayRef<c10::IValue>({}));
 
@@ -1423,17 +2332,27 @@ std::tuple<at::Tensor, at::Tensor> flash_attention_kernel(
       query.dim() == 4 && key.dim() == 4 && value.dim() == 4,
       "IPEX flash_attention: Accept only 4 dims inputs shape of {B, H, T, K}");
   TORCH_CHECK(
-      dropout_p == 0.0,
-      "IPEX flash_attention: Currently do not support dropout > 0");
+      dropout_p >= 0.0 && dropout_p <= 1.0,
+      "IPEX flash_attention: dropout_p should be in [0, 1], but got ",
+      dropout_p);
+  TORCH_CHECK(
+      dropout_p == 0.0 || dropout_seed.has_value(),
+      "IPEX flash_attention: dropout_seed is required for dropout_p > 0");
   TORCH_CHECK(
       (query.size(3) == value.size(3)) && (key.size(3) == value.size(3)),
       "IPEX flash_attention: Q/K/V should have the same head size");
+  TORCH_CHECK(
+      key.size(1) == value.size(1) && key.size(1) > 0 &&
+          query.size(1) % key.size(1) == 0,
+      "IPEX flash_attention: the number of query heads should be a multiple of the key/value heads");
   TORCH_CHECK(
       (query.stride(-1) == 1) && (key.stride(-1) == 1) &&
           (value.stride(-1) == 1) &&
           (!attention_mask.has_value() ||
            attention_mask.value().stride(-1) == 1),
       "IPEX flash_attention: Q/K/V/Mask should be continuous on the last dim");
+  check_attention_layout(
+      "IPEX flash_attention", query, key, block_mask, block_size);
 
   at::Tensor output =
       at::empty({batchSize, qSize, num_head, headSize}, query.options());
@@ -1450,16 +2369,126 @@ std::tuple<at::Tensor, at::Tensor> flash_attention_kernel(
       dropout_p,
       is_causal,
       attention_mask,
-      scale);
+      scale,
+      dropout_seed,
+      window_size,
+      block_mask,
+      block_size);
 
   output = output.transpose(1, 2);
   logsumexp = logsumexp.transpose(1, 2);
 
   return std::make_tuple(std::move(output), std::move(logsumexp));
 }
+
+std::tuple<at::Tensor, at::Tensor, at::Tensor> flash_attention_backward_kernel(
+    const at::Tensor& grad_out,
+    const at::Tensor& query,
+    const at::Tensor& key,
+    const at::Tensor& value,
+    const at::Tensor& out,
+    const at::Tensor& logsumexp,
+    double dropout_p,
+    bool is_causal,
+    c10::optional<at::Tensor> attention_mask,
+    c10::optional<double> scale,
+    c10::optional<int64_t> dropout_seed,
+    int64_t window_size,
+    c10::optional<at::Tensor> block_mask,
+    int64_t block_size) {
+  RECORD_FUNCTION(
+      "torch_ipex::flash_attention_backward_kernel",
+      c10::ArrayRef<c10::IValue>({}));
+
+  const auto dtype = query.scalar_type();
+  TORCH_CHECK(
+      c10::isFloatingType(dtype),
+      "IPEX flash_attention_backward: Expected data type in FP32, FP64, BF16, FP16, but got ",
+      dtype,
+      " instead.");
+  TORCH_CHECK(
+      dtype == key.scalar_type() && dtype == value.scalar_type() &&
+          dtype == out.scalar_type() && dtype == grad_out.scalar_type(),
+      "IPEX flash_attention_backward: Q/K/V/Out/Grad_out should have the same data type");
+  TORCH_CHECK(
+      logsumexp.scalar_type() == at::toOpMathType(dtype),
+      "IPEX flash_attention_backward: Logsumexp should be in the accumulate type of Q/K/V");
+  TORCH_CHECK(
+      !attention_mask.has_value() ||
+          dtype == attention_mask.value().scalar_type() ||
+          attention_mask.value().scalar_type() == ScalarType::Bool,
+      "IPEX flash_attention_backward: Mask should have the same data type as Q/K/V or Bool");
+  TORCH_CHECK(
+      query.dim() == 4 && key.dim() == 4 && value.dim() == 4,
+      "IPEX flash_attention_backward: Accept only 4 dims inputs shape of {B, H, T, K}");
+  TORCH_CHECK(
+      dropout_p >= 0.0 && dropout_p <= 1.0,
+      "IPEX flash_attention_backward: dropout_p should be in [0, 1], but got ",
+      dropout_p);
+  TORCH_CHECK(
+      dropout_p == 0.0 || dropout_seed.has_value(),
+      "IPEX flash_attention_backward: dropout_seed is required for dropout_p > 0");
+  TORCH_CHECK(
+      (query.size(3) == value.size(3)) && (key.size(3) == value.size(3)),
+      "IPEX flash_attention_backward: Q/K/V should have the same head size");
+  TORCH_CHECK(
+      key.size(1) == value.size(1) && key.size(1) > 0 &&
+          query.size(1) % key.size(1) == 0,
+      "IPEX flash_attention_backward: the number of query heads should be a multiple of the key/value heads");
+  TORCH_CHECK(
+      grad_out.sizes() == query.sizes() && out.sizes() == query.sizes(),
+      "IPEX flash_attention_backward: Out/Grad_out should have the shape of Q");
+  TORCH_CHECK(
+      (query.stride(-1) == 1) && (key.stride(-1) == 1) &&
+          (value.stride(-1) == 1) && (out.stride(-1) == 1) &&
+          (grad_out.stride(-1) == 1) &&
+          (!attention_mask.has_value() ||
+           attention_mask.value().stride(-1) == 1),
+      "IPEX flash_attention_backward: Q/K/V/Out/Grad_out/Mask should be continuous on the last dim");
+  check_attention_layout(
+      "IPEX flash_attention_backward", query, key, block_mask, block_size);
+
+  int64_t batchSize = query.size(0);
+  int64_t num_head = query.size(1);
+  int64_t num_kv_head = key.size(1);
+  int64_t qSize = query.size(2);
+  int64_t kvSize = key.size(2);
+  int64_t headSize = query.size(3);
+  at::Tensor grad_q =
+      at::empty({batchSize, qSize, num_head, headSize}, query.options());
+  at::Tensor grad_k =
+      at::empty({batchSize, kvSize, num_kv_head, headSize}, key.options());
+  at::Tensor grad_v =
+      at::empty({batchSize, kvSize, num_kv_head, headSize}, value.options());
+
+  flash_attention_backward_kernel_impl(
+      grad_q,
+      grad_k,
+      grad_v,
+      grad_out,
+      query,
+      key,
+      value,
+      out,
+      logsumexp,
+      dropout_p,
+      is_causal,
+      attention_mask,
+      scale,
+      dropout_seed,
+      window_size,
+      block_mask,
+      block_size);
+
+  return std::make_tuple(
+      grad_q.transpose(1, 2), grad_k.transpose(1, 2), grad_v.transpose(1, 2));
+}
 } // anonymous namespace
 
 IPEX_REGISTER_DISPATCH(flash_attention_kernel_stub, &flash_attention_kernel);
+IPEX_REGISTER_DISPATCH(
+    flash_attention_backward_kernel_stub,
+    &flash_attention_backward_kernel);
 
 } // namespace cpu
 } // namespace torch_ipex
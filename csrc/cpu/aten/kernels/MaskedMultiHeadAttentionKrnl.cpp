@@ -1319,18 +1319,13 @@ first_token_masked_mha(
     copy_key_value<at::BFloat16>(
         key_cache, key, value_cache, value, beam_batch);
   }
-  // support MGQ/MQA
-  // expand the head dimensiopn of key/value to be same to the query
-  if (query.size(2) != key.size(2)) {
-    auto n_req = query.size(2) / key.size(2);
-    key = key.repeat_interleave(n_req, 2);
-    value = value.repeat_interleave(n_req, 2);
-  }
   auto attn_outputs = at::Tensor();
   auto attn_weights = at::Tensor();
   if ((key.scalar_type() == at::kFloat || key.scalar_type() == at::kBFloat16 ||
        key.scalar_type() == at::kHalf) &&
       attention_mask.stride(-1) == 1) {
+    // flash attention shares the key/value heads between the query heads
+    // of MGQ/MQA without expanding them
     query = query.transpose(1, 2);
     key = key.transpose(1, 2);
     value = value.transpose(1, 2);
@@ -1342,8 +1337,19 @@ first_token_masked_mha(
         /* dropout */ 0.0,
         /* is_causal*/ false,
         attention_mask,
-        1. / scale_attn));
+        1. / scale_attn,
+        /* dropout_seed */ c10::nullopt,
+        /* window_size */ -1,
+        /* block_mask */ c10::nullopt,
+        /* block_size */ 0));
   } else {
+    // support MGQ/MQA
+    // expand the head dimensiopn of key/value to be same to the query
+    if (query.size(2) != key.size(2)) {
+      auto n_req = query.size(2) / key.size(2);
+      key = key.repeat_interleave(n_req, 2);
+      value = value.repeat_interleave(n_req, 2);
+    }
     key = key.permute({0, 2, 1, 3});
     query = query.permute({0, 2, 1, 3});
     value = value.permute({0, 2, 1, 3});
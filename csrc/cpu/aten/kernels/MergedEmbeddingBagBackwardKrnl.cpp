@@ -564,6 +564,123 @@ inline void adagrad_update<at::BFloat16, float>(
   }
 }
 
+// Unpack a row of split bf16 weight (top half + trail) into fp32.
+inline void pack_split_bf16_row(
+    float* out,
+    const at::BFloat16* param_ptr,
+    const at::BFloat16* trail_ptr,
+    int64_t size) {
+  using bVec = at::vec::Vectorized<at::BFloat16>;
+  using fVec = at::vec::Vectorized<float>;
+  int64_t d = 0;
+  for (; d < size - (size % bVec::size()); d += bVec::size()) {
+    fVec param_fvec, param_fvec2;
+    std::tie(param_fvec, param_fvec2) = at::vec::pack_bfloat16_float(
+        bVec::loadu(param_ptr + d), bVec::loadu(trail_ptr + d));
+    param_fvec.store(out + d);
+    param_fvec2.store(out + d + fVec::size());
+  }
+  for (; d < size; d++) {
+    out[d] = at::vec::pack_bfloat16_float(param_ptr[d], trail_ptr[d]);
+  }
+}
+
+inline void unpack_split_bf16_row(
+    at::BFloat16* param_ptr,
+    at::BFloat16* trail_ptr,
+    const float* in,
+    int64_t size) {
+  using bVec = at::vec::Vectorized<at::BFloat16>;
+  using fVec = at::vec::Vectorized<float>;
+  int64_t d = 0;
+  for (; d < size - (size % bVec::size()); d += bVec::size()) {
+    bVec param_bvec, trail_bvec;
+    std::tie(param_bvec, trail_bvec) = at::vec::unpack_float_bfloat16(
+        fVec::loadu(in + d), fVec::loadu(in + d + fVec::size()));
+    param_bvec.store(param_ptr + d);
+    trail_bvec.store(trail_ptr + d);
+  }
+  for (; d < size; d++) {
+    std::tie(param_ptr[d], trail_ptr[d]) =
+        at::vec::unpack_float_bfloat16(in[d]);
+  }
+}
+
+template <typename acc_t>
+inline void adam_update(
+    acc_t* param_ptr,
+    acc_t* update_ptr,
+    acc_t* exp_avg_ptr,
+    acc_t* exp_avg_sq_ptr,
+    const acc_t* grad_ptr,
+    const AdamArgs& args,
+    int64_t size) {
+  // exp_avg = beta1 * exp_avg + (1 - beta1) * grad
+  // exp_avg_sq = beta2 * exp_avg_sq + (1 - beta2) * grad**2
+  // update = exp_avg_hat / (sqrt(exp_avg_sq_hat) + eps) + weight_decay * param
+  // param -= lr * trust_ratio * update, trust_ratio is 1 for Adam
+  using Vec = at::vec::Vectorized<acc_t>;
+  const acc_t beta1 = args.beta1;
+  const acc_t beta2 = args.beta2;
+  const acc_t bias_correction1 = 1 - std::pow(beta1, acc_t(args.step));
+  const acc_t bias_correction2 = 1 - std::pow(beta2, acc_t(args.step));
+  Vec beta1_vec = Vec(beta1);
+  Vec beta2_vec = Vec(beta2);
+  Vec grad_coef1_vec = Vec(1 - beta1);
+  Vec grad_coef2_vec = Vec(1 - beta2);
+  Vec bias_correction1_vec = Vec(bias_correction1);
+  Vec bias_correction2_vec = Vec(bias_correction2);
+  Vec eps_vec = Vec(args.eps);
+  Vec weight_decay_vec = Vec(args.weight_decay);
+  Vec param_norm_vec = Vec(0);
+  Vec update_norm_vec = Vec(0);
+  int64_t d = 0;
+  for (; d < size - (size % Vec::size()); d += Vec::size()) {
+    Vec grad_vec = Vec::loadu(grad_ptr + d);
+    Vec exp_avg_vec =
+        Vec::loadu(exp_avg_ptr + d) * beta1_vec + grad_vec * grad_coef1_vec;
+    Vec exp_avg_sq_vec = Vec::loadu(exp_avg_sq_ptr + d) * beta2_vec +
+        grad_vec * grad_vec * grad_coef2_vec;
+    exp_avg_vec.store(exp_avg_ptr + d);
+    exp_avg_sq_vec.store(exp_avg_sq_ptr + d);
+    Vec param_vec = Vec::loadu(param_ptr + d);
+    Vec update_vec = (exp_avg_vec / bias_correction1_vec) /
+            ((exp_avg_sq_vec / bias_correction2_vec).sqrt() + eps_vec) +
+        param_vec * weight_decay_vec;
+    update_vec.store(update_ptr + d);
+    param_norm_vec += param_vec * param_vec;
+    update_norm_vec += update_vec * update_vec;
+  }
+  acc_t param_norm = at::vec::vec_reduce_all<acc_t>(
+      [](Vec& x, Vec& y) { return x + y; }, param_norm_vec);
+  acc_t update_norm = at::vec::vec_reduce_all<acc_t>(
+      [](Vec& x, Vec& y) { return x + y; }, update_norm_vec);
+  for (; d < size; d++) {
+    exp_avg_ptr[d] = exp_avg_ptr[d] * beta1 + grad_ptr[d] * (1 - beta1);
+    exp_avg_sq_ptr[d] =
+        exp_avg_sq_ptr[d] * beta2 + grad_ptr[d] * grad_ptr[d] * (1 - beta2);
+    update_ptr[d] = (exp_avg_ptr[d] / bias_correction1) /
+            (std::sqrt(exp_avg_sq_ptr[d] / bias_correction2) + args.eps) +
+        param_ptr[d] * args.weight_decay;
+    param_norm += param_ptr[d] * param_ptr[d];
+    update_norm += update_ptr[d] * update_ptr[d];
+  }
+  acc_t step_size = args.lr;
+  if (args.use_lamb && param_norm > 0 && update_norm > 0) {
+    step_size *= std::sqrt(param_norm) / std::sqrt(update_norm);
+  }
+  Vec step_size_vec = Vec(step_size);
+  d = 0;
+  for (; d < size - (size % Vec::size()); d += Vec::size()) {
+    Vec param_vec = Vec::loadu(param_ptr + d) -
+        Vec::loadu(update_ptr + d) * step_size_vec;
+    param_vec.store(param_ptr + d);
+  }
+  for (; d < size; d++) {
+    param_ptr[d] -= update_ptr[d] * step_size;
+  }
+}
+
 template <typename data_t, typename acc_t>
 void inline EmbeddingGradUpdate<data_t, acc_t, SGDArgs>::update(
     data_t* weight,
@@ -610,6 +727,56 @@ void inline EmbeddingGradUpdate<data_t, acc_t, AdaGradArgs>::update(
   }
 }
 
+template <typename data_t, typename acc_t>
+void inline EmbeddingGradUpdate<data_t, acc_t, AdamArgs>::update(
+    data_t* weight,
+    const EmbeddingRowCache<acc_t>& ewc,
+    const AdamArgs& args,
+    const int32_t table_id,
+    const int64_t emb_dim) {
+  BFloat16* bf16_trail_ptr = args.bf16_trail[table_id].data_ptr<BFloat16>();
+  acc_t* exp_avg_ptr = args.exp_avg[table_id].data_ptr<acc_t>();
+  acc_t* exp_avg_sq_ptr = args.exp_avg_sq[table_id].data_ptr<acc_t>();
+  // row buffers for the update and, for split bf16 weight, the fp32 master
+  std::vector<acc_t> buffer(2 * emb_dim);
+  acc_t* update_buf = buffer.data();
+  acc_t* param_buf = buffer.data() + emb_dim;
+  auto emb_cache = ewc.cache();
+  for (auto& it : emb_cache) {
+    size_t idx = it.first;
+    acc_t* grad = it.second;
+    if constexpr (std::is_same<data_t, BFloat16>::value) {
+      pack_split_bf16_row(
+          param_buf,
+          &weight[idx * emb_dim],
+          &bf16_trail_ptr[idx * emb_dim],
+          emb_dim);
+      adam_update<acc_t>(
+          param_buf,
+          update_buf,
+          &exp_avg_ptr[idx * emb_dim],
+          &exp_avg_sq_ptr[idx * emb_dim],
+          grad,
+          args,
+          emb_dim);
+      unpack_split_bf16_row(
+          &weight[idx * emb_dim],
+          &bf16_trail_ptr[idx * emb_dim],
+          param_buf,
+          emb_dim);
+    } else {
+      adam_update<acc_t>(
+          &weight[idx * emb_dim],
+          update_buf,
+          &exp_avg_ptr[idx * emb_dim],
+          &exp_avg_sq_ptr[idx * emb_dim],
+          grad,
+          args,
+          emb_dim);
+    }
+  }
+}
+
 template <typename data_t, typename index_t, typename optimizer_arg_t>
 void merged_embeddingbag_backward_update(
     data_t** w_ptr,
@@ -975,18 +1142,18 @@ void mergedemb_distribute_backward_merge(
   }
 }
 
-template <typename acc_t, typename data_t>
-void mergedemb_distribute_adagrad_update(
+template <typename acc_t, typename data_t, typename optimizer_arg_t>
+void mergedemb_distribute_optimizer_update(
     std::vector<EmbeddingRowCache<acc_t>>& thdcache,
     data_t* weight_ptr,
     int64_t emb_dim,
-    AdaGradArgs args) {
+    const optimizer_arg_t& args) {
   RECORD_FUNCTION(__FUNCTION__, c10::ArrayRef<c10::IValue>({}));
 #pragma omp parallel shared(thdcache)
   {
     const int64_t thdidx = omp_get_thread_num();
     EmbeddingRowCache<acc_t>& cache = thdcache[thdidx];
-    EmbeddingGradUpdate<data_t, acc_t, AdaGradArgs>::update(
+    EmbeddingGradUpdate<data_t, acc_t, optimizer_arg_t>::update(
         weight_ptr, cache, args, /*table_id=*/0, emb_dim);
   }
 }
@@ -1025,10 +1192,78 @@ void mergedemb_distribute_backward_merge_adagrad_update_kernel_impl(
               // read from weight and accumuate in emb cache
               mergedemb_distribute_backward_merge<acc_t, scalar_t, index_t>(
                   cache, world_size, emb_dim, idx_ptr, val_ptr, ofs_ptr);
-              AdaGradArgs args =
-                  AdaGradArgs({weight_trail}, {hessian}, eps, lr);
+              // AdaGradArgs only holds TensorLists, keep the vectors they
+              // point to alive during the update
+              std::vector<Tensor> weight_trails{weight_trail};
+              std::vector<Tensor> hessians{hessian};
+              AdaGradArgs args = AdaGradArgs(weight_trails, hessians, eps, lr);
               scalar_t* weight_ptr = weight.data_ptr<scalar_t>();
-              mergedemb_distribute_adagrad_update<acc_t, scalar_t>(
+              mergedemb_distribute_optimizer_update<acc_t, scalar_t>(
+                  cache, weight_ptr, emb_dim, args);
+            });
+      });
+
+  return;
+}
+
+void mergedemb_distribute_backward_merge_adam_update_kernel_impl(
+    const TensorList& idx,
+    const TensorList& val,
+    const TensorList& ofs,
+    Tensor& weight,
+    Tensor& weight_trail,
+    Tensor& exp_avg,
+    Tensor& exp_avg_sq,
+    const int64_t step,
+    const double lr,
+    const double beta1,
+    const double beta2,
+    const double eps,
+    const double weight_decay,
+    const bool use_lamb) {
+  RECORD_FUNCTION(__FUNCTION__, c10::ArrayRef<c10::IValue>({}));
+  int64_t world_size = idx.size();
+  int64_t emb_dim = weight.size(1);
+  const int64_t num_thd = omp_get_max_threads();
+  AT_DISPATCH_FLOATING_TYPES_AND(
+      at::kBFloat16,
+      weight.scalar_type(),
+      "mergedemb_distribute_backward_merge",
+      [&] {
+        AT_DISPATCH_INDEX_TYPES(
+            idx[0].scalar_type(), "mergedemb_distribute_backward_merge", [&] {
+              using acc_t = acc_type<scalar_t, true>;
+              std::vector<EmbeddingRowCache<acc_t>> cache(num_thd);
+              index_t* idx_ptr[world_size];
+              scalar_t* val_ptr[world_size];
+              int64_t* ofs_ptr[world_size];
+              for (int i = 0; i < world_size; i++) {
+                idx_ptr[i] = idx[i].data_ptr<index_t>();
+                val_ptr[i] = val[i].data_ptr<scalar_t>();
+                ofs_ptr[i] = ofs[i].data_ptr<int64_t>();
+              }
+              // merge the received grads into the row cache, only the rows
+              // in the cache are updated
+              mergedemb_distribute_backward_merge<acc_t, scalar_t, index_t>(
+                  cache, world_size, emb_dim, idx_ptr, val_ptr, ofs_ptr);
+              // AdamArgs only holds TensorLists, keep the vectors they
+              // point to alive during the update
+              std::vector<Tensor> weight_trails{weight_trail};
+              std::vector<Tensor> exp_avgs{exp_avg};
+              std::vector<Tensor> exp_avg_sqs{exp_avg_sq};
+              AdamArgs args = AdamArgs(
+                  weight_trails,
+                  exp_avgs,
+                  exp_avg_sqs,
+                  step,
+                  lr,
+                  beta1,
+                  beta2,
+                  eps,
+                  weight_decay,
+                  use_lamb);
+              scalar_t* weight_ptr = weight.data_ptr<scalar_t>();
+              mergedemb_distribute_optimizer_update<acc_t, scalar_t>(
                   cache, weight_ptr, emb_dim, args);
             });
       });
@@ -1058,5 +1293,9 @@ IPEX_REGISTER_DISPATCH(
     mergedemb_distribute_backward_merge_adagrad_update_stub,
     &mergedemb_distribute_backward_merge_adagrad_update_kernel_impl);
 
+IPEX_REGISTER_DISPATCH(
+    mergedemb_distribute_backward_merge_adam_update_stub,
+    &mergedemb_distribute_backward_merge_adam_update_kernel_impl);
+
 } // namespace cpu
 } // namespace torch_ipex
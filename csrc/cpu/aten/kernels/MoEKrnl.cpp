@@ -9,13 +9,50 @@
 #include <torch/csrc/autograd/function.h>
 #include <torch/csrc/utils/python_symnode.h>
 #include <algorithm>
+#include <cstring>
 #include "tpp/kernels/TPPGEMMKrnl.h"
+#include "vec/vec.h"
+#ifdef USE_CCL
+#include <comm/messager.h>
+#endif
 
 namespace torch_ipex {
 namespace cpu {
 
 namespace {
 
+#ifdef USE_CCL
+// Whether the MoE outputs are reduced through the in-tree Messenger, set
+// with IPEX_MOE_ALLREDUCE_MESSENGER=1. It is only valid when the tensor
+// parallel group is the whole MPI world, so it is never used by default.
+bool use_messenger_all_reduce() {
+  static bool use_messenger = [] {
+    const char* env = getenv("IPEX_MOE_ALLREDUCE_MESSENGER");
+    return env != nullptr && atoi(env) != 0;
+  }();
+  return use_messenger;
+}
+#endif
+
+// Sums t_in over the tensor parallel ranks with the DeepSpeed all_reduce
+// registered from Python. With IPEX_MOE_ALLREDUCE_MESSENGER=1 the ranks
+// launched with MPI reduce through the CCL/SHM Messenger instead, without
+// taking the GIL.
+void moe_all_reduce(at::Tensor& t_in) {
+#ifdef USE_CCL
+  if (use_messenger_all_reduce() && Messenger::getInstance().getSize() > 1) {
+    Messenger::getInstance().reduceAdd(t_in);
+    return;
+  }
+#endif
+  py::gil_scoped_acquire acquire;
+  py::function allreduce = py::module_::import("torch")
+                               .attr("ops")
+                               .attr("deepspeed_comm")
+                               .attr("all_reduce");
+  allreduce(t_in);
+}
+
 at::Tensor mixtral_moe_tpp_kernl_impl(
     const at::Tensor& hidden_states,
     const at::Tensor& top_x,
@@ -45,15 +82,8 @@ at::Tensor mixtral_moe_tpp_kernl_impl(
     curr_state =
         tpp_linear_nobias_forward_cpu(curr_state, down_wei, c10::nullopt);
   }
-  if (is_distributed) {
-    py::gil_scoped_acquire acquire;
-    py::function allreduce = py::module_::import("torch")
-                                 .attr("ops")
-                                 .attr("deepspeed_comm")
-                                 .attr("all_reduce");
-    allreduce(curr_state);
-    py::gil_scoped_release release;
-  }
+  if (is_distributed)
+    moe_all_reduce(curr_state);
   curr_state = curr_state * routing_w;
   output.index_add_(0, top_x, curr_state.squeeze(0).to(hidden_states.dtype()));
 
@@ -97,15 +127,8 @@ at::Tensor mixtral_moe_kernl_impl(
         down_op_ctx,
         c10::nullopt);
   }
-  if (is_distributed) {
-    py::gil_scoped_acquire acquire;
-    py::function allreduce = py::module_::import("torch")
-                                 .attr("ops")
-                                 .attr("deepspeed_comm")
-                                 .attr("all_reduce");
-    allreduce(curr_state);
-    py::gil_scoped_release release;
-  }
+  if (is_distributed)
+    moe_all_reduce(curr_state);
   curr_state = curr_state * routing_w;
   output.index_add_(0, top_x, curr_state.squeeze(0).to(hidden_states.dtype()));
 
@@ -129,20 +152,405 @@ at::Tensor mixtral_moe_woq_kernl_impl(
           woq_linear_forward(curr_state, up_wei),
       down_wei);
 
-  if (is_distributed) {
-    py::gil_scoped_acquire acquire;
-    py::function allreduce = py::module_::import("torch")
-                                 .attr("ops")
-                                 .attr("deepspeed_comm")
-                                 .attr("all_reduce");
-    allreduce(curr_state);
-    py::gil_scoped_release release;
-  }
+  if (is_distributed)
+    moe_all_reduce(curr_state);
   curr_state = curr_state * routing_w;
   output.index_add_(0, top_x, curr_state.squeeze(0).to(hidden_states.dtype()));
 
   return output;
 }
+
+// Expert weights of fused_moe and fused_moe_ep, the op contexts are only
+// used by MOE_BACKEND_DNNL and MOE_BACKEND_MKL.
+struct MoEExperts {
+  const std::vector<at::Tensor>& gate_wei;
+  const std::vector<at::Tensor>& up_wei;
+  const std::vector<at::Tensor>& down_wei;
+  const std::vector<at::Tensor>& gate_op_ctx;
+  const std::vector<at::Tensor>& up_op_ctx;
+  const std::vector<at::Tensor>& down_op_ctx;
+  int64_t backend;
+};
+
+// Runs gate/up (fused with SiLU-mul) and down projections of expert e on the
+// rows of curr_state, with the GEMMs of the given MOE_BACKEND_*.
+at::Tensor fused_moe_expert_forward(
+    const at::Tensor& curr_state,
+    int64_t e,
+    const MoEExperts& experts) {
+  switch (experts.backend) {
+    case MOE_BACKEND_TPP:
+      return tpp_linear_nobias_forward_cpu(
+          tpp_fused_gate_up_proj_forward_cpu(
+              curr_state,
+              experts.gate_wei[e],
+              at::empty(0, curr_state.options()),
+              experts.up_wei[e],
+              at::empty(0, curr_state.options()),
+              c10::nullopt),
+          experts.down_wei[e],
+          c10::nullopt);
+    case MOE_BACKEND_TPP_FALLBACK:
+      return at::linear(
+          at::silu(at::linear(curr_state, experts.gate_wei[e])) *
+              at::linear(curr_state, experts.up_wei[e]),
+          experts.down_wei[e]);
+    case MOE_BACKEND_DNNL:
+      return ipex_linear(
+          at::silu(ipex_linear(
+              curr_state,
+              experts.gate_wei[e],
+              c10::nullopt,
+              experts.gate_op_ctx[e],
+              c10::nullopt)) *
+              ipex_linear(
+                  curr_state,
+                  experts.up_wei[e],
+                  c10::nullopt,
+                  experts.up_op_ctx[e],
+                  c10::nullopt),
+          experts.down_wei[e],
+          c10::nullopt,
+          experts.down_op_ctx[e],
+          c10::nullopt);
+    case MOE_BACKEND_MKL:
+      return mkl_sgemm_forward(
+          at::silu(mkl_sgemm_forward(
+              curr_state,
+              experts.gate_wei[e],
+              c10::nullopt,
+              experts.gate_op_ctx[e],
+              c10::nullopt)) *
+              mkl_sgemm_forward(
+                  curr_state,
+                  experts.up_wei[e],
+                  c10::nullopt,
+                  experts.up_op_ctx[e],
+                  c10::nullopt),
+          experts.down_wei[e],
+          c10::nullopt,
+          experts.down_op_ctx[e],
+          c10::nullopt);
+    default:
+      return woq_linear_forward(
+          at::silu(woq_linear_forward(curr_state, experts.gate_wei[e])) *
+              woq_linear_forward(curr_state, experts.up_wei[e]),
+          experts.down_wei[e]);
+  }
+}
+
+void fused_moe_check_ids(
+    const int64_t* ids,
+    int64_t num_pairs,
+    int64_t num_experts) {
+  for (int64_t i = 0; i < num_pairs; i++) {
+    TORCH_CHECK(
+        ids[i] >= 0 && ids[i] < num_experts,
+        "fused_moe: expert id ",
+        ids[i],
+        " out of range [0, ",
+        num_experts,
+        ")");
+  }
+}
+
+// Runs every expert on the rows of states routed to it: pair i is routed to
+// expert ids[i] and reads row rows[i] of states. Returns the outputs of the
+// experts, the result of pair i being row pair_rows[i] of the output of
+// expert ids[i].
+std::vector<at::Tensor> fused_moe_run_experts(
+    const at::Tensor& states,
+    const int64_t* ids,
+    const int64_t* rows,
+    int64_t num_pairs,
+    const MoEExperts& experts,
+    int64_t* pair_rows) {
+  int64_t num_experts = experts.gate_wei.size();
+  // Bucket the pairs by expert with one counting sort, the rows routed to
+  // expert e are sorted_rows[offsets[e], offsets[e + 1]).
+  std::vector<int64_t> offsets(num_experts + 1, 0);
+  for (int64_t i = 0; i < num_pairs; i++)
+    offsets[ids[i] + 1]++;
+  for (int64_t e = 0; e < num_experts; e++)
+    offsets[e + 1] += offsets[e];
+  auto sorted_rows = at::empty({num_pairs}, at::kLong);
+  int64_t* sorted_rows_ptr = sorted_rows.data_ptr<int64_t>();
+  std::vector<int64_t> fill(offsets.begin(), offsets.end() - 1);
+  for (int64_t i = 0; i < num_pairs; i++) {
+    int64_t e = ids[i];
+    pair_rows[i] = fill[e] - offsets[e];
+    sorted_rows_ptr[fill[e]++] = rows[i];
+  }
+
+  // The expert GEMMs are parallel themselves, so the experts run one after
+  // the other and only the routed rows are computed.
+  std::vector<at::Tensor> expert_out(num_experts);
+  for (int64_t e = 0; e < num_experts; e++) {
+    if (offsets[e + 1] == offsets[e])
+      continue;
+    auto expert_rows = sorted_rows.slice(0, offsets[e], offsets[e + 1]);
+    auto curr_state = states.index_select(0, expert_rows).unsqueeze(0);
+    expert_out[e] = fused_moe_expert_forward(curr_state, e, experts)
+                        .squeeze(0)
+                        .to(states.scalar_type())
+                        .contiguous();
+  }
+  return expert_out;
+}
+
+// Sums the expert outputs of every token weighted by its routing weights:
+// output[t] = sum_j topk_weights[t][j] * pair_out[t * top_k + j].
+template <typename T>
+void fused_moe_combine(
+    at::Tensor& output,
+    const std::vector<const T*>& pair_out,
+    const float* topk_weights,
+    int64_t num_tokens,
+    int64_t top_k,
+    int64_t hidden_size) {
+  using namespace torch_ipex::cpu::kernel;
+  T* out = output.data_ptr<T>();
+  at::parallel_for(0, num_tokens, 1, [&](int64_t start, int64_t end) {
+    std::vector<float> acc(hidden_size);
+    for (int64_t t = start; t < end; t++) {
+      zero_ker(acc.data(), hidden_size);
+      for (int64_t j = 0; j < top_k; j++) {
+        int64_t pair = t * top_k + j;
+        madd_ker(
+            acc.data(),
+            const_cast<T*>(pair_out[pair]),
+            hidden_size,
+            topk_weights[pair]);
+      }
+      move_ker(out + t * hidden_size, acc.data(), hidden_size);
+    }
+  });
+}
+
+at::Tensor fused_moe_kernl_impl(
+    const at::Tensor& hidden_states,
+    const at::Tensor& topk_ids,
+    const at::Tensor& topk_weights,
+    const std::vector<at::Tensor>& gate_wei,
+    const std::vector<at::Tensor>& up_wei,
+    const std::vector<at::Tensor>& down_wei,
+    const std::vector<at::Tensor>& gate_op_ctx,
+    const std::vector<at::Tensor>& up_op_ctx,
+    const std::vector<at::Tensor>& down_op_ctx,
+    int64_t backend,
+    bool is_distributed) {
+  int64_t num_tokens = hidden_states.size(0);
+  int64_t hidden_size = hidden_states.size(1);
+  int64_t top_k = topk_ids.size(1);
+  int64_t num_experts = gate_wei.size();
+  auto output = at::empty({num_tokens, hidden_size}, hidden_states.options());
+  if (num_tokens == 0)
+    return output;
+
+  auto ids = topk_ids.to(at::kLong).contiguous();
+  auto weights = topk_weights.to(at::kFloat).contiguous();
+  const int64_t* ids_ptr = ids.data_ptr<int64_t>();
+  int64_t num_pairs = num_tokens * top_k;
+  fused_moe_check_ids(ids_ptr, num_pairs, num_experts);
+
+  MoEExperts experts{
+      gate_wei, up_wei, down_wei, gate_op_ctx, up_op_ctx, down_op_ctx, backend};
+  std::vector<int64_t> rows(num_pairs), pair_rows(num_pairs);
+  for (int64_t i = 0; i < num_pairs; i++)
+    rows[i] = i / top_k;
+  auto expert_out = fused_moe_run_experts(
+      hidden_states,
+      ids_ptr,
+      rows.data(),
+      num_pairs,
+      experts,
+      pair_rows.data());
+
+  AT_DISPATCH_FLOATING_TYPES_AND2(
+      at::kBFloat16, at::kHalf, output.scalar_type(), "fused_moe", [&] {
+        std::vector<const scalar_t*> pair_out(num_pairs);
+        for (int64_t i = 0; i < num_pairs; i++) {
+          pair_out[i] = expert_out[ids_ptr[i]].data_ptr<scalar_t>() +
+              pair_rows[i] * hidden_size;
+        }
+        fused_moe_combine<scalar_t>(
+            output,
+            pair_out,
+            weights.data_ptr<float>(),
+            num_tokens,
+            top_k,
+            hidden_size);
+      });
+
+  // The expert outputs are partial sums under tensor parallelism, reduce the
+  // combined output once instead of once per expert.
+  if (is_distributed)
+    moe_all_reduce(output);
+  return output;
+}
+
+at::Tensor fused_moe_ep_kernl_impl(
+    const at::Tensor& hidden_states,
+    const at::Tensor& topk_ids,
+    const at::Tensor& topk_weights,
+    const std::vector<at::Tensor>& gate_wei,
+    const std::vector<at::Tensor>& up_wei,
+    const std::vector<at::Tensor>& down_wei,
+    const std::vector<at::Tensor>& gate_op_ctx,
+    const std::vector<at::Tensor>& up_op_ctx,
+    const std::vector<at::Tensor>& down_op_ctx,
+    int64_t backend,
+    int64_t num_experts) {
+#ifdef USE_CCL
+  auto& messenger = Messenger::getInstance();
+  int64_t rank = messenger.getRank();
+  int64_t world_size = messenger.getSize();
+  int64_t num_local_experts = gate_wei.size();
+  TORCH_CHECK(
+      num_local_experts * world_size == num_experts,
+      "fused_moe_ep: expect num_experts / world_size experts on every rank");
+  auto states = hidden_states.contiguous();
+  int64_t num_tokens = states.size(0);
+  int64_t hidden_size = states.size(1);
+  int64_t top_k = topk_ids.size(1);
+  int64_t num_pairs = num_tokens * top_k;
+  auto ids = topk_ids.to(at::kLong).contiguous();
+  auto weights = topk_weights.to(at::kFloat).contiguous();
+  const int64_t* ids_ptr = ids.data_ptr<int64_t>();
+  fused_moe_check_ids(ids_ptr, num_pairs, num_experts);
+  MoEExperts experts{
+      gate_wei, up_wei, down_wei, gate_op_ctx, up_op_ctx, down_op_ctx, backend};
+
+  // Bucket the pairs by the rank owning their expert. The pairs of remote
+  // experts are sent in rank order, send_pairs[s] being sent as row s.
+  std::vector<int64_t> send_splits(world_size, 0);
+  std::vector<int64_t> local_pairs, local_ids, local_rows;
+  for (int64_t i = 0; i < num_pairs; i++) {
+    int64_t owner = ids_ptr[i] / num_local_experts;
+    if (owner == rank) {
+      local_pairs.push_back(i);
+      local_ids.push_back(ids_ptr[i] - rank * num_local_experts);
+      local_rows.push_back(i / top_k);
+    } else {
+      send_splits[owner]++;
+    }
+  }
+  std::vector<int64_t> fill(world_size, 0);
+  for (int64_t r = 1; r < world_size; r++)
+    fill[r] = fill[r - 1] + send_splits[r - 1];
+  int64_t num_send = num_pairs - local_pairs.size();
+  std::vector<int64_t> send_pairs(num_send);
+  for (int64_t i = 0; i < num_pairs; i++) {
+    int64_t owner = ids_ptr[i] / num_local_experts;
+    if (owner != rank)
+      send_pairs[fill[owner]++] = i;
+  }
+
+  // Every sent row is the hidden state of the token followed by the id of
+  // the expert on its owner rank.
+  int64_t state_bytes = hidden_size * states.element_size();
+  int64_t row_bytes = state_bytes + sizeof(int64_t);
+  auto send = at::empty({num_send, row_bytes}, at::kByte);
+  uint8_t* send_ptr = send.data_ptr<uint8_t>();
+  const uint8_t* states_ptr = (const uint8_t*)states.data_ptr();
+  at::parallel_for(0, num_send, 1, [&](int64_t start, int64_t end) {
+    for (int64_t s = start; s < end; s++) {
+      int64_t pair = send_pairs[s];
+      int64_t expert = ids_ptr[pair] % num_local_experts;
+      uint8_t* row = send_ptr + s * row_bytes;
+      memcpy(row, states_ptr + pair / top_k * state_bytes, state_bytes);
+      memcpy(row + state_bytes, &expert, sizeof(int64_t));
+    }
+  });
+
+  // Exchange the tokens on the communication thread of the messenger, whose
+  // OpenMP team is small, while the local experts compute the pairs routed
+  // to them.
+  std::vector<int64_t> recv_splits;
+  at::Tensor recv;
+  auto dispatch =
+      messenger.alltoallvAsync(send, send_splits, recv_splits, recv);
+  std::vector<int64_t> local_pair_rows(local_pairs.size());
+  std::vector<at::Tensor> local_out;
+  try {
+    local_out = fused_moe_run_experts(
+        states,
+        local_ids.data(),
+        local_rows.data(),
+        local_pairs.size(),
+        experts,
+        local_pair_rows.data());
+  } catch (...) {
+    // recv_splits and recv must outlive the exchange.
+    messenger.wait(dispatch);
+    throw;
+  }
+  messenger.wait(dispatch);
+
+  int64_t num_recv = recv.size(0);
+  const uint8_t* recv_ptr = recv.data_ptr<uint8_t>();
+  auto recv_states = at::empty({num_recv, hidden_size}, states.options());
+  uint8_t* recv_states_ptr = (uint8_t*)recv_states.data_ptr();
+  std::vector<int64_t> recv_ids(num_recv), recv_rows(num_recv);
+  at::parallel_for(0, num_recv, 1, [&](int64_t start, int64_t end) {
+    for (int64_t r = start; r < end; r++) {
+      const uint8_t* row = recv_ptr + r * row_bytes;
+      memcpy(recv_states_ptr + r * state_bytes, row, state_bytes);
+      memcpy(&recv_ids[r], row + state_bytes, sizeof(int64_t));
+      recv_rows[r] = r;
+    }
+  });
+  std::vector<int64_t> recv_pair_rows(num_recv);
+  auto recv_out = fused_moe_run_experts(
+      recv_states,
+      recv_ids.data(),
+      recv_rows.data(),
+      num_recv,
+      experts,
+      recv_pair_rows.data());
+
+  // Return the results in the order the rows were received, so that they
+  // come back in the order they were sent.
+  auto results = at::empty({num_recv, hidden_size}, states.options());
+  uint8_t* results_ptr = (uint8_t*)results.data_ptr();
+  at::parallel_for(0, num_recv, 1, [&](int64_t start, int64_t end) {
+    for (int64_t r = start; r < end; r++) {
+      memcpy(
+          results_ptr + r * state_bytes,
+          (uint8_t*)recv_out[recv_ids[r]].data_ptr() +
+              recv_pair_rows[r] * state_bytes,
+          state_bytes);
+    }
+  });
+  std::vector<int64_t> back_splits;
+  auto back = messenger.alltoallv(results, recv_splits, back_splits);
+
+  auto output = at::empty({num_tokens, hidden_size}, states.options());
+  AT_DISPATCH_FLOATING_TYPES_AND2(
+      at::kBFloat16, at::kHalf, output.scalar_type(), "fused_moe_ep", [&] {
+        std::vector<const scalar_t*> pair_out(num_pairs);
+        for (size_t j = 0; j < local_pairs.size(); j++) {
+          pair_out[local_pairs[j]] =
+              local_out[local_ids[j]].data_ptr<scalar_t>() +
+              local_pair_rows[j] * hidden_size;
+        }
+        const scalar_t* back_ptr = back.data_ptr<scalar_t>();
+        for (int64_t s = 0; s < num_send; s++)
+          pair_out[send_pairs[s]] = back_ptr + s * hidden_size;
+        fused_moe_combine<scalar_t>(
+            output,
+            pair_out,
+            weights.data_ptr<float>(),
+            num_tokens,
+            top_k,
+            hidden_size);
+      });
+  return output;
+#else
+  TORCH_CHECK(false, "fused_moe_ep: USE_CCL is not enabled.");
+  return hidden_states;
+#endif
+}
 } // anonymous namespace
 
 IPEX_REGISTER_DISPATCH(
@@ -152,6 +560,8 @@ IPEX_REGISTER_DISPATCH(
     mixtral_moe_woq_kernel_stub,
     &mixtral_moe_woq_kernl_impl);
 IPEX_REGISTER_DISPATCH(mixtral_moe_kernel_stub, &mixtral_moe_kernl_impl);
+IPEX_REGISTER_DISPATCH(fused_moe_kernel_stub, &fused_moe_kernl_impl);
+IPEX_REGISTER_DISPATCH(fused_moe_ep_kernel_stub, &fused_moe_ep_kernl_impl);
 
 } // namespace cpu
 } // namespace torch_ipex
@@ -2,7 +2,9 @@
 #include <aten/PagedAttention.h>
 #include <torch/all.h>
 #include <torch/csrc/autograd/function.h>
+#include <algorithm>
 #include <limits>
+#include <vector>
 #include "vec/vec.h"
 
 namespace torch_ipex {
@@ -18,7 +20,7 @@ void reduce_head(
     int64_t head_size) {
   attn_w_pos[0] = 0;
 #if defined(CPU_CAPABILITY_AVX512)
-  torch_ipex::cpu::kernel::_reduce_head<QT, KT, KT>(
+  torch_ipex::cpu::kernel::_reduce_head<QT, KT, float>(
       q_ptr_start, k_cache_start, attn_w_pos, head_size, false, nullptr);
 #else
   for (auto hsi = 0; hsi < head_size; hsi++) {
@@ -37,7 +39,7 @@ inline void mul_attenion_weights_and_value_of_head(
   auto vec_size = 16; // 512/32
   auto hsi = 0;
 #if defined(CPU_CAPABILITY_AVX512)
-  torch_ipex::cpu::kernel::_mul_and_accumulate<CT, OT, CT>(
+  torch_ipex::cpu::kernel::_mul_and_accumulate<CT, OT, float>(
       attn_w,
       v_cache_start,
       attn_out_start,
@@ -57,7 +59,54 @@ inline void mul_attenion_weights_and_value_of_head(
 }
 
 /**
- * Performs scale-dot-product for the next token based on cached key-value
+ * Quantizes one head of key/value states with the scale of its cache block
+ * and stores it into a low precision (int8 or e4m3 fp8) cache slot.
+ */
+template <typename DST_T, typename SRC_T>
+inline void quantize_and_store(
+    DST_T* dst,
+    const SRC_T* src,
+    int64_t len,
+    float scale) {
+  auto inv_scale = scale == 0.0f ? 0.0f : 1.0f / scale;
+  for (auto i = 0; i < len; i++) {
+    auto val = (float)src[i] * inv_scale;
+    if constexpr (std::is_same_v<DST_T, int8_t>) {
+      dst[i] = (int8_t)std::max(-128.0f, std::min(127.0f, std::nearbyint(val)));
+    } else {
+      // values out of the e4m3fn range would be converted to NaN
+      dst[i] = (DST_T)std::max(-448.0f, std::min(448.0f, val));
+    }
+  }
+}
+
+void check_kv_cache_scales(
+    const at::Tensor& key_cache,
+    const at::Tensor& value_cache,
+    const c10::optional<at::Tensor>& k_scale,
+    const c10::optional<at::Tensor>& v_scale) {
+  TORCH_CHECK(
+      k_scale.has_value() && v_scale.has_value(),
+      "k_scale and v_scale are required by the int8/fp8 kv cache");
+  for (auto& cache_scale : {k_scale.value(), v_scale.value()}) {
+    TORCH_CHECK(
+        cache_scale.scalar_type() == at::ScalarType::Float &&
+            cache_scale.is_contiguous(),
+        "k_scale and v_scale should be contiguous float tensors");
+    TORCH_CHECK(
+        cache_scale.dim() == 2 && cache_scale.size(0) == key_cache.size(0) &&
+            cache_scale.size(1) == key_cache.size(2),
+        "k_scale and v_scale should have the shape of ",
+        "[num_blocks, num_kv_heads]");
+  }
+}
+
+// The number of context tokens handled by one task of the split-KV
+// (flash-decoding) kernel. It is rounded up to a multiple of block_size.
+constexpr int64_t PARTITION_SIZE = 512;
+
+/**
+ * Performs scale-dot-product for query tokens based on cached key-value
  * attention.
  *
  * This function computes the attention weights and applies the attention
@@ -66,8 +115,19 @@ inline void mul_attenion_weights_and_value_of_head(
  * lengths, block size, max context length, and optional alibi slopes. The
  * output tensor is updated with the computed attention values.
  *
- * @param out           Output tensor [num_seqs, num_heads, head_size].
- * @param query         Query tensor [num_seqs, num_heads, head_size].
+ * Every query row is a single query token. It belongs to the sequence
+ * row_seq_ids[row] and attends to the first context_lens[row] tokens of that
+ * sequence's cache, decoding uses one row per sequence. The query tokens of
+ * the prefill chunks take paged_attention_prefill_kernel instead.
+ *
+ * The context of every row is split into partitions of PARTITION_SIZE
+ * tokens which are processed in parallel with an online softmax. Each
+ * partition produces a partial (max, sum, acc) triple and the triples of one
+ * row/head are merged at the end, so neither a [num_rows, num_heads,
+ * max_context_len] score buffer nor per-thread private outputs are needed.
+ *
+ * @param out           Output tensor [num_rows, num_heads, head_size].
+ * @param query         Query tensor [num_rows, num_heads, head_size].
  * @param key_cache     The pre-allocated buffer to store the key cache. The
  * shape should be [num_blocks, block_size, num_heads, head_size].
  * @param value_cache   The pre-allocated buffer to store the value cache. The
@@ -78,15 +138,23 @@ inline void mul_attenion_weights_and_value_of_head(
  * @param scale         Scaling factor for attention weights. In general, it is:
  * float(1.0 / (head_size ** 0.5)).
  * @param block_tables  Block tables tensor [num_seqs, max_num_blocks_per_seq].
- * @param context_lens  Context lengths tensor [num_seqs].
+ * @param row_seq_ids   The sequence of every query row [num_rows].
+ * @param context_lens  Context lengths of every query row [num_rows].
  * @param block_size    The block size which means the number of token in every
  * block.
  * @param max_context_len Maximum context length.
  * @param alibi_slopes  Optional tensor of alibi slopes with the shape of
  * (num_heads).
+ * @param k_scale       Optional per-block/per-head dequantization scales of
+ * an int8/fp8 key cache with the shape of [num_blocks, num_kv_heads].
+ * @param v_scale       Optional per-block/per-head dequantization scales of
+ * an int8/fp8 value cache with the shape of [num_blocks, num_kv_heads].
+ * @param window_size   Sliding window size, a row only attends to its last
+ * window_size context tokens and the partitions before them are skipped.
+ * Disabled if <= 0.
  */
-template <typename scalar_t>
-void single_query_cached_kv_attention_kernel(
+template <typename scalar_t, typename cache_t>
+void paged_attention_kernel(
     at::Tensor& out,
     at::Tensor& query,
     at::Tensor& key_cache,
@@ -94,32 +162,37 @@ void single_query_cached_kv_attention_kernel(
     at::Tensor& head_mapping,
     const double scale,
     at::Tensor& block_tables,
+    at::Tensor& row_seq_ids,
     at::Tensor& context_lens,
     int64_t block_size,
     int64_t max_context_len,
-    const c10::optional<at::Tensor>& alibi_slopes) {
+    const c10::optional<at::Tensor>& alibi_slopes,
+    const c10::optional<at::Tensor>& k_scale,
+    const c10::optional<at::Tensor>& v_scale,
+    int64_t window_size) {
   auto out_ptr = out.data_ptr<scalar_t>();
   auto query_ptr = query.data_ptr<scalar_t>();
-  auto key_cache_ptr = key_cache.data_ptr<scalar_t>();
-  auto value_cache_ptr = value_cache.data_ptr<scalar_t>();
+  auto key_cache_ptr = key_cache.data_ptr<cache_t>();
+  auto value_cache_ptr = value_cache.data_ptr<cache_t>();
+  auto k_scale_ptr =
+      k_scale.has_value() ? k_scale.value().data_ptr<float>() : nullptr;
+  auto v_scale_ptr =
+      v_scale.has_value() ? v_scale.value().data_ptr<float>() : nullptr;
   auto head_mapping_ptr = head_mapping.data_ptr<int>();
   auto block_tables_ptr = block_tables.data_ptr<int>();
+  auto row_seq_ids_ptr = row_seq_ids.data_ptr<int>();
   auto context_lens_ptr = context_lens.data_ptr<int>();
   auto alibi_slopes_ptr = alibi_slopes.has_value()
       ? alibi_slopes.value().data_ptr<float>()
       : nullptr;
-  auto num_seqs = query.size(0);
+  auto num_rows = query.size(0);
   auto num_heads = query.size(1);
   auto head_size = query.size(2);
   auto num_kv_heads = key_cache.size(2);
   auto max_num_blocks_per_seq = block_tables.size(1);
-  auto attn_weights = at::empty(
-      {num_seqs, num_heads, max_context_len},
-      query.options().dtype(at::ScalarType::Float));
-  auto attn_weights_ptr = attn_weights.data_ptr<float>();
   auto kv_block_stride = key_cache.stride(0);
   auto q_stride = query.stride(0);
-  auto attn_weights_stride = attn_weights.stride(0);
+  auto out_stride = out.stride(0);
 
   if (alibi_slopes.has_value()) {
     auto alibi_slopes_size = alibi_slopes.value().size(0);
@@ -128,164 +201,161 @@ void single_query_cached_kv_attention_kernel(
         "alibi_slopes size is not equal to num_heads");
   }
 
+  auto partition_size =
+      (PARTITION_SIZE + block_size - 1) / block_size * block_size;
+  auto max_num_partitions =
+      (max_context_len + partition_size - 1) / partition_size;
+  // partial results of every partition, merged in the reduction below
+  auto partial_outs = at::empty(
+      {num_rows, num_heads, max_num_partitions, head_size}, at::kFloat);
+  auto partial_max =
+      at::empty({num_rows, num_heads, max_num_partitions}, at::kFloat);
+  auto partial_sum =
+      at::empty({num_rows, num_heads, max_num_partitions}, at::kFloat);
+  auto partial_outs_ptr = partial_outs.data_ptr<float>();
+  auto partial_max_ptr = partial_max.data_ptr<float>();
+  auto partial_sum_ptr = partial_sum.data_ptr<float>();
+  // scores of the partition under processing, one row per thread
+  auto thread_numbers = omp_get_max_threads();
+  auto attn_weights = at::empty({thread_numbers, partition_size}, at::kFloat);
+  auto attn_weights_ptr = attn_weights.data_ptr<float>();
+
 #pragma omp parallel for collapse(3)
-  for (auto seq_id = 0; seq_id < num_seqs; seq_id++) {
+  for (auto row_id = 0; row_id < num_rows; row_id++) {
     for (auto head_id = 0; head_id < num_heads; head_id++) {
-      for (auto token_id = 0; token_id < max_context_len; token_id++) {
-        auto context_len = context_lens_ptr[seq_id];
-        if (token_id >= context_len)
+      for (auto partition_id = 0; partition_id < max_num_partitions;
+           partition_id++) {
+        auto context_len = context_lens_ptr[row_id];
+        auto window_start = window_size > 0
+            ? std::max<int64_t>(context_len - window_size, 0)
+            : 0;
+        auto token_start = partition_id * partition_size;
+        // skip the partitions out of the context or the sliding window
+        if (token_start >= context_len ||
+            token_start + partition_size <= window_start)
           continue;
-        auto attn_w_pos = attn_weights_ptr + seq_id * attn_weights_stride +
-            head_id * max_context_len + token_id;
-        auto q_ptr_start = query_ptr + seq_id * q_stride + head_id * head_size;
-        auto block_id = block_tables_ptr
-            [seq_id * max_num_blocks_per_seq + token_id / block_size];
-        auto block_offset = token_id % block_size;
-        auto k_cache_start = key_cache_ptr + block_id * kv_block_stride +
-            block_offset * num_kv_heads * head_size +
-            head_mapping_ptr[head_id] * head_size;
-        reduce_head<scalar_t, scalar_t>(
-            q_ptr_start, k_cache_start, attn_w_pos, head_size);
-      }
-    }
-  }
-
-// div+add+softmax
-#pragma omp parallel for collapse(2)
-  for (auto seq_id = 0; seq_id < num_seqs; seq_id++) {
-    for (auto head_id = 0; head_id < num_heads; head_id++) {
-      auto max_val = -10000.0f;
-      float sum = 0.0f;
-      auto context_len = context_lens_ptr[seq_id];
-      auto attn_w_start = attn_weights_ptr + seq_id * attn_weights_stride +
-          head_id * max_context_len;
+        auto token_end =
+            std::min<int64_t>(token_start + partition_size, context_len);
+        token_start = std::max<int64_t>(token_start, window_start);
+        auto partition_len = token_end - token_start;
+        auto attn_w_start =
+            attn_weights_ptr + omp_get_thread_num() * partition_size;
+        auto q_ptr_start = query_ptr + row_id * q_stride + head_id * head_size;
+        auto kv_head_id = head_mapping_ptr[head_id];
+        auto kv_head_offset = kv_head_id * head_size;
+        auto block_table_start =
+            block_tables_ptr + row_seq_ids_ptr[row_id] * max_num_blocks_per_seq;
+        auto alibi_slope =
+            alibi_slopes_ptr != nullptr ? alibi_slopes_ptr[head_id] : 0.0f;
+        // qk + scale + alibi
+        auto max_val = std::numeric_limits<float>::lowest();
+        for (auto token_id = token_start; token_id < token_end; token_id++) {
+          auto block_id = block_table_start[token_id / block_size];
+          auto block_offset = token_id % block_size;
+          auto k_cache_start = key_cache_ptr + block_id * kv_block_stride +
+              block_offset * num_kv_heads * head_size + kv_head_offset;
+          auto attn_w_pos = attn_w_start + token_id - token_start;
+          reduce_head<scalar_t, cache_t>(
+              q_ptr_start, k_cache_start, attn_w_pos, head_size);
+          // the dequantization of the key is folded into the scale
+          auto attn_scale = k_scale_ptr != nullptr
+              ? scale * k_scale_ptr[block_id * num_kv_heads + kv_head_id]
+              : scale;
+          attn_w_pos[0] = attn_w_pos[0] * attn_scale;
+          if (alibi_slopes_ptr != nullptr) {
+            attn_w_pos[0] += alibi_slope * (token_id + 1 - context_len);
+          }
+          max_val = std::max(max_val, attn_w_pos[0]);
+        }
+        // exp and sum, normalized against the partition-local max
+        float sum = 0.0f;
 #if defined(CPU_CAPABILITY_AVX512)
-      if (alibi_slopes_ptr != nullptr) {
-        auto alibi_slope = alibi_slopes_ptr[head_id];
-        torch_ipex::cpu::kernel::
-            _dil_div_add_alibi_and_reduce_max_fusion_kernel<float>(
-                attn_w_start,
-                scale,
-                context_len,
-                attn_w_start,
-                max_val,
-                alibi_slope,
-                true);
-      } else {
-        torch_ipex::cpu::kernel::
-            _dil_div_add_alibi_and_reduce_max_fusion_kernel<float>(
-                attn_w_start,
-                scale,
-                context_len,
-                attn_w_start,
-                max_val,
-                1,
-                false);
-      }
-      torch_ipex::cpu::kernel::_dil_exp_reduce_sum_fusion_kernel(
-          attn_w_start, context_len, attn_w_start, max_val);
-      torch_ipex::cpu::kernel::_dil_normalization_kernel<float>(
-          attn_w_start, max_val, context_len, attn_w_start);
-
+        sum = max_val;
+        torch_ipex::cpu::kernel::_dil_exp_reduce_sum_fusion_kernel(
+            attn_w_start, partition_len, attn_w_start, sum);
 #else
-      // div+add+softmax
-      for (auto token_id = 0; token_id < context_lens_ptr[seq_id]; token_id++) {
-        attn_w_start[token_id] = attn_w_start[token_id] * scale;
-        if (alibi_slopes_ptr != nullptr) {
-          auto alibi_slope = alibi_slopes_ptr[head_id];
-          auto alibi_slopes_val =
-              alibi_slope * (token_id + 1 - context_lens_ptr[seq_id]);
-          attn_w_start[token_id] = attn_w_start[token_id] + alibi_slopes_val;
-        }
-        if (attn_w_start[token_id] > max_val) {
-          max_val = attn_w_start[token_id];
+        for (auto i = 0; i < partition_len; i++) {
+          attn_w_start[i] = exp(attn_w_start[i] - max_val);
+          sum += attn_w_start[i];
         }
-      }
-      // exp and sum
-      for (auto token_id = 0; token_id < context_lens_ptr[seq_id]; token_id++) {
-        attn_w_start[token_id] = exp(attn_w_start[token_id] - max_val);
-        sum += attn_w_start[token_id];
-      }
-      // normalize
-      for (auto token_id = 0; token_id < context_lens_ptr[seq_id]; token_id++) {
-        attn_w_start[token_id] = attn_w_start[token_id] / sum;
-      }
 #endif
-    }
-  }
-
-  auto thread_numbers = omp_get_max_threads();
-  auto private_attn_outs =
-      at::empty({thread_numbers, num_seqs, num_heads, head_size}, at::kFloat);
-  auto private_attn_out_flag =
-      at::zeros({thread_numbers, num_seqs, num_heads}, at::kByte);
-  auto flag_access = private_attn_out_flag.accessor<uint8_t, 3>();
-  auto private_attn_out_ptr = private_attn_outs.data_ptr<float>();
-  auto private_attn_out_stride = private_attn_outs.stride(0);
-// mul and accumulate
-#pragma omp parallel for collapse(3)
-  for (auto seq_id = 0; seq_id < num_seqs; seq_id++) {
-    for (auto head_id = 0; head_id < num_heads; head_id++) {
-      for (auto token_id = 0; token_id < max_context_len; token_id++) {
-        auto context_len = context_lens_ptr[seq_id];
-        auto thread_id = omp_get_thread_num();
-        if (token_id >= context_len)
-          continue;
-        auto attn_w = attn_weights_ptr
-            [seq_id * attn_weights_stride + head_id * max_context_len +
-             token_id];
-        auto block_id = block_tables_ptr
-            [seq_id * max_num_blocks_per_seq + token_id / block_size];
-        auto block_offset = token_id % block_size;
-        auto v_cache_start = value_cache_ptr + block_id * kv_block_stride +
-            block_offset * num_kv_heads * head_size +
-            head_mapping_ptr[head_id] * head_size;
-        auto attn_out_start = private_attn_out_ptr +
-            thread_id * private_attn_out_stride + seq_id * q_stride +
-            head_id * head_size;
-        mul_attenion_weights_and_value_of_head<float, scalar_t>(
-            attn_w,
-            v_cache_start,
-            attn_out_start,
-            head_size,
-            flag_access[thread_id][seq_id][head_id]);
-        if (flag_access[thread_id][seq_id][head_id] == 0) {
-          flag_access[thread_id][seq_id][head_id] = 1;
+        // mul and accumulate
+        auto partial_idx =
+            (row_id * num_heads + head_id) * max_num_partitions + partition_id;
+        auto attn_out_start = partial_outs_ptr + partial_idx * head_size;
+        for (auto token_id = token_start; token_id < token_end; token_id++) {
+          auto block_id = block_table_start[token_id / block_size];
+          auto block_offset = token_id % block_size;
+          auto v_cache_start = value_cache_ptr + block_id * kv_block_stride +
+              block_offset * num_kv_heads * head_size + kv_head_offset;
+          auto attn_w = attn_w_start[token_id - token_start];
+          if (v_scale_ptr != nullptr) {
+            attn_w *= v_scale_ptr[block_id * num_kv_heads + kv_head_id];
+          }
+          mul_attenion_weights_and_value_of_head<float, cache_t>(
+              attn_w,
+              v_cache_start,
+              attn_out_start,
+              head_size,
+              token_id != token_start);
         }
-      } // for token_id
+        partial_max_ptr[partial_idx] = max_val;
+        partial_sum_ptr[partial_idx] = sum;
+      } // for partition_id
     } // for head_id
-  } // for seq_id
+  } // for row_id
+
   {
     RECORD_FUNCTION(
-        "ipex::single_query_cached_kv_attention::reduction_private_result",
+        "ipex::paged_attention::reduction_partitions",
         c10::ArrayRef<c10::IValue>({}));
 #pragma omp parallel for collapse(2)
-    for (auto seq_id = 0; seq_id < num_seqs; seq_id++) {
-      for (auto hi = 0; hi < num_heads; hi++) {
-        auto thr0_head_start =
-            private_attn_out_ptr + (seq_id * num_heads + hi) * head_size;
-        if (flag_access[0][seq_id][hi] == 0) {
-          torch_ipex::cpu::kernel::zero_ker(thr0_head_start, head_size);
+    for (auto row_id = 0; row_id < num_rows; row_id++) {
+      for (auto head_id = 0; head_id < num_heads; head_id++) {
+        auto context_len = context_lens_ptr[row_id];
+        auto window_start = window_size > 0
+            ? std::max<int64_t>(context_len - window_size, 0)
+            : 0;
+        auto first_partition = window_start / partition_size;
+        auto num_partitions =
+            (context_len + partition_size - 1) / partition_size -
+            first_partition;
+        auto out_start = out_ptr + row_id * out_stride + head_id * head_size;
+        if (num_partitions == 0) {
+          torch_ipex::cpu::kernel::zero_ker(out_start, head_size);
+          continue;
         }
-        for (auto thread_id = 1; thread_id < thread_numbers; thread_id++) {
-          if (flag_access[thread_id][seq_id][hi] == 0) {
-            continue;
-          }
-          auto attn_out_head_stride = thread_id * private_attn_out_stride +
-              (seq_id * num_heads + hi) * head_size;
-          auto private_attn_out_start =
-              private_attn_out_ptr + attn_out_head_stride;
-          torch_ipex::cpu::kernel::add_ker<float, float>(
-              thr0_head_start, private_attn_out_start, head_size);
+        auto partial_start =
+            (row_id * num_heads + head_id) * max_num_partitions +
+            first_partition;
+        auto max_start = partial_max_ptr + partial_start;
+        auto sum_start = partial_sum_ptr + partial_start;
+        auto acc_start = partial_outs_ptr + partial_start * head_size;
+        auto global_max = std::numeric_limits<float>::lowest();
+        for (auto p = 0; p < num_partitions; p++) {
+          global_max = std::max(global_max, max_start[p]);
+        }
+        float global_sum = 0.0f;
+        for (auto p = 0; p < num_partitions; p++) {
+          // turn the partial max into the rescale factor of its partition
+          max_start[p] = exp(max_start[p] - global_max);
+          global_sum += max_start[p] * sum_start[p];
+        }
+        // the accumulator of the first partition holds the merged result
+        for (auto p = 0; p < num_partitions; p++) {
+          mul_attenion_weights_and_value_of_head<float, float>(
+              max_start[p] / global_sum,
+              acc_start + p * head_size,
+              acc_start,
+              head_size,
+              p != 0);
         }
-        auto out_start = out_ptr + (seq_id * num_heads + hi) * head_size;
         torch_ipex::cpu::kernel::move_ker<scalar_t, float>(
-            out_start, thr0_head_start, head_size);
+            out_start, acc_start, head_size);
       }
     }
   }
-
-} // single_query_cached_kv_attention_kernel
+} // paged_attention_kernel
 
 /**
  * Reshapes and caches the key and value tensors based on the provided slot
@@ -306,6 +376,11 @@ void single_query_cached_kv_attention_kernel(
  * sequences. For sequence i, the slot_mapping[i]//block_number can get the
  * block index, and the slot_mapping%block_size can get the offset of this
  * block.
+ * @param k_scale Optional scales of an int8/fp8 key cache with the shape of
+ * [num_blocks, num_kv_heads]. The key is quantized with the scale of the block
+ * it is stored into.
+ * @param v_scale Optional scales of an int8/fp8 value cache with the shape of
+ * [num_blocks, num_kv_heads].
  *
  * @tparam DST_T The data type of the output tensors.
  * @tparam SRC_T The data type of the input tensors.
@@ -316,7 +391,9 @@ void reshape_and_cache_kernel(
     at::Tensor& value,
     at::Tensor& key_cache,
     at::Tensor& value_cache,
-    at::Tensor& slot_mapping) {
+    at::Tensor& slot_mapping,
+    const c10::optional<at::Tensor>& k_scale,
+    const c10::optional<at::Tensor>& v_scale) {
   auto num_tokens = key.size(0);
   auto head_num = key.size(1);
   auto head_size = key.size(2);
@@ -327,6 +404,10 @@ void reshape_and_cache_kernel(
   auto value_cache_ptr = value_cache.data_ptr<DST_T>();
   auto value_ptr = value.data_ptr<SRC_T>();
   auto slot_mapping_ptr = slot_mapping.data_ptr<int>();
+  auto k_scale_ptr =
+      k_scale.has_value() ? k_scale.value().data_ptr<float>() : nullptr;
+  auto v_scale_ptr =
+      v_scale.has_value() ? v_scale.value().data_ptr<float>() : nullptr;
   auto cache_stride = key_cache.stride(0);
   auto state_stride = key.stride(0);
 #pragma omp parallel for collapse(2)
@@ -341,14 +422,328 @@ void reshape_and_cache_kernel(
       auto key_ptr_start = key_ptr + state_offset;
       auto value_cache_start = value_cache_ptr + cache_offset;
       auto value_ptr_start = value_ptr + state_offset;
-      torch_ipex::cpu::kernel::move_ker<DST_T, SRC_T>(
-          key_cache_start, key_ptr_start, head_size);
-      torch_ipex::cpu::kernel::move_ker<DST_T, SRC_T>(
-          value_cache_start, value_ptr_start, head_size);
+      if constexpr (std::is_same_v<DST_T, SRC_T>) {
+        torch_ipex::cpu::kernel::move_ker<DST_T, SRC_T>(
+            key_cache_start, key_ptr_start, head_size);
+        torch_ipex::cpu::kernel::move_ker<DST_T, SRC_T>(
+            value_cache_start, value_ptr_start, head_size);
+      } else {
+        auto scale_offset = block_id * head_num + hi;
+        quantize_and_store<DST_T, SRC_T>(
+            key_cache_start,
+            key_ptr_start,
+            head_size,
+            k_scale_ptr[scale_offset]);
+        quantize_and_store<DST_T, SRC_T>(
+            value_cache_start,
+            value_ptr_start,
+            head_size,
+            v_scale_ptr[scale_offset]);
+      }
     }
   }
 }
 
+// Calls kernel(scalar_t(), cache_t(), k_scale, v_scale) with the q/k/v
+// data type and the kv cache data type, the scales are only passed for the
+// int8/fp8 caches.
+template <typename scalar_t, typename F>
+void paged_attention_cache_dispatch(
+    at::Tensor& key_cache,
+    at::Tensor& value_cache,
+    const c10::optional<at::Tensor>& k_scale,
+    const c10::optional<at::Tensor>& v_scale,
+    const F& kernel) {
+  if (key_cache.scalar_type() == c10::CppTypeToScalarType<scalar_t>::value) {
+    kernel(scalar_t(), scalar_t(), c10::nullopt, c10::nullopt);
+  } else if (key_cache.scalar_type() == at::ScalarType::Char) {
+    check_kv_cache_scales(key_cache, value_cache, k_scale, v_scale);
+    kernel(scalar_t(), int8_t(), k_scale, v_scale);
+  } else if (key_cache.scalar_type() == at::ScalarType::Float8_e4m3fn) {
+    check_kv_cache_scales(key_cache, value_cache, k_scale, v_scale);
+    kernel(scalar_t(), at::Float8_e4m3fn(), k_scale, v_scale);
+  } else {
+    TORCH_CHECK(false, "Unsupported kv cache data type for paged attention");
+  }
+}
+
+template <typename F>
+void paged_attention_dispatch(
+    at::Tensor& out,
+    at::Tensor& key_cache,
+    at::Tensor& value_cache,
+    const c10::optional<at::Tensor>& k_scale,
+    const c10::optional<at::Tensor>& v_scale,
+    const F& kernel) {
+  TORCH_CHECK(
+      key_cache.scalar_type() == value_cache.scalar_type(),
+      "key_cache and value_cache should have the same data type");
+  // dispatch kernel according to the data type of input tensor
+  if (out.scalar_type() == at::ScalarType::Float) {
+    paged_attention_cache_dispatch<float>(
+        key_cache, value_cache, k_scale, v_scale, kernel);
+  } else if (out.scalar_type() == at::ScalarType::BFloat16) {
+    paged_attention_cache_dispatch<at::BFloat16>(
+        key_cache, value_cache, k_scale, v_scale, kernel);
+  } else {
+    TORCH_CHECK(false, "Unsupported data type for paged attention");
+  }
+}
+
+// Runs paged_attention_kernel on the single query rows of row_seq_ids.
+void paged_attention_rows(
+    at::Tensor& out,
+    at::Tensor& query,
+    at::Tensor& key_cache,
+    at::Tensor& value_cache,
+    at::Tensor& head_mapping,
+    const double scale,
+    at::Tensor& block_tables,
+    at::Tensor& row_seq_ids,
+    at::Tensor& context_lens,
+    int64_t block_size,
+    int64_t max_context_len,
+    const c10::optional<at::Tensor>& alibi_slopes,
+    const c10::optional<at::Tensor>& k_scale,
+    const c10::optional<at::Tensor>& v_scale,
+    int64_t window_size) {
+  paged_attention_dispatch(
+      out,
+      key_cache,
+      value_cache,
+      k_scale,
+      v_scale,
+      [&](auto scalar, auto cache, const auto& ks, const auto& vs) {
+        using scalar_t = decltype(scalar);
+        using cache_t = decltype(cache);
+        paged_attention_kernel<scalar_t, cache_t>(
+            out,
+            query,
+            key_cache,
+            value_cache,
+            head_mapping,
+            scale,
+            block_tables,
+            row_seq_ids,
+            context_lens,
+            block_size,
+            max_context_len,
+            alibi_slopes,
+            ks,
+            vs,
+            window_size);
+      });
+}
+
+// A tile of consecutive query tokens of one sequence. The query token at
+// pos_start + i is row row_start + i of the query.
+struct QueryTile {
+  int64_t seq_id;
+  int64_t row_start;
+  int64_t num_rows;
+  int64_t pos_start;
+  int64_t context_len;
+};
+
+// The number of query tokens of a prefill sequence that share the key/value
+// loads of the cache in paged_attention_prefill_kernel.
+constexpr int64_t Q_TILE_SIZE = 32;
+
+/**
+ * Performs scale-dot-product for the query tiles of the prefill chunks
+ * against the paged key-value cache.
+ *
+ * Every task takes a query tile and a head, and walks the visible context of
+ * the tile in partitions of PARTITION_SIZE tokens with an online softmax.
+ * Every key/value of a partition is loaded once for all the rows of the
+ * tile, and the scores, max, sum and accumulators of the tile live in the
+ * buffer of the thread, so the scratch doesn't grow with the number of query
+ * tokens or the context length.
+ *
+ * Query row i of a tile attends to the first pos_start + i + 1 tokens of its
+ * sequence if is_causal, to the whole context_len tokens otherwise, within
+ * the sliding window of its last token. The other arguments are the same as
+ * paged_attention_kernel.
+ */
+template <typename scalar_t, typename cache_t>
+void paged_attention_prefill_kernel(
+    at::Tensor& out,
+    at::Tensor& query,
+    at::Tensor& key_cache,
+    at::Tensor& value_cache,
+    at::Tensor& head_mapping,
+    const double scale,
+    at::Tensor& block_tables,
+    const std::vector<QueryTile>& tiles,
+    int64_t block_size,
+    bool is_causal,
+    const c10::optional<at::Tensor>& alibi_slopes,
+    const c10::optional<at::Tensor>& k_scale,
+    const c10::optional<at::Tensor>& v_scale,
+    int64_t window_size) {
+  auto out_ptr = out.data_ptr<scalar_t>();
+  auto query_ptr = query.data_ptr<scalar_t>();
+  auto key_cache_ptr = key_cache.data_ptr<cache_t>();
+  auto value_cache_ptr = value_cache.data_ptr<cache_t>();
+  auto k_scale_ptr =
+      k_scale.has_value() ? k_scale.value().data_ptr<float>() : nullptr;
+  auto v_scale_ptr =
+      v_scale.has_value() ? v_scale.value().data_ptr<float>() : nullptr;
+  auto head_mapping_ptr = head_mapping.data_ptr<int>();
+  auto block_tables_ptr = block_tables.data_ptr<int>();
+  auto alibi_slopes_ptr = alibi_slopes.has_value()
+      ? alibi_slopes.value().data_ptr<float>()
+      : nullptr;
+  int64_t num_tiles = tiles.size();
+  int64_t num_heads = query.size(1);
+  int64_t head_size = query.size(2);
+  auto num_kv_heads = key_cache.size(2);
+  auto max_num_blocks_per_seq = block_tables.size(1);
+  auto kv_block_stride = key_cache.stride(0);
+  auto q_stride = query.stride(0);
+  auto out_stride = out.stride(0);
+  if (alibi_slopes.has_value()) {
+    TORCH_CHECK(
+        alibi_slopes.value().size(0) == num_heads,
+        "alibi_slopes size is not equal to num_heads");
+  }
+
+  auto partition_size =
+      (PARTITION_SIZE + block_size - 1) / block_size * block_size;
+  // per thread: scores, accumulators, max and sum of the rows of a tile
+  auto size_per_thread = Q_TILE_SIZE * (partition_size + head_size + 2);
+  auto thread_numbers = omp_get_max_threads();
+  auto buf = at::empty({thread_numbers, size_per_thread}, at::kFloat);
+  auto buf_ptr = buf.data_ptr<float>();
+
+#pragma omp parallel for collapse(2) schedule(dynamic)
+  for (int64_t tile_id = 0; tile_id < num_tiles; tile_id++) {
+    for (int64_t head_id = 0; head_id < num_heads; head_id++) {
+      const auto& tile = tiles[tile_id];
+      auto num_rows = tile.num_rows;
+      auto attn_w = buf_ptr + omp_get_thread_num() * size_per_thread;
+      auto acc = attn_w + Q_TILE_SIZE * partition_size;
+      auto row_max = acc + Q_TILE_SIZE * head_size;
+      auto row_sum = row_max + Q_TILE_SIZE;
+      auto kv_head_id = head_mapping_ptr[head_id];
+      auto kv_head_offset = kv_head_id * head_size;
+      auto block_table_start =
+          block_tables_ptr + tile.seq_id * max_num_blocks_per_seq;
+      auto alibi_slope =
+          alibi_slopes_ptr != nullptr ? alibi_slopes_ptr[head_id] : 0.0f;
+      // the visible context of row i is [row_begin(i), row_end(i))
+      auto row_end = [&](int64_t i) {
+        return is_causal ? tile.pos_start + i + 1 : tile.context_len;
+      };
+      auto row_begin = [&](int64_t i) {
+        return window_size > 0 ? std::max<int64_t>(row_end(i) - window_size, 0)
+                               : 0;
+      };
+      auto q_ptr_start =
+          query_ptr + tile.row_start * q_stride + head_id * head_size;
+      for (auto i = 0; i < num_rows; i++) {
+        row_max[i] = std::numeric_limits<float>::lowest();
+        row_sum[i] = 0.0f;
+      }
+      torch_ipex::cpu::kernel::zero_ker(acc, num_rows * head_size);
+      auto tile_end = row_end(num_rows - 1);
+      for (auto token_start = row_begin(0); token_start < tile_end;
+           token_start += partition_size) {
+        auto token_end =
+            std::min<int64_t>(token_start + partition_size, tile_end);
+        auto partition_len = token_end - token_start;
+        // qk + scale + alibi, every key is loaded once for the tile
+        for (auto token_id = token_start; token_id < token_end; token_id++) {
+          auto block_id = block_table_start[token_id / block_size];
+          auto block_offset = token_id % block_size;
+          auto k_cache_start = key_cache_ptr + block_id * kv_block_stride +
+              block_offset * num_kv_heads * head_size + kv_head_offset;
+          // the dequantization of the key is folded into the scale
+          auto attn_scale = k_scale_ptr != nullptr
+              ? scale * k_scale_ptr[block_id * num_kv_heads + kv_head_id]
+              : scale;
+          for (auto i = 0; i < num_rows; i++) {
+            auto attn_w_pos =
+                attn_w + i * partition_size + token_id - token_start;
+            if (token_id < row_begin(i) || token_id >= row_end(i)) {
+              attn_w_pos[0] = std::numeric_limits<float>::lowest();
+              continue;
+            }
+            reduce_head<scalar_t, cache_t>(
+                q_ptr_start + i * q_stride,
+                k_cache_start,
+                attn_w_pos,
+                head_size);
+            attn_w_pos[0] = attn_w_pos[0] * attn_scale;
+            if (alibi_slopes_ptr != nullptr) {
+              attn_w_pos[0] += alibi_slope * (token_id + 1 - row_end(i));
+            }
+          }
+        }
+        // online softmax: rescale the rows to the new max, then exp and sum
+        for (auto i = 0; i < num_rows; i++) {
+          auto attn_w_row = attn_w + i * partition_size;
+          auto begin = std::max(row_begin(i), token_start) - token_start;
+          auto end = std::min(row_end(i), token_end) - token_start;
+          if (begin >= end) {
+            torch_ipex::cpu::kernel::zero_ker(attn_w_row, partition_len);
+            continue;
+          }
+          auto max_val = row_max[i];
+          for (auto j = begin; j < end; j++) {
+            max_val = std::max(max_val, attn_w_row[j]);
+          }
+          auto correction = exp(row_max[i] - max_val);
+          row_max[i] = max_val;
+          row_sum[i] *= correction;
+          auto acc_row = acc + i * head_size;
+          for (auto hsi = 0; hsi < head_size; hsi++) {
+            acc_row[hsi] *= correction;
+          }
+          // the masked scores underflow to 0
+          for (auto j = 0; j < partition_len; j++) {
+            attn_w_row[j] = exp(attn_w_row[j] - max_val);
+            row_sum[i] += attn_w_row[j];
+          }
+        }
+        // mul and accumulate, every value is loaded once for the tile
+        for (auto token_id = token_start; token_id < token_end; token_id++) {
+          auto block_id = block_table_start[token_id / block_size];
+          auto block_offset = token_id % block_size;
+          auto v_cache_start = value_cache_ptr + block_id * kv_block_stride +
+              block_offset * num_kv_heads * head_size + kv_head_offset;
+          auto v_scale = v_scale_ptr != nullptr
+              ? v_scale_ptr[block_id * num_kv_heads + kv_head_id]
+              : 1.0f;
+          for (auto i = 0; i < num_rows; i++) {
+            auto w = attn_w[i * partition_size + token_id - token_start];
+            if (w == 0.0f) {
+              continue;
+            }
+            mul_attenion_weights_and_value_of_head<float, cache_t>(
+                w * v_scale,
+                v_cache_start,
+                acc + i * head_size,
+                head_size,
+                true);
+          }
+        }
+      }
+      for (auto i = 0; i < num_rows; i++) {
+        auto out_start =
+            out_ptr + (tile.row_start + i) * out_stride + head_id * head_size;
+        auto acc_row = acc + i * head_size;
+        auto inv_sum = row_sum[i] > 0.0f ? 1.0f / row_sum[i] : 0.0f;
+        for (auto hsi = 0; hsi < head_size; hsi++) {
+          acc_row[hsi] *= inv_sum;
+        }
+        torch_ipex::cpu::kernel::move_ker<scalar_t, float>(
+            out_start, acc_row, head_size);
+      }
+    } // for head_id
+  } // for tile_id
+} // paged_attention_prefill_kernel
+
 void single_query_cached_kv_attention_kernel_impl(
     at::Tensor& out, // [num_seqs, num_heads, head_size]
     at::Tensor& query, // [num_seqs, num_heads, head_size]
@@ -360,40 +755,199 @@ void single_query_cached_kv_attention_kernel_impl(
     at::Tensor& context_lens, // [num_seqs]
     int64_t block_size,
     int64_t max_context_len,
-    const c10::optional<at::Tensor>& alibi_slopes) {
+    const c10::optional<at::Tensor>& alibi_slopes,
+    const c10::optional<at::Tensor>& k_scale, // [num_blocks, num_kv_heads]
+    const c10::optional<at::Tensor>& v_scale, // [num_blocks, num_kv_heads]
+    int64_t window_size) {
   RECORD_FUNCTION(
       "ipex::single_query_cached_kv_attention_kernel_impl",
       c10::ArrayRef<c10::IValue>({}));
-  // dispatch kernel according to the data type of input tensor
-  if (out.scalar_type() == at::ScalarType::Float) {
-    single_query_cached_kv_attention_kernel<float>(
-        out,
-        query,
+  // one query row per sequence
+  auto row_seq_ids = at::arange(query.size(0), context_lens.options());
+  paged_attention_rows(
+      out,
+      query,
+      key_cache,
+      value_cache,
+      head_mapping,
+      scale,
+      block_tables,
+      row_seq_ids,
+      context_lens,
+      block_size,
+      max_context_len,
+      alibi_slopes,
+      k_scale,
+      v_scale,
+      window_size);
+}
+
+/**
+ * Performs scale-dot-product for a variable number of query tokens per
+ * sequence against the paged key-value cache.
+ *
+ * The key/value of all query tokens must have been stored into the cache
+ * (e.g. by reshape_and_cache) before calling this function, so that prefill
+ * chunks and decode tokens can be mixed in one batch. The query tokens of a
+ * sequence are its last tokens, i.e. query token i of sequence s sits at the
+ * position context_lens[s] - q_len[s] + i.
+ *
+ * @param out           Output tensor [num_tokens, num_heads, head_size].
+ * @param query         Query tensor [num_tokens, num_heads, head_size].
+ * @param cu_seqlens_q  The cumulative query lengths [num_seqs + 1].
+ * @param context_lens  The context lengths (including the query tokens) of
+ * every sequence [num_seqs].
+ * @param is_causal     Whether query token i can only attend to the context
+ * up to its own position.
+ *
+ * The other arguments are the same as single_query_cached_kv_attention.
+ */
+void paged_attention_varlen_kernel_impl(
+    at::Tensor& out, // [num_tokens, num_heads, head_size]
+    at::Tensor& query, // [num_tokens, num_heads, head_size]
+    at::Tensor& key_cache, // [num_blocks,  block_size, num_heads, head_size]
+    at::Tensor& value_cache, // [num_blocks,  block_size, num_heads, head_size]
+    at::Tensor& head_mapping, // [num_heads]
+    const double scale,
+    at::Tensor& block_tables, // [num_seqs, max_num_blocks_per_seq]
+    at::Tensor& cu_seqlens_q, // [num_seqs + 1]
+    at::Tensor& context_lens, // [num_seqs]
+    int64_t block_size,
+    int64_t max_context_len,
+    bool is_causal,
+    const c10::optional<at::Tensor>& alibi_slopes,
+    const c10::optional<at::Tensor>& k_scale, // [num_blocks, num_kv_heads]
+    const c10::optional<at::Tensor>& v_scale, // [num_blocks, num_kv_heads]
+    int64_t window_size) {
+  RECORD_FUNCTION(
+      "ipex::paged_attention_varlen_kernel_impl",
+      c10::ArrayRef<c10::IValue>({}));
+  TORCH_CHECK(
+      cu_seqlens_q.scalar_type() == at::ScalarType::Int &&
+          context_lens.scalar_type() == at::ScalarType::Int,
+      "cu_seqlens_q and context_lens should be int32 tensors");
+  auto num_seqs = context_lens.size(0);
+  auto num_tokens = query.size(0);
+  TORCH_CHECK(
+      cu_seqlens_q.size(0) == num_seqs + 1,
+      "cu_seqlens_q should have the size of num_seqs + 1");
+  auto cu_seqlens_q_c = cu_seqlens_q.contiguous();
+  auto context_lens_c = context_lens.contiguous();
+  auto cu_seqlens_q_ptr = cu_seqlens_q_c.data_ptr<int>();
+  auto context_lens_ptr = context_lens_c.data_ptr<int>();
+  TORCH_CHECK(
+      cu_seqlens_q_ptr[0] == 0,
+      "the first element of cu_seqlens_q should be 0");
+  TORCH_CHECK(
+      cu_seqlens_q_ptr[num_seqs] == num_tokens,
+      "the last element of cu_seqlens_q should be the number of query tokens");
+  // The single query tokens (decoding) take the split-KV kernel, which
+  // parallelizes over the context partitions. The query tokens of the
+  // prefill chunks are tiled, for the tiles to share the key/value loads.
+  std::vector<int> decode_rows, decode_seq_ids, decode_context_lens;
+  std::vector<QueryTile> tiles;
+  for (auto seq_id = 0; seq_id < num_seqs; seq_id++) {
+    auto q_start = cu_seqlens_q_ptr[seq_id];
+    auto q_len = cu_seqlens_q_ptr[seq_id + 1] - q_start;
+    auto context_len = context_lens_ptr[seq_id];
+    TORCH_CHECK(
+        q_len >= 0 && q_len <= context_len,
+        "the query length of a sequence should not exceed its context length");
+    if (q_len == 1) {
+      decode_rows.push_back(q_start);
+      decode_seq_ids.push_back(seq_id);
+      decode_context_lens.push_back(context_len);
+      continue;
+    }
+    for (int64_t i = 0; i < q_len; i += Q_TILE_SIZE) {
+      tiles.push_back(
+          {seq_id,
+           q_start + i,
+           std::min<int64_t>(Q_TILE_SIZE, q_len - i),
+           context_len - q_len + i,
+           context_len});
+    }
+  }
+  if (!decode_rows.empty()) {
+    auto row_seq_ids = at::tensor(decode_seq_ids, context_lens.options());
+    auto row_context_lens =
+        at::tensor(decode_context_lens, context_lens.options());
+    bool all_decode = (int64_t)decode_rows.size() == num_tokens;
+    auto rows = at::tensor(decode_rows, context_lens.options()).to(at::kLong);
+    auto decode_query = all_decode ? query : query.index_select(0, rows);
+    auto decode_out = all_decode ? out : at::empty_like(decode_query);
+    paged_attention_rows(
+        decode_out,
+        decode_query,
         key_cache,
         value_cache,
         head_mapping,
         scale,
         block_tables,
-        context_lens,
+        row_seq_ids,
+        row_context_lens,
         block_size,
         max_context_len,
-        alibi_slopes);
-  } else if (out.scalar_type() == at::ScalarType::BFloat16) {
-    single_query_cached_kv_attention_kernel<at::BFloat16>(
+        alibi_slopes,
+        k_scale,
+        v_scale,
+        window_size);
+    if (!all_decode) {
+      out.index_copy_(0, rows, decode_out);
+    }
+  }
+  if (!tiles.empty()) {
+    paged_attention_dispatch(
         out,
-        query,
         key_cache,
         value_cache,
-        head_mapping,
-        scale,
-        block_tables,
-        context_lens,
-        block_size,
-        max_context_len,
-        alibi_slopes);
+        k_scale,
+        v_scale,
+        [&](auto scalar, auto cache, const auto& ks, const auto& vs) {
+          using scalar_t = decltype(scalar);
+          using cache_t = decltype(cache);
+          paged_attention_prefill_kernel<scalar_t, cache_t>(
+              out,
+              query,
+              key_cache,
+              value_cache,
+              head_mapping,
+              scale,
+              block_tables,
+              tiles,
+              block_size,
+              is_causal,
+              alibi_slopes,
+              ks,
+              vs,
+              window_size);
+        });
+  }
+}
+
+template <typename SRC_T>
+void reshape_and_cache_cache_dispatch(
+    at::Tensor& key,
+    at::Tensor& value,
+    at::Tensor& key_cache,
+    at::Tensor& value_cache,
+    at::Tensor& slot_mapping,
+    const c10::optional<at::Tensor>& k_scale,
+    const c10::optional<at::Tensor>& v_scale) {
+  if (key_cache.scalar_type() == key.scalar_type()) {
+    reshape_and_cache_kernel<SRC_T, SRC_T>(
+        key, value, key_cache, value_cache, slot_mapping, k_scale, v_scale);
+  } else if (key_cache.scalar_type() == at::ScalarType::Char) {
+    check_kv_cache_scales(key_cache, value_cache, k_scale, v_scale);
+    reshape_and_cache_kernel<int8_t, SRC_T>(
+        key, value, key_cache, value_cache, slot_mapping, k_scale, v_scale);
+  } else if (key_cache.scalar_type() == at::ScalarType::Float8_e4m3fn) {
+    check_kv_cache_scales(key_cache, value_cache, k_scale, v_scale);
+    reshape_and_cache_kernel<at::Float8_e4m3fn, SRC_T>(
+        key, value, key_cache, value_cache, slot_mapping, k_scale, v_scale);
   } else {
     TORCH_CHECK(
-        false, "Unsupported data type for single_query_cached_kv_attention");
+        false, "Unsupported kv cache data type for ipex::reshape_and_cache");
   }
 }
 
@@ -403,7 +957,9 @@ void reshape_and_cache_cpu_kernel_impl(
     at::Tensor& value,
     at::Tensor& key_cache,
     at::Tensor& value_cache,
-    at::Tensor& slot_mapping) {
+    at::Tensor& slot_mapping,
+    const c10::optional<at::Tensor>& k_scale,
+    const c10::optional<at::Tensor>& v_scale) {
   TORCH_CHECK(
       key.scalar_type() == value.scalar_type(),
       "key and value should have the same data type");
@@ -418,24 +974,151 @@ void reshape_and_cache_cpu_kernel_impl(
       "ipex::reshape_and_cache_cpu_kernel_impl",
       c10::ArrayRef<c10::IValue>({}));
   if (key.scalar_type() == at::ScalarType::Float) {
-    reshape_and_cache_kernel<float, float>(
-        key, value, key_cache, value_cache, slot_mapping);
+    reshape_and_cache_cache_dispatch<float>(
+        key, value, key_cache, value_cache, slot_mapping, k_scale, v_scale);
   } else if (key.scalar_type() == at::ScalarType::BFloat16) {
-    reshape_and_cache_kernel<at::BFloat16, at::BFloat16>(
-        key, value, key_cache, value_cache, slot_mapping);
+    reshape_and_cache_cache_dispatch<at::BFloat16>(
+        key, value, key_cache, value_cache, slot_mapping, k_scale, v_scale);
   } else {
     TORCH_CHECK(false, "Unsupported data type for ipex::reshape_and_cache");
   }
 }
 
+/**
+ * Copies whole cache blocks inside every cache tensor. It is used to fork the
+ * blocks shared by several sequences (copy-on-write of a shared prefix or of a
+ * beam) without going through the generic indexing ops.
+ *
+ * @param key_caches The key caches of all layers. Every tensor is indexed by
+ * the block id in its first dimension, e.g. [num_blocks, block_size,
+ * num_heads, head_size]. The k_scale of a quantized cache can be passed here
+ * as well.
+ * @param value_caches The value caches of all layers, same as key_caches.
+ * @param block_mapping The int64 [num_pairs, 2] tensor of (src, dst) block ids.
+ */
+void copy_blocks_kernel_impl(
+    at::TensorList key_caches,
+    at::TensorList value_caches,
+    const at::Tensor& block_mapping) {
+  RECORD_FUNCTION(
+      "ipex::copy_blocks_kernel_impl", c10::ArrayRef<c10::IValue>({}));
+  TORCH_CHECK(
+      key_caches.size() == value_caches.size(),
+      "key_caches and value_caches should have the same number of layers");
+  TORCH_CHECK(
+      block_mapping.scalar_type() == at::ScalarType::Long &&
+          block_mapping.dim() == 2 && block_mapping.size(1) == 2,
+      "block_mapping should be an int64 tensor of [num_pairs, 2]");
+  std::vector<at::Tensor> caches(key_caches.begin(), key_caches.end());
+  caches.insert(caches.end(), value_caches.begin(), value_caches.end());
+  int64_t num_blocks = std::numeric_limits<int64_t>::max();
+  for (auto& cache : caches) {
+    TORCH_CHECK(cache.is_contiguous(), "kv cache should be contiguous");
+    num_blocks = std::min(num_blocks, cache.size(0));
+  }
+  auto block_mapping_c = block_mapping.contiguous();
+  auto block_mapping_ptr = block_mapping_c.data_ptr<int64_t>();
+  int64_t num_caches = caches.size();
+  auto num_pairs = block_mapping.size(0);
+  for (auto pi = 0; pi < 2 * num_pairs; pi++) {
+    TORCH_CHECK(
+        block_mapping_ptr[pi] >= 0 && block_mapping_ptr[pi] < num_blocks,
+        "copy_blocks: block id ",
+        block_mapping_ptr[pi],
+        " is out of the range of the kv cache with ",
+        num_blocks,
+        " blocks");
+  }
+#pragma omp parallel for collapse(2)
+  for (auto ci = 0; ci < num_caches; ci++) {
+    for (auto pi = 0; pi < num_pairs; pi++) {
+      auto& cache = caches[ci];
+      auto block_bytes = cache.stride(0) * cache.element_size();
+      auto cache_ptr = static_cast<char*>(cache.data_ptr());
+      auto src_block = block_mapping_ptr[2 * pi];
+      auto dst_block = block_mapping_ptr[2 * pi + 1];
+      torch_ipex::cpu::kernel::move_ker<char, char>(
+          cache_ptr + dst_block * block_bytes,
+          cache_ptr + src_block * block_bytes,
+          block_bytes);
+    }
+  }
+}
+
+/**
+ * Copies cache blocks from src to dst, e.g. swapping the blocks of a
+ * preempted sequence out to a host buffer and back into the cache later.
+ *
+ * @param src The source cache indexed by the block id in its first dimension.
+ * @param dst The destination cache or host buffer. It may have a different
+ * number of blocks but must have the same block layout and data type as src.
+ * @param block_mapping The int64 [num_pairs, 2] tensor of (src, dst) block ids.
+ */
+void swap_blocks_kernel_impl(
+    const at::Tensor& src,
+    at::Tensor& dst,
+    const at::Tensor& block_mapping) {
+  RECORD_FUNCTION(
+      "ipex::swap_blocks_kernel_impl", c10::ArrayRef<c10::IValue>({}));
+  TORCH_CHECK(
+      src.scalar_type() == dst.scalar_type(),
+      "src and dst should have the same data type");
+  TORCH_CHECK(
+      src.is_contiguous() && dst.is_contiguous(),
+      "src and dst should be contiguous");
+  TORCH_CHECK(
+      src.sizes().slice(1) == dst.sizes().slice(1),
+      "src and dst should have the same block shape");
+  TORCH_CHECK(
+      block_mapping.scalar_type() == at::ScalarType::Long &&
+          block_mapping.dim() == 2 && block_mapping.size(1) == 2,
+      "block_mapping should be an int64 tensor of [num_pairs, 2]");
+  auto block_mapping_c = block_mapping.contiguous();
+  auto block_mapping_ptr = block_mapping_c.data_ptr<int64_t>();
+  auto num_pairs = block_mapping.size(0);
+  for (auto pi = 0; pi < num_pairs; pi++) {
+    auto src_block = block_mapping_ptr[2 * pi];
+    auto dst_block = block_mapping_ptr[2 * pi + 1];
+    TORCH_CHECK(
+        src_block >= 0 && src_block < src.size(0) && dst_block >= 0 &&
+            dst_block < dst.size(0),
+        "swap_blocks: block mapping (",
+        src_block,
+        ", ",
+        dst_block,
+        ") is out of the range of src/dst with ",
+        src.size(0),
+        "/",
+        dst.size(0),
+        " blocks");
+  }
+  auto block_bytes = src.stride(0) * src.element_size();
+  auto src_ptr = static_cast<char*>(src.data_ptr());
+  auto dst_ptr = static_cast<char*>(dst.data_ptr());
+#pragma omp parallel for
+  for (auto pi = 0; pi < num_pairs; pi++) {
+    auto src_block = block_mapping_ptr[2 * pi];
+    auto dst_block = block_mapping_ptr[2 * pi + 1];
+    torch_ipex::cpu::kernel::move_ker<char, char>(
+        dst_ptr + dst_block * block_bytes,
+        src_ptr + src_block * block_bytes,
+        block_bytes);
+  }
+}
+
 } // namespace
 
 IPEX_REGISTER_DISPATCH(
     single_query_cached_kv_attention_kernel_stub,
     &single_query_cached_kv_attention_kernel_impl);
+IPEX_REGISTER_DISPATCH(
+    paged_attention_varlen_kernel_stub,
+    &paged_attention_varlen_kernel_impl);
 IPEX_REGISTER_DISPATCH(
     reshape_and_cache_kernel_stub,
     &reshape_and_cache_cpu_kernel_impl);
+IPEX_REGISTER_DISPATCH(copy_blocks_kernel_stub, &copy_blocks_kernel_impl);
+IPEX_REGISTER_DISPATCH(swap_blocks_kernel_stub, &swap_blocks_kernel_impl);
 
 } // namespace cpu
 } // namespace torch_ipex
@@ -4,6 +4,7 @@
 #include <aten/MergedEmbCat.h>
 #include <torch/all.h>
 #include <torch/csrc/autograd/function.h>
+#include "vec/rowwise_quant_utils.hpp"
 #include "vec/vec.h"
 
 namespace torch_ipex {
@@ -471,11 +472,133 @@ Tensor qmerged_embedding_cat_fw_impl(
   return output;
 }
 
+// Sum pooling of the row-wise quantized rows of the bags [bs_begin, bs_end)
+// of one table, dequantized into the fp32 output rows directly.
+template <ScalarType qtype, typename index_t>
+inline void rowwise_qembeddingbag_kern(
+    const int64_t bs_begin,
+    const int64_t bs_end,
+    const int64_t num_emb,
+    const int64_t emb_dim,
+    const index_t last_offset,
+    const index_t* indices,
+    const index_t* offsets,
+    const uint8_t* weight,
+    const int64_t row_bytes,
+    float* result) {
+  for (int64_t b = bs_begin; b < bs_end; ++b) {
+    int64_t start_idx = offsets[b];
+    int64_t end_idx =
+        ((b + 1) == bs_end && last_offset != -1) ? last_offset : offsets[b + 1];
+    kernel::zero_ker(result, emb_dim);
+    for (int64_t j = start_idx; j < end_idx; ++j) {
+      rowwise_dequant_add_ker<qtype>(
+          result, &weight[indices[j] * row_bytes], emb_dim);
+    }
+    result += (num_emb + 1) * emb_dim;
+  }
+}
+
+template <ScalarType qtype, typename index_t>
+void rowwise_qembeddingbagcat(
+    float* o_ptr,
+    const uint8_t** w_ptr,
+    index_t** indices_ptr,
+    index_t** offsets_ptr,
+    const float* d_ptr,
+    int64_t num_batch,
+    int64_t num_emb,
+    int64_t emb_dim,
+    const std::vector<int64_t>& last_offsets) {
+  constexpr int64_t b_block = 512;
+  const int64_t n_b_blocks = (num_batch - 1) / b_block + 1;
+  const int64_t row_bytes = rowwise_quant_row_bytes(qtype, emb_dim);
+#pragma omp parallel for collapse(2)
+  for (int64_t b = 0; b < n_b_blocks; ++b) {
+    for (int64_t n = 0; n < (num_emb + 1); ++n) {
+      const int64_t bs_begin = b * b_block;
+      const int64_t bs_end = std::min(num_batch, (b + 1) * b_block);
+      float* r = &o_ptr[b * b_block * (num_emb + 1) * emb_dim + n * emb_dim];
+      if (n == 0) {
+        const float* dense = &d_ptr[b * b_block * emb_dim];
+        for (int64_t bs = bs_begin; bs < bs_end; ++bs) {
+          memcpy(r, dense, emb_dim * sizeof(float));
+          r += (num_emb + 1) * emb_dim;
+          dense += emb_dim;
+        }
+      } else {
+        const int64_t m = n - 1;
+        // avoid offsets not include last batch
+        const index_t last_offset = bs_end == num_batch ? last_offsets[m] : -1;
+        rowwise_qembeddingbag_kern<qtype>(
+            bs_begin,
+            bs_end,
+            num_emb,
+            emb_dim,
+            last_offset,
+            indices_ptr[m],
+            offsets_ptr[m],
+            w_ptr[m],
+            row_bytes,
+            r);
+      }
+    }
+  }
+}
+
+Tensor rowwise_qmerged_embedding_cat_fw_impl(
+    const TensorList& qweights,
+    const TensorList& indices,
+    const TensorList& offsets,
+    const Tensor& dense,
+    ScalarType qtype) {
+  RECORD_FUNCTION(__FUNCTION__, c10::ArrayRef<c10::IValue>({}));
+  int64_t batch_size = dense.size(0);
+  int64_t emb_dim = dense.size(1);
+  int64_t num_emb = qweights.size();
+
+  std::vector<int64_t> last_offsets(num_emb);
+  for (int i = 0; i < num_emb; i++) {
+    // handle last offsets
+    last_offsets[i] = indices[i].numel();
+  }
+
+  Tensor output =
+      at::empty({batch_size, (num_emb + 1) * emb_dim}, dense.options());
+  AT_DISPATCH_INDEX_TYPES(indices[0].scalar_type(), "embeddingbag_cat", [&] {
+    std::vector<const uint8_t*> qweights_ptr(num_emb);
+    std::vector<index_t*> indices_ptr(num_emb);
+    std::vector<index_t*> offsets_ptr(num_emb);
+    for (int i = 0; i < num_emb; i++) {
+      qweights_ptr[i] = qweights[i].data_ptr<uint8_t>();
+      indices_ptr[i] = indices[i].data_ptr<index_t>();
+      offsets_ptr[i] = offsets[i].data_ptr<index_t>();
+    }
+    auto kernel = qtype == kQUInt4x2
+        ? &rowwise_qembeddingbagcat<kQUInt4x2, index_t>
+        : &rowwise_qembeddingbagcat<kFloat8_e4m3fn, index_t>;
+    kernel(
+        output.data_ptr<float>(),
+        qweights_ptr.data(),
+        indices_ptr.data(),
+        offsets_ptr.data(),
+        dense.data_ptr<float>(),
+        batch_size,
+        num_emb,
+        emb_dim,
+        last_offsets);
+  });
+  return output;
+}
+
 } // anonymous namespace
 
 IPEX_REGISTER_DISPATCH(
     qmerged_embeddingbag_cat_fw_stub,
     &qmerged_embedding_cat_fw_impl);
+IPEX_REGISTER_DISPATCH(
+    rowwise_qmerged_embeddingbag_cat_fw_stub,
+    &rowwise_qmerged_embedding_cat_fw_impl);
 
 } // namespace cpu
 } // namespace torch_ipex
\ No newline at end of file
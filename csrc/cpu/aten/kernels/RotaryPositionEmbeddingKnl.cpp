@@ -2,6 +2,7 @@
 #include <aten/RotaryPositionEmbedding.h>
 #include <torch/all.h>
 #include <torch/csrc/autograd/function.h>
+#include <algorithm>
 #include "vec/vec.h"
 
 namespace torch_ipex {
@@ -23,6 +24,57 @@ bool is_fused_qkv(at::Tensor& t_in, int64_t hidden_size) {
   return false;
 }
 
+// Returns the sin of the rotary position embedding of token (b, s), which is
+// followed by the cos at HR / 2.
+inline float* get_rope_emb(
+    float* emb_pos_ptr,
+    long* pos_ptr,
+    bool single_pos,
+    int64_t b,
+    int64_t s,
+    int64_t S,
+    int64_t HR) {
+  if (single_pos) { // used by Falcon & ChatGLM, the past_kv_length
+    return emb_pos_ptr + (pos_ptr[0] + s) * HR;
+  }
+  return emb_pos_ptr + pos_ptr[b * S + s] * HR;
+}
+
+// Applies the rotary position embedding to the rotary_dim elements of a head
+// and copies the rest of the head from in to out.
+template <typename T>
+inline void apply_rope_to_head(
+    T* in,
+    T* out,
+    float* cos_start,
+    float* sin_start,
+    int64_t H,
+    int64_t HR,
+    int64_t offset,
+    int64_t rotary_dim) {
+  if (offset != 1) { // use vectorized version if there are more than 16
+                     // continuous elements, used by lamma/gpt-neox/falcon
+                     // logic is like to the rotate_half in python code
+    torch_ipex::cpu::kernel::apply_rope_along_head_kernel<T>(
+        in, out, cos_start, sin_start, rotary_dim, offset);
+  } else { // used by GPT-J 6B & CodeGen & ChatGLM
+           // logic is like to the rotate_every_two in python code
+    for (int h = 0, h2 = 0; h < HR; h += 2, h2++) {
+      float sin = sin_start[h2];
+      float cos = cos_start[h2];
+      float in0 = in[h];
+      float in1 = in[h + offset];
+      out[h] = in0 * cos - in1 * sin;
+      out[h + offset] = in1 * cos + in0 * sin;
+    }
+  }
+  // copy the rest of the head (query_pass & key_pass)
+  if (rotary_dim < H) {
+    torch_ipex::cpu::kernel::move_ker<T, T>(
+        out + rotary_dim, in + rotary_dim, H - rotary_dim);
+  }
+}
+
 /**
  * Applies the Rotary Position Embedding Kernel to the input tensors.
  *
@@ -97,77 +149,33 @@ std::tuple<at::Tensor, at::Tensor, at::Tensor> ApplyROPEKernel(
           auto out_offset_k =
               concat_qkv ? b * out_stride_kb + s * out_stride_ks + n * H : 0;
           auto in_offset_k = concat_qkv ? in_offset_q + N * H : 0;
-          long p = 0;
-          float* sin_start = nullptr;
-          float* cos_start = nullptr;
           // step 0) get the rotary position embedding for the current position
-          if (t_pos.numel() == 1) { // used by Falcon & ChatGLM,
-            p = pos_ptr[0];
-            sin_start = emb_pos_ptr + (p + s) * HR;
-            cos_start = emb_pos_ptr + (p + s) * HR + COFF;
-          } else {
-            p = pos_ptr[b * S + s];
-            sin_start = emb_pos_ptr + p * HR;
-            cos_start = emb_pos_ptr + p * HR + COFF;
-          }
+          float* sin_start = get_rope_emb(
+              emb_pos_ptr, pos_ptr, t_pos.numel() == 1, b, s, S, HR);
+          float* cos_start = sin_start + COFF;
           // step 1) apply_rotary_pos_emb for the rotary_dim elements in every
-          // head of query/key
-          if (offset !=
-              1) { // use vectorized version if there are more than 16
-                   // continuous elements, used by lamma/gpt-neox/falcon
-                   // logic is like to the rotate_half in python code
-            torch_ipex::cpu::kernel::apply_rope_along_head_kernel<T>(
-                in_ptr + in_offset_q,
-                query_ptr + out_offset_q,
+          // head of query/key, and copy the rest of them
+          apply_rope_to_head<T>(
+              in_ptr + in_offset_q,
+              query_ptr + out_offset_q,
+              cos_start,
+              sin_start,
+              H,
+              HR,
+              offset,
+              rotary_dim);
+          if (concat_qkv && n < N_KV) {
+            apply_rope_to_head<T>(
+                in_ptr + in_offset_k,
+                key_ptr + out_offset_k,
                 cos_start,
                 sin_start,
-                rotary_dim,
-                offset);
-            if (concat_qkv && n < N_KV) {
-              torch_ipex::cpu::kernel::apply_rope_along_head_kernel<T>(
-                  in_ptr + in_offset_k,
-                  key_ptr + out_offset_k,
-                  cos_start,
-                  sin_start,
-                  rotary_dim,
-                  offset);
-            }
-          } else { // used by GPT-J 6B & CodeGen & ChatGLM
-                   // logic is like to the rotate_every_two in python code
-            for (int h = 0, h2 = 0; h < HR; h += 2, h2++) {
-              float sin = sin_start[h2];
-              float cos = cos_start[h2];
-              float in0 = in_ptr[in_offset_q + h];
-              float in1 = in_ptr[in_offset_q + h + offset];
-              float out0 = in0 * cos - in1 * sin;
-              float out1 = in1 * cos + in0 * sin;
-              query_ptr[out_offset_q + h] = out0;
-              query_ptr[out_offset_q + h + offset] = out1;
-              if (concat_qkv && n < N_KV) {
-                in0 = in_ptr[in_offset_k + h];
-                in1 = in_ptr[in_offset_k + h + offset];
-                out0 = in0 * cos - in1 * sin;
-                out1 = in1 * cos + in0 * sin;
-                key_ptr[out_offset_k + h] = out0;
-                key_ptr[out_offset_k + h + offset] = out1;
-              }
-            }
+                H,
+                HR,
+                offset,
+                rotary_dim);
           }
-          // step 2) copy the rest of the input tensor to query/key (query_pass
-          // & key_pass)
-          if (rotary_dim < H) {
-            torch_ipex::cpu::kernel::move_ker<T, T>(
-                query_ptr + out_offset_q + rotary_dim,
-                in_ptr + in_offset_q + rotary_dim,
-                H - rotary_dim);
-            if (concat_qkv && n < N_KV) {
-              torch_ipex::cpu::kernel::move_ker<T, T>(
-                  key_ptr + out_offset_k + rotary_dim,
-                  in_ptr + in_offset_k + rotary_dim,
-                  H - rotary_dim);
-            }
-          }
-          // step 3) copy value from t_in when concat_qkv is true
+          // step 2) copy value from t_in when concat_qkv is true
           if (concat_qkv && n < N_KV) {
             auto in_offset_v = in_offset_k + N_KV * H;
             torch_ipex::cpu::kernel::move_ker<T, T>(
@@ -180,6 +188,102 @@ std::tuple<at::Tensor, at::Tensor, at::Tensor> ApplyROPEKernel(
   return std::make_tuple(query, key, value);
 }
 
+/**
+ * Applies the Rotary Position Embedding Kernel to a fused qkv tensor and
+ * stores the key/value into the paged kv cache in the same pass, instead of
+ * writing them to intermediate tensors which are then copied by
+ * reshape_and_cache.
+ *
+ * @param t_in The fused qkv tensor in the shape of [B][S][F], where F is
+ * (N + 2 * N_KV) * H.
+ * @param key_cache The key cache in the shape of [num_blocks][block_size][N_KV]
+ * [H], with the same data type as t_in.
+ * @param value_cache The value cache in the same shape as key_cache.
+ * @param slot_mapping The int32 slots of the B * S tokens in the kv cache.
+ * slot / block_size is the block index and slot % block_size is the offset in
+ * the block. The tokens with a negative slot (e.g. padding) are not stored.
+ * The other params are the same as ApplyROPEKernel.
+ * @return The query tensor in the shape of [B][S][N][H].
+ */
+template <typename T>
+at::Tensor ApplyROPEAndCacheKernel(
+    at::Tensor& t_in,
+    at::Tensor& t_emb_pos,
+    at::Tensor& t_pos,
+    int64_t N, // N: number of head, H: head size
+    int64_t H,
+    int64_t offset,
+    int64_t rotary_dim,
+    at::Tensor& key_cache,
+    at::Tensor& value_cache,
+    at::Tensor& slot_mapping) {
+  auto HR = t_emb_pos.size(1); // rotary_dim
+  auto B = t_in.size(0);
+  auto S = t_in.size(1);
+  auto in_stride_b = t_in.stride(0);
+  auto in_stride_s = t_in.stride(1);
+  auto N_KV = key_cache.size(2); // GQA/MQA, N_KV: number of head for key/value
+  auto block_size = key_cache.size(1);
+  auto cache_stride_b = key_cache.stride(0);
+  auto cache_stride_s = key_cache.stride(1);
+
+  auto COFF = HR / 2;
+  auto in_ptr = t_in.data_ptr<T>();
+  auto query = at::empty({B, S, N, H}, t_in.options());
+  auto query_ptr = query.data_ptr<T>();
+  auto out_stride_qb = query.stride(0);
+  auto out_stride_qs = query.stride(1);
+  auto key_cache_ptr = key_cache.data_ptr<T>();
+  auto value_cache_ptr = value_cache.data_ptr<T>();
+  auto slot_mapping_ptr = slot_mapping.data_ptr<int>();
+  auto emb_pos_ptr = t_emb_pos.data_ptr<float>(); // [MP][HR]
+  auto pos_ptr = t_pos.data_ptr<long>(); // [MB][S]
+  auto num_head = std::max(N, N_KV);
+  {
+#pragma omp parallel for collapse(3)
+    for (int b = 0; b < B; b++) {
+      for (int s = 0; s < S; s++) {
+        for (int n = 0; n < num_head; n++) {
+          auto in_offset_q = b * in_stride_b + s * in_stride_s + n * H;
+          auto in_offset_k = b * in_stride_b + s * in_stride_s + (N + n) * H;
+          auto in_offset_v = in_offset_k + N_KV * H;
+          float* sin_start = get_rope_emb(
+              emb_pos_ptr, pos_ptr, t_pos.numel() == 1, b, s, S, HR);
+          float* cos_start = sin_start + COFF;
+          if (n < N) {
+            apply_rope_to_head<T>(
+                in_ptr + in_offset_q,
+                query_ptr + b * out_stride_qb + s * out_stride_qs + n * H,
+                cos_start,
+                sin_start,
+                H,
+                HR,
+                offset,
+                rotary_dim);
+          }
+          auto slot = slot_mapping_ptr[b * S + s];
+          if (n < N_KV && slot >= 0) {
+            auto cache_offset = slot / block_size * cache_stride_b +
+                slot % block_size * cache_stride_s + n * H;
+            apply_rope_to_head<T>(
+                in_ptr + in_offset_k,
+                key_cache_ptr + cache_offset,
+                cos_start,
+                sin_start,
+                H,
+                HR,
+                offset,
+                rotary_dim);
+            torch_ipex::cpu::kernel::move_ker<T, T>(
+                value_cache_ptr + cache_offset, in_ptr + in_offset_v, H);
+          }
+        }
+      }
+    }
+  }
+  return query;
+}
+
 std::tuple<at::Tensor, at::Tensor, at::Tensor>
 rotary_position_embedding_kernel_impl(
     at::Tensor& t_in,
@@ -211,11 +315,96 @@ rotary_position_embedding_kernel_impl(
   }
 }
 
+at::Tensor rotary_position_embedding_paged_cache_kernel_impl(
+    at::Tensor& t_in,
+    at::Tensor& t_emb_pos,
+    at::Tensor& t_pos,
+    int64_t N, // N: number of head, H: head size
+    int64_t H,
+    int64_t offset,
+    int64_t rotary_dim,
+    at::Tensor& key_cache,
+    at::Tensor& value_cache,
+    at::Tensor& slot_mapping) {
+  TORCH_CHECK(
+      t_in.dim() == 3,
+      "rotary_position_embedding_paged_cache: t_in should be the fused qkv in shape of (batch, seq_len, qkv_hidden_size)");
+  TORCH_CHECK(
+      key_cache.dim() == 4 && key_cache.sizes() == value_cache.sizes(),
+      "rotary_position_embedding_paged_cache: key_cache and value_cache should be in shape of (num_blocks, block_size, num_kv_heads, head_size)");
+  auto N_KV = key_cache.size(2);
+  TORCH_CHECK(
+      t_in.size(2) == (N + 2 * N_KV) * H && key_cache.size(3) == H,
+      "rotary_position_embedding_paged_cache: the shape of t_in doesn't match the heads of query and kv cache");
+  TORCH_CHECK(
+      key_cache.scalar_type() == t_in.scalar_type() &&
+          value_cache.scalar_type() == t_in.scalar_type(),
+      "rotary_position_embedding_paged_cache: kv cache should have the same data type as t_in");
+  TORCH_CHECK(
+      key_cache.is_contiguous() && value_cache.is_contiguous(),
+      "rotary_position_embedding_paged_cache: kv cache should be contiguous");
+  TORCH_CHECK(
+      slot_mapping.scalar_type() == at::kInt &&
+          slot_mapping.numel() == t_in.size(0) * t_in.size(1),
+      "rotary_position_embedding_paged_cache: slot_mapping should be int32 with one slot per token");
+  t_in = t_in.contiguous();
+  t_emb_pos = t_emb_pos.contiguous();
+  t_pos = t_pos.contiguous();
+  slot_mapping = slot_mapping.contiguous();
+  if (t_in.scalar_type() == at::kFloat) {
+    return ApplyROPEAndCacheKernel<float>(
+        t_in,
+        t_emb_pos,
+        t_pos,
+        N,
+        H,
+        offset,
+        rotary_dim,
+        key_cache,
+        value_cache,
+        slot_mapping);
+  } else if (t_in.scalar_type() == at::kBFloat16) {
+    return ApplyROPEAndCacheKernel<at::BFloat16>(
+        t_in,
+        t_emb_pos,
+        t_pos,
+        N,
+        H,
+        offset,
+        rotary_dim,
+        key_cache,
+        value_cache,
+        slot_mapping);
+  } else if (t_in.scalar_type() == at::kHalf) {
+    return ApplyROPEAndCacheKernel<at::Half>(
+        t_in,
+        t_emb_pos,
+        t_pos,
+        N,
+        H,
+        offset,
+        rotary_dim,
+        key_cache,
+        value_cache,
+        slot_mapping);
+  } else {
+    TORCH_CHECK(
+        false,
+        "rotary_position_embedding_paged_cache_kernel_impl: unsupported '",
+        t_in.scalar_type(),
+        "'");
+    return at::Tensor();
+  }
+}
+
 } // anonymous namespace
 
 IPEX_REGISTER_DISPATCH(
     rotary_position_embedding_kernel_stub,
     &rotary_position_embedding_kernel_impl);
+IPEX_REGISTER_DISPATCH(
+    rotary_position_embedding_paged_cache_kernel_stub,
+    &rotary_position_embedding_paged_cache_kernel_impl);
 
 } // namespace cpu
 } // namespace torch_ipex
@@ -4,6 +4,8 @@
 #include <aten/ShmAllReduceAdd.h>
 #include <torch/all.h>
 #include <torch/csrc/autograd/function.h>
+#include <cstring>
+#include <numeric>
 #include "vec/vec.h"
 
 namespace torch_ipex {
@@ -11,16 +13,69 @@ namespace cpu {
 
 namespace {
 
-enum shm_state { INIT = 0, RANK0_COPY = 1, RANKX_COPY_ADD = 2, BROADCAST = 3 };
+// The states of every collective only grow within one call
+enum shm_state {
+  INIT = 0,
+  RANK0_COPY = 1,
+  RANKX_COPY_ADD = 2,
+  // states of the reduce-scatter + all-gather algorithm
+  RS_COPY = 3,
+  RS_REDUCE = 4,
+  // states of the all-to-all
+  A2A_SPLITS = 5,
+  A2A_COPY = 6,
+  // states of the all-gather and of the broadcast
+  GATHER_COPY = 7,
+  BCAST_COPY = 8
+};
 enum shm_block_state { INIT_BLOCK = 0, COPY_ADD_DONE_BLOCK = 1 };
 
-inline void wait_state_until(
+// The state word of a rank is only written by the rank itself. It holds the
+// epoch, i.e. the number of collectives the rank has finished, above
+// kStateBits bits of shm_state, so that the words only grow (modulo 2^32)
+// and a state left from a previous collective never satisfies a wait of the
+// current one. A rank finishing epoch e moves to (e + 1, INIT).
+constexpr int kStateBits = 4;
+
+inline uint32_t make_state(uint32_t epoch, enum shm_state state) {
+  return (epoch << kStateBits) | state;
+}
+
+inline void set_state(
     int* states_ptr,
     const int index,
+    uint32_t epoch,
     enum shm_state state) {
-  volatile int* state_ptr = states_ptr + index;
-  while (*state_ptr != state)
+  std::atomic_thread_fence(std::memory_order_release);
+  ((volatile uint32_t*)states_ptr)[index] = make_state(epoch, state);
+}
+
+// Waits until the rank index reaches (epoch, state). The rank may already be
+// in a later state of the same epoch, or in a later epoch.
+inline void wait_state_reached(
+    int* states_ptr,
+    const int index,
+    uint32_t epoch,
+    enum shm_state state) {
+  volatile uint32_t* state_ptr = (volatile uint32_t*)states_ptr + index;
+  uint32_t target = make_state(epoch, state);
+  while ((int32_t)(*state_ptr - target) < 0)
     _mm_pause();
+  std::atomic_thread_fence(std::memory_order_acquire);
+}
+
+// Returns the epoch of the collective to start, once all the ranks have
+// finished the previous one and won't read the shared memory buffer anymore.
+inline uint32_t begin_collective(int* states_ptr, int rank, int world_size) {
+  uint32_t epoch = ((uint32_t)states_ptr[rank]) >> kStateBits;
+  for (int i = 0; i < world_size; i++) {
+    wait_state_reached(states_ptr, i, epoch, INIT);
+  }
+  return epoch;
+}
+
+inline void finish_collective(int* states_ptr, int rank, uint32_t epoch) {
+  set_state(states_ptr, rank, epoch + 1, INIT);
 }
 
 inline void wait_block_until(
@@ -52,9 +107,9 @@ static inline void multiThreadCopy(DST_T* dst, SRC_T* src, int size) {
  * in the receive buffer. Firstly, the elements in the send buffer are
  * copied into the shared memory buffer. Then, the elements in the shared
  * memory buffer are added together and stored in the receive buffer. They
- * are 4 state to be maintained in the shared memory buffer:  0: ready for
- * all-reduce, e.g, initialized or last round all-reduce finished; 1: rank-0
- * copy ready; 2: finish add for other ranks; 3: finish broadcast
+ * are 3 states of the current epoch to be maintained in the shared memory
+ * buffer: 0: ready for all-reduce, i.e. every rank finished the last round;
+ * 1: rank-0 copy ready; 2: finish add for other ranks
  * @tparam T The data type of the elements in the buffers.
  * @param sendBuf Pointer to the send buffer.
  * @param recvBuf Pointer to the receive buffer.
@@ -86,22 +141,17 @@ void reduceAdd_impl(
   float* address = (float*)t_address.data_ptr();
   uint8_t* block_states_ptr = (uint8_t*)t_blockState.data_ptr();
   int* states_ptr = t_state.data_ptr<int>();
+  uint32_t epoch = begin_collective(states_ptr, rank, rankSize);
   {
     RECORD_FUNCTION(
         "ipex::shm_all_reduce_add::rank0_copy", c10::ArrayRef<c10::IValue>({}));
     if (rank == 0) {
-      for (int i = 1; i < rankSize; i++) {
-        wait_state_until(states_ptr, i, INIT);
-      }
       multiThreadCopy<float, T>(address, sendBuf, size);
-
     } else {
-      wait_state_until(states_ptr, rank, INIT);
-      wait_state_until(states_ptr, 0, RANK0_COPY);
+      wait_state_reached(states_ptr, 0, epoch, RANK0_COPY);
     }
   }
-  std::atomic_thread_fence(std::memory_order_release);
-  states_ptr[rank] = RANK0_COPY;
+  set_state(states_ptr, rank, epoch, RANK0_COPY);
   {
     RECORD_FUNCTION(
         "ipex::shm_all_reduce_add::copy_add_rankx",
@@ -129,29 +179,135 @@ void reduceAdd_impl(
         std::atomic_thread_fence(std::memory_order_release);
         block_states_ptr[blockIndex * rankSize + rank] = COPY_ADD_DONE_BLOCK;
       }
-      std::atomic_thread_fence(std::memory_order_release);
-      states_ptr[rank] = RANKX_COPY_ADD;
+      set_state(states_ptr, rank, epoch, RANKX_COPY_ADD);
     }
   }
   {
     RECORD_FUNCTION(
         "ipex::shm_all_reduce_add::broadcast", c10::ArrayRef<c10::IValue>({}));
-    wait_state_until(states_ptr, rankSize - 1, RANKX_COPY_ADD);
+    wait_state_reached(states_ptr, rankSize - 1, epoch, RANKX_COPY_ADD);
     multiThreadCopy<T, float>(recvBuf, address, size);
-    if (rank == rankSize - 1) {
-      for (int i = 0; i < rankSize - 1; i++) {
-        wait_state_until(states_ptr, i, BROADCAST);
-      }
+  }
+  finish_collective(states_ptr, rank, epoch);
+}
 
-      for (int i = 0; i < rankSize; i++) {
-        std::atomic_thread_fence(std::memory_order_release);
-        states_ptr[i] = INIT;
+/**
+ * @brief Performs the all-reduce with a reduce-scatter followed by an
+ * all-gather. Every rank copies its send buffer into its own region of the
+ * shared memory buffer. Each rank then owns 1/rankSize of the elements and
+ * reduces that slice from the regions of all peers in parallel. It writes
+ * the result back into the same slice of its own region, which no other rank
+ * reads during the reduction. At last every rank gathers the reduced slices
+ * of all ranks into the receive buffer. Unlike the chained algorithm, no rank
+ * copies the whole tensor serially and no rank waits on its predecessor, so
+ * the latency does not grow linearly with the world size. The states of the
+ * current epoch are: 3: own region copied; 4: own slice reduced.
+ * @tparam T The data type of the elements in the buffers.
+ * @param sendBuf Pointer to the send buffer.
+ * @param recvBuf Pointer to the receive buffer.
+ * @param t_address The tensor of the shared memory buffer. It must hold
+ * rankSize * size elements of T.
+ * @param t_state The tensor of the state.
+ * @param size The number of elements in the buffers.
+ * @param rank The rank of the current process.
+ * @param rankSize The total number of processes.
+ */
+template <typename T>
+void reduceAdd_rs_ag_impl(
+    T* sendBuf,
+    T* recvBuf,
+    at::Tensor t_address,
+    at::Tensor t_state,
+    unsigned long size,
+    int rank,
+    int rankSize) {
+  constexpr int sizePerSplit = 512;
+  T* address = (T*)t_address.data_ptr();
+  int* states_ptr = t_state.data_ptr<int>();
+  uint32_t epoch = begin_collective(states_ptr, rank, rankSize);
+  // Slices are the share of a rank rounded up to a multiple of sizePerSplit,
+  // so that no rank reduces more than one split over the even share. The last
+  // slices are shorter, or empty, as the slices are clipped to size.
+  unsigned long share = (size + rankSize - 1) / rankSize;
+  unsigned long slice_size =
+      (share + sizePerSplit - 1) / sizePerSplit * sizePerSplit;
+  auto slice_begin = [&](int r) {
+    return std::min<unsigned long>(r * slice_size, size);
+  };
+  auto slice_end = [&](int r) { return slice_begin(r + 1); };
+  {
+    RECORD_FUNCTION(
+        "ipex::shm_all_reduce_add::rs_copy", c10::ArrayRef<c10::IValue>({}));
+    multiThreadCopy<T, T>(address + rank * size, sendBuf, size);
+    set_state(states_ptr, rank, epoch, RS_COPY);
+  }
+  {
+    RECORD_FUNCTION(
+        "ipex::shm_all_reduce_add::reduce_scatter",
+        c10::ArrayRef<c10::IValue>({}));
+    for (int i = 0; i < rankSize; i++) {
+      wait_state_reached(states_ptr, i, epoch, RS_COPY);
+    }
+    auto begin = slice_begin(rank);
+    int splits = (slice_end(rank) - begin + sizePerSplit - 1) / sizePerSplit;
+#pragma omp parallel for
+    for (int i = 0; i < splits; ++i) {
+      auto offset = begin + i * sizePerSplit;
+      int split_size = std::min<unsigned long>(
+          sizePerSplit, slice_end(rank) - offset);
+      float acc[sizePerSplit];
+      torch_ipex::cpu::kernel::move_ker<float, T>(
+          acc, address + offset, split_size);
+      for (int r = 1; r < rankSize; r++) {
+        torch_ipex::cpu::kernel::add_ker<float, T>(
+            acc, address + r * size + offset, split_size);
       }
-    } else {
-      std::atomic_thread_fence(std::memory_order_release);
-      states_ptr[rank] = BROADCAST;
+      torch_ipex::cpu::kernel::move_ker<T, float>(
+          address + rank * size + offset, acc, split_size);
+    }
+    set_state(states_ptr, rank, epoch, RS_REDUCE);
+  }
+  {
+    RECORD_FUNCTION(
+        "ipex::shm_all_reduce_add::all_gather", c10::ArrayRef<c10::IValue>({}));
+    for (int i = 0; i < rankSize; i++) {
+      wait_state_reached(states_ptr, i, epoch, RS_REDUCE);
+    }
+    for (int r = 0; r < rankSize; r++) {
+      auto begin = slice_begin(r);
+      multiThreadCopy<T, T>(
+          recvBuf + begin, address + r * size + begin, slice_end(r) - begin);
     }
   }
+  finish_collective(states_ptr, rank, epoch);
+}
+
+template <typename T>
+void reduceAdd_dispatch(
+    T* buf,
+    at::Tensor& t_address,
+    at::Tensor& t_state,
+    at::Tensor& t_blockState,
+    int64_t shm_block_size,
+    int64_t rank,
+    int64_t world_size,
+    unsigned long size,
+    bool reduce_scatter) {
+  if (reduce_scatter) {
+    reduceAdd_rs_ag_impl(buf, buf, t_address, t_state, size, rank, world_size);
+  } else {
+    reduceAdd_impl(
+        buf,
+        buf,
+        t_address,
+        t_state,
+        t_blockState,
+        shm_block_size,
+        size,
+        sizeof(T),
+        rank,
+        world_size);
+  }
 }
 
 at::Tensor shm_all_reduce_add_kernel_impl(
@@ -161,70 +317,66 @@ at::Tensor shm_all_reduce_add_kernel_impl(
     at::Tensor& t_blockState,
     int64_t shm_block_size,
     int64_t rank,
-    int64_t world_size) {
+    int64_t world_size,
+    bool reduce_scatter) {
   RECORD_FUNCTION("ipex::shm_all_reduce_add", c10::ArrayRef<c10::IValue>({}));
   // torch_ipex::cpu::shm_all_reduce_add_kernel_stub(kCPU, t_in);
   auto dtype = t_in.scalar_type();
   if (dtype == at::ScalarType::BFloat16) {
-    reduceAdd_impl(
-        (at::BFloat16*)t_in.data_ptr(),
+    reduceAdd_dispatch(
         (at::BFloat16*)t_in.data_ptr(),
         t_address,
         t_state,
         t_blockState,
         shm_block_size,
-        t_in.numel(),
-        sizeof(at::BFloat16),
         rank,
-        world_size);
+        world_size,
+        t_in.numel(),
+        reduce_scatter);
   } else if (dtype == at::ScalarType::Half) {
-    reduceAdd_impl(
-        (at::Half*)t_in.data_ptr(),
+    reduceAdd_dispatch(
         (at::Half*)t_in.data_ptr(),
         t_address,
         t_state,
         t_blockState,
         shm_block_size,
-        t_in.numel(),
-        sizeof(at::Half),
         rank,
-        world_size);
+        world_size,
+        t_in.numel(),
+        reduce_scatter);
   } else if (dtype == at::ScalarType::Float) {
-    reduceAdd_impl(
-        (float*)t_in.data_ptr(),
+    reduceAdd_dispatch(
         (float*)t_in.data_ptr(),
         t_address,
         t_state,
         t_blockState,
         shm_block_size,
-        t_in.numel(),
-        sizeof(float),
         rank,
-        world_size);
+        world_size,
+        t_in.numel(),
+        reduce_scatter);
   } else if (dtype == at::ScalarType::Int) {
-    reduceAdd_impl(
-        (int*)t_in.data_ptr(),
+    reduceAdd_dispatch(
         (int*)t_in.data_ptr(),
         t_address,
         t_state,
         t_blockState,
         shm_block_size,
-        t_in.numel(),
-        sizeof(int),
         rank,
-        world_size);
+        world_size,
+        t_in.numel(),
+        reduce_scatter);
   } else if (dtype == at::ScalarType::Long) {
-    reduceAdd_impl(
-        (int64_t*)t_in.data_ptr(),
+    reduceAdd_dispatch(
         (int64_t*)t_in.data_ptr(),
         t_address,
         t_state,
         t_blockState,
         shm_block_size,
-        t_in.numel(),
-        sizeof(int64_t),
         rank,
-        world_size);
+        world_size,
+        t_in.numel(),
+        reduce_scatter);
   } else {
     TORCH_CHECK(
         false,
@@ -234,11 +386,196 @@ at::Tensor shm_all_reduce_add_kernel_impl(
   }
   return t_in;
 }
+
+/**
+ * @brief Exchanges the rows of t_in between all the ranks. The shared memory
+ * buffer is split into one region per rank. Every rank publishes its send
+ * splits in the header of its region, so that all the ranks learn the size
+ * of every message. If the messages of every rank fit into its region, each
+ * rank copies its rows after its header and then gathers the rows sent to
+ * it from the regions of all ranks, ordered by source rank. The states of
+ * the current epoch are: 5: splits published; 6: rows copied.
+ * @param t_in The rows to send, send_splits[r] of them to rank r.
+ * @param send_splits The number of rows sent to each rank.
+ * @param recv_splits Filled with the number of rows received from each rank.
+ * @param t_address The tensor of the shared memory buffer.
+ * @param t_state The tensor of the state.
+ * @param rank The rank of the current process.
+ * @param world_size The total number of processes.
+ * @return The received rows, or an undefined tensor if the messages don't
+ * fit into the shared memory buffer.
+ */
+at::Tensor shm_all_to_all_kernel_impl(
+    const at::Tensor& t_in,
+    const std::vector<int64_t>& send_splits,
+    std::vector<int64_t>& recv_splits,
+    at::Tensor& t_address,
+    at::Tensor& t_state,
+    int64_t rank,
+    int64_t world_size) {
+  RECORD_FUNCTION("ipex::shm_all_to_all", c10::ArrayRef<c10::IValue>({}));
+  int64_t row_bytes =
+      c10::multiply_integers(t_in.sizes().slice(1)) * t_in.element_size();
+  uint8_t* address = (uint8_t*)t_address.data_ptr();
+  int* states_ptr = t_state.data_ptr<int>();
+  size_t region_bytes = t_address.nbytes() / world_size / 64 * 64;
+  size_t header_bytes = (world_size * sizeof(int64_t) + 63) / 64 * 64;
+  auto region = [&](int64_t r) { return address + r * region_bytes; };
+  auto splits_of = [&](int64_t r) { return (int64_t*)region(r); };
+  uint32_t epoch = begin_collective(states_ptr, rank, world_size);
+  {
+    RECORD_FUNCTION(
+        "ipex::shm_all_to_all::splits", c10::ArrayRef<c10::IValue>({}));
+    std::copy(send_splits.begin(), send_splits.end(), splits_of(rank));
+    set_state(states_ptr, rank, epoch, A2A_SPLITS);
+    for (int i = 0; i < world_size; i++) {
+      wait_state_reached(states_ptr, i, epoch, A2A_SPLITS);
+    }
+  }
+  bool fits = true;
+  recv_splits.assign(world_size, 0);
+  for (int64_t r = 0; r < world_size; r++) {
+    int64_t rows = 0;
+    for (int64_t d = 0; d < world_size; d++)
+      rows += splits_of(r)[d];
+    recv_splits[r] = splits_of(r)[rank];
+    fits = fits && header_bytes + rows * row_bytes <= region_bytes;
+  }
+  at::Tensor t_out;
+  if (fits) {
+    RECORD_FUNCTION(
+        "ipex::shm_all_to_all::copy", c10::ArrayRef<c10::IValue>({}));
+    multiThreadCopy<uint8_t, uint8_t>(
+        region(rank) + header_bytes, (uint8_t*)t_in.data_ptr(), t_in.nbytes());
+    set_state(states_ptr, rank, epoch, A2A_COPY);
+    for (int i = 0; i < world_size; i++) {
+      wait_state_reached(states_ptr, i, epoch, A2A_COPY);
+    }
+    auto shape = t_in.sizes().vec();
+    shape[0] = std::accumulate(
+        recv_splits.begin(), recv_splits.end(), (int64_t)0);
+    t_out = at::empty(shape, t_in.options());
+    uint8_t* out = (uint8_t*)t_out.data_ptr();
+    for (int64_t r = 0; r < world_size; r++) {
+      int64_t rows_before = 0;
+      for (int64_t d = 0; d < rank; d++)
+        rows_before += splits_of(r)[d];
+      multiThreadCopy<uint8_t, uint8_t>(
+          out,
+          region(r) + header_bytes + rows_before * row_bytes,
+          recv_splits[r] * row_bytes);
+      out += recv_splits[r] * row_bytes;
+    }
+  }
+  finish_collective(states_ptr, rank, epoch);
+  return t_out;
+}
+
+/**
+ * @brief Gathers t_in of all the ranks along the last dimension. Every rank
+ * copies t_in into its block of the shared memory buffer, the blocks being
+ * laid out in rank order. Once all the blocks are copied, every rank copies
+ * the columns of each block directly into their place in t_out, so that no
+ * concatenation is needed afterwards. The state of the current epoch is:
+ * 7: own block copied.
+ * @param t_in The contiguous input of the current rank.
+ * @param t_out The contiguous output, its last dimension holding the
+ * columns of all ranks.
+ * @param cols_per_rank The offsets of the columns of each rank in t_out.
+ * @param t_address The tensor of the shared memory buffer.
+ * @param t_state The tensor of the state.
+ * @param rank The rank of the current process.
+ * @param world_size The total number of processes.
+ */
+void shm_all_gather_kernel_impl(
+    const at::Tensor& t_in,
+    at::Tensor& t_out,
+    const std::vector<int64_t>& cols_per_rank,
+    at::Tensor& t_address,
+    at::Tensor& t_state,
+    int64_t rank,
+    int64_t world_size) {
+  RECORD_FUNCTION("ipex::shm_all_gather", c10::ArrayRef<c10::IValue>({}));
+  uint8_t* address = (uint8_t*)t_address.data_ptr();
+  int* states_ptr = t_state.data_ptr<int>();
+  int64_t element_size = t_out.element_size();
+  int64_t total_cols = t_out.size(-1);
+  int64_t rows = total_cols == 0 ? 0 : t_out.numel() / total_cols;
+  auto block = [&](int64_t r) {
+    return address + rows * cols_per_rank[r] * element_size;
+  };
+  uint32_t epoch = begin_collective(states_ptr, rank, world_size);
+  {
+    RECORD_FUNCTION(
+        "ipex::shm_all_gather::copy", c10::ArrayRef<c10::IValue>({}));
+    multiThreadCopy<uint8_t, uint8_t>(
+        block(rank), (uint8_t*)t_in.data_ptr(), t_in.nbytes());
+    set_state(states_ptr, rank, epoch, GATHER_COPY);
+    for (int i = 0; i < world_size; i++) {
+      wait_state_reached(states_ptr, i, epoch, GATHER_COPY);
+    }
+  }
+  {
+    RECORD_FUNCTION(
+        "ipex::shm_all_gather::gather", c10::ArrayRef<c10::IValue>({}));
+    uint8_t* out = (uint8_t*)t_out.data_ptr();
+    int64_t out_row_bytes = total_cols * element_size;
+#pragma omp parallel for collapse(2)
+    for (int64_t r = 0; r < world_size; r++) {
+      for (int64_t i = 0; i < rows; i++) {
+        int64_t row_bytes =
+            (cols_per_rank[r + 1] - cols_per_rank[r]) * element_size;
+        memcpy(
+            out + i * out_row_bytes + cols_per_rank[r] * element_size,
+            block(r) + i * row_bytes,
+            row_bytes);
+      }
+    }
+  }
+  finish_collective(states_ptr, rank, epoch);
+}
+
+/**
+ * @brief Broadcasts t_in of rank root in place. The root copies t_in into
+ * the shared memory buffer, then the other ranks copy it out. The state of
+ * the current epoch is: 8: root copied.
+ * @param t_in The contiguous tensor to broadcast.
+ * @param root The rank broadcasting t_in.
+ * @param t_address The tensor of the shared memory buffer.
+ * @param t_state The tensor of the state.
+ * @param rank The rank of the current process.
+ * @param world_size The total number of processes.
+ */
+void shm_broadcast_kernel_impl(
+    at::Tensor& t_in,
+    int64_t root,
+    at::Tensor& t_address,
+    at::Tensor& t_state,
+    int64_t rank,
+    int64_t world_size) {
+  RECORD_FUNCTION("ipex::shm_broadcast", c10::ArrayRef<c10::IValue>({}));
+  uint8_t* address = (uint8_t*)t_address.data_ptr();
+  int* states_ptr = t_state.data_ptr<int>();
+  uint32_t epoch = begin_collective(states_ptr, rank, world_size);
+  if (rank == root) {
+    multiThreadCopy<uint8_t, uint8_t>(
+        address, (uint8_t*)t_in.data_ptr(), t_in.nbytes());
+    set_state(states_ptr, rank, epoch, BCAST_COPY);
+  } else {
+    wait_state_reached(states_ptr, root, epoch, BCAST_COPY);
+    multiThreadCopy<uint8_t, uint8_t>(
+        (uint8_t*)t_in.data_ptr(), address, t_in.nbytes());
+  }
+  finish_collective(states_ptr, rank, epoch);
+}
 } // namespace
 
 IPEX_REGISTER_DISPATCH(
     shm_all_reduce_add_kernel_stub,
     &shm_all_reduce_add_kernel_impl);
+IPEX_REGISTER_DISPATCH(shm_all_to_all_kernel_stub, &shm_all_to_all_kernel_impl);
+IPEX_REGISTER_DISPATCH(shm_all_gather_kernel_stub, &shm_all_gather_kernel_impl);
+IPEX_REGISTER_DISPATCH(shm_broadcast_kernel_stub, &shm_broadcast_kernel_impl);
 
 } // namespace cpu
 } // namespace torch_ipex
@@ -5,6 +5,13 @@
 #include <ATen/cpu/vec/functional.h>
 #include <ATen/cpu/vec/vec.h>
 #include <aten/Linear.h>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <unordered_map>
 #include "csrc/cpu/tpp/woq/tla.h"
 
 #ifdef __GNUC__
@@ -1630,6 +1637,189 @@ class DequantGemmTPP<
   long ldc;
 };
 
+// Blocking and scheduling of qlinear_woq_affine_impl that can be tuned at
+// runtime. PREFETCH_K_DIST and LOOP_K_UNROLL are template parameters of the
+// micro-kernels and are not part of it.
+struct WoqTuneConfig {
+  long block_m;
+  long k_splits;
+  // parallelize over M in the GEMM loop nest ("ACb"/"CAB" vs "aCb"/"ABc")
+  bool parallel_m;
+};
+
+// The heuristic used when autotuning is off or a shape isn't tuned yet.
+inline WoqTuneConfig woq_default_config(long M, long Kc, long k_splits) {
+  // TODO(jgong5): improve the heuristic
+  long block_m = M < 32 ? M : (M < 64 ? 32 : 64);
+  // TODO(jgong5): use heuristics to decide k_splits
+  if (k_splits <= 0 || M >= 32 || M % block_m) {
+    k_splits = 1;
+  }
+  return {block_m, k_splits, M >= PARALLEL_M_THRESHOLD};
+}
+
+// Autotuner of WoqTuneConfig, enabled by IPEX_WOQ_AUTOTUNE=1. On the first
+// call of a (M bucket, N, K, qw_type, dtypes, quant modes) key it times every
+// valid candidate with the real inputs and keeps the fastest one. With
+// IPEX_WOQ_TUNING_FILE, tuned configs are loaded from the file at startup (also
+// when autotuning is off) and new winners are appended to it, so that later
+// processes skip the tuning.
+class WoqTuner {
+ public:
+  static WoqTuner& get() {
+    static WoqTuner tuner;
+    return tuner;
+  }
+
+  bool active() const {
+    return autotune_ || loaded_configs_;
+  }
+
+  static std::string make_key(
+      long M,
+      long N,
+      long K,
+      int qw_type,
+      at::ScalarType act_dtype,
+      at::ScalarType compute_dtype,
+      int quant_a_mode,
+      int quant_w_mode) {
+    // M is bucketed to the next power of 2
+    long m_bucket = 1;
+    while (m_bucket < M)
+      m_bucket <<= 1;
+    std::ostringstream key;
+    key << m_bucket << ',' << N << ',' << K << ',' << qw_type << ','
+        << c10::toString(act_dtype) << ',' << c10::toString(compute_dtype)
+        << ',' << quant_a_mode << ',' << quant_w_mode;
+    return key.str();
+  }
+
+  // run(config) computes the output with the given config. The tuned keys
+  // are looked up under a shared lock. A missing key is tuned without the
+  // lock, so that the other shapes keep running meanwhile, and the first
+  // thread to finish the tuning of a key inserts its winner.
+  template <typename F>
+  WoqTuneConfig lookup_or_tune(
+      const std::string& key,
+      long M,
+      long Kc,
+      const WoqTuneConfig& default_config,
+      const F& run) {
+    {
+      std::shared_lock<std::shared_mutex> lock(mutex_);
+      auto search = configs_.find(key);
+      if (search != configs_.end()) {
+        return search->second;
+      }
+    }
+    if (!autotune_) {
+      return default_config;
+    }
+    constexpr int kWarmupIters = 1;
+    constexpr int kTimedIters = 3;
+    WoqTuneConfig best = default_config;
+    double best_time = std::numeric_limits<double>::max();
+    for (auto& config : candidates(M, Kc, default_config)) {
+      for (int i = 0; i < kWarmupIters; i++) {
+        run(config);
+      }
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < kTimedIters; i++) {
+        run(config);
+      }
+      double time = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+      if (time < best_time) {
+        best_time = time;
+        best = config;
+      }
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto inserted = configs_.emplace(key, best);
+    if (!inserted.second) {
+      // tuned concurrently by another thread
+      return inserted.first->second;
+    }
+    if (!tuning_file_.empty()) {
+      std::ofstream ofs(tuning_file_, std::ofstream::app);
+      ofs << key << ' ' << best.block_m << ' ' << best.k_splits << ' '
+          << best.parallel_m << std::endl;
+    }
+    return best;
+  }
+
+ private:
+  WoqTuner() {
+    const char* autotune = getenv("IPEX_WOQ_AUTOTUNE");
+    autotune_ = autotune != nullptr && std::string(autotune) == "1";
+    const char* tuning_file = getenv("IPEX_WOQ_TUNING_FILE");
+    if (tuning_file != nullptr) {
+      tuning_file_ = tuning_file;
+      std::ifstream ifs(tuning_file_);
+      std::string line;
+      while (std::getline(ifs, line)) {
+        if (line.empty()) {
+          continue;
+        }
+        // BLOCK_M sizes the on-stack buffers of the kernel, so a stale or
+        // corrupted entry falls back to the default config of its shape
+        std::istringstream iss(line);
+        std::string key;
+        long block_m = 0, k_splits = 0, parallel_m = -1;
+        if (!(iss >> key >> block_m >> k_splits >> parallel_m) ||
+            block_m <= 0 || block_m > 64 ||
+            (k_splits != 1 && k_splits != 2 && k_splits != 4) ||
+            (parallel_m != 0 && parallel_m != 1)) {
+          TORCH_WARN(
+              "IPEX_WOQ_TUNING_FILE: skip the invalid entry \"", line, "\"");
+          continue;
+        }
+        configs_[key] = {block_m, k_splits, parallel_m == 1};
+      }
+    }
+    // configs_ is only read under mutex_ once the kernels run
+    loaded_configs_ = !configs_.empty();
+  }
+
+  static std::vector<WoqTuneConfig> candidates(
+      long M,
+      long Kc,
+      const WoqTuneConfig& default_config) {
+    std::vector<WoqTuneConfig> configs{default_config};
+    // BLOCK_M sizes the on-stack buffers, so it's kept at most 64
+    for (long block_m : {M, 16L, 32L, 64L}) {
+      if (block_m > M || block_m <= 0 || block_m > 64)
+        continue;
+      for (long k_splits : {1L, 2L, 4L}) {
+        // k_splits > 1 requires full M blocks
+        if (k_splits > 1 && (Kc % k_splits != 0 || M % block_m != 0))
+          continue;
+        for (bool parallel_m : {false, true}) {
+          WoqTuneConfig config{block_m, k_splits, parallel_m};
+          bool seen = false;
+          for (auto& c : configs) {
+            seen = seen ||
+                (c.block_m == config.block_m &&
+                 c.k_splits == config.k_splits &&
+                 c.parallel_m == config.parallel_m);
+          }
+          if (!seen)
+            configs.push_back(config);
+        }
+      }
+    }
+    return configs;
+  }
+
+  bool autotune_;
+  bool loaded_configs_;
+  std::string tuning_file_;
+  std::unordered_map<std::string, WoqTuneConfig> configs_;
+  std::shared_mutex mutex_;
+};
+
 // If T != TComp
 //   T -> TComp -> GEMM -> TComp -> bias/PostOp -> Tout
 // If T == TComp (we can save intermediate output buffer and schedule M/N/K
@@ -1657,7 +1847,8 @@ void qlinear_woq_affine_impl(
     int64_t quant_block_k,
     const std::optional<at::Tensor>& zps = std::nullopt, // dtype is TComp
     float* scales_a_ptr = nullptr,
-    int32_t* zps_a_ptr = nullptr) {
+    int32_t* zps_a_ptr = nullptr,
+    const WoqTuneConfig* tune_config = nullptr) {
   const bool is_4bit_flag = is_4bit(qw_type);
   const bool sym_quant = is_sym_quant(qw_type);
   auto w_sizes = qw_packed.sizes();
@@ -1675,24 +1866,56 @@ void qlinear_woq_affine_impl(
 
   TLA_ASSERT(Nb % 16 == 0, "Nb must be a multiple of 16");
 
-  // select BLOCK_M according to M
-  // TODO(jgong5): improve the heuristic
-  auto BLOCK_M = [&]() -> long {
-    if (M < 32) {
-      return M;
-    } else if (M < 64) {
-      return 32;
-    } else {
-      return 64;
-    }
-  }();
-
+  // select BLOCK_M, k_splits and the loop scheme according to M, or take
+  // them from the autotuner
+  auto config = woq_default_config(M, Kc, k_splits);
+  if (tune_config) {
+    config = *tune_config;
+  } else if (WoqTuner::get().active()) {
+    auto key = WoqTuner::make_key(
+        M,
+        N,
+        K,
+        qw_type,
+        c10::CppTypeToScalarType<T>::value,
+        c10::CppTypeToScalarType<TComp>::value,
+        quant_a_mode,
+        quant_w_mode);
+    config = WoqTuner::get().lookup_or_tune(
+        key, M, Kc, config, [&](const WoqTuneConfig& candidate) {
+          qlinear_woq_affine_impl<
+              T,
+              TComp,
+              TGemmOut,
+              Tout,
+              TScale,
+              TZero,
+              quant_a_mode,
+              quant_w_mode>(
+              x,
+              qw_packed,
+              scales,
+              b,
+              y,
+              qw_type,
+              k_splits,
+              fusion_type,
+              others_list,
+              quant_block_k,
+              zps,
+              scales_a_ptr,
+              zps_a_ptr,
+              &candidate);
+        });
+  }
+  // a config tuned for the M bucket may not fit this M
+  auto BLOCK_M = std::min<long>(config.block_m, M);
   auto BLOCK_M_rem = M % BLOCK_M;
-
-  // TODO(jgong5): use heuristics to decide k_splits
-  if (k_splits <= 0 || M >= 32 || BLOCK_M_rem) {
+  k_splits = config.k_splits;
+  if (k_splits <= 0 || BLOCK_M_rem || Kc % k_splits) {
     k_splits = 1;
   }
+  const bool parallel_m = config.parallel_m;
   TLA_ASSERT(Kc % k_splits == 0, "Kc must be a multiple of k_splits");
   TLA_ASSERT(
       !(std::is_same<T, uint8_t>()) || (std::is_same<T, TComp>()),
@@ -1879,7 +2102,7 @@ void qlinear_woq_affine_impl(
 
             // TODO(jgong5): parallelize over M on large BS
             if (no_y_buf) {
-              auto loop_scheme = M >= PARALLEL_M_THRESHOLD ? "ACb" : "aCb";
+              auto loop_scheme = parallel_m ? "ACb" : "aCb";
               auto gemm_loop = ThreadedLoop<3>(
                   {{0, M, BLOCK_M, false}, {Kc}, {Nc}}, loop_scheme);
               gemm_loop(
@@ -2022,7 +2245,7 @@ void qlinear_woq_affine_impl(
               auto y_private_ptr = GetVLAPtr<TGemmOut>(y_private, {M, Nc, Nb});
               auto y_private_valid_ptr =
                   GetVLAPtr<bool>(y_private_valid, {M / BLOCK_M, Nc});
-              auto loop_scheme = M >= PARALLEL_M_THRESHOLD ? "CAB" : "ABc";
+              auto loop_scheme = parallel_m ? "CAB" : "ABc";
               auto gemm_loop = ThreadedLoop<3>(
                   {{Nc}, {0, Kc, Kc / k_splits, true}, {0, M, BLOCK_M, false}},
                   loop_scheme);
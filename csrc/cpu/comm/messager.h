@@ -3,8 +3,15 @@
 #include <mpi.h>
 
 #include <torch/all.h>
+#include <condition_variable>
 #include <cstdlib>
+#include <deque>
+#include <future>
 #include <iostream>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <unordered_map>
 #include "oneapi/ccl.hpp"
 #ifdef USE_SHM
 #include "shm_reduction.h"
@@ -63,45 +70,72 @@ class Messenger {
     size = pcomm->size();
 
 #ifdef USE_SHM
-    char my_hostname[MPI_MAX_PROCESSOR_NAME];
-    char all_hostnames[MPI_MAX_PROCESSOR_NAME * MPI_MAX_PROCESSOR_NAME];
-    int hostname_len;
-
-    // Check ranks are on the same physical machine
-    MPI_Get_processor_name(my_hostname, &hostname_len);
-    MPI_Allgather(
-        my_hostname,
-        MPI_MAX_PROCESSOR_NAME,
-        MPI_CHAR,
-        all_hostnames,
-        MPI_MAX_PROCESSOR_NAME,
-        MPI_CHAR,
-        MPI_COMM_WORLD);
-
-    int same_hostnames = 1;
-    for (int i = 1; i < size; i++) {
-      if (strcmp(my_hostname, &all_hostnames[i * MPI_MAX_PROCESSOR_NAME]) !=
-          0) {
-        same_hostnames = 0;
-        break;
-      }
-    }
+    // Group the ranks sharing a host, which reduce through SHM. With several
+    // hosts, the local rank 0 of every host also joins a CCL communicator of
+    // the host leaders for the hierarchical all-reduce.
+    MPI_Comm local_comm;
+    MPI_Comm_split_type(
+        MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &local_comm);
+    MPI_Comm_size(local_comm, &local_size);
+    MPI_Comm_rank(local_comm, &local_rank);
+    single_host = local_size == size;
 
-    if (same_hostnames) {
-      pshm = new ShmReduction(rank, size, [this](int* pid_fd, size_t count) {
-        this->broadcast(pid_fd, count);
-      });
+    if (local_size > 1) {
+      pshm = new ShmReduction(
+          local_rank, local_size, [local_comm](int* pid_fd, size_t count) {
+            MPI_Bcast(pid_fd, count, MPI_INT, 0, local_comm);
+          });
     } else {
       pshm = nullptr;
     }
+    MPI_Comm_free(&local_comm);
+
+    if (!single_host) {
+      MPI_Comm leader_mpi_comm;
+      MPI_Comm_split(
+          MPI_COMM_WORLD,
+          local_rank == 0 ? 0 : MPI_UNDEFINED,
+          rank,
+          &leader_mpi_comm);
+      if (local_rank == 0) {
+        int num_hosts, host_id;
+        MPI_Comm_size(leader_mpi_comm, &num_hosts);
+        MPI_Comm_rank(leader_mpi_comm, &host_id);
+        ccl::shared_ptr_class<ccl::kvs> leader_kvs;
+        ccl::kvs::address_type leader_addr;
+        if (host_id == 0) {
+          leader_kvs = ccl::create_main_kvs();
+          leader_addr = leader_kvs->get_address();
+        }
+        MPI_Bcast(
+            (void*)leader_addr.data(),
+            leader_addr.size(),
+            MPI_BYTE,
+            0,
+            leader_mpi_comm);
+        if (host_id != 0)
+          leader_kvs = ccl::create_kvs(leader_addr);
+        leader_comm = new ccl::communicator(
+            ccl::create_communicator(num_hosts, host_id, leader_kvs));
+        MPI_Comm_free(&leader_mpi_comm);
+      }
+    }
 #endif
   }
 
   ~Messenger() {
+    {
+      std::lock_guard<std::mutex> lock(async_mutex);
+      async_stop = true;
+    }
+    async_cv.notify_all();
+    if (comm_thread.joinable())
+      comm_thread.join();
     delete pcomm;
 #ifdef USE_SHM
     if (pshm != nullptr)
       delete pshm;
+    delete leader_comm;
 #endif
   }
 
@@ -122,7 +156,7 @@ class Messenger {
     }
   }
 
-  void ccl_allreduce_add(at::Tensor& t_in) {
+  void ccl_allreduce_add(at::Tensor& t_in, ccl::communicator& comm) {
     auto ccl_dtype = get_ccl_dtype(t_in.scalar_type());
     ccl::allreduce(
         t_in.data_ptr(),
@@ -130,8 +164,35 @@ class Messenger {
         (size_t)t_in.numel(),
         ccl_dtype,
         ccl::reduction::sum,
+        comm)
+        .wait();
+  }
+
+  at::Tensor ccl_alltoallv(
+      const at::Tensor& t_in,
+      const std::vector<int64_t>& send_splits,
+      const std::vector<int64_t>& recv_splits) {
+    int64_t row_bytes =
+        c10::multiply_integers(t_in.sizes().slice(1)) * t_in.element_size();
+    std::vector<size_t> send_counts, recv_counts;
+    for (int i = 0; i < size; i++) {
+      send_counts.push_back(send_splits[i] * row_bytes);
+      recv_counts.push_back(recv_splits[i] * row_bytes);
+    }
+    auto shape = t_in.sizes().vec();
+    shape[0] = std::accumulate(
+        recv_splits.begin(), recv_splits.end(), (int64_t)0);
+    auto t_out = at::empty(shape, t_in.options());
+    RECORD_FUNCTION("ccl::alltoallv", std::vector<c10::IValue>());
+    ccl::alltoallv(
+        t_in.data_ptr(),
+        send_counts,
+        t_out.data_ptr(),
+        recv_counts,
+        ccl::datatype::uint8,
         *pcomm)
         .wait();
+    return t_out;
   }
 
  public:
@@ -154,57 +215,189 @@ class Messenger {
 
   /**
    * Performs a reduction operation by adding the elements of the input tensor.
-   * If USE_SHM is defined and the size of the tensor exceeds the shared memory
-   * size or local ranks flag is false, the reduction is performed using the
-   * ccl_allreduce_add method. Otherwise, the reduction is performed using the
-   * reduceAdd method of the pshm object which used SHM. If USE_SHM is not
-   * defined, the reduction is always performed using the ccl_allreduce_add
-   * method.
+   * If USE_SHM is defined and several ranks share this host, or the ranks
+   * span several hosts, the tensor is streamed in chunks of at most the SHM
+   * buffer size. On a single host every chunk is reduced with the reduceAdd
+   * method of the pshm object. Across several hosts every chunk is reduced
+   * hierarchically: SHM within the host, ccl_allreduce_add between the host
+   * leaders, then SHM broadcast within the host, the SHM stages being
+   * skipped on the hosts running a single rank. Otherwise the reduction is
+   * always performed using the ccl_allreduce_add method.
    *
    * @param t_in The input tensor to be reduced.
    */
   void reduceAdd(at::Tensor& t_in) {
-#ifdef USE_SHM
-    if (t_in.numel() * sizeof(float) > pshm->getSHMSize() || pshm == nullptr) {
-      this->ccl_allreduce_add(t_in);
-    } else {
-      pshm->reduceAdd(t_in);
+    wait_async_collectives();
+    reduce_add_impl(t_in);
+  }
+
+  /**
+   * Starts reduceAdd of t_in on the communication thread and returns a
+   * handle to wait for it with wait(), so that the caller can run
+   * independent compute meanwhile. The asynchronous all-reduces run one
+   * after the other in the order they were started, which must be the same
+   * on every rank. The synchronous collectives wait for them first. t_in
+   * must not be accessed until its handle is waited.
+   *
+   * @param t_in The input tensor to be reduced.
+   * @return The handle of the all-reduce.
+   */
+  int64_t reduceAddAsync(at::Tensor& t_in) {
+    return start_async(std::packaged_task<void()>(
+        [this, t_in]() mutable { this->reduce_add_impl(t_in); }));
+  }
+
+  /**
+   * Starts alltoallv of data on the communication thread, like
+   * reduceAddAsync, and returns a handle to wait for it with wait().
+   * recv_splits and t_out are filled by the exchange, so they must outlive
+   * the handle and must not be accessed until it is waited.
+   *
+   * @param data The rows to send, split along the first dimension.
+   * @param send_splits The number of rows sent to each rank.
+   * @param recv_splits Filled with the number of rows received from each
+   * rank.
+   * @param t_out Set to the received rows, ordered by source rank.
+   * @return The handle of the exchange.
+   */
+  int64_t alltoallvAsync(
+      const at::Tensor& data,
+      const std::vector<int64_t>& send_splits,
+      std::vector<int64_t>& recv_splits,
+      at::Tensor& t_out) {
+    TORCH_CHECK(
+        send_splits.size() == (size_t)size,
+        "alltoallv: expect one split per rank");
+    return start_async(std::packaged_task<void()>(
+        [this, data, send_splits, &recv_splits, &t_out]() {
+          t_out = this->alltoallv_impl(data, send_splits, recv_splits);
+        }));
+  }
+
+  /**
+   * Waits for the collective started by reduceAddAsync or alltoallvAsync
+   * and rethrows its error, if any. Every handle must be waited exactly
+   * once.
+   *
+   * @param handle The handle returned by reduceAddAsync or alltoallvAsync.
+   */
+  void wait(int64_t handle) {
+    std::shared_future<void> work;
+    {
+      std::lock_guard<std::mutex> lock(async_mutex);
+      auto it = async_works.find(handle);
+      TORCH_CHECK(
+          it != async_works.end(), "wait: unknown collective handle ", handle);
+      work = it->second;
+      async_works.erase(it);
     }
-#else
-    this->ccl_allreduce_add(t_in);
-#endif
+    RECORD_FUNCTION("ipex::all_reduce_wait", std::vector<c10::IValue>());
+    work.get();
   }
 
+  /**
+   * Gathers data of all the ranks along the last dimension. The columns of
+   * rank r are [cols_per_rank[r], cols_per_rank[r + 1]) of the output. Like
+   * reduceAdd, single-host ranks gather through SHM, directly into the
+   * output, when the whole output fits into the SHM buffer. Otherwise
+   * ccl::allgatherv is used.
+   *
+   * @param data The input tensor of the current rank.
+   * @param cols_per_rank The offsets of the columns of each rank.
+   * @return The gathered tensor.
+   */
   at::Tensor allgather(
-      at::Tensor data,
-      const std::vector<at::Tensor>& vec_data_out) {
+      const at::Tensor& data,
+      const std::vector<int64_t>& cols_per_rank) {
+    wait_async_collectives();
+    auto t_in = data.contiguous();
+    if (!check())
+      return t_in.clone();
+    auto shape = t_in.sizes().vec();
+    shape.back() = cols_per_rank[size] - cols_per_rank[0];
+    auto t_out = at::empty(shape, t_in.options());
+#ifdef USE_SHM
+    if (pshm != nullptr && single_host &&
+        t_out.nbytes() <= (size_t)pshm->getSHMSize()) {
+      pshm->allGather(t_in, t_out, cols_per_rank);
+      return t_out;
+    }
+#endif
+    std::vector<at::Tensor> vec_data_out;
     std::vector<size_t> recvCounts;
-    std::transform(
-        vec_data_out.begin(),
-        vec_data_out.end(),
-        std::back_inserter(recvCounts),
-        [](const at::Tensor& t) { return t.numel(); });
     std::vector<void*> recvBufs;
-    std::transform(
-        vec_data_out.begin(),
-        vec_data_out.end(),
-        std::back_inserter(recvBufs),
-        [](const at::Tensor& t) { return t.data_ptr(); });
+    for (int r = 0; r < size; r++) {
+      shape.back() = cols_per_rank[r + 1] - cols_per_rank[r];
+      vec_data_out.push_back(at::empty(shape, t_in.options()));
+      recvCounts.push_back(vec_data_out.back().numel());
+      recvBufs.push_back(vec_data_out.back().data_ptr());
+    }
     {
       RECORD_FUNCTION("ccl::allgatherv", std::vector<c10::IValue>());
       ccl::allgatherv(
-          data.data_ptr(),
-          (size_t)data.numel(),
+          t_in.data_ptr(),
+          (size_t)t_in.numel(),
           recvBufs,
           recvCounts,
-          get_ccl_dtype(data.scalar_type()),
+          get_ccl_dtype(t_in.scalar_type()),
           *pcomm)
           .wait();
     }
-    return at::cat(vec_data_out, -1);
+    return at::cat_out(t_out, vec_data_out, -1);
+  }
+
+  /**
+   * Broadcasts t_in of rank root to all the ranks in place. Like reduceAdd,
+   * single-host ranks broadcast through SHM when t_in fits into the SHM
+   * buffer, otherwise ccl::broadcast is used.
+   *
+   * @param t_in The contiguous tensor to broadcast.
+   * @param root The rank broadcasting t_in.
+   */
+  void broadcast(at::Tensor& t_in, int root) {
+    TORCH_CHECK(
+        t_in.is_contiguous(), "broadcast: expect a contiguous tensor");
+    wait_async_collectives();
+    if (!check())
+      return;
+#ifdef USE_SHM
+    if (pshm != nullptr && single_host &&
+        t_in.nbytes() <= (size_t)pshm->getSHMSize()) {
+      pshm->broadcast(t_in, root);
+      return;
+    }
+#endif
+    RECORD_FUNCTION("ccl::broadcast", std::vector<c10::IValue>());
+    ccl::broadcast(
+        t_in.data_ptr(), t_in.nbytes(), ccl::datatype::uint8, root, *pcomm)
+        .wait();
+  }
+
+  /**
+   * Exchanges the rows of data between all the ranks: the first
+   * send_splits[0] rows are sent to rank 0, the next send_splits[1] rows to
+   * rank 1 and so on. Same-host ranks exchange through SHM if the messages
+   * fit into it, otherwise the exchange uses ccl::alltoallv.
+   *
+   * @param data The rows to send, split along the first dimension.
+   * @param send_splits The number of rows sent to each rank.
+   * @param recv_splits Filled with the number of rows received from each
+   * rank.
+   * @return The received rows, ordered by source rank.
+   */
+  at::Tensor alltoallv(
+      const at::Tensor& data,
+      const std::vector<int64_t>& send_splits,
+      std::vector<int64_t>& recv_splits) {
+    TORCH_CHECK(
+        send_splits.size() == (size_t)size,
+        "alltoallv: expect one split per rank");
+    wait_async_collectives();
+    return alltoallv_impl(data, send_splits, recv_splits);
   }
 
   void barrier() {
+    wait_async_collectives();
     if (check()) {
       ccl::barrier(*pcomm);
     }
@@ -241,6 +434,134 @@ class Messenger {
     return size > 1;
   }
 
+  void reduce_add_impl(at::Tensor& t_in) {
+    if (!check())
+      return;
+#ifdef USE_SHM
+    // With several hosts every rank takes the hierarchical path, also the
+    // ranks alone on their host, so that all the host leaders join the same
+    // all-reduces of leader_comm.
+    if (pshm != nullptr || !single_host) {
+      TORCH_CHECK(
+          t_in.is_contiguous(), "reduceAdd: expect a contiguous tensor");
+      // Stream the large tensors through the SHM buffer in chunks. A chunk
+      // spans at most MAX_SHM_BLOCK_COUNT blocks of the chained algorithm,
+      // the number of block states in the SHM, and its fp32 staging fits the
+      // SHM buffer. The chunks do not depend on pshm, for the leaders of all
+      // the hosts to reduce the same chunks.
+      auto flat = t_in.view(-1);
+      int64_t numel = flat.numel();
+      constexpr int64_t chunk_numel =
+          (int64_t)SHM_BLOCK_SIZE_L * MAX_SHM_BLOCK_COUNT;
+      for (int64_t offset = 0; offset < numel; offset += chunk_numel) {
+        auto chunk =
+            flat.narrow(0, offset, std::min(chunk_numel, numel - offset));
+        if (single_host) {
+          pshm->reduceAdd(chunk);
+        } else {
+          hierarchical_reduce_add(chunk);
+        }
+      }
+      return;
+    }
+#endif
+    this->ccl_allreduce_add(t_in, *pcomm);
+  }
+
+  at::Tensor alltoallv_impl(
+      const at::Tensor& data,
+      const std::vector<int64_t>& send_splits,
+      std::vector<int64_t>& recv_splits) {
+    auto t_in = data.contiguous();
+    if (!check()) {
+      recv_splits = send_splits;
+      return t_in.clone();
+    }
+#ifdef USE_SHM
+    if (pshm != nullptr && single_host) {
+      auto t_out = pshm->allToAll(t_in, send_splits, recv_splits);
+      return t_out.defined() ? t_out
+                             : ccl_alltoallv(t_in, send_splits, recv_splits);
+    }
+#endif
+    recv_splits.assign(size, 0);
+    {
+      RECORD_FUNCTION("ccl::alltoall", std::vector<c10::IValue>());
+      ccl::alltoall(
+          send_splits.data(),
+          recv_splits.data(),
+          1,
+          ccl::datatype::int64,
+          *pcomm)
+          .wait();
+    }
+    return ccl_alltoallv(t_in, send_splits, recv_splits);
+  }
+
+#ifdef USE_SHM
+  // All-reduce over several hosts: SHM all-reduce within every host, CCL
+  // all-reduce of the host sums between the host leaders (local rank 0),
+  // then SHM broadcast of the result of the leader within every host. A rank
+  // alone on its host has no pshm and only joins the leader all-reduce.
+  void hierarchical_reduce_add(at::Tensor& t_in) {
+    if (pshm != nullptr)
+      pshm->reduceAdd(t_in);
+    if (leader_comm != nullptr)
+      this->ccl_allreduce_add(t_in, *leader_comm);
+    if (pshm != nullptr)
+      pshm->broadcast(t_in, 0);
+  }
+#endif
+
+  // Runs the asynchronous collectives in order. The SHM copies of the
+  // communication thread use a few OpenMP threads only, to leave the cores
+  // to the compute that overlaps them.
+  void comm_loop() {
+#ifdef USE_SHM
+    omp_set_num_threads(std::min(kAsyncCommThreads, omp_get_max_threads()));
+#endif
+    while (true) {
+      std::packaged_task<void()> work;
+      {
+        std::unique_lock<std::mutex> lock(async_mutex);
+        async_cv.wait(
+            lock, [this] { return async_stop || !async_queue.empty(); });
+        if (async_queue.empty())
+          return;
+        work = std::move(async_queue.front());
+        async_queue.pop_front();
+      }
+      work();
+      {
+        std::lock_guard<std::mutex> lock(async_mutex);
+        async_pending--;
+      }
+      async_cv.notify_all();
+    }
+  }
+
+  int64_t start_async(std::packaged_task<void()> work) {
+    int64_t handle;
+    {
+      std::lock_guard<std::mutex> lock(async_mutex);
+      if (!comm_thread.joinable())
+        comm_thread = std::thread(&Messenger::comm_loop, this);
+      handle = next_async_handle++;
+      async_works.emplace(handle, work.get_future().share());
+      async_queue.push_back(std::move(work));
+      async_pending++;
+    }
+    async_cv.notify_all();
+    return handle;
+  }
+
+  // The collectives must run in the same order on all the ranks, so the
+  // synchronous ones wait for the asynchronous ones started before.
+  void wait_async_collectives() {
+    std::unique_lock<std::mutex> lock(async_mutex);
+    async_cv.wait(lock, [this] { return async_pending == 0; });
+  }
+
  private:
   int size;
   int rank;
@@ -252,6 +573,23 @@ class Messenger {
 
 #ifdef USE_SHM
   ShmReduction* pshm;
+  // Ranks sharing the host of this rank, which reduce through pshm.
+  int local_rank = 0;
+  int local_size = 1;
+  bool single_host = true;
+  // Communicator of the local rank 0 of every host, only created on them
+  // when the ranks span several hosts.
+  ccl::communicator* leader_comm = nullptr;
 #endif
+
+  static constexpr int kAsyncCommThreads = 4;
+  std::thread comm_thread;
+  std::mutex async_mutex;
+  std::condition_variable async_cv;
+  std::deque<std::packaged_task<void()>> async_queue;
+  std::unordered_map<int64_t, std::shared_future<void>> async_works;
+  int64_t next_async_handle = 0;
+  int async_pending = 0;
+  bool async_stop = false;
 };
 #endif
\ No newline at end of file
@@ -24,6 +24,9 @@ namespace cpu {
 #define SHM_BLOCK_SIZE_S (16 * 5120)
 #define MAX_SHM_BLOCK_COUNT 4096
 #define MAX_SHM_SIZE (SHM_BLOCK_SIZE_S * MAX_SHM_BLOCK_COUNT * sizeof(float))
+// The reduce-scatter + all-gather all-reduce is used for messages with at
+// least this many elements per rank, below it the chained algorithm is used.
+#define SHM_RS_AG_MIN_NUMEL_PER_RANK (512)
 
 struct ShmContext {
   const char* name;
@@ -171,6 +174,10 @@ class ShmReduction {
   void reduceAdd(at::Tensor& t_in) {
     bool is_small = t_in.numel() < 51200;
     auto block_size = is_small ? SHM_BLOCK_SIZE_S : SHM_BLOCK_SIZE_L;
+    // every rank stages its whole input in the reduce-scatter algorithm
+    bool reduce_scatter =
+        t_in.numel() >= SHM_RS_AG_MIN_NUMEL_PER_RANK * rank_size_ &&
+        t_in.numel() * t_in.element_size() * rank_size_ <= MAX_SHM_SIZE;
     torch_ipex::cpu::shm_all_reduce_add_kernel_stub(
         kCPU,
         t_in,
@@ -179,6 +186,48 @@ class ShmReduction {
         shmCtx_.t_blockState,
         block_size,
         rank_,
+        rank_size_,
+        reduce_scatter);
+  }
+
+  at::Tensor allToAll(
+      const at::Tensor& t_in,
+      const std::vector<int64_t>& send_splits,
+      std::vector<int64_t>& recv_splits) {
+    return torch_ipex::cpu::shm_all_to_all_kernel_stub(
+        kCPU,
+        t_in,
+        send_splits,
+        recv_splits,
+        shmCtx_.t_address,
+        shmCtx_.t_state,
+        rank_,
+        rank_size_);
+  }
+
+  void allGather(
+      const at::Tensor& t_in,
+      at::Tensor& t_out,
+      const std::vector<int64_t>& cols_per_rank) {
+    torch_ipex::cpu::shm_all_gather_kernel_stub(
+        kCPU,
+        t_in,
+        t_out,
+        cols_per_rank,
+        shmCtx_.t_address,
+        shmCtx_.t_state,
+        rank_,
+        rank_size_);
+  }
+
+  void broadcast(at::Tensor& t_in, int root) {
+    torch_ipex::cpu::shm_broadcast_kernel_stub(
+        kCPU,
+        t_in,
+        root,
+        shmCtx_.t_address,
+        shmCtx_.t_state,
+        rank_,
         rank_size_);
   }
 
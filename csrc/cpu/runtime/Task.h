@@ -6,6 +6,7 @@
 #include <iostream>
 #include <memory>
 #include <stdexcept>
+#include <type_traits>
 #include <vector>
 
 #include <ATen/core/ivalue.h>
@@ -48,27 +49,27 @@ template <class F, class... Args>
 auto Task<F, Args...>::operator()(Args&&... args)
     -> std::future<decltype(F()(std::forward<Args>(args)...))> {
   typedef decltype(F()(std::forward<Args>(args)...)) return_type;
-  auto task = std::make_shared<std::packaged_task<return_type()>>(
-      [&, this]() -> return_type {
-        return this->f(std::forward<Args>(args)...);
-      });
-  std::future<return_type> res = task->get_future();
+  std::promise<return_type> promise;
+  std::future<return_type> res = promise.get_future();
   auto grad_mode = at::GradMode::is_enabled();
-  {
-    std::unique_lock<std::mutex> lock(this->task_executor->get_mutex());
-    // submit task to a stopping the pool is not allowed
-    if (this->task_executor->is_stop())
-      throw std::runtime_error("Task submit on stopped ThreadPool");
-    this->task_executor->get_tasks().emplace([task, grad_mode]() {
-      // set the thread local status, such as the grad mode before execuating
-      // the status
-      at::GradMode::set_enabled(grad_mode);
-      // execuate the task
-      (*task)();
-    });
-  }
-
-  this->task_executor->get_condition().notify_one();
+  // The closure is stored in place inside the executor's task queue, so no
+  // packaged_task or std::function is allocated per submission.
+  this->task_executor->submit(
+      [&, this, promise = std::move(promise), grad_mode]() mutable {
+        // set the thread local status, such as the grad mode before
+        // execuating the task
+        at::GradMode::set_enabled(grad_mode);
+        try {
+          if constexpr (std::is_void<return_type>::value) {
+            this->f(std::forward<Args>(args)...);
+            promise.set_value();
+          } else {
+            promise.set_value(this->f(std::forward<Args>(args)...));
+          }
+        } catch (...) {
+          promise.set_exception(std::current_exception());
+        }
+      });
   return res;
 }
 
@@ -1,9 +1,66 @@
 #include "TaskExecutor.h"
 
+#ifndef _WIN32
+#include <dirent.h>
+#endif
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
 namespace torch_ipex {
 namespace runtime {
 
-TaskExecutor::TaskExecutor(const torch_ipex::runtime::CPUPool& cpu_pool) {
+namespace {
+// Capacity of the lock-free queue owned by each worker. Submitters fall back
+// to the next queue when a queue is full, and to the overflow queue when all
+// of them are.
+constexpr size_t kTaskQueueCapacity = 1024;
+// Number of failed polls an idle worker spins for before it sleeps on the
+// condition variable.
+constexpr int kIdleSpinCount = 64;
+
+// Executors created with steal_across_executors, guarded by the registry
+// mutex. Steals from other executors happen under this mutex so that an
+// executor can't be destroyed while it's being stolen from.
+std::mutex& executor_registry_mutex() {
+  static std::mutex registry_mutex;
+  return registry_mutex;
+}
+
+std::vector<TaskExecutor*>& executor_registry() {
+  static std::vector<TaskExecutor*> registry;
+  return registry;
+}
+
+int get_numa_node_of_core(int32_t core_id) {
+#ifdef _WIN32
+  return -1;
+#else
+  std::string path =
+      "/sys/devices/system/cpu/cpu" + std::to_string(core_id) + "/";
+  DIR* dir = opendir(path.c_str());
+  if (dir == nullptr)
+    return -1;
+  int node = -1;
+  while (struct dirent* entry = readdir(dir)) {
+    if (strncmp(entry->d_name, "node", 4) == 0 &&
+        std::isdigit(entry->d_name[4])) {
+      node = std::atoi(entry->d_name + 4);
+      break;
+    }
+  }
+  closedir(dir);
+  return node;
+#endif
+}
+} // namespace
+
+TaskExecutor::TaskExecutor(
+    const torch_ipex::runtime::CPUPool& cpu_pool,
+    int num_workers,
+    bool steal_across_executors) {
   // Notice: We shouldn't load iomp symbol in sub_thread, otherwise race
   // condition happens.
   if (!is_runtime_ext_enabled()) {
@@ -11,56 +68,227 @@ TaskExecutor::TaskExecutor(const torch_ipex::runtime::CPUPool& cpu_pool) {
         "Fail to init TaskExecutor. Didn't preload IOMP "
         "before using the runtime API.");
   }
-  this->stop = false;
+  if (num_workers < 1) {
+    throw std::runtime_error(
+        "Fail to init TaskExecutor. num_workers should be positive.");
+  }
 
-  this->worker = std::make_shared<std::thread>([&, this] {
-    _pin_cpu_cores(cpu_pool);
-    while (true) {
-      std::function<void()> task;
-      {
-        std::unique_lock<std::mutex> lock(this->worker_mutex);
-        this->worker_condition.wait(
-            lock, [this] { return this->stop || !this->tasks.empty(); });
+  // Split the cores of cpu_pool between the workers, the first
+  // (num_cores % num_workers) workers get one extra core.
+  std::vector<std::unique_ptr<CPUPool>> worker_pools;
+  if (cpu_pool.is_cpu_core_list_initialized()) {
+    const std::vector<int32_t>& cores = cpu_pool.get_cpu_core_list();
+    if (!cores.empty()) {
+      num_workers = std::min<int>(num_workers, cores.size());
+      this->numa_node = get_numa_node_of_core(cores[0]);
+    }
+    if (num_workers > 1) {
+      int cores_per_worker = cores.size() / num_workers;
+      int remainder = cores.size() % num_workers;
+      auto begin = cores.begin();
+      for (int i = 0; i < num_workers; i++) {
+        auto end = begin + cores_per_worker + (i < remainder ? 1 : 0);
+        worker_pools.emplace_back(
+            std::make_unique<CPUPool>(std::vector<int32_t>(begin, end)));
+        begin = end;
+      }
+    }
+  }
+  this->steal_across_executors = steal_across_executors && numa_node >= 0;
+
+  for (int i = 0; i < num_workers; i++) {
+    this->queues.emplace_back(std::make_unique<TaskQueue>(kTaskQueueCapacity));
+  }
+
+  // Wait until every worker has pinned its cores, since the pools are only
+  // alive during the construction.
+  std::vector<std::promise<void>> pinned(num_workers);
+  for (int i = 0; i < num_workers; i++) {
+    const CPUPool* worker_pool =
+        worker_pools.empty() ? &cpu_pool : worker_pools[i].get();
+    std::promise<void>* worker_pinned = &pinned[i];
+    this->workers.emplace_back(
+        std::make_shared<std::thread>([worker_pool, worker_pinned, i, this] {
+          try {
+            _pin_cpu_cores(*worker_pool);
+          } catch (...) {
+            worker_pinned->set_exception(std::current_exception());
+            return;
+          }
+          worker_pinned->set_value();
+          this->worker_loop(i);
+        }));
+  }
+  std::exception_ptr pin_error;
+  for (auto& worker_pinned : pinned) {
+    try {
+      worker_pinned.get_future().get();
+    } catch (...) {
+      pin_error = std::current_exception();
+    }
+  }
+  if (pin_error) {
+    this->stop_executor();
+    std::rethrow_exception(pin_error);
+  }
+
+  if (this->steal_across_executors) {
+    std::lock_guard<std::mutex> lock(executor_registry_mutex());
+    executor_registry().push_back(this);
+  }
+}
 
-        if (this->stop && this->tasks.empty())
-          return;
+void TaskExecutor::submit_task(TaskFunction&& task) {
+  // Count the task before checking stop, so that the workers can't exit
+  // between the check and the push below.
+  this->pending_tasks.fetch_add(1);
+  if (this->stop.load()) {
+    this->pending_tasks.fetch_sub(1);
+    throw std::runtime_error("Task submit on stopped TaskExecutor");
+  }
+  size_t num_queues = this->queues.size();
+  size_t start = this->next_queue.fetch_add(1, std::memory_order_relaxed);
+  bool pushed = false;
+  for (size_t i = 0; i < num_queues && !pushed; i++) {
+    pushed = this->queues[(start + i) % num_queues]->try_push(task);
+  }
+  if (!pushed) {
+    // All the queues are full. Don't wait for the workers to drain them, the
+    // submitter may be the only worker.
+    std::lock_guard<std::mutex> lock(this->overflow_mutex);
+    this->overflow_tasks.push_back(std::move(task));
+    this->overflow_size.fetch_add(1);
+  }
 
-        task = std::move(this->tasks.front());
-        this->tasks.pop();
+  if (this->sleeping_workers.load() > 0) {
+    { std::lock_guard<std::mutex> lock(this->worker_mutex); }
+    this->worker_condition.notify_one();
+  } else if (this->steal_across_executors) {
+    // All our workers are busy, wake up an idle executor on the same NUMA
+    // node to steal the task.
+    std::lock_guard<std::mutex> registry_lock(executor_registry_mutex());
+    for (TaskExecutor* executor : executor_registry()) {
+      if (executor == this || executor->numa_node != this->numa_node ||
+          executor->sleeping_workers.load() == 0)
+        continue;
+      {
+        std::lock_guard<std::mutex> lock(executor->worker_mutex);
+        executor->steal_requests++;
       }
-      task();
+      executor->worker_condition.notify_one();
+      break;
     }
-  });
+  }
 }
 
-std::mutex& TaskExecutor::get_mutex() {
-  return this->worker_mutex;
+bool TaskExecutor::try_get_task(int worker_id, TaskFunction& task) {
+  // Own queue first, then the sibling workers of this executor, then the
+  // overflow queue.
+  size_t num_queues = this->queues.size();
+  for (size_t i = 0; i < num_queues; i++) {
+    if (this->queues[(worker_id + i) % num_queues]->try_pop(task)) {
+      this->pending_tasks.fetch_sub(1);
+      return true;
+    }
+  }
+  if (this->overflow_size.load() > 0) {
+    std::lock_guard<std::mutex> lock(this->overflow_mutex);
+    if (!this->overflow_tasks.empty()) {
+      task = std::move(this->overflow_tasks.front());
+      this->overflow_tasks.pop_front();
+      this->overflow_size.fetch_sub(1);
+      this->pending_tasks.fetch_sub(1);
+      return true;
+    }
+  }
+  return false;
 }
 
-std::condition_variable& TaskExecutor::get_condition() {
-  return this->worker_condition;
+bool TaskExecutor::try_steal_task(TaskFunction& task) {
+  std::lock_guard<std::mutex> lock(executor_registry_mutex());
+  for (TaskExecutor* executor : executor_registry()) {
+    if (executor == this || executor->numa_node != this->numa_node)
+      continue;
+    for (auto& queue : executor->queues) {
+      if (queue->try_pop(task)) {
+        executor->pending_tasks.fetch_sub(1);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void TaskExecutor::worker_loop(int worker_id) {
+  TaskFunction task;
+  int idle_spins = 0;
+  while (true) {
+    if (this->try_get_task(worker_id, task)) {
+      task();
+      task.reset();
+      idle_spins = 0;
+      continue;
+    }
+    // Read stop before pending_tasks, pairs with submit_task.
+    if (this->stop.load() && this->pending_tasks.load() == 0)
+      return;
+    if (++idle_spins < kIdleSpinCount) {
+      std::this_thread::yield();
+      continue;
+    }
+    idle_spins = 0;
+    if (this->steal_across_executors && !this->stop.load() &&
+        this->try_steal_task(task)) {
+      task();
+      task.reset();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(this->worker_mutex);
+    this->sleeping_workers.fetch_add(1);
+    this->worker_condition.wait(lock, [this] {
+      return this->stop.load() || this->pending_tasks.load() > 0 ||
+          this->steal_requests > 0;
+    });
+    this->sleeping_workers.fetch_sub(1);
+    if (this->steal_requests > 0)
+      this->steal_requests--;
+  }
 }
 
 bool TaskExecutor::is_stop() {
-  return this->stop;
+  return this->stop.load();
+}
+
+int TaskExecutor::get_num_workers() const {
+  return this->workers.size();
 }
 
-std::queue<std::function<void()>>& TaskExecutor::get_tasks() {
-  return this->tasks;
+int TaskExecutor::get_numa_node() const {
+  return this->numa_node;
 }
 
 void TaskExecutor::stop_executor() {
+  if (this->steal_across_executors) {
+    std::lock_guard<std::mutex> lock(executor_registry_mutex());
+    auto& registry = executor_registry();
+    registry.erase(
+        std::remove(registry.begin(), registry.end(), this), registry.end());
+  }
   bool should_wait_worker_join = false;
   {
     std::unique_lock<std::mutex> lock(this->worker_mutex);
-    if (this->stop == false) {
+    if (this->stop.load() == false) {
       should_wait_worker_join = true;
-      this->stop = true;
+      this->stop.store(true);
     }
   }
   if (should_wait_worker_join) {
     this->worker_condition.notify_all();
-    this->worker->join();
+    for (auto& worker : this->workers) {
+      if (worker->joinable())
+        worker->join();
+    }
   }
   return;
 }
@@ -1,16 +1,18 @@
 #pragma once
 
 #include <omp.h>
+#include <atomic>
 #include <cassert>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <future>
 #include <iostream>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <stdexcept>
 #include <thread>
+#include <utility>
 #include <vector>
 
 #include <ATen/core/ivalue.h>
@@ -18,26 +20,55 @@
 #include <torch/csrc/autograd/profiler.h>
 #include <torch/csrc/jit/api/module.h>
 #include "CPUPool.h"
+#include "TaskQueue.h"
 
 namespace torch_ipex {
 namespace runtime {
 
+// TaskExecutor runs the submitted tasks on num_workers worker threads. The
+// cores of cpu_pool are split evenly between the workers, and every worker owns
+// a lock-free TaskQueue. Submissions are distributed round-robin over the
+// queues, and a worker whose queue is empty steals from its siblings. Tasks
+// submitted while all the queues are full go to a locked overflow queue, so
+// that a submitter never waits for the workers (which may include itself). With
+// steal_across_executors, an idle worker also steals from the other executors
+// (with the same flag) whose cores sit on the same NUMA node.
 class IPEX_API TaskExecutor {
  public:
-  explicit TaskExecutor(const torch_ipex::runtime::CPUPool& cpu_pool);
-  std::mutex& get_mutex();
-  std::condition_variable& get_condition();
+  explicit TaskExecutor(
+      const torch_ipex::runtime::CPUPool& cpu_pool,
+      int num_workers = 1,
+      bool steal_across_executors = false);
+  template <class F>
+  void submit(F&& f) {
+    this->submit_task(TaskFunction(std::forward<F>(f)));
+  }
   bool is_stop();
-  std::queue<std::function<void()>>& get_tasks();
+  int get_num_workers() const;
+  int get_numa_node() const;
   void stop_executor();
   ~TaskExecutor();
 
  private:
-  std::queue<std::function<void()>> tasks;
-  std::shared_ptr<std::thread> worker;
+  void submit_task(TaskFunction&& task);
+  bool try_get_task(int worker_id, TaskFunction& task);
+  bool try_steal_task(TaskFunction& task);
+  void worker_loop(int worker_id);
+
+  std::vector<std::unique_ptr<TaskQueue>> queues;
+  std::vector<std::shared_ptr<std::thread>> workers;
+  std::atomic<size_t> next_queue{0};
+  std::deque<TaskFunction> overflow_tasks; // guarded by overflow_mutex
+  std::atomic<int64_t> overflow_size{0};
+  std::mutex overflow_mutex;
+  int numa_node{-1};
+  bool steal_across_executors{false};
 
   // Synchronization
-  bool stop;
+  std::atomic<bool> stop{false};
+  std::atomic<int64_t> pending_tasks{0};
+  std::atomic<int> sleeping_workers{0};
+  int steal_requests{0}; // guarded by worker_mutex
   std::mutex worker_mutex;
   std::condition_variable worker_condition;
 
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace torch_ipex {
+namespace runtime {
+
+// TaskFunction is a move-only replacement of std::function<void()>. Callables
+// up to kInlineSize bytes are stored in place, so that the task objects kept
+// in the slots of TaskQueue are reused across submissions without allocating.
+// Larger callables fall back to a heap allocation.
+class TaskFunction {
+ public:
+  static constexpr size_t kInlineSize = 64;
+
+  TaskFunction() = default;
+
+  template <
+      class F,
+      class FT = typename std::decay<F>::type,
+      class = typename std::enable_if<
+          !std::is_same<FT, TaskFunction>::value>::type>
+  explicit TaskFunction(F&& f) {
+    if constexpr (
+        sizeof(FT) <= kInlineSize &&
+        alignof(FT) <= alignof(std::max_align_t) &&
+        std::is_nothrow_move_constructible<FT>::value) {
+      new (storage_) FT(std::forward<F>(f));
+      ops_ = &InlineOps<FT>::ops;
+    } else {
+      *reinterpret_cast<FT**>(storage_) = new FT(std::forward<F>(f));
+      ops_ = &HeapOps<FT>::ops;
+    }
+  }
+
+  TaskFunction(TaskFunction&& other) noexcept {
+    move_from(other);
+  }
+
+  TaskFunction& operator=(TaskFunction&& other) noexcept {
+    if (this != &other) {
+      reset();
+      move_from(other);
+    }
+    return *this;
+  }
+
+  ~TaskFunction() {
+    reset();
+  }
+
+  void operator()() {
+    ops_->invoke(storage_);
+  }
+
+  explicit operator bool() const {
+    return ops_ != nullptr;
+  }
+
+  void reset() {
+    if (ops_ != nullptr) {
+      ops_->destroy(storage_);
+      ops_ = nullptr;
+    }
+  }
+
+ private:
+  struct Ops {
+    void (*invoke)(void*);
+    void (*move)(void* dst, void* src);
+    void (*destroy)(void*);
+  };
+
+  template <class FT>
+  struct InlineOps {
+    static void invoke(void* p) {
+      (*static_cast<FT*>(p))();
+    }
+    static void move(void* dst, void* src) {
+      new (dst) FT(std::move(*static_cast<FT*>(src)));
+      static_cast<FT*>(src)->~FT();
+    }
+    static void destroy(void* p) {
+      static_cast<FT*>(p)->~FT();
+    }
+    static constexpr Ops ops{invoke, move, destroy};
+  };
+
+  template <class FT>
+  struct HeapOps {
+    static void invoke(void* p) {
+      (**static_cast<FT**>(p))();
+    }
+    static void move(void* dst, void* src) {
+      *static_cast<FT**>(dst) = *static_cast<FT**>(src);
+    }
+    static void destroy(void* p) {
+      delete *static_cast<FT**>(p);
+    }
+    static constexpr Ops ops{invoke, move, destroy};
+  };
+
+  void move_from(TaskFunction& other) noexcept {
+    if (other.ops_ != nullptr) {
+      other.ops_->move(storage_, other.storage_);
+      ops_ = other.ops_;
+      other.ops_ = nullptr;
+    }
+  }
+
+  alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+  const Ops* ops_{nullptr};
+};
+
+// Bounded lock-free multi-producer/multi-consumer queue of TaskFunction
+// (D. Vyukov's sequence-numbered ring buffer). Each worker of TaskExecutor
+// owns one TaskQueue; submitters push into it and idle workers of the same
+// NUMA node pop (steal) from it concurrently with the owner.
+class TaskQueue {
+ public:
+  explicit TaskQueue(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity)
+      size <<= 1;
+    mask_ = size - 1;
+    cells_.reset(new Cell[size]);
+    for (size_t i = 0; i < size; i++)
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    enqueue_pos_.store(0, std::memory_order_relaxed);
+    dequeue_pos_.store(0, std::memory_order_relaxed);
+  }
+
+  TaskQueue(const TaskQueue&) = delete;
+  TaskQueue& operator=(const TaskQueue&) = delete;
+
+  // Moves task into the queue. Returns false (and leaves task untouched) if
+  // the queue is full.
+  bool try_push(TaskFunction& task) {
+    Cell* cell;
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->task = std::move(task);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool try_pop(TaskFunction& task) {
+    Cell* cell;
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    task = std::move(cell->task);
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  struct alignas(64) Cell {
+    std::atomic<size_t> sequence;
+    TaskFunction task;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_;
+  alignas(64) std::atomic<size_t> enqueue_pos_;
+  alignas(64) std::atomic<size_t> dequeue_pos_;
+};
+
+} // namespace runtime
+} // namespace torch_ipex
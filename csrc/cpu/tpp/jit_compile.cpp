@@ -1,15 +1,34 @@
 #include "jit_compile.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <cstdint>
 #include <string>
 #ifndef _WIN32
 #include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #else
 #include <stdexcept>
 #endif
 namespace torch_ipex {
 namespace tpp {
+static const std::string jit_compiler = "g++";
+static const std::string jit_base_flags = "-shared -fPIC -x c++";
+
+#ifndef _WIN32
+static bool jit_compile(
+    const std::string filename,
+    const std::string flags,
+    const std::string libname) {
+  auto cmd = jit_compiler + " " + jit_base_flags + " " + flags;
+  cmd = cmd + " -o " + libname + " " + filename;
+  printf("JIT COMPILE: %s\n", cmd.c_str());
+  return system(cmd.c_str()) == 0;
+}
+#endif
+
 void* jit_compile_and_load(
     const std::string filename,
     const std::string flags) {
@@ -19,11 +38,7 @@ void* jit_compile_and_load(
   unlink(libname);
   char fdname[50];
   snprintf(fdname, sizeof(fdname), "/proc/self/fd/%d", fd);
-  auto cmd = std::string("g++ -shared -fPIC -x c++ ") + flags;
-  cmd = cmd + " -o " + fdname + " " + filename;
-  printf("JIT COMPILE: %s\n", cmd.c_str());
-  int ret = system(cmd.c_str());
-  if (ret != 0)
+  if (!jit_compile(filename, flags, fdname))
     return NULL;
   auto handle = dlopen(fdname, RTLD_LAZY | RTLD_NODELETE);
   if (!handle) {
@@ -74,5 +89,123 @@ void* jit_from_str(
   return NULL;
 #endif
 }
+
+#ifndef _WIN32
+// 64-bit FNV-1a, stable across builds and processes unlike std::hash.
+static uint64_t fnv1a_hash(const std::string& str, uint64_t hash) {
+  for (unsigned char c : str) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+// Output of `g++ --version`, so that the cached objects of another compiler
+// are not reused. Falls back to the version of the compiler that built this
+// library if g++ can't be run.
+static const std::string& get_jit_compiler_version() {
+  static const std::string version = [] {
+    std::string out;
+    auto cmd = jit_compiler + " --version 2>/dev/null";
+    FILE* pipe = popen(cmd.c_str(), "r");
+    if (pipe != NULL) {
+      char buf[256];
+      size_t n;
+      while ((n = fread(buf, 1, sizeof(buf), pipe)) > 0)
+        out.append(buf, n);
+      if (pclose(pipe) != 0)
+        out.clear();
+    }
+    return out.empty() ? std::string(__VERSION__) : out;
+  }();
+  return version;
+}
+
+// mkdir -p, returns false if path isn't a writable directory in the end.
+static bool make_dirs(const std::string& path) {
+  for (size_t pos = path.find('/', 1);; pos = path.find('/', pos + 1)) {
+    auto dir = path.substr(0, pos);
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+      return false;
+    if (pos == std::string::npos)
+      break;
+  }
+  return access(path.c_str(), W_OK) == 0;
+}
+
+static std::string get_jit_cache_dir() {
+  const char* dir = getenv("IPEX_TPP_JIT_CACHE_DIR");
+  if (dir != NULL)
+    return dir;
+  const char* xdg_cache = getenv("XDG_CACHE_HOME");
+  const char* home = getenv("HOME");
+  std::string cache_root;
+  if (xdg_cache != NULL && xdg_cache[0] != '\0')
+    cache_root = xdg_cache;
+  else if (home != NULL && home[0] != '\0')
+    cache_root = std::string(home) + "/.cache";
+  else
+    return "";
+  return cache_root + "/intel_extension_for_pytorch/tpp_jit";
+}
+#endif
+
+void* jit_from_str_cached(
+    const std::string src,
+    const std::string flags,
+    const std::string func_name) {
+#ifndef _WIN32
+  auto cache_dir = get_jit_cache_dir();
+  if (cache_dir.empty() || !make_dirs(cache_dir))
+    return jit_from_str(src, flags, func_name);
+
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  hash = fnv1a_hash(jit_compiler, hash);
+  hash = fnv1a_hash(get_jit_compiler_version(), hash);
+  hash = fnv1a_hash(jit_base_flags, hash);
+  hash = fnv1a_hash(flags, hash);
+  hash = fnv1a_hash(src, hash);
+  char key[17];
+  snprintf(key, sizeof(key), "%016llx", (unsigned long long)hash);
+  auto libname = cache_dir + "/" + key + ".so";
+
+  if (access(libname.c_str(), R_OK) != 0) {
+    // Compile into a private file and rename it into place, so concurrent
+    // processes never dlopen a partially written shared object.
+    std::string tmpname = libname + ".tmp.XXXXXX";
+    int fd = mkstemp(&tmpname[0]);
+    if (fd < 0)
+      return jit_from_str(src, flags, func_name);
+    close(fd);
+    auto srcname = tmpname + ".cpp";
+    FILE* fsrc = fopen(srcname.c_str(), "w");
+    bool ok = fsrc != NULL &&
+        fwrite(src.c_str(), 1, src.length(), fsrc) == src.length();
+    if (fsrc != NULL)
+      ok = (fclose(fsrc) == 0) && ok;
+    ok = ok && jit_compile(srcname, flags, tmpname);
+    unlink(srcname.c_str());
+    if (!ok || rename(tmpname.c_str(), libname.c_str()) != 0) {
+      unlink(tmpname.c_str());
+      return NULL;
+    }
+  }
+
+  auto handle = dlopen(libname.c_str(), RTLD_LAZY | RTLD_NODELETE);
+  if (!handle) {
+    fputs(dlerror(), stderr);
+    return NULL;
+  }
+  void* func = dlsym(handle, func_name.c_str());
+  if (func == NULL) {
+    printf("Unable to find '%s' symbol in JIT COMPILE\n", func_name.c_str());
+  }
+  dlclose(handle);
+  return func;
+#else
+  throw std::runtime_error("not implemented.");
+  return NULL;
+#endif
+}
 } // namespace tpp
 } // namespace torch_ipex
\ No newline at end of file
@@ -13,6 +13,17 @@ void* jit_from_str(
     const std::string src,
     const std::string flags,
     const std::string func_name);
+
+// Same as jit_from_str, but the shared object is kept in an on-disk cache
+// addressed by the hash of (compiler and its version, flags, src), so that
+// later processes load it instead of invoking the compiler again. The cache
+// lives in $IPEX_TPP_JIT_CACHE_DIR (default: $XDG_CACHE_HOME or ~/.cache, under
+// intel_extension_for_pytorch/tpp_jit); set it to an empty string to disable
+// it. Falls back to jit_from_str if the cache directory isn't writable.
+void* jit_from_str_cached(
+    const std::string src,
+    const std::string flags,
+    const std::string func_name);
 } // namespace tpp
 
 } // namespace torch_ipex
@@ -0,0 +1,147 @@
+#ifndef _TPP_KERNEL_CACHE_H_
+#define _TPP_KERNEL_CACHE_H_
+
+#include <stdlib.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace torch_ipex {
+namespace tpp {
+
+struct KernelCacheStats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+  uint64_t size;
+  uint64_t capacity; // 0 means unbounded
+  double jit_time_ms; // time spent building the missed entries
+};
+
+// Read the default capacity of the kernel caches from
+// IPEX_TPP_KERNEL_CACHE_CAPACITY, 0 (unbounded) if not set.
+inline size_t get_default_kernel_cache_capacity() {
+  const char* capacity = getenv("IPEX_TPP_KERNEL_CACHE_CAPACITY");
+  return capacity ? std::max(atol(capacity), 0L) : 0;
+}
+
+// Concurrent cache of JIT-generated kernels. Keys are spread over kNumShards
+// independently locked shards, each an LRU list. A missing entry is built
+// under its shard lock, so concurrent first uses of the same kernel JIT it
+// only once. With a non-zero capacity the least recently used entries of a
+// shard are dropped once it holds more than capacity / kNumShards entries.
+template <class K, class V>
+class KernelCache {
+ public:
+  static constexpr size_t kNumShards = 16;
+
+  explicit KernelCache(size_t capacity = 0) : capacity_(capacity) {}
+  KernelCache(const KernelCache&) = delete;
+  KernelCache& operator=(const KernelCache&) = delete;
+
+  // Returns the cached value of key, or calls build() and caches its result
+  // unless it's empty (e.g. a NULL kernel, which the caller reports).
+  template <class F>
+  V get_or_build(const K& key, F&& build) {
+    Shard& shard = shards_[std::hash<K>()(key) % kNumShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto search = shard.map.find(key);
+    if (search != shard.map.end()) {
+      hits_++;
+      shard.lru.splice(shard.lru.begin(), shard.lru, search->second.lru_pos);
+      return search->second.value;
+    }
+    misses_++;
+    auto start = std::chrono::steady_clock::now();
+    V value = build();
+    jit_time_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+    if (!value)
+      return value;
+    shard.lru.push_front(key);
+    shard.map.emplace(key, Entry{value, shard.lru.begin()});
+    size_++;
+    trim(shard);
+    return value;
+  }
+
+  void set_capacity(size_t capacity) {
+    capacity_ = capacity;
+    for (auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      trim(shard);
+    }
+  }
+
+  void clear() {
+    for (auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      size_ -= shard.map.size();
+      shard.map.clear();
+      shard.lru.clear();
+    }
+  }
+
+  KernelCacheStats get_stats() const {
+    return KernelCacheStats{
+        hits_.load(),
+        misses_.load(),
+        evictions_.load(),
+        size_.load(),
+        capacity_.load(),
+        jit_time_ns_.load() / 1e6};
+  }
+
+  void reset_stats() {
+    hits_ = 0;
+    misses_ = 0;
+    evictions_ = 0;
+    jit_time_ns_ = 0;
+  }
+
+ private:
+  struct Entry {
+    V value;
+    typename std::list<K>::iterator lru_pos;
+  };
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<K, Entry> map;
+    std::list<K> lru; // most recently used first
+  };
+
+  // Requires the shard lock.
+  void trim(Shard& shard) {
+    size_t capacity = capacity_.load();
+    if (capacity == 0)
+      return;
+    size_t shard_capacity =
+        std::max<size_t>((capacity + kNumShards - 1) / kNumShards, 1);
+    while (shard.map.size() > shard_capacity) {
+      shard.map.erase(shard.lru.back());
+      shard.lru.pop_back();
+      size_--;
+      evictions_++;
+    }
+  }
+
+  std::array<Shard, kNumShards> shards_;
+  std::atomic<size_t> capacity_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> evictions_{0};
+  std::atomic<uint64_t> size_{0};
+  std::atomic<uint64_t> jit_time_ns_{0};
+};
+
+} // namespace tpp
+} // namespace torch_ipex
+
+#endif // _TPP_KERNEL_CACHE_H_
@@ -2,15 +2,20 @@
 #define _THREADED_LOOPS_H_
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <array>
 #include <cassert>
 #include <fstream>
 #include <initializer_list>
 #include <iostream>
+#include <memory>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include "jit_compile.h"
+#include "kernel_cache.h"
 #include "par_loop_generator.h"
 
 namespace torch_ipex {
@@ -199,14 +204,16 @@ class LoopingScheme {
       test_kernel = search->second;
     } else {
       std::string gen_code = loop_generator(scheme.c_str());
-      std::ofstream ofs("debug.cpp", std::ofstream::out);
-      ofs << code_str + gen_code;
-      ofs.close();
-      std::cout << "Scheme: " << scheme << std::endl;
-      std::cout << "Generated code:" << std::endl << gen_code;
-
-      test_kernel = (par_loop_kernel)jit_from_str(
+      if (getenv("TPP_DEBUG_LOOP_SCHEME")) {
+        std::cout << "Scheme: " << scheme << std::endl;
+        std::cout << "Generated code:" << std::endl << gen_code;
+      }
+      test_kernel = (par_loop_kernel)jit_from_str_cached(
           code_str + gen_code, " -fopenmp ", "par_nested_loops");
+      if (test_kernel == NULL) {
+        throw std::runtime_error(
+            "LoopingScheme: failed to JIT compile the loop scheme " + scheme);
+      }
     }
   }
 
@@ -233,18 +240,26 @@ class LoopingScheme {
   par_loop_kernel test_kernel;
 };
 
-inline LoopingScheme* getLoopingScheme(std::string scheme) {
-  static std::unordered_map<std::string, LoopingScheme*> kernel_cache;
+inline KernelCache<std::string, std::shared_ptr<LoopingScheme>>&
+get_looping_scheme_cache() {
+  static KernelCache<std::string, std::shared_ptr<LoopingScheme>>
+      kernel_cache;
+  return kernel_cache;
+}
+
+inline std::shared_ptr<LoopingScheme> getLoopingScheme(std::string scheme) {
+  return get_looping_scheme_cache().get_or_build(
+      scheme, [&]() { return std::make_shared<LoopingScheme>(scheme); });
+}
 
-  LoopingScheme* kernel = NULL;
-  auto search = kernel_cache.find(scheme);
-  if (search != kernel_cache.end())
-    kernel = search->second;
-  if (kernel == NULL) {
-    kernel = new LoopingScheme(scheme);
-    kernel_cache[scheme] = kernel;
+// Builds the loop nests of the given schemes ahead of time, e.g. the custom
+// GEMM_LOOP_SCHEME, so that the first call doesn't pay for the JIT compiler.
+// Together with the on-disk cache of jit_from_str_cached, a restarted process
+// only loads the shared objects compiled by a previous one.
+inline void prewarm_looping_schemes(const std::vector<std::string>& schemes) {
+  for (auto& scheme : schemes) {
+    getLoopingScheme(scheme);
   }
-  return kernel;
 }
 
 template <int N>
@@ -296,7 +311,7 @@ class ThreadedLoop {
  private:
   LoopSpecs bounds[N];
   std::string scheme;
-  LoopingScheme* loopScheme;
+  std::shared_ptr<LoopingScheme> loopScheme;
 };
 } // namespace tpp
 } // namespace torch_ipex
@@ -0,0 +1,163 @@
+#ifndef ROWWISE_QUANT_UTILS_HPP
+#define ROWWISE_QUANT_UTILS_HPP
+#include <c10/util/Float8_e4m3fn.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "vec.h"
+
+namespace torch_ipex {
+namespace cpu {
+
+/**
+ * Row-wise quantized embedding tables are uint8 tensors of
+ * [num_rows, row_bytes]. Every row holds the quantized elements followed by
+ * their fp32 quantization parameters, so that a lookup reads one contiguous
+ * row:
+ *
+ * at::kQUInt4x2: (dim + 1) / 2 bytes of unsigned nibbles, element 2i in the
+ *     low and element 2i + 1 in the high nibble, then scale and bias.
+ *     x = q * scale + bias.
+ * at::kFloat8_e4m3fn: dim e4m3fn bytes, then scale. x = q * scale.
+ */
+inline int64_t rowwise_quant_row_bytes(at::ScalarType qtype, int64_t dim) {
+  return qtype == at::kQUInt4x2 ? (dim + 1) / 2 + 2 * sizeof(float)
+                                : dim + sizeof(float);
+}
+
+// Dequantizes the row of dim elements and adds it to acc.
+template <at::ScalarType qtype>
+inline void rowwise_dequant_add_ker(
+    float* acc,
+    const uint8_t* row,
+    int64_t dim);
+
+template <>
+inline void rowwise_dequant_add_ker<at::kQUInt4x2>(
+    float* acc,
+    const uint8_t* row,
+    int64_t dim) {
+  float scale, bias;
+  std::memcpy(&scale, row + (dim + 1) / 2, sizeof(float));
+  std::memcpy(&bias, row + (dim + 1) / 2 + sizeof(float), sizeof(float));
+  int64_t d = 0;
+#if defined(CPU_CAPABILITY_AVX512)
+  auto vec_scale = _mm512_set1_ps(scale);
+  auto vec_bias = _mm512_set1_ps(bias);
+  auto nibble_mask = _mm_set1_epi8(0x0f);
+  for (; d + 16 <= dim; d += 16) {
+    // 8 bytes -> 16 nibbles in element order -> 16 floats
+    auto bytes = _mm_loadl_epi64((const __m128i*)(row + d / 2));
+    auto lo = _mm_and_si128(bytes, nibble_mask);
+    auto hi = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble_mask);
+    auto q = _mm512_cvtepi32_ps(
+        _mm512_cvtepu8_epi32(_mm_unpacklo_epi8(lo, hi)));
+    _mm512_storeu_ps(
+        acc + d,
+        _mm512_add_ps(
+            _mm512_loadu_ps(acc + d),
+            _mm512_fmadd_ps(q, vec_scale, vec_bias)));
+  }
+#elif defined(CPU_CAPABILITY_AVX2)
+  auto vec_scale = _mm256_set1_ps(scale);
+  auto vec_bias = _mm256_set1_ps(bias);
+  auto nibble_mask = _mm_set1_epi8(0x0f);
+  for (; d + 8 <= dim; d += 8) {
+    int32_t packed;
+    std::memcpy(&packed, row + d / 2, sizeof(packed));
+    auto bytes = _mm_cvtsi32_si128(packed);
+    auto lo = _mm_and_si128(bytes, nibble_mask);
+    auto hi = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble_mask);
+    auto q = _mm256_cvtepi32_ps(
+        _mm256_cvtepu8_epi32(_mm_unpacklo_epi8(lo, hi)));
+    _mm256_storeu_ps(
+        acc + d,
+        _mm256_add_ps(
+            _mm256_loadu_ps(acc + d),
+            _mm256_fmadd_ps(q, vec_scale, vec_bias)));
+  }
+#endif
+  for (; d < dim; d++) {
+    uint8_t byte = row[d / 2];
+    int32_t q = d % 2 == 0 ? byte & 0x0f : byte >> 4;
+    acc[d] += q * scale + bias;
+  }
+}
+
+template <>
+inline void rowwise_dequant_add_ker<at::kFloat8_e4m3fn>(
+    float* acc,
+    const uint8_t* row,
+    int64_t dim) {
+  float scale;
+  std::memcpy(&scale, row + dim, sizeof(float));
+  int64_t d = 0;
+#if defined(CPU_CAPABILITY_AVX512)
+  auto vec_scale = _mm512_set1_ps(scale);
+  for (; d + 16 <= dim; d += 16) {
+    auto q = _loadu((const at::Float8_e4m3fn*)(row + d));
+    _mm512_storeu_ps(
+        acc + d, _mm512_fmadd_ps(q, vec_scale, _mm512_loadu_ps(acc + d)));
+  }
+#elif defined(CPU_CAPABILITY_AVX2)
+  // Same conversion as the AVX-512 _loadu of e4m3fn: rebias the exponent
+  // with a multiply by 2^120.
+  auto vec_scale = _mm256_set1_ps(scale);
+  for (; d + 8 <= dim; d += 8) {
+    auto vec_u32 =
+        _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(row + d)));
+    auto vec_sign = _mm256_slli_epi32(
+        _mm256_and_si256(vec_u32, _mm256_set1_epi32(0x80)), 24);
+    auto vec_bits = _mm256_slli_epi32(
+        _mm256_and_si256(vec_u32, _mm256_set1_epi32(0x7f)), 20);
+    auto vec_abs = _mm256_mul_ps(
+        _mm256_castsi256_ps(vec_bits),
+        _mm256_castsi256_ps(_mm256_set1_epi32(0x7b800000)));
+    auto q = _mm256_castsi256_ps(
+        _mm256_or_si256(_mm256_castps_si256(vec_abs), vec_sign));
+    _mm256_storeu_ps(
+        acc + d, _mm256_fmadd_ps(q, vec_scale, _mm256_loadu_ps(acc + d)));
+  }
+#endif
+  for (; d < dim; d++) {
+    float q = at::Float8_e4m3fn(row[d], at::Float8_e4m3fn::from_bits());
+    acc[d] += q * scale;
+  }
+}
+
+// Quantizes the row of dim elements of src into row.
+template <at::ScalarType qtype, typename T>
+inline void rowwise_quant_row(uint8_t* row, const T* src, int64_t dim) {
+  float min_val = dim > 0 ? float(src[0]) : 0.f;
+  float max_val = min_val;
+  for (int64_t d = 1; d < dim; d++) {
+    min_val = std::min(min_val, float(src[d]));
+    max_val = std::max(max_val, float(src[d]));
+  }
+  if constexpr (qtype == at::kQUInt4x2) {
+    float scale = max_val > min_val ? (max_val - min_val) / 15.f : 1.f;
+    float inv_scale = 1.f / scale;
+    std::memset(row, 0, (dim + 1) / 2);
+    for (int64_t d = 0; d < dim; d++) {
+      int32_t q = std::nearbyint((float(src[d]) - min_val) * inv_scale);
+      q = std::min(std::max(q, 0), 15);
+      row[d / 2] |= d % 2 == 0 ? q : q << 4;
+    }
+    std::memcpy(row + (dim + 1) / 2, &scale, sizeof(float));
+    std::memcpy(row + (dim + 1) / 2 + sizeof(float), &min_val, sizeof(float));
+  } else {
+    // 448 is the largest finite e4m3fn value
+    float amax = std::max(std::abs(min_val), std::abs(max_val));
+    float scale = amax > 0.f ? amax / 448.f : 1.f;
+    float inv_scale = 1.f / scale;
+    for (int64_t d = 0; d < dim; d++) {
+      float q = std::min(std::max(float(src[d]) * inv_scale, -448.f), 448.f);
+      row[d] = at::Float8_e4m3fn(q).x;
+    }
+    std::memcpy(row + dim, &scale, sizeof(float));
+  }
+}
+
+} // namespace cpu
+} // namespace torch_ipex
+#endif
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <c10/util/Float8_e4m3fn.h>
+
 // below is for aligned data load
 inline __m512 _load_f32_data(const float* data_base) {
   return _mm512_loadu_ps(data_base);
@@ -42,6 +44,27 @@ inline __m512 _loadu(const at::Half* data_base) {
   return cvt_fp16_to_fp32(_mm256_loadu_si256((__m256i*)data_base));
 }
 
+inline __m512 _loadu(const int8_t* data_base) {
+  return _mm512_cvtepi32_ps(
+      _mm512_cvtepi8_epi32(_mm_loadu_si128((__m128i*)data_base)));
+}
+
+// e4m3fn -> fp32: move the exponent and mantissa bits into the fp32 layout
+// and rebias the exponent (7 -> 127) with a multiply by 2^120, which also
+// handles the e4m3 subnormals. NaN is not preserved.
+inline __m512 _loadu(const at::Float8_e4m3fn* data_base) {
+  auto vec_u32 = _mm512_cvtepu8_epi32(_mm_loadu_si128((__m128i*)data_base));
+  auto vec_sign = _mm512_slli_epi32(
+      _mm512_and_si512(vec_u32, _mm512_set1_epi32(0x80)), 24);
+  auto vec_bits = _mm512_slli_epi32(
+      _mm512_and_si512(vec_u32, _mm512_set1_epi32(0x7f)), 20);
+  auto vec_abs = _mm512_mul_ps(
+      _mm512_castsi512_ps(vec_bits),
+      _mm512_castsi512_ps(_mm512_set1_epi32(0x7b800000))); // 2^120
+  return _mm512_castsi512_ps(
+      _mm512_or_si512(_mm512_castps_si512(vec_abs), vec_sign));
+}
+
 inline __m512 _maskz_loadu(const float* data_base, __mmask16 mask) {
   return _mm512_maskz_loadu_ps(mask, data_base);
 }
@@ -380,6 +380,20 @@ def meta_embedding_bag(
     return weight.new_empty(shape_out)
 
 
+@register_meta("embedding_bag_hot_cache")
+def meta_embedding_bag_hot_cache(
+    weight,
+    hot_weight,
+    hot_map,
+    indices,
+    offsets,
+    stats,
+    include_last_offset,
+):
+    num_bags = offsets.shape[0] - 1 if include_last_offset else offsets.shape[0]
+    return weight.new_empty([num_bags, weight.shape[1]])
+
+
 @register_meta("ipex_lstm")
 def meta_ipex_lstm(
     input,
@@ -669,3 +683,57 @@ def meta_rmsnorm(
     eps,
 ):
     return input.new_empty(input.shape)
+
+
+@register_meta("flash_attention")
+def meta_flash_attention(
+    query,
+    key,
+    value,
+    dropout_p=0.0,
+    is_causal=False,
+    *,
+    attention_mask=None,
+    scale=None,
+    dropout_seed=None,
+    window_size=-1,
+    block_mask=None,
+    block_size=0,
+):
+    batch_size, num_head, q_len, head_size = query.shape
+    # the kernel writes the output in [B, T, H, D] and logsumexp in
+    # [B, T, H], both are returned transposed to [B, H, T, ...]
+    out = query.new_empty((batch_size, q_len, num_head, head_size)).transpose(1, 2)
+    # logsumexp is kept in the accumulate type
+    lse_dtype = query.dtype
+    if lse_dtype in [torch.bfloat16, torch.half]:
+        lse_dtype = torch.float
+    logsumexp = query.new_empty((batch_size, q_len, num_head), dtype=lse_dtype)
+    return (out, logsumexp.transpose(1, 2))
+
+
+@register_meta("flash_attention_backward")
+def meta_flash_attention_backward(
+    grad_out,
+    query,
+    key,
+    value,
+    out,
+    logsumexp,
+    dropout_p=0.0,
+    is_causal=False,
+    *,
+    attention_mask=None,
+    scale=None,
+    dropout_seed=None,
+    window_size=-1,
+    block_mask=None,
+    block_size=0,
+):
+    # the grads are allocated in [B, T, H, D] and returned transposed
+    def grad_like(t):
+        batch_size, num_head, seq_len, head_size = t.shape
+        grad = t.new_empty((batch_size, seq_len, num_head, head_size))
+        return grad.transpose(1, 2)
+
+    return (grad_like(query), grad_like(key), grad_like(value))
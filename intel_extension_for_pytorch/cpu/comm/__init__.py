@@ -5,4 +5,7 @@ get_world_size = torch_ipex_cpp.get_world_size
 get_rank = torch_ipex_cpp.get_rank
 barrier = torch_ipex_cpp.barrier
 allreduce_add = torch.ops.torch_ipex.all_reduce_add
+allreduce_add_async = torch.ops.torch_ipex.all_reduce_add_async
+wait = torch.ops.torch_ipex.all_reduce_wait
 allgather = torch.ops.torch_ipex.allgather
+broadcast = torch.ops.torch_ipex.broadcast
@@ -13,19 +13,56 @@ class Task(object):
         cpu_pool (intel_extension_for_pytorch.cpu.runtime.CPUPool): An
             intel_extension_for_pytorch.cpu.runtime.CPUPool object, contains
             all CPU cores used to run Task asynchronously.
+        max_batch_size (int): If set, concurrent calls are coalesced into one
+            run of the module. Calls whose positional tensor inputs only differ
+            in the first (batch) dimension are concatenated along it, up to
+            max_batch_size rows, and the outputs (Tensor, or tuple or list of
+            Tensors) are split back to the individual calls. Default: ``None``
+            (each call runs separately).
+        batch_timeout_us (int): How long, in microseconds, the first call of a
+            batch waits for more calls before the batch runs. Only takes effect
+            with ``max_batch_size``. Default: ``1000``.
+        num_workers (int): Number of worker threads running the calls, the
+            cores of ``cpu_pool`` are split evenly between them. It is capped
+            by the number of cores of ``cpu_pool``. Default: ``1``.
+        steal_across_executors (bool): If set, idle workers also run the
+            pending calls of the other Tasks created with this flag whose
+            cores sit on the same NUMA node. Default: ``False``.
 
     Returns:
         intel_extension_for_pytorch.cpu.runtime.Task: Generated
         intel_extension_for_pytorch.cpu.runtime.Task object.
     """
 
-    def __init__(self, module, cpu_pool: CPUPool):
+    def __init__(
+        self,
+        module,
+        cpu_pool: CPUPool,
+        max_batch_size: int = None,
+        batch_timeout_us: int = 1000,
+        num_workers: int = 1,
+        steal_across_executors: bool = False,
+    ):
         self.cpu_pool = cpu_pool
         assert type(self.cpu_pool) is CPUPool
         if isinstance(module, torch.jit.ScriptModule):
-            self._task = ipex._C.TaskModule(module._c, self.cpu_pool.cpu_pool, True)
+            self._task = ipex._C.TaskModule(
+                module._c,
+                self.cpu_pool.cpu_pool,
+                True,
+                num_workers,
+                steal_across_executors,
+            )
         else:
-            self._task = ipex._C.TaskModule(module, self.cpu_pool.cpu_pool)
+            self._task = ipex._C.TaskModule(
+                module, self.cpu_pool.cpu_pool, num_workers, steal_across_executors
+            )
+        if max_batch_size is not None:
+            self._task.enable_batching(max_batch_size, batch_timeout_us)
+
+    @property
+    def num_workers(self):
+        return self._task.get_num_workers()
 
     def __call__(self, *args, **kwargs):
         # async execution
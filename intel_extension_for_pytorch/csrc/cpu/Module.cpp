@@ -33,6 +33,7 @@
 #include <torch/csrc/api/include/torch/python.h>
 #include <torch/csrc/jit/passes/pass_manager.h>
 #include "aten/GradScaler.h"
+#include "aten/MoE.h"
 
 #include "TaskModule.h"
 #include "aten/EmbeddingBag.h"
@@ -41,7 +42,9 @@
 #include "runtime/TaskExecutor.h"
 #include "toolkit/sklearn.h"
 #include "tpp/optim.h"
+#include "tpp/threaded_loops.h"
 #include "tpp/utils.h"
+#include "tpp/xsmm_functors.h"
 
 namespace torch_ipex {
 namespace {
@@ -174,6 +177,13 @@ void InitIpexModuleBindings(py::module m) {
       .value("BF32", FP32MathMode::BF32)
       .export_values();
 
+  // backends of torch.ops.torch_ipex.fused_moe
+  m.attr("MOE_BACKEND_TPP") = MOE_BACKEND_TPP;
+  m.attr("MOE_BACKEND_TPP_FALLBACK") = MOE_BACKEND_TPP_FALLBACK;
+  m.attr("MOE_BACKEND_DNNL") = MOE_BACKEND_DNNL;
+  m.attr("MOE_BACKEND_MKL") = MOE_BACKEND_MKL;
+  m.attr("MOE_BACKEND_WOQ") = MOE_BACKEND_WOQ;
+
   // runtime
   py::class_<torch_ipex::runtime::FutureTensor>(m, "FutureTensor")
       .def("get", &torch_ipex::runtime::FutureTensor::get);
@@ -195,17 +205,39 @@ void InitIpexModuleBindings(py::module m) {
   py::class_<
       torch_ipex::runtime::TaskModule,
       std::shared_ptr<torch_ipex::runtime::TaskModule>>(m, "TaskModule")
-      .def(py::init([](const py::object& module,
-                       std::shared_ptr<torch_ipex::runtime::CPUPool> cpu_pool) {
-        return std::make_shared<torch_ipex::runtime::TaskModule>(
-            module, (*cpu_pool));
-      }))
-      .def(py::init([](const torch::jit::Module& module,
-                       std::shared_ptr<torch_ipex::runtime::CPUPool> cpu_pool,
-                       bool traced_module) {
-        return std::make_shared<torch_ipex::runtime::TaskModule>(
-            module, (*cpu_pool), traced_module);
-      }))
+      .def(
+          py::init([](const py::object& module,
+                      std::shared_ptr<torch_ipex::runtime::CPUPool> cpu_pool,
+                      int num_workers,
+                      bool steal_across_executors) {
+            return std::make_shared<torch_ipex::runtime::TaskModule>(
+                module, (*cpu_pool), num_workers, steal_across_executors);
+          }),
+          py::arg("module"),
+          py::arg("cpu_pool"),
+          py::arg("num_workers") = 1,
+          py::arg("steal_across_executors") = false)
+      .def(
+          py::init([](const torch::jit::Module& module,
+                      std::shared_ptr<torch_ipex::runtime::CPUPool> cpu_pool,
+                      bool traced_module,
+                      int num_workers,
+                      bool steal_across_executors) {
+            return std::make_shared<torch_ipex::runtime::TaskModule>(
+                module,
+                (*cpu_pool),
+                traced_module,
+                num_workers,
+                steal_across_executors);
+          }),
+          py::arg("module"),
+          py::arg("cpu_pool"),
+          py::arg("traced_module"),
+          py::arg("num_workers") = 1,
+          py::arg("steal_across_executors") = false)
+      .def(
+          "get_num_workers",
+          &torch_ipex::runtime::TaskModule::get_num_workers)
       .def(
           "run_sync",
           [](torch_ipex::runtime::TaskModule& self,
@@ -223,7 +255,12 @@ void InitIpexModuleBindings(py::module m) {
             // Depending on this being ScriptModule of nn.Module we will release
             // the GIL or not further down in the stack
             return self.run_async(std::move(args), std::move(kwargs));
-          });
+          })
+      .def(
+          "enable_batching",
+          &torch_ipex::runtime::TaskModule::enable_batching,
+          py::arg("max_batch_size"),
+          py::arg("batch_timeout_us"));
 
   m.def(
       "get_process_available_cores",
@@ -259,6 +296,35 @@ void InitIpexModuleBindings(py::module m) {
   // libxsmm
   m.def("xsmm_manual_seed", &torch_ipex::tpp::xsmm_manual_seed);
   m.def("init_libxsmm", &torch_ipex::tpp::init_libxsmm);
+  m.def(
+      "tpp_prewarm_loop_schemes",
+      &torch_ipex::tpp::prewarm_looping_schemes,
+      py::call_guard<py::gil_scoped_release>());
+  m.def("tpp_get_kernel_cache_stats", []() {
+    auto stats_to_dict = [](const torch_ipex::tpp::KernelCacheStats& stats) {
+      py::dict d;
+      d["hits"] = stats.hits;
+      d["misses"] = stats.misses;
+      d["evictions"] = stats.evictions;
+      d["size"] = stats.size;
+      d["capacity"] = stats.capacity;
+      d["jit_time_ms"] = stats.jit_time_ms;
+      return d;
+    };
+    py::dict stats;
+    stats["xsmm_kernels"] = stats_to_dict(
+        torch_ipex::tpp::BaseTPP::get_kernel_cache().get_stats());
+    stats["loop_schemes"] = stats_to_dict(
+        torch_ipex::tpp::get_looping_scheme_cache().get_stats());
+    return stats;
+  });
+  m.def("tpp_reset_kernel_cache_stats", []() {
+    torch_ipex::tpp::BaseTPP::get_kernel_cache().reset_stats();
+    torch_ipex::tpp::get_looping_scheme_cache().reset_stats();
+  });
+  m.def("tpp_set_kernel_cache_capacity", [](size_t capacity) {
+    torch_ipex::tpp::BaseTPP::get_kernel_cache().set_capacity(capacity);
+  });
 
   // tpp-for-optimizer
   m.def("tpp_dense_sparse_add_", &torch_ipex::tpp::dense_sparse_add_);
@@ -1,8 +1,92 @@
 #include "TaskModule.h"
 
+#include <algorithm>
+#include <iterator>
+
 namespace torch_ipex {
 namespace runtime {
 
+namespace {
+// Returns the dim 0 size shared by all the tensors of inputs, or -1 if there
+// is no tensor, a 0-dim tensor or the tensors disagree on dim 0.
+int64_t get_batch_size(const std::vector<c10::IValue>& inputs) {
+  int64_t batch_size = -1;
+  for (auto& input : inputs) {
+    if (!input.isTensor())
+      continue;
+    const at::Tensor& tensor = input.toTensor();
+    if (tensor.dim() == 0 ||
+        (batch_size != -1 && tensor.size(0) != batch_size))
+      return -1;
+    batch_size = tensor.size(0);
+  }
+  return batch_size;
+}
+
+// Two requests can be concatenated if their tensors only differ in dim 0 and
+// their other inputs are the same objects or values.
+bool can_batch(const BatchRequest& a, const BatchRequest& b) {
+  if (a.batch_size < 0 || b.batch_size < 0 || a.grad_mode != b.grad_mode ||
+      a.inputs.size() != b.inputs.size())
+    return false;
+  for (size_t i = 0; i < a.inputs.size(); i++) {
+    const c10::IValue& x = a.inputs[i];
+    const c10::IValue& y = b.inputs[i];
+    if (x.isTensor() != y.isTensor())
+      return false;
+    if (x.isTensor()) {
+      const at::Tensor& tx = x.toTensor();
+      const at::Tensor& ty = y.toTensor();
+      if (tx.scalar_type() != ty.scalar_type() || tx.dim() != ty.dim() ||
+          tx.sizes().slice(1) != ty.sizes().slice(1))
+        return false;
+    } else if (!x.isSameIdentity(y)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Splits a batched output (Tensor, or tuple/list of Tensors) along dim 0.
+std::vector<c10::IValue> split_batch_output(
+    const c10::IValue& output,
+    at::IntArrayRef batch_sizes) {
+  size_t num_requests = batch_sizes.size();
+  std::vector<c10::IValue> results;
+  results.reserve(num_requests);
+  if (output.isTensor()) {
+    for (auto& tensor : output.toTensor().split_with_sizes(batch_sizes, 0))
+      results.emplace_back(std::move(tensor));
+  } else if (output.isTuple()) {
+    auto elements = output.toTupleRef().elements();
+    std::vector<std::vector<c10::IValue>> split_elements(num_requests);
+    for (auto& element : elements) {
+      auto splits = split_batch_output(element, batch_sizes);
+      for (size_t i = 0; i < num_requests; i++)
+        split_elements[i].emplace_back(std::move(splits[i]));
+    }
+    for (auto& split_element : split_elements)
+      results.emplace_back(
+          c10::ivalue::Tuple::create(std::move(split_element)));
+  } else if (output.isTensorList()) {
+    std::vector<c10::List<at::Tensor>> split_lists(num_requests);
+    for (const at::Tensor& tensor : output.toTensorVector()) {
+      auto splits = tensor.split_with_sizes(batch_sizes, 0);
+      for (size_t i = 0; i < num_requests; i++)
+        split_lists[i].push_back(std::move(splits[i]));
+    }
+    for (auto& split_list : split_lists)
+      results.emplace_back(std::move(split_list));
+  } else {
+    throw std::runtime_error(
+        "TaskModule batching only supports the output of Tensor, or tuple or "
+        "list of Tensors, but got " +
+        output.tagKind());
+  }
+  return results;
+}
+} // namespace
+
 py::object FutureTensor::get() {
   CHECK(this->script_module_initialized_ ^ this->module_initialized_);
   if (this->script_module_initialized_) {
@@ -24,25 +108,52 @@ py::object FutureTensor::get() {
 TaskModule::TaskModule(
     const torch::jit::Module& script_module,
     const torch_ipex::runtime::CPUPool& cpu_pool,
-    bool traced_module)
+    bool traced_module,
+    int num_workers,
+    bool steal_across_executors)
     : script_module_(script_module) {
-  this->task_executor = std::make_shared<TaskExecutor>(cpu_pool);
+  this->task_executor = std::make_shared<TaskExecutor>(
+      cpu_pool, num_workers, steal_across_executors);
   this->script_module_initialized_ = true;
 }
 
 TaskModule::TaskModule(
     const py::object& module,
-    const torch_ipex::runtime::CPUPool& cpu_pool)
+    const torch_ipex::runtime::CPUPool& cpu_pool,
+    int num_workers,
+    bool steal_across_executors)
     : module_(module) {
-  this->task_executor = std::make_shared<TaskExecutor>(cpu_pool);
+  this->task_executor = std::make_shared<TaskExecutor>(
+      cpu_pool, num_workers, steal_across_executors);
   this->module_initialized_ = true;
 }
 
 TaskModule::~TaskModule() {
   pybind11::gil_scoped_release no_gil_guard;
+  {
+    // flush the pending batch without waiting for its deadline
+    std::lock_guard<std::mutex> lock(this->batch_mutex_);
+    this->batch_stop_ = true;
+  }
+  this->batch_condition_.notify_all();
   this->task_executor->stop_executor();
 }
 
+void TaskModule::enable_batching(
+    int64_t max_batch_size,
+    int64_t batch_timeout_us) {
+  TORCH_CHECK(max_batch_size > 0, "max_batch_size should be positive");
+  TORCH_CHECK(batch_timeout_us >= 0, "batch_timeout_us should not be negative");
+  std::lock_guard<std::mutex> lock(this->batch_mutex_);
+  this->batching_enabled_ = true;
+  this->max_batch_size_ = max_batch_size;
+  this->batch_timeout_ = std::chrono::microseconds(batch_timeout_us);
+}
+
+int TaskModule::get_num_workers() const {
+  return this->task_executor->get_num_workers();
+}
+
 std::unique_ptr<FutureTensor> TaskModule::run_async(
     py::args&& args,
     py::kwargs&& kwargs) {
@@ -65,72 +176,239 @@ std::unique_ptr<FutureTensor> TaskModule::run_async(
           std::move(kwargs),
           script_module_._ivalue());
 
-      typedef std::function<c10::IValue(std::vector<at::IValue>)>
-          SubmitFunctionType;
-      typedef decltype(SubmitFunctionType()(stack)) return_type;
-      auto task = std::make_shared<std::packaged_task<return_type()>>(std::bind(
-          std::forward<SubmitFunctionType>(
-              [&](std::vector<at::IValue> stack) -> c10::IValue {
-                return function(std::move(stack));
-              }),
-          std::forward<std::vector<at::IValue>>(stack)));
-
-      future_tensor_result->script_module_initialized_ = true;
-      future_tensor_result->future_script_tensor = task->get_future();
-
-      {
-        std::unique_lock<std::mutex> lock(this->task_executor->get_mutex());
-        // submit task to a stopping the pool is not allowed
-        if (this->task_executor->is_stop())
-          throw std::runtime_error(
-              "submit TaskModule(py::object) on stopped ThreadPool");
-        this->task_executor->get_tasks().emplace([task, grad_mode]() {
-          // set the thread local status, such as the grad mode before
-          // execuating the status
-          at::GradMode::set_enabled(grad_mode);
-          // execuate the task
-          (*task)();
-        });
+      if (this->batching_enabled_) {
+        auto request = std::make_unique<BatchRequest>();
+        request->batch_size = get_batch_size(stack);
+        request->grad_mode = grad_mode;
+        request->inputs = std::move(stack);
+        return this->submit_batch_request(std::move(request));
       }
-      this->task_executor->get_condition().notify_one();
-    }
-  } else {
-    CHECK(this->module_initialized_);
-    this->args = args;
-    this->kwargs = kwargs;
-
-    typedef std::function<py::object()> SubmitFunctionType;
-    typedef decltype(SubmitFunctionType()()) return_type;
-    auto task = std::make_shared<std::packaged_task<return_type()>>(
-        [&, this]() -> py::object {
-          {
-            pybind11::gil_scoped_acquire gil_guard;
-            return this->module_(*(this->args), **(this->kwargs));
-          }
-        });
 
-    future_tensor_result->module_initialized_ = true;
-    future_tensor_result->future_tensor = task->get_future();
+      std::promise<c10::IValue> promise;
+      future_tensor_result->script_module_initialized_ = true;
+      future_tensor_result->future_script_tensor = promise.get_future();
 
-    {
-      std::unique_lock<std::mutex> lock(this->task_executor->get_mutex());
       // submit task to a stopping the pool is not allowed
       if (this->task_executor->is_stop())
         throw std::runtime_error(
             "submit TaskModule(py::object) on stopped ThreadPool");
-      this->task_executor->get_tasks().emplace([task, grad_mode]() {
-        // set the thread local status, such as the grad mode before execuating
-        // the status
+      this->task_executor->submit([&function,
+                                   stack = std::move(stack),
+                                   promise = std::move(promise),
+                                   grad_mode]() mutable {
+        // set the thread local status, such as the grad mode before
+        // execuating the status
         at::GradMode::set_enabled(grad_mode);
         // execuate the task
-        (*task)();
+        try {
+          promise.set_value(function(std::move(stack)));
+        } catch (...) {
+          promise.set_exception(std::current_exception());
+        }
       });
     }
-    this->task_executor->get_condition().notify_one();
+  } else {
+    CHECK(this->module_initialized_);
+    // nn.Module calls are batched only when all the inputs are positional
+    // tensors, the others go through the per-call path below.
+    bool batchable = this->batching_enabled_ && kwargs.size() == 0 &&
+        args.size() > 0;
+    for (auto& arg : args) {
+      batchable = batchable && THPVariable_Check(arg.ptr());
+    }
+    if (batchable) {
+      auto request = std::make_unique<BatchRequest>();
+      for (auto& arg : args) {
+        request->inputs.emplace_back(THPVariable_Unpack(arg.ptr()));
+      }
+      request->batch_size = get_batch_size(request->inputs);
+      request->grad_mode = grad_mode;
+      pybind11::gil_scoped_release no_gil_guard;
+      return this->submit_batch_request(std::move(request));
+    }
+
+    std::promise<py::object> promise;
+    future_tensor_result->module_initialized_ = true;
+    future_tensor_result->future_tensor = promise.get_future();
+
+    // submit task to a stopping the pool is not allowed
+    if (this->task_executor->is_stop())
+      throw std::runtime_error(
+          "submit TaskModule(py::object) on stopped ThreadPool");
+    // The arguments are owned by the task, since several workers may run
+    // the calls concurrently. They are released under the GIL.
+    this->task_executor->submit([this,
+                                 args = std::move(args),
+                                 kwargs = std::move(kwargs),
+                                 promise = std::move(promise),
+                                 grad_mode]() mutable {
+      // set the thread local status, such as the grad mode before
+      // execuating the status
+      at::GradMode::set_enabled(grad_mode);
+      // execuate the task
+      try {
+        pybind11::gil_scoped_acquire gil_guard;
+        py::args task_args = std::move(args);
+        py::kwargs task_kwargs = std::move(kwargs);
+        promise.set_value(this->module_(*task_args, **task_kwargs));
+      } catch (...) {
+        promise.set_exception(std::current_exception());
+      }
+    });
+  }
+  return future_tensor_result;
+}
+
+std::unique_ptr<FutureTensor> TaskModule::submit_batch_request(
+    std::unique_ptr<BatchRequest> request) {
+  std::unique_ptr<FutureTensor> future_tensor_result =
+      std::make_unique<FutureTensor>();
+  // batched results are always returned as IValue
+  future_tensor_result->script_module_initialized_ = true;
+  future_tensor_result->future_script_tensor = request->promise.get_future();
+
+  bool schedule_batch = false;
+  bool batch_full = false;
+  {
+    std::lock_guard<std::mutex> lock(this->batch_mutex_);
+    if (this->batch_stop_ || this->task_executor->is_stop())
+      throw std::runtime_error("submit TaskModule on stopped ThreadPool");
+    this->pending_batch_size_ += std::max<int64_t>(request->batch_size, 1);
+    this->pending_requests_.emplace_back(std::move(request));
+    if (!this->batch_scheduled_) {
+      // the first request of a batch opens the latency window
+      this->batch_scheduled_ = true;
+      this->batch_deadline_ =
+          std::chrono::steady_clock::now() + this->batch_timeout_;
+      schedule_batch = true;
+    } else {
+      batch_full = this->pending_batch_size_ >= this->max_batch_size_;
+    }
+  }
+  if (schedule_batch) {
+    this->task_executor->submit([this] { this->run_batches(); });
+  } else if (batch_full) {
+    this->batch_condition_.notify_all();
   }
   return future_tensor_result;
 }
 
+void TaskModule::run_batches() {
+  while (true) {
+    std::vector<std::unique_ptr<BatchRequest>> requests;
+    bool has_more = false;
+    {
+      std::unique_lock<std::mutex> lock(this->batch_mutex_);
+      this->batch_condition_.wait_until(lock, this->batch_deadline_, [this] {
+        return this->batch_stop_ ||
+            this->pending_batch_size_ >= this->max_batch_size_;
+      });
+      // Take up to max_batch_size rows, but at least one request.
+      int64_t batch_size = 0;
+      size_t num_requests = 0;
+      while (num_requests < this->pending_requests_.size()) {
+        int64_t request_size = std::max<int64_t>(
+            this->pending_requests_[num_requests]->batch_size, 1);
+        if (num_requests > 0 &&
+            batch_size + request_size > this->max_batch_size_)
+          break;
+        batch_size += request_size;
+        num_requests++;
+      }
+      auto first = this->pending_requests_.begin();
+      requests.insert(
+          requests.end(),
+          std::make_move_iterator(first),
+          std::make_move_iterator(first + num_requests));
+      this->pending_requests_.erase(first, first + num_requests);
+      this->pending_batch_size_ -= batch_size;
+      if (this->pending_requests_.empty()) {
+        this->batch_scheduled_ = false;
+      } else {
+        // the left requests have waited long enough
+        this->batch_deadline_ = std::chrono::steady_clock::now();
+        has_more = true;
+      }
+    }
+    // Hand the left requests to another worker if there's one, or run them
+    // here after this batch when the executor is stopping.
+    if (has_more) {
+      try {
+        this->task_executor->submit([this] { this->run_batches(); });
+        has_more = false;
+      } catch (const std::runtime_error&) {
+      }
+    }
+    this->run_batch(requests);
+    if (!has_more)
+      return;
+  }
+}
+
+void TaskModule::run_batch(
+    std::vector<std::unique_ptr<BatchRequest>>& requests) {
+  std::vector<bool> batched(requests.size(), false);
+  for (size_t i = 0; i < requests.size(); i++) {
+    if (batched[i])
+      continue;
+    // group the requests which can be concatenated with request i
+    std::vector<BatchRequest*> group{requests[i].get()};
+    for (size_t j = i + 1; j < requests.size(); j++) {
+      if (!batched[j] && can_batch(*requests[i], *requests[j])) {
+        group.emplace_back(requests[j].get());
+        batched[j] = true;
+      }
+    }
+
+    at::GradMode::set_enabled(group[0]->grad_mode);
+    try {
+      if (group.size() == 1) {
+        group[0]->promise.set_value(
+            this->forward_batch(std::move(group[0]->inputs)));
+        continue;
+      }
+      size_t num_inputs = group[0]->inputs.size();
+      std::vector<c10::IValue> inputs;
+      inputs.reserve(num_inputs);
+      for (size_t k = 0; k < num_inputs; k++) {
+        if (!group[0]->inputs[k].isTensor()) {
+          inputs.emplace_back(group[0]->inputs[k]);
+          continue;
+        }
+        std::vector<at::Tensor> tensors;
+        tensors.reserve(group.size());
+        for (auto request : group)
+          tensors.emplace_back(request->inputs[k].toTensor());
+        inputs.emplace_back(at::cat(tensors, 0));
+      }
+      std::vector<int64_t> batch_sizes;
+      batch_sizes.reserve(group.size());
+      for (auto request : group)
+        batch_sizes.emplace_back(request->batch_size);
+      auto results = split_batch_output(
+          this->forward_batch(std::move(inputs)), batch_sizes);
+      for (size_t r = 0; r < group.size(); r++)
+        group[r]->promise.set_value(std::move(results[r]));
+    } catch (...) {
+      for (auto request : group)
+        request->promise.set_exception(std::current_exception());
+    }
+  }
+}
+
+c10::IValue TaskModule::forward_batch(std::vector<c10::IValue>&& inputs) {
+  if (this->script_module_initialized_) {
+    auto& function = script_module_.get_method("forward").function();
+    return function(std::move(inputs));
+  }
+  pybind11::gil_scoped_acquire gil_guard;
+  py::tuple py_inputs(inputs.size());
+  for (size_t i = 0; i < inputs.size(); i++)
+    py_inputs[i] = torch::jit::toPyObject(std::move(inputs[i]));
+  py::object output = this->module_(*py_inputs);
+  return torch::jit::toTypeInferredIValue(output);
+}
+
 py::object TaskModule::run_sync(py::args&& args, py::kwargs&& kwargs) {
   // sync API to run application inside task
   std::unique_ptr<FutureTensor> future_tensor_result =
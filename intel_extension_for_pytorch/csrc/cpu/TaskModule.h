@@ -1,15 +1,19 @@
 #pragma once
 
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <functional>
 #include <future>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <vector>
 
 #include <ATen/core/ivalue.h>
 #include <Macros.h>
+#include <torch/csrc/autograd/python_variable.h>
 #include <torch/csrc/jit/api/module.h>
 #include <torch/csrc/jit/python/pybind_utils.h>
 #include <torch/csrc/utils/pybind.h>
@@ -18,7 +22,7 @@
 namespace torch_ipex {
 namespace runtime {
 struct FutureTensor {
-  // script module
+  // script module, or any module when the request goes through batching
   std::future<c10::IValue> future_script_tensor;
   bool script_module_initialized_{false};
   // nn module
@@ -28,16 +32,34 @@ struct FutureTensor {
   py::object get();
 };
 
+// A run_async call waiting to be coalesced with other calls. For script
+// modules inputs is the whole stack (with the module object first), for
+// nn.Module it's the positional tensor arguments.
+struct BatchRequest {
+  std::vector<c10::IValue> inputs;
+  // Size of dim 0 shared by all the tensor inputs, -1 if the request can't
+  // be concatenated with others.
+  int64_t batch_size{-1};
+  bool grad_mode{false};
+  std::promise<c10::IValue> promise;
+};
+
 /*TaskModule is used to handle Python input of nn.module or script module*/
 class TaskModule {
  public:
+  // num_workers and steal_across_executors configure the TaskExecutor
+  // running the module, see TaskExecutor.
   explicit TaskModule(
       const torch::jit::Module& module,
       const torch_ipex::runtime::CPUPool& cpu_pool,
-      bool traced_module);
+      bool traced_module,
+      int num_workers = 1,
+      bool steal_across_executors = false);
   explicit TaskModule(
       const py::object& module,
-      const torch_ipex::runtime::CPUPool& cpu_pool);
+      const torch_ipex::runtime::CPUPool& cpu_pool,
+      int num_workers = 1,
+      bool steal_across_executors = false);
   TaskModule(const TaskModule& task_module) = delete;
   TaskModule(TaskModule&& task_module) = delete;
   TaskModule& operator=(const TaskModule& task_module) = delete;
@@ -47,7 +69,22 @@ class TaskModule {
   std::unique_ptr<FutureTensor> run_async(
       py::args&& args,
       py::kwargs&& kwargs); /*async execution in threadpool*/
+  // Coalesce concurrent run_async calls whose tensor inputs only differ in
+  // dim 0: wait up to batch_timeout_us after the first call, or until
+  // max_batch_size rows are queued, then run the concatenated inputs once and
+  // split the outputs back along dim 0.
+  void enable_batching(int64_t max_batch_size, int64_t batch_timeout_us);
+  // The number of worker threads, which may be less than requested when
+  // cpu_pool has fewer cores.
+  int get_num_workers() const;
+
  private:
+  std::unique_ptr<FutureTensor> submit_batch_request(
+      std::unique_ptr<BatchRequest> request);
+  void run_batches();
+  void run_batch(std::vector<std::unique_ptr<BatchRequest>>& requests);
+  c10::IValue forward_batch(std::vector<c10::IValue>&& inputs);
+
   // Script module input
   torch::jit::Module script_module_;
   bool script_module_initialized_{false};
@@ -57,8 +94,18 @@ class TaskModule {
 
   // TaskExecutor
   std::shared_ptr<TaskExecutor> task_executor;
-  py::args args;
-  py::kwargs kwargs;
+
+  // Dynamic batching
+  bool batching_enabled_{false};
+  int64_t max_batch_size_{1};
+  std::chrono::microseconds batch_timeout_{0};
+  std::mutex batch_mutex_;
+  std::condition_variable batch_condition_;
+  std::vector<std::unique_ptr<BatchRequest>> pending_requests_;
+  int64_t pending_batch_size_{0};
+  std::chrono::steady_clock::time_point batch_deadline_;
+  bool batch_scheduled_{false};
+  bool batch_stop_{false};
 };
 
 } // namespace runtime
@@ -1,6 +1,6 @@
 import torch
 import torch.nn as nn
-from typing import Optional, Tuple
+from typing import List, Optional, Tuple
 from .utils import IPEXRuntimeCustomOps, IPEXCustomOpType
 
 
@@ -404,7 +404,8 @@ class PagedAttention:
     The block tables are used to map the logical block of sequence into the physical block.
 
     [class method]: reshape_and_cache
-    ipex.llm.modules.PagedAttention.reshape_and_cache(key,  value,  key_cache, value_cache, slot_mapping)
+    ipex.llm.modules.PagedAttention.reshape_and_cache(key,  value,  key_cache, value_cache, slot_mapping,
+                                                      k_scale=None, v_scale=None)
     This operator is used to store the key/value token states into the pre-allcated kv_cache buffers of paged attention.
     Args:
     - key (torch.Tensor):  The keytensor. The shape should be [num_seqs, num_heads, head_size].
@@ -416,6 +417,34 @@ class PagedAttention:
     - slot_mapping (torch.Tensor):  It stores the position to store the key/value in the pre-allocated buffers.
                                     The shape should be the number of sequences. For sequence _i_, the slot_mapping[i]//block_number
                                     can get the block index, and the slot_mapping%block_size can get the offset of this block.
+    - k_scale (torch.Tensor, optional): The float scales of an int8 or float8_e4m3fn key_cache with the shape of
+                                        [num_blocks, num_heads]. The key is quantized with the scale of the block
+                                        it is stored into. The scales are owned and initialized by the caller.
+    - v_scale (torch.Tensor, optional): The float scales of an int8 or float8_e4m3fn value_cache with the shape of
+                                        [num_blocks, num_heads].
+
+    [class method]: rotary_embedding_and_cache
+    ipex.llm.modules.PagedAttention.rotary_embedding_and_cache(qkv, sin_cos, position_ids, num_heads, head_size,
+                                                               offset, rotary_dim, key_cache, value_cache,
+                                                               slot_mapping)
+    This operator splits the fused qkv, applies the rotary embedding to the query/key, and stores the key/value
+    into the kv cache slots directly, so that the key/value are not written to intermediate tensors before
+    reshape_and_cache. It returns the query only.
+    Args:
+    - qkv (torch.Tensor): The fused qkv tensor with the shape of [bs, seqlen, (num_heads + 2 * num_kv_heads) * head_size]
+                          or [num_tokens, (num_heads + 2 * num_kv_heads) * head_size].
+    - sin_cos (torch.Tensor): The float rotary embedding table with the shape of [max_positions, rotary_dim], sin in the
+                              first half of every row and cos in the second half.
+    - position_ids (torch.Tensor): The int64 position of every token, or a single past_kv_length.
+    - num_heads (int): The number of query heads.
+    - head_size (int): The head dimension.
+    - offset (int): 1 if cos/sin are applied to the neighboring 2 elements (e.g. GPT-J), or rotary_dim // 2 if they
+                    are applied to the rotary halves (e.g. Llama).
+    - rotary_dim (int): The number of rotated elements of every head.
+    - key_cache, value_cache (torch.Tensor): The kv cache with the shape of [num_blocks, block_size, num_kv_heads,
+                                             head_size] and the data type of qkv.
+    - slot_mapping (torch.Tensor): The int32 slot of every token, the same as reshape_and_cache. The tokens with a
+                                   negative slot (e.g. padding) are not stored.
 
     [class method]: single_query_cached_kv_attention
     ipex.llm.modules.PagedAttention.single_query_cached_kv_attention(
@@ -429,7 +458,10 @@ class PagedAttention:
                                                         context_lens,
                                                         block_size,
                                                         max_context_len,
-                                                        alibi_slopes
+                                                        alibi_slopes,
+                                                        k_scale=None,
+                                                        v_scale=None,
+                                                        window_size=-1,
                                                         )
 
     This operator is used to be calculated the scale-dot-product based on the paged attention.
@@ -451,6 +483,68 @@ class PagedAttention:
     - block_size (int): The block size which means the number of token in every block.
     - max_context_len (int): The max sequence length.
     - alibi_slopes (torch.Tensor, optinal): which is the alibi slope with the shape of (num_heads).
+    - k_scale (torch.Tensor, optional): The dequantization scales of an int8 or float8_e4m3fn key_cache with the
+                                        shape of [num_blocks, num_heads]. Required by a quantized key_cache.
+    - v_scale (torch.Tensor, optional): The dequantization scales of an int8 or float8_e4m3fn value_cache with the
+                                        shape of [num_blocks, num_heads]. Required by a quantized value_cache.
+    - window_size (int, optional): The sliding window size, e.g. of Mistral. Every query only attends to the last
+                                   window_size tokens of its context, the blocks before them are not read. Disabled
+                                   if <= 0.
+
+    [class method]: paged_attention_varlen
+    ipex.llm.modules.PagedAttention.paged_attention_varlen(
+                                                        out,
+                                                        query,
+                                                        key_cache,
+                                                        value_cache,
+                                                        head_mapping,
+                                                        scale,
+                                                        block_tables,
+                                                        cu_seqlens_q,
+                                                        context_lens,
+                                                        block_size,
+                                                        max_context_len,
+                                                        is_causal,
+                                                        alibi_slopes,
+                                                        k_scale=None,
+                                                        v_scale=None,
+                                                        window_size=-1,
+                                                        )
+
+    This operator calculates the scale-dot-product of several query tokens per sequence based on the paged
+    attention, so that chunked prefill and decode sequences can be mixed in one batch. The key/value of the
+    query tokens must be stored by reshape_and_cache before calling it.
+    Args:
+    - out (torch.Tensor): The output tensor with shape of [num_tokens, num_heads, head_size], where num_tokens is
+                          the total number of query tokens in this batch.
+    - query (torch.Tensor): The query tensor. The shape should be [num_tokens, num_heads, head_size].
+    - cu_seqlens_q (torch.Tensor): The int32 cumulative query lengths of the sequences with the shape of
+                                   [num_seqs + 1].
+    - context_lens (torch.Tensor): The int32 context length (including the query tokens) of every sequence
+                                   with the shape of [num_seqs].
+    - max_context_len (int): The max context length.
+    - is_causal (bool): Whether the query tokens of a sequence, which are its last tokens, are causally masked.
+    - The other args are the same as single_query_cached_kv_attention.
+
+    [class method]: copy_blocks
+    ipex.llm.modules.PagedAttention.copy_blocks(key_caches, value_caches, block_mapping)
+    This operator copies whole blocks inside the kv caches of all layers, e.g. to fork the blocks of a shared
+    prompt prefix or of a beam before they are written (copy-on-write).
+    Args:
+    - key_caches (List[torch.Tensor]): The key caches of all layers. Every cache is indexed by the block id in
+                                       its first dimension, so the k_scale of a quantized cache can be passed too.
+    - value_caches (List[torch.Tensor]): The value caches of all layers.
+    - block_mapping (torch.Tensor): The int64 tensor of (src, dst) block ids with the shape of [num_pairs, 2].
+
+    [class method]: swap_blocks
+    ipex.llm.modules.PagedAttention.swap_blocks(src, dst, block_mapping)
+    This operator copies blocks from src to dst, e.g. to swap the blocks of a preempted sequence out to a host
+    buffer and back into the kv cache later.
+    Args:
+    - src (torch.Tensor): The source kv cache or host buffer.
+    - dst (torch.Tensor): The destination kv cache or host buffer. The number of blocks may differ from src but the
+                          block shape and data type must be the same.
+    - block_mapping (torch.Tensor): The int64 tensor of (src, dst) block ids with the shape of [num_pairs, 2].
 
     """
 
@@ -464,10 +558,43 @@ class PagedAttention:
         key_cache: torch.Tensor,
         value_cache: torch.Tensor,
         slot_mapping: torch.Tensor,
+        k_scale: torch.Tensor = None,
+        v_scale: torch.Tensor = None,
     ):
         return cls.runtime_ops.get_module_from_device(
             key.device.type, IPEXCustomOpType.PAGED_ATTENTION, False
-        ).reshape_and_cache(key, value, key_cache, value_cache, slot_mapping)
+        ).reshape_and_cache(
+            key, value, key_cache, value_cache, slot_mapping, k_scale, v_scale
+        )
+
+    @classmethod
+    def rotary_embedding_and_cache(
+        cls,
+        qkv: torch.Tensor,
+        sin_cos: torch.Tensor,
+        position_ids: torch.Tensor,
+        num_heads: int,
+        head_size: int,
+        offset: int,
+        rotary_dim: int,
+        key_cache: torch.Tensor,
+        value_cache: torch.Tensor,
+        slot_mapping: torch.Tensor,
+    ):
+        return cls.runtime_ops.get_module_from_device(
+            qkv.device.type, IPEXCustomOpType.PAGED_ATTENTION, False
+        ).rotary_embedding_and_cache(
+            qkv,
+            sin_cos,
+            position_ids,
+            num_heads,
+            head_size,
+            offset,
+            rotary_dim,
+            key_cache,
+            value_cache,
+            slot_mapping,
+        )
 
     @classmethod
     def single_query_cached_kv_attention(
@@ -483,6 +610,9 @@ class PagedAttention:
         block_size: int,
         max_context_len: int,
         alibi_slopes: torch.Tensor,
+        k_scale: torch.Tensor = None,
+        v_scale: torch.Tensor = None,
+        window_size: int = -1,
     ):
         return cls.runtime_ops.get_module_from_device(
             output.device.type, IPEXCustomOpType.PAGED_ATTENTION, False
@@ -498,8 +628,74 @@ class PagedAttention:
             block_size,
             max_context_len,
             alibi_slopes,
+            k_scale,
+            v_scale,
+            window_size,
+        )
+
+    @classmethod
+    def paged_attention_varlen(
+        cls,
+        output: torch.Tensor,
+        query: torch.Tensor,
+        key_cache: torch.Tensor,
+        value_cache: torch.Tensor,
+        head_mapping: torch.Tensor,
+        scale: float,
+        block_tables: torch.Tensor,
+        cu_seqlens_q: torch.Tensor,
+        context_lens: torch.Tensor,
+        block_size: int,
+        max_context_len: int,
+        is_causal: bool,
+        alibi_slopes: torch.Tensor,
+        k_scale: torch.Tensor = None,
+        v_scale: torch.Tensor = None,
+        window_size: int = -1,
+    ):
+        return cls.runtime_ops.get_module_from_device(
+            output.device.type, IPEXCustomOpType.PAGED_ATTENTION, False
+        ).paged_attention_varlen(
+            output,
+            query,
+            key_cache,
+            value_cache,
+            head_mapping,
+            scale,
+            block_tables,
+            cu_seqlens_q,
+            context_lens,
+            block_size,
+            max_context_len,
+            is_causal,
+            alibi_slopes,
+            k_scale,
+            v_scale,
+            window_size,
         )
 
+    @classmethod
+    def copy_blocks(
+        cls,
+        key_caches: List[torch.Tensor],
+        value_caches: List[torch.Tensor],
+        block_mapping: torch.Tensor,
+    ):
+        return cls.runtime_ops.get_module_from_device(
+            block_mapping.device.type, IPEXCustomOpType.PAGED_ATTENTION, False
+        ).copy_blocks(key_caches, value_caches, block_mapping)
+
+    @classmethod
+    def swap_blocks(
+        cls,
+        src: torch.Tensor,
+        dst: torch.Tensor,
+        block_mapping: torch.Tensor,
+    ):
+        return cls.runtime_ops.get_module_from_device(
+            dst.device.type, IPEXCustomOpType.PAGED_ATTENTION, False
+        ).swap_blocks(src, dst, block_mapping)
+
 
 class IndirectAccessKVCacheAttention(nn.Module):
     r"""
@@ -5,5 +5,8 @@ from .merged_embeddingbag import MergedEmbeddingBag
 from .merged_embeddingbag import MergedEmbeddingBagWithCat
 from .merged_embeddingbag import MergedEmbeddingBagWithAdaGrad
 from .merged_embeddingbag import DistMergeEmbeddingBagWithAdaGrad
+from .merged_embeddingbag import DistMergeEmbeddingBagWithAdam
+from .merged_embeddingbag import save_embedding_table
+from .hot_row_embeddingbag import HotRowEmbeddingBag
 from ...cpu.nn.linear_fuse_eltwise import IPEXLinearEltwise
 from .weight_only_quantization import WeightOnlyQuantizedLinear
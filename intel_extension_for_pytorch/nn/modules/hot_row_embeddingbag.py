@@ -0,0 +1,96 @@
+import torch
+from torch import nn
+from typing import Optional
+
+
+class HotRowEmbeddingBag(nn.Module):
+    r"""
+    Inference `EmbeddingBag <https://pytorch.org/docs/stable/generated/torch.nn.EmbeddingBag.html
+    #embeddingbag>`_ with mode="sum" for tables much larger than the last level cache.
+
+    Lookups of such tables miss the caches and the TLB on nearly every row. `HotRowEmbeddingBag` keeps a
+    compact, contiguous copy of the `capacity` rows most frequently accessed in `sample_indices` (e.g. the
+    indices of a few recorded batches), found through a small hash map. The other rows are read from the
+    table, with software prefetching of the upcoming rows inside the pooling loop.
+
+        >>> emb = torch.nn.EmbeddingBag(num_rows, dim, mode="sum")
+        >>> cached_emb = HotRowEmbeddingBag.from_embeddingbag(emb, sample_indices, capacity=65536)
+        >>> output = cached_emb(indices, offsets)
+        >>> cached_emb.get_cache_stats()
+
+    The hot rows are a copy of the weight: call `build_cache` again after the weight is updated, or to adapt
+    the cache to a new access distribution.
+    """
+
+    def __init__(
+        self,
+        weight: torch.Tensor,
+        include_last_offset: bool = False,
+        sample_indices: Optional[torch.Tensor] = None,
+        capacity: int = 0,
+    ):
+        super(HotRowEmbeddingBag, self).__init__()
+        assert weight.dtype in (
+            torch.float,
+            torch.bfloat16,
+        ), "HotRowEmbeddingBag only supports fp32/bf16 weight"
+        self.weight = nn.Parameter(weight.contiguous(), requires_grad=False)
+        self.include_last_offset = include_last_offset
+        self.register_buffer("stats", torch.zeros(2, dtype=torch.long), False)
+        if sample_indices is None:
+            sample_indices = torch.empty(0, dtype=torch.long)
+        self.build_cache(sample_indices, capacity)
+
+    @classmethod
+    def from_embeddingbag(
+        cls,
+        emb: torch.nn.EmbeddingBag,
+        sample_indices: torch.Tensor,
+        capacity: int,
+    ):
+        assert (
+            emb.mode == "sum"
+            and emb.padding_idx is None
+            and not emb.scale_grad_by_freq
+        ), "HotRowEmbeddingBag only supports mode='sum' without padding_idx"
+        return cls(
+            emb.weight.detach(), emb.include_last_offset, sample_indices, capacity
+        )
+
+    def build_cache(self, sample_indices: torch.Tensor, capacity: int):
+        hot_weight, hot_map = torch.ops.torch_ipex.embedding_bag_build_hot_cache(
+            self.weight, sample_indices.to(torch.long), capacity
+        )
+        self.register_buffer("hot_weight", hot_weight, False)
+        self.register_buffer("hot_map", hot_map, False)
+        self.reset_cache_stats()
+
+    def forward(self, input: torch.Tensor, offsets: torch.Tensor) -> torch.Tensor:
+        return torch.ops.torch_ipex.embedding_bag_hot_cache(
+            self.weight,
+            self.hot_weight,
+            self.hot_map,
+            input.to(torch.long),
+            offsets.to(torch.long),
+            self.stats,
+            self.include_last_offset,
+        )
+
+    def get_cache_stats(self):
+        r"""
+        Returns the number of lookups served by the hot rows (`hits`) and by the table (`misses`) since the
+        last reset, the `hit_rate`, and `hit_bytes`, the bytes of rows read from the hot rows instead of the
+        table.
+        """
+        hits, misses = self.stats.tolist()
+        row_bytes = self.weight.size(1) * self.weight.element_size()
+        return {
+            "hits": hits,
+            "misses": misses,
+            "hit_rate": hits / max(hits + misses, 1),
+            "hit_bytes": hits * row_bytes,
+            "num_hot_rows": self.hot_weight.size(0),
+        }
+
+    def reset_cache_stats(self):
+        self.stats.zero_()
@@ -23,6 +23,19 @@ class AdaGradArgs(NamedTuple):
     lr: float
 
 
+class AdamArgs(NamedTuple):
+    exp_avg: List[torch.Tensor]
+    exp_avg_sq: List[torch.Tensor]
+    bf16_trail: List[Optional[torch.Tensor]]
+    step: torch.Tensor
+    lr: float
+    beta1: float
+    beta2: float
+    eps: float
+    weight_decay: float
+    use_lamb: bool
+
+
 class EmbeddingSpec(NamedTuple):
     num_embeddings: int
     embedding_dim: int
@@ -33,6 +46,13 @@ class EmbeddingSpec(NamedTuple):
     include_last_offset: bool
 
 
+def save_embedding_table(weight, path):
+    r"""
+    Writes `weight` as the row-major file read by `MergedEmbeddingBag.from_mmap_files`.
+    """
+    weight.detach().contiguous().view(torch.uint8).numpy().tofile(path)
+
+
 def merged_embeddingbag(weights, indices, offsets, pooling_mode, include_last_offset):
     if torch.is_grad_enabled():
         return MergedEmbeddingBagFunc.apply(
@@ -329,6 +349,58 @@ class MergedEmbeddingBag(nn.Module):
             )
         return cls(embedding_specs)
 
+    @classmethod
+    def from_mmap_files(
+        cls,
+        paths: List[str],
+        num_embeddings: List[int],
+        embedding_dim: int,
+        dtype: torch.dtype = torch.float,
+        pooling_mode: str = "sum",
+        include_last_offset: bool = False,
+        readahead: bool = False,
+    ):
+        r"""
+        Builds the tables from row-major files (e.g. written by `save_embedding_table`) which are memory-mapped
+        instead of loaded: the rows are read from the files on their first lookup, so that tables larger than
+        the memory of an instance start serving immediately. With `readahead`, the rows of each batch are read
+        ahead asynchronously before the lookups, which pays off while most of the lookups miss the page cache
+        (e.g. cold tables on fast storage) but costs a few syscalls per batch once the tables are resident.
+        fp32/bf16/fp16 tables are supported, store bf16 tables to run under autocast without casting (and
+        loading) them. Only for inference, the files are never written.
+        """
+        embedding_specs = []
+        for path, rows in zip(paths, num_embeddings):
+            weight = torch.ops.torch_ipex.mmap_embedding_table(
+                path, rows, embedding_dim, dtype, readahead=readahead
+            )
+            embedding_specs.append(
+                EmbeddingSpec(
+                    num_embeddings=rows,
+                    embedding_dim=embedding_dim,
+                    pooling_mode=pooling_mode,
+                    dtype=dtype,
+                    weight=weight,
+                    sparse=False,
+                    include_last_offset=include_last_offset,
+                )
+            )
+        return cls(embedding_specs)
+
+    def pin_hot_rows(self, sample_indices: List[torch.Tensor], capacity: int):
+        r"""
+        Locks in memory the `capacity` rows of each memory-mapped table most frequently accessed in
+        `sample_indices` (e.g. the indices of a few recorded batches), so that they are never read from the
+        files again. Returns the number of rows locked for each table, which is less than `capacity` if the
+        RLIMIT_MEMLOCK limit is reached.
+        """
+        return [
+            torch.ops.torch_ipex.embedding_table_pin_hot_rows(
+                weight, indices, capacity
+            )
+            for weight, indices in zip(self.weights, sample_indices)
+        ]
+
     def extra_repr(self) -> str:
         s = "number of tables={}\n".format(self.n_tables)
         for i in range(self.n_tables):
@@ -699,7 +771,7 @@ class DistMergeEmbeddingBagFunc(Function):
         rank: int,
         world_size: int,
         include_last_offsets: bool,
-        adagrad_args: AdaGradArgs,
+        optimizer_args,
     ):
         global_bs = offsets[0].size(0)
         if include_last_offsets:
@@ -710,7 +782,7 @@ class DistMergeEmbeddingBagFunc(Function):
         ctx.weight = weight
         ctx.row_offset = row_offset
         ctx.include_last_offsets = include_last_offsets
-        ctx.adagrad_args = adagrad_args
+        ctx.optimizer_args = optimizer_args
         ctx.rank = rank
         ctx.world_size = world_size
         num_emb = len(indices)
@@ -750,17 +822,61 @@ class DistMergeEmbeddingBagFunc(Function):
             world_size, send_idx, send_buf, send_ofs
         )
         weight = ctx.weight
-        adagrad_args = ctx.adagrad_args
-        trail = adagrad_args.bf16_trail
-        hessian = adagrad_args.hessian
-        lr = adagrad_args.lr
-        eps = adagrad_args.eps
-        torch.ops.torch_ipex.mergedemb_distribute_backward_merge_adagrad_update(
-            recv_idx, recv_buf, recv_ofs, weight, trail[0], hessian[0], lr, eps
-        )
+        args = ctx.optimizer_args
+        if isinstance(args, AdamArgs):
+            args.step.add_(1)
+            torch.ops.torch_ipex.mergedemb_distribute_backward_merge_adam_update(
+                recv_idx,
+                recv_buf,
+                recv_ofs,
+                weight,
+                args.bf16_trail[0],
+                args.exp_avg[0],
+                args.exp_avg_sq[0],
+                int(args.step),
+                args.lr,
+                args.beta1,
+                args.beta2,
+                args.eps,
+                args.weight_decay,
+                args.use_lamb,
+            )
+        else:
+            torch.ops.torch_ipex.mergedemb_distribute_backward_merge_adagrad_update(
+                recv_idx,
+                recv_buf,
+                recv_ofs,
+                weight,
+                args.bf16_trail[0],
+                args.hessian[0],
+                args.lr,
+                args.eps,
+            )
         return None, None, None, None, None, None, None, None
 
 
+def _shard_merged_weights(module: MergedEmbeddingBag):
+    # Keep rows rank::world_size of all the tables merged into 1 weight
+    module._rank = dist.get_rank()
+    module._size = dist.get_world_size()
+    # create row_offset
+    module._row_offset = [0 for i in range(module.n_tables + 1)]
+    for i in range(module.n_tables):
+        module._row_offset[i + 1] = module.weights[i].shape[0] + module._row_offset[i]
+    # create allin1 weight
+    # TODO: The initialization for weight here requiures 2 * total weight size PEAK memory
+    # We may able to optimize here to:
+    #     1. Require (1 + 1 / world_size) PEAK memory if always load all table first
+    #     2. Require (1 / world_size) memory with loading optimizations like using "meta" device
+    weight_allin1 = torch.cat([w.data for w in module.weights])[
+        module._rank :: module._size, :
+    ].clone()
+    # drop the oringal weighs
+    module.weights = nn.ParameterList([nn.parameter.Parameter(weight_allin1)])
+    module.n_tables = 1
+    return weight_allin1
+
+
 class DistMergeEmbeddingBagWithAdaGrad(MergedEmbeddingBagWithAdaGrad):
     r"""
     The distributed version or MergedEmbeddingBagWithAdaGrad
@@ -787,23 +903,7 @@ class DistMergeEmbeddingBagWithAdaGrad(MergedEmbeddingBagWithAdaGrad):
         assert (
             self.pooling_mode == PoolingMode.SUM
         ), "only support SUM for DistMergeEmbeddingBagWithAdaGrad"
-        self._rank = dist.get_rank()
-        self._size = dist.get_world_size()
-        # create row_offset
-        self._row_offset = [0 for i in range(self.n_tables + 1)]
-        for i in range(self.n_tables):
-            self._row_offset[i + 1] = self.weights[i].shape[0] + self._row_offset[i]
-        # create allin1 weight
-        # TODO: The initialization for weight here requiures 2 * total weight size PEAK memory
-        # We may able to optimize here to:
-        #     1. Require (1 + 1 / world_size) PEAK memory if always load all table first
-        #     2. Require (1 / world_size) memory with loading optimizations like using "meta" device
-        weight_allin1 = torch.cat([w.data for w in self.weights])[
-            self._rank :: self._size, :
-        ].clone()
-        # drop the oringal weighs
-        self.weights = nn.ParameterList([nn.parameter.Parameter(weight_allin1)])
-        self.n_tables = 1
+        weight_allin1 = _shard_merged_weights(self)
         self.adagrad_args = self.init_adagrad_args(lr, eps)
         if weight_allin1.dtype == torch.bfloat16:
             self.adagrad_args.bf16_trail.append(
@@ -834,3 +934,110 @@ class DistMergeEmbeddingBagWithAdaGrad(MergedEmbeddingBagWithAdaGrad):
         s += f"world_size: {self._size}, rank_id: {self._rank}\n"
         s += super(DistMergeEmbeddingBagWithAdaGrad, self).extra_repr()
         return s
+
+
+class DistMergeEmbeddingBagWithAdam(MergedEmbeddingBag):
+    r"""
+    The distributed MergedEmbeddingBag with a fused row-wise Adam (or LAMB) update.
+    Tables are sharded across ranks the same way as DistMergeEmbeddingBagWithAdaGrad.
+    The backward merges the gradients received from all ranks per row and updates
+    only those rows: the moments of rows without gradient are not decayed (lazy Adam),
+    so no dense gradient is materialized.
+    With `use_lamb=True`, the step of each row is scaled by its trust ratio
+    ||weight_row|| / ||update_row||.
+    bfloat16 weights are trained in split mode: the fp32 master weight is kept as the
+    bf16 weight plus its bf16 trail, and the moments are kept in fp32.
+    Example usage:
+
+        >>> EmbLists = torch.nn.Modulist(emb1, emb2, emb3, ..., emb_m)
+        >>> dist.init_process_group("ccl", world_size=world_size, rank=rank)
+        >>> distributed_emb = DistMergeEmbeddingBagWithAdam.from_embeddingbag_list(EmbLists, lr=1e-3)
+        >>> out = distributed_emb(indices, offsets)
+    """
+
+    def __init__(
+        self,
+        embedding_specs: List[EmbeddingSpec],
+        lr: float = 1e-3,
+        betas=(0.9, 0.999),
+        eps: float = 1e-8,
+        weight_decay: float = 0.0,
+        use_lamb: bool = False,
+    ):
+        super(DistMergeEmbeddingBagWithAdam, self).__init__(embedding_specs)
+        assert (
+            self.pooling_mode == PoolingMode.SUM
+        ), "only support SUM for DistMergeEmbeddingBagWithAdam"
+        if lr < 0.0:
+            raise ValueError("Invalid learning rate: {}".format(lr))
+        if eps < 0.0:
+            raise ValueError("Invalid eps value: {}".format(eps))
+        if not 0.0 <= betas[0] < 1.0 or not 0.0 <= betas[1] < 1.0:
+            raise ValueError("Invalid beta parameters: {}".format(betas))
+        if weight_decay < 0.0:
+            raise ValueError("Invalid weight_decay value: {}".format(weight_decay))
+        weight_allin1 = _shard_merged_weights(self)
+        if weight_allin1.dtype == torch.bfloat16:
+            bf16_trail = torch.zeros_like(weight_allin1)
+            state_dtype = torch.float
+        else:
+            bf16_trail = torch.empty(0, dtype=torch.bfloat16)
+            state_dtype = weight_allin1.dtype
+        self.adam_args = AdamArgs(
+            exp_avg=[torch.zeros_like(weight_allin1, dtype=state_dtype)],
+            exp_avg_sq=[torch.zeros_like(weight_allin1, dtype=state_dtype)],
+            bf16_trail=[bf16_trail],
+            step=torch.zeros(1, dtype=torch.int64),
+            lr=lr,
+            beta1=betas[0],
+            beta2=betas[1],
+            eps=eps,
+            weight_decay=weight_decay,
+            use_lamb=use_lamb,
+        )
+
+    def forward(self, indices: List[torch.Tensor], offset: List[torch.Tensor]):
+        out = DistMergeEmbeddingBagFunc.apply(
+            self.weights[0],
+            self._row_offset,
+            indices,
+            offset,
+            self._rank,
+            self._size,
+            self.include_last_offset,
+            self.adam_args,
+        )
+        return out
+
+    @classmethod
+    def from_embeddingbag_list(
+        cls,
+        tables: List[torch.nn.EmbeddingBag],
+        lr: float = 1e-3,
+        betas=(0.9, 0.999),
+        eps: float = 1e-8,
+        weight_decay: float = 0.0,
+        use_lamb: bool = False,
+    ):
+        embedding_specs = []
+        for emb in tables:
+            emb_shape = emb.weight.shape
+            embedding_specs.append(
+                EmbeddingSpec(
+                    num_embeddings=emb_shape[0],
+                    embedding_dim=emb_shape[1],
+                    pooling_mode=emb.mode,
+                    dtype=emb.weight.dtype,
+                    weight=emb.weight.detach(),
+                    sparse=emb.sparse,
+                    include_last_offset=emb.include_last_offset,
+                )
+            )
+        return cls(embedding_specs, lr, betas, eps, weight_decay, use_lamb)
+
+    def extra_repr(self) -> str:
+        s = ""
+        s += f"world_size: {self._size}, rank_id: {self._rank}\n"
+        s += f"lr: {self.adam_args.lr}, use_lamb: {self.adam_args.use_lamb}\n"
+        s += super(DistMergeEmbeddingBagWithAdam, self).extra_repr()
+        return s
@@ -336,10 +336,55 @@ class _IPEXFastLayerNormCPU(nn.Module):
 
 class _IPEXPagedAttentionCPU:
     @classmethod
-    def reshape_and_cache(cls, key, value, key_cache, value_cache, slot_mapping):
+    def reshape_and_cache(
+        cls,
+        key,
+        value,
+        key_cache,
+        value_cache,
+        slot_mapping,
+        k_scale=None,
+        v_scale=None,
+    ):
         torch.ops.torch_ipex.reshape_and_cache(
-            key, value, key_cache, value_cache, slot_mapping
+            key, value, key_cache, value_cache, slot_mapping, k_scale, v_scale
+        )
+
+    @classmethod
+    def rotary_embedding_and_cache(
+        cls,
+        qkv,
+        sin_cos,
+        position_ids,
+        num_heads,
+        head_size,
+        offset,
+        rotary_dim,
+        key_cache,
+        value_cache,
+        slot_mapping,
+    ):
+        # qkv (in shape): [bs, seqlen, (num_heads + 2 * num_kv_heads) * head_size]
+        #   or [num_tokens, (num_heads + 2 * num_kv_heads) * head_size]
+        # query (out shape): the shape of qkv with num_heads * head_size
+        input_2d = qkv.dim() == 2
+        if input_2d:
+            qkv = qkv.unsqueeze(0)
+        query = torch.ops.torch_ipex.rotary_position_embedding_paged_cache(
+            qkv,
+            sin_cos,
+            position_ids,
+            num_heads,
+            head_size,
+            offset,
+            rotary_dim,
+            key_cache,
+            value_cache,
+            slot_mapping,
         )
+        if input_2d:
+            query = query.squeeze(0)
+        return query
 
     @classmethod
     def single_query_cached_kv_attention(
@@ -355,6 +400,9 @@ class _IPEXPagedAttentionCPU:
         block_size,
         max_context_len,
         alibi_slopes,
+        k_scale=None,
+        v_scale=None,
+        window_size=-1,
     ):
         torch.ops.torch_ipex.single_query_cached_kv_attention(
             output,
@@ -368,8 +416,58 @@ class _IPEXPagedAttentionCPU:
             block_size,
             max_context_len,
             alibi_slopes,
+            k_scale,
+            v_scale,
+            window_size,
+        )
+
+    @classmethod
+    def paged_attention_varlen(
+        cls,
+        output,
+        query,
+        key_cache,
+        value_cache,
+        head_mapping,
+        scale,
+        block_tables,
+        cu_seqlens_q,
+        context_lens,
+        block_size,
+        max_context_len,
+        is_causal,
+        alibi_slopes,
+        k_scale=None,
+        v_scale=None,
+        window_size=-1,
+    ):
+        torch.ops.torch_ipex.paged_attention_varlen(
+            output,
+            query,
+            key_cache,
+            value_cache,
+            head_mapping,
+            scale,
+            block_tables,
+            cu_seqlens_q,
+            context_lens,
+            block_size,
+            max_context_len,
+            is_causal,
+            alibi_slopes,
+            k_scale,
+            v_scale,
+            window_size,
         )
 
+    @classmethod
+    def copy_blocks(cls, key_caches, value_caches, block_mapping):
+        torch.ops.torch_ipex.copy_blocks(key_caches, value_caches, block_mapping)
+
+    @classmethod
+    def swap_blocks(cls, src, dst, block_mapping):
+        torch.ops.torch_ipex.swap_blocks(src, dst, block_mapping)
+
 
 class _IPEXVarlenScaledDotProductCPU(nn.Module):
     def __init__(self):
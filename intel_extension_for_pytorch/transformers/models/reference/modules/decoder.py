@@ -12,6 +12,7 @@ from ...reference.fusions.linear_fusion import (
 )
 from torch.nn import functional as F
 from .....utils._logger import logger, WarningType
+import intel_extension_for_pytorch._C as core
 
 
 def LlamaDecoderLayer_forward(
@@ -692,6 +693,62 @@ def MistralDecoderLayer_forward(
     return outputs
 
 
+def _get_fused_moe_weights(experts):
+    # The weights and op contexts of the experts, and the data pointers of the
+    # weights, which the fused MoE args are collected from.
+    objs, ptrs = [], []
+    for e in experts:
+        for linear in [e.w1, e.w3, e.w2]:
+            objs.append(linear.weight)
+            objs.append(getattr(linear, "_op_context", None))
+            objs.append(getattr(linear, "ctx", None))
+            ptrs.append(linear.weight.data_ptr())
+    return objs, ptrs
+
+
+def _get_fused_moe_args(moe):
+    # Collect the per-expert weights and op contexts once per MoE block, and
+    # again whenever they are replaced (e.g. re-quantized or re-prepacked).
+    # The cache holds the objects it was built from, so that they are compared
+    # by identity without their ids being reused.
+    experts = moe.experts
+    objs, ptrs = _get_fused_moe_weights(experts)
+    cached = getattr(moe, "_fused_moe_args", None)
+    if (
+        cached is not None
+        and cached[1] == ptrs
+        and all(a is b for a, b in zip(cached[0], objs))
+    ):
+        return cached[2]
+    w1 = experts[0].w1
+    gate_ctx, up_ctx, down_ctx = [], [], []
+    if w1.weight.dtype in [torch.qint8, torch.int8, torch.uint8]:
+        backend = core.MOE_BACKEND_WOQ
+        gate = [e.w1._op_context.get_data_handle() for e in experts]
+        up = [e.w3._op_context.get_data_handle() for e in experts]
+        down = [e.w2._op_context.get_data_handle() for e in experts]
+    else:
+        if hasattr(w1, "use_dnnl") and w1.use_dnnl:
+            backend = core.MOE_BACKEND_DNNL
+            gate = [e.w1._get_forward_weight() for e in experts]
+            up = [e.w3._get_forward_weight() for e in experts]
+            down = [e.w2._get_forward_weight() for e in experts]
+            gate_ctx = [e.w1.ctx.get_data_handle() for e in experts]
+            up_ctx = [e.w3.ctx.get_data_handle() for e in experts]
+            down_ctx = [e.w2.ctx.get_data_handle() for e in experts]
+        else:
+            tpp_fallback = w1.tpp_fallback if hasattr(w1, "tpp_fallback") else True
+            backend = (
+                core.MOE_BACKEND_TPP_FALLBACK if tpp_fallback else core.MOE_BACKEND_TPP
+            )
+            gate = [e.w1.weight for e in experts]
+            up = [e.w3.weight for e in experts]
+            down = [e.w2.weight for e in experts]
+    args = (gate, up, down, gate_ctx, up_ctx, down_ctx, backend)
+    moe._fused_moe_args = (objs, ptrs, args)
+    return args
+
+
 def MixtralDecoderLayer_forward(
     self,
     hidden_states: torch.Tensor,
@@ -763,67 +820,15 @@ def MixtralDecoderLayer_forward(
     # we cast back to the input dtype
     routing_weights = routing_weights.to(hidden_states.dtype)
 
-    final_hidden_states = torch.zeros(
-        (batch_size * sequence_length, hidden_dim),
-        dtype=hidden_states.dtype,
-        device=hidden_states.device,
+    # All the experts run in one op call, which buckets the tokens by expert
+    # and sums the weighted expert outputs of every token.
+    final_hidden_states = torch.ops.torch_ipex.fused_moe(
+        hidden_states,
+        selected_experts,
+        routing_weights,
+        *_get_fused_moe_args(self.block_sparse_moe),
+        self.distributed,
     )
-
-    # One hot encode the selected experts to create an expert mask
-    # this will be used to easily index which expert is going to be sollicitated
-    expert_mask = torch.nn.functional.one_hot(
-        selected_experts, num_classes=self.block_sparse_moe.num_experts
-    ).permute(2, 1, 0)
-
-    # Loop over all available experts in the model and perform the computation on each expert
-    for expert_idx in range(self.block_sparse_moe.num_experts):
-        expert_layer = self.block_sparse_moe.experts[expert_idx]
-        idx, top_x = torch.where(expert_mask[expert_idx])
-        if expert_layer.w1.weight.dtype in [torch.qint8, torch.int8, torch.uint8]:
-            final_hidden_states = torch.ops.torch_ipex.mixtral_moe_woq(
-                hidden_states,
-                top_x,
-                idx,
-                expert_layer.w1._op_context.get_data_handle(),
-                expert_layer.w3._op_context.get_data_handle(),
-                expert_layer.w2._op_context.get_data_handle(),
-                routing_weights,
-                final_hidden_states,
-                self.distributed,
-            )
-        elif hasattr(expert_layer.w1, "use_dnnl") and expert_layer.w1.use_dnnl:
-            final_hidden_states = torch.ops.torch_ipex.mixtral_moe(
-                hidden_states,
-                top_x,
-                idx,
-                expert_layer.w1._get_forward_weight(),
-                expert_layer.w1.ctx.get_data_handle(),
-                expert_layer.w3._get_forward_weight(),
-                expert_layer.w3.ctx.get_data_handle(),
-                expert_layer.w2._get_forward_weight(),
-                expert_layer.w2.ctx.get_data_handle(),
-                hasattr(expert_layer.w1, "use_dnnl") and expert_layer.w1.use_dnnl,
-                routing_weights,
-                final_hidden_states,
-                self.distributed,
-            )
-        else:
-            final_hidden_states = torch.ops.torch_ipex.mixtral_moe_tpp(
-                hidden_states,
-                top_x,
-                idx,
-                expert_layer.w1.weight,
-                expert_layer.w3.weight,
-                expert_layer.w2.weight,
-                (
-                    expert_layer.w1.tpp_fallback
-                    if hasattr(expert_layer.w1, "tpp_fallback")
-                    else True
-                ),
-                routing_weights,
-                final_hidden_states,
-                self.distributed,
-            )
     final_hidden_states = final_hidden_states.reshape(
         batch_size, sequence_length, hidden_dim
     )
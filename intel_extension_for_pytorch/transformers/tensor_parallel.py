@@ -3,6 +3,27 @@ import torch.nn as nn
 from ..cpu import comm as ipex_comm
 import os
 
+# Number of row chunks the output of a row-sharded linear is all-reduced in.
+# With more than one chunk, the all-reduce of each chunk runs while the GEMM
+# of the next chunk is computed.
+_allreduce_chunks = int(os.environ.get("IPEX_TP_ALLREDUCE_CHUNKS", "1"))
+
+
+def _linear_allreduce_add(linear, input):
+    rows = input.numel() // input.shape[-1]
+    if _allreduce_chunks <= 1 or rows < _allreduce_chunks:
+        out = linear(input)
+        ipex_comm.allreduce_add(out)
+        return out
+    outs, works = [], []
+    for chunk in input.reshape(rows, input.shape[-1]).chunk(_allreduce_chunks):
+        outs.append(linear(chunk))
+        works.append(ipex_comm.allreduce_add_async(outs[-1]))
+    for work in works:
+        ipex_comm.wait(work)
+    out = torch.cat(outs)
+    return out.view(*input.shape[:-1], out.shape[-1])
+
 
 class TensorParallelConv2d(nn.Module):
     def __init__(self, conv, rank, world_size, shard_by_oc):
@@ -439,10 +460,9 @@ class TensorParallelRowLinear(TensorParallellLinear):
         )
 
     def forward(self, input: torch.Tensor) -> torch.Tensor:
-        out = self.linear(input)
         if self.world_size > 1:
-            ipex_comm.allreduce_add(out)
-        return out
+            return _linear_allreduce_add(self.linear, input)
+        return self.linear(input)
 
 
 class TensorParallelLMhead(TensorParallellLinear):
@@ -478,9 +498,9 @@ class TensorParallelLMhead(TensorParallellLinear):
                     ...,
                     self.cols_per_rank[self.rank] : self.cols_per_rank[self.rank + 1],
                 ]
-            out = self.linear(input)
-            if self.world_size > 1:
-                ipex_comm.allreduce_add(out)
+                out = _linear_allreduce_add(self.linear, input)
+            else:
+                out = self.linear(input)
 
         return out
 
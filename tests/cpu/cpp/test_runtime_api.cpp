@@ -430,3 +430,96 @@ TEST(TestRuntimeTaskAPI, TestTaskAPISameTasksMultiTensorInputs) {
   ASSERT_VARIABLE_EQ(res, res_ref);
   ASSERT_VARIABLE_EQ(res2, res_ref2);
 }
+
+TEST(TestRuntimeTaskAPI, TestTaskAPIMultiWorkers) {
+  if (!torch_ipex::runtime::is_runtime_ext_enabled()) {
+    GTEST_SKIP()
+        << "Skip TestRuntimeTaskAPI::TestTaskAPIMultiWorkers. Didn't preload IOMP.";
+  }
+  std::vector<int32_t> cpu_core_list({0, 1});
+  torch_ipex::runtime::CPUPool cpu_pool(cpu_core_list);
+  std::shared_ptr<torch_ipex::runtime::TaskExecutor> task_executor =
+      std::make_shared<torch_ipex::runtime::TaskExecutor>(
+          cpu_pool, /* num_workers */ 2);
+  ASSERT_EQ(task_executor->get_num_workers(), 2);
+
+  at::Tensor input_tensor = at::rand({100, 8276});
+  // Get the reference result
+  auto res_ref = at::softmax(input_tensor, -1);
+  // Create the task
+  torch_ipex::runtime::
+      Task<at::Tensor (*)(const at::Tensor&), const at::Tensor&>
+          task(taskfunction_const_lvalue_reference, task_executor);
+  // Submit more tasks than the capacity of the worker queues
+  std::vector<std::future<at::Tensor>> res_futures;
+  for (int i = 0; i < 4096; i++) {
+    res_futures.emplace_back(task(input_tensor));
+  }
+  // Assert the result
+  for (auto& res_future : res_futures) {
+    ASSERT_VARIABLE_EQ(res_future.get(), res_ref);
+  }
+}
+
+TEST(TestRuntimeTaskAPI, TestTaskAPIStealAcrossExecutors) {
+  if (!torch_ipex::runtime::is_runtime_ext_enabled()) {
+    GTEST_SKIP()
+        << "Skip TestRuntimeTaskAPI::TestTaskAPIStealAcrossExecutors. Didn't preload IOMP.";
+  }
+  std::vector<int32_t> cpu_core_list({0});
+  torch_ipex::runtime::CPUPool cpu_pool(cpu_core_list);
+  std::shared_ptr<torch_ipex::runtime::TaskExecutor> task_executor =
+      std::make_shared<torch_ipex::runtime::TaskExecutor>(
+          cpu_pool, /* num_workers */ 1, /* steal_across_executors */ true);
+
+  std::vector<int32_t> cpu_core_list2({1});
+  torch_ipex::runtime::CPUPool cpu_pool2(cpu_core_list2);
+  std::shared_ptr<torch_ipex::runtime::TaskExecutor> task_executor2 =
+      std::make_shared<torch_ipex::runtime::TaskExecutor>(
+          cpu_pool2, /* num_workers */ 1, /* steal_across_executors */ true);
+
+  at::Tensor input_tensor = at::rand({100, 8276});
+  // Get the reference result
+  auto res_ref = at::softmax(input_tensor, -1);
+  // Only submit to the first executor, the idle worker of the second one
+  // may steal tasks if both cores are on the same NUMA node.
+  torch_ipex::runtime::
+      Task<at::Tensor (*)(const at::Tensor&), const at::Tensor&>
+          task(taskfunction_const_lvalue_reference, task_executor);
+  std::vector<std::future<at::Tensor>> res_futures;
+  for (int i = 0; i < 64; i++) {
+    res_futures.emplace_back(task(input_tensor));
+  }
+  // Assert the result
+  for (auto& res_future : res_futures) {
+    ASSERT_VARIABLE_EQ(res_future.get(), res_ref);
+  }
+  // Executors stop in any order without losing the stolen tasks.
+  task_executor2->stop_executor();
+  task_executor->stop_executor();
+}
+
+TEST(TestRuntimeTaskAPI, TestTaskAPISubmitFromWorkerToFullQueue) {
+  if (!torch_ipex::runtime::is_runtime_ext_enabled()) {
+    GTEST_SKIP()
+        << "Skip TestRuntimeTaskAPI::TestTaskAPISubmitFromWorkerToFullQueue. Didn't preload IOMP.";
+  }
+  std::vector<int32_t> cpu_core_list({0});
+  torch_ipex::runtime::CPUPool cpu_pool(cpu_core_list);
+  std::shared_ptr<torch_ipex::runtime::TaskExecutor> task_executor =
+      std::make_shared<torch_ipex::runtime::TaskExecutor>(cpu_pool);
+
+  // The only worker fills its own queue, the tasks beyond its capacity go to
+  // the overflow queue instead of waiting for the worker itself.
+  std::atomic<int> num_done{0};
+  std::promise<void> submitted;
+  task_executor->submit([&] {
+    for (int i = 0; i < 4096; i++) {
+      task_executor->submit([&num_done] { num_done++; });
+    }
+    submitted.set_value();
+  });
+  submitted.get_future().get();
+  task_executor->stop_executor();
+  ASSERT_EQ(num_done.load(), 4096);
+}
@@ -2,6 +2,7 @@ import unittest
 import os
 import torch
 import intel_extension_for_pytorch as ipex
+from test_fused_moe import moe_reference, MOE_BACKEND_TPP_FALLBACK
 
 
 @unittest.skip("oneccl can't works in docker")
@@ -11,8 +12,9 @@ class CCLTester(unittest.TestCase):
         mpi_rank = int(os.environ.get("PMI_RANK", -1))
         ipex.enable_onednn_fusion(False)  # just to workaround the flake8
         dtypes = [torch.float32, torch.float16, torch.bfloat16]
-        tensor_sizes = [4096, 4096 * 32, 8 * 1024 * 5120 * 4 * 2]
-        # Less than 8 * 1024 * 5120 * 4 use SHM, otherwise use ccl allreduce
+        tensor_sizes = [7, 4096, 4096 * 32, 4096 * 32 + 7, 8 * 1024 * 5120 * 4 * 2]
+        # Larger than 8 * 1024 * 5120 * 4 bytes are streamed through SHM in chunks
+        # SHM uses reduce-scatter + all-gather for at least 512 elements per rank
         # The above dispatch rule is transparent to users
         for dtype in dtypes:
             for tensor_size in tensor_sizes:
@@ -31,6 +33,95 @@ class CCLTester(unittest.TestCase):
         self.assertEqual(mpi_world_size, ipex.cpu.comm.get_world_size())
         self.assertEqual(mpi_rank, ipex.cpu.comm.get_rank())
 
+    def test_all_reduce_add_back_to_back(self):
+        # no barrier between the calls, so that a fast rank starts the next
+        # all-reduce while the others are still reading the last one
+        mpi_world_size = int(os.environ.get("PMI_SIZE", -1))
+        mpi_rank = int(os.environ.get("PMI_RANK", -1))
+        for dtype in [torch.float32, torch.bfloat16]:
+            for tensor_size in [7, 4096 * 32 + 7]:
+                for step in range(64):
+                    input_tensor = (
+                        torch.tensor([mpi_rank + step + 1.0])
+                        .to(dtype)
+                        .repeat(tensor_size)
+                    )
+                    target = float(
+                        mpi_world_size * (mpi_world_size + 1) / 2
+                        + mpi_world_size * step
+                    )
+                    ipex.cpu.comm.allreduce_add(input_tensor)
+                    self.assertTrue(torch.all(input_tensor == target))
+
+    def test_all_reduce_add_uneven_hosts(self):
+        # e.g. mpirun -n 3 -hosts host0,host1 -ppn 2, the rank alone on host1
+        # has no SHM but joins the all-reduces of the host leaders
+        mpi_world_size = int(os.environ.get("PMI_SIZE", -1))
+        mpi_rank = int(os.environ.get("PMI_RANK", -1))
+        local_size = int(os.environ.get("MPI_LOCALNRANKS", mpi_world_size))
+        if local_size == mpi_world_size:
+            self.skipTest("only runs with the ranks spread over several hosts")
+        target = float(mpi_world_size * (mpi_world_size + 1) / 2)
+        # the last size is streamed in two chunks
+        for tensor_size in [7, 4096 * 32 + 7, 5120 * 4096 + 7]:
+            for step in range(4):
+                input_tensor = torch.tensor([mpi_rank + 1.0]).repeat(tensor_size)
+                ipex.cpu.comm.allreduce_add(input_tensor)
+                self.assertTrue(torch.all(input_tensor == target))
+
+    def test_all_reduce_add_async(self):
+        mpi_world_size = int(os.environ.get("PMI_SIZE", -1))
+        mpi_rank = int(os.environ.get("PMI_RANK", -1))
+        target = float(mpi_world_size * (mpi_world_size + 1) / 2)
+        for dtype in [torch.float32, torch.bfloat16]:
+            tensors = [
+                torch.tensor([mpi_rank + 1.0]).to(dtype).repeat(tensor_size)
+                for tensor_size in [7, 4096, 4096 * 32 + 7]
+            ]
+            works = [ipex.cpu.comm.allreduce_add_async(t) for t in tensors]
+            # a synchronous collective waits for the pending ones
+            sync_tensor = torch.tensor([mpi_rank + 1.0]).to(dtype).repeat(16)
+            ipex.cpu.comm.allreduce_add(sync_tensor)
+            for work in works:
+                ipex.cpu.comm.wait(work)
+            for t in tensors + [sync_tensor]:
+                self.assertTrue(torch.all(t == target))
+
+    def test_fused_moe_ep_back_to_back(self):
+        # every step runs two all-to-alls without a barrier, and the ranks
+        # route different numbers of tokens to each other
+        mpi_world_size = int(os.environ.get("PMI_SIZE", -1))
+        mpi_rank = int(os.environ.get("PMI_RANK", -1))
+        num_experts, hidden_size, inter_size = 2 * mpi_world_size, 64, 96
+        torch.manual_seed(0)
+        gate, up = [
+            [torch.randn(inter_size, hidden_size) * 0.1 for _ in range(num_experts)]
+            for _ in range(2)
+        ]
+        down = [torch.randn(hidden_size, inter_size) * 0.1 for _ in range(num_experts)]
+        local = slice(2 * mpi_rank, 2 * mpi_rank + 2)
+        for step in range(32):
+            torch.manual_seed(step * mpi_world_size + mpi_rank)
+            num_tokens = (step + mpi_rank) % 7
+            hidden_states = torch.randn(num_tokens, hidden_size)
+            router_logits = torch.randn(num_tokens, num_experts)
+            topk_weights, topk_ids = torch.topk(router_logits.softmax(-1), 2, dim=-1)
+            out = torch.ops.torch_ipex.fused_moe_ep(
+                hidden_states,
+                topk_ids,
+                topk_weights,
+                gate[local],
+                up[local],
+                down[local],
+                [],
+                [],
+                [],
+                MOE_BACKEND_TPP_FALLBACK,
+                num_experts,
+            )
+            ref = moe_reference(hidden_states, topk_ids, topk_weights, gate, up, down)
+            self.assertTrue(torch.allclose(out, ref, atol=1e-4))
+
     def test_allgather(self):
         mpi_world_size = int(os.environ.get("PMI_SIZE", -1))
         mpi_rank = int(os.environ.get("PMI_RANK", -1))
@@ -50,6 +141,47 @@ class CCLTester(unittest.TestCase):
                 output = ipex.cpu.comm.allgather(input, col_per_rank, mpi_world_size)
                 torch.allclose(expected_output, output)
 
+    def test_broadcast(self):
+        mpi_world_size = int(os.environ.get("PMI_SIZE", -1))
+        mpi_rank = int(os.environ.get("PMI_RANK", -1))
+        dtypes = [torch.float32, torch.bfloat16, torch.int64]
+        # Less than 8 * 1024 * 5120 * 4 bytes use SHM, otherwise use ccl broadcast
+        tensor_sizes = [1, 4096, 8 * 1024 * 5120 * 2]
+        for dtype in dtypes:
+            for tensor_size in tensor_sizes:
+                for root in range(mpi_world_size):
+                    input = torch.tensor([mpi_rank]).to(dtype).repeat(tensor_size)
+                    ipex.cpu.comm.broadcast(input, root)
+                    expected_output = torch.tensor([root]).to(dtype).repeat(tensor_size)
+                    self.assertTrue(torch.equal(input, expected_output))
+
+    def test_allgather_broadcast_back_to_back(self):
+        # alternate the collectives and the broadcast roots without a barrier,
+        # so that a fast rank enters the next collective while the others are
+        # still copying out of the last one
+        mpi_world_size = int(os.environ.get("PMI_SIZE", -1))
+        mpi_rank = int(os.environ.get("PMI_RANK", -1))
+        col_per_rank = [r * (r + 1) // 2 for r in range(mpi_world_size + 1)]
+        for dtype in [torch.float32, torch.bfloat16]:
+            for step in range(64):
+                input = torch.full([4, mpi_rank + 1], float(step + mpi_rank))
+                output = ipex.cpu.comm.allgather(
+                    input.to(dtype), col_per_rank, mpi_world_size
+                )
+                expected_output = torch.cat(
+                    [
+                        torch.full([4, r + 1], float(step + r))
+                        for r in range(mpi_world_size)
+                    ],
+                    dim=-1,
+                ).to(dtype)
+                self.assertTrue(torch.equal(output, expected_output))
+
+                root = step % mpi_world_size
+                input = torch.full([4096], float(step + mpi_rank)).to(dtype)
+                ipex.cpu.comm.broadcast(input, root)
+                expected_output = torch.full([4096], float(step + root)).to(dtype)
+                self.assertTrue(torch.equal(input, expected_output))
 
 if __name__ == "__main__":
     test = unittest.main()
@@ -1483,6 +1483,381 @@ class CPUOPsTester(TestCase):
                         math_ref = math_ref.to(dtype)
                     torch.testing.assert_close(actual, math_ref, atol=atol, rtol=rtol)
 
+    def test_flash_attention_backward(self):
+        dtypes = [torch.float, torch.double, torch.bfloat16]
+        if core.isa_has_amx_fp16_support():
+            dtypes.append(torch.float16)
+        for dtype in dtypes:
+            for causal, mask_dtype in [
+                [False, None],
+                [True, None],
+                [False, dtype],
+                [False, torch.bool],
+            ]:
+                for batch_size, seq_len, n_head, head_dim in itertools.product(
+                    [2], [1, 129, 533, 1030], [3], [7, 16]
+                ):
+                    atol = 1e-4
+                    rtol = 1e-4
+                    if dtype in [torch.bfloat16, torch.float16]:
+                        atol = 5e-2
+                        rtol = 5e-2
+                    q, k, v, grad_out = [
+                        torch.randn(batch_size, n_head, seq_len, head_dim).to(dtype)
+                        for _ in range(4)
+                    ]
+                    mask = None
+                    if mask_dtype is torch.bool:
+                        mask = torch.rand(batch_size, 1, seq_len, seq_len) > 0.3
+                        # keep at least one key per query
+                        mask[..., 0] = True
+                    elif mask_dtype is not None:
+                        mask = torch.randn(batch_size, 1, seq_len, seq_len).to(dtype)
+                    out, lse = torch.ops.torch_ipex.flash_attention(
+                        q, k, v, is_causal=causal, attention_mask=mask
+                    )
+                    actual = torch.ops.torch_ipex.flash_attention_backward(
+                        grad_out,
+                        q,
+                        k,
+                        v,
+                        out,
+                        lse,
+                        is_causal=causal,
+                        attention_mask=mask,
+                    )
+
+                    q2, k2, v2 = [
+                        t.detach().float().requires_grad_() for t in (q, k, v)
+                    ]
+                    math_ref = torch._scaled_dot_product_attention_math(
+                        q2,
+                        k2,
+                        v2,
+                        attn_mask=mask.float() if mask_dtype == dtype else mask,
+                        is_causal=causal,
+                    )[0]
+                    math_ref.backward(grad_out.float())
+                    for grad, ref in zip(actual, (q2.grad, k2.grad, v2.grad)):
+                        torch.testing.assert_close(
+                            grad, ref.to(dtype), atol=atol, rtol=rtol
+                        )
+
+        # training through SDPA uses the IPEX flash attention backward
+        q, k, v = [torch.randn(2, 4, 300, 16, requires_grad=True) for _ in range(3)]
+        torch.nn.functional.scaled_dot_product_attention(
+            q, k, v, is_causal=True
+        ).sum().backward()
+        q2, k2, v2 = [t.detach().clone().requires_grad_() for t in (q, k, v)]
+        ref = torch._scaled_dot_product_attention_math(q2, k2, v2, is_causal=True)[0]
+        ref.sum().backward()
+        for grad, ref in zip((q.grad, k.grad, v.grad), (q2.grad, k2.grad, v2.grad)):
+            torch.testing.assert_close(grad, ref, atol=1e-4, rtol=1e-4)
+
+    def test_flash_attention_dropout(self):
+        dropout_p, seed = 0.3, 2024
+        # head_dim == seq_len to read the dropped weights with v = I
+        batch_size, n_head, seq_len, head_dim = 2, 3, 40, 40
+        for dtype, causal in itertools.product(
+            [torch.float, torch.bfloat16], [False, True]
+        ):
+            atol = rtol = 1e-4 if dtype is torch.float else 5e-2
+            q, k, v, grad_out = [
+                torch.randn(batch_size, n_head, seq_len, head_dim).to(dtype)
+                for _ in range(4)
+            ]
+            # with v = I the output is the dropped attention weights, which
+            # only depend on the seed and (batch, head, q, k)
+            eye = torch.eye(seq_len).expand(batch_size, n_head, -1, -1).to(dtype)
+            probs = torch.ops.torch_ipex.flash_attention(
+                q, k, eye, dropout_p, causal, dropout_seed=seed
+            )[0]
+            keep = probs != 0
+            if not causal:
+                self.assertTrue(0.6 < keep.float().mean().item() < 0.8)
+
+            out, lse = torch.ops.torch_ipex.flash_attention(
+                q, k, v, dropout_p, causal, dropout_seed=seed
+            )
+            # reproducible across the number of threads
+            num_threads = torch.get_num_threads()
+            torch.set_num_threads(1)
+            out2, _ = torch.ops.torch_ipex.flash_attention(
+                q, k, v, dropout_p, causal, dropout_seed=seed
+            )
+            torch.set_num_threads(num_threads)
+            self.assertEqual(out, out2)
+
+            q2, k2, v2 = [t.detach().float().requires_grad_() for t in (q, k, v)]
+            attn = q2 @ k2.transpose(-2, -1) / head_dim**0.5
+            if causal:
+                causal_mask = torch.ones(seq_len, seq_len).tril().bool()
+                attn = attn.masked_fill(~causal_mask, float("-inf"))
+            attn = attn.softmax(-1) * keep / (1 - dropout_p)
+            ref = attn @ v2
+            ref.backward(grad_out.float())
+            torch.testing.assert_close(out, ref.to(dtype), atol=atol, rtol=rtol)
+
+            grads = torch.ops.torch_ipex.flash_attention_backward(
+                grad_out, q, k, v, out, lse, dropout_p, causal, dropout_seed=seed
+            )
+            for grad, ref_grad in zip(grads, (q2.grad, k2.grad, v2.grad)):
+                torch.testing.assert_close(
+                    grad, ref_grad.to(dtype), atol=atol, rtol=rtol
+                )
+
+        # without a seed, it is drawn from the default CPU generator
+        torch.manual_seed(seed)
+        out = torch.ops.torch_ipex.flash_attention(q, k, v, dropout_p)[0]
+        torch.manual_seed(seed)
+        out2 = torch.ops.torch_ipex.flash_attention(q, k, v, dropout_p)[0]
+        self.assertEqual(out, out2)
+        out2 = torch.ops.torch_ipex.flash_attention(q, k, v, dropout_p)[0]
+        self.assertNotEqual(out, out2)
+
+    def test_flash_attention_dropout_autograd(self):
+        dropout_p, seed = 0.2, 1234
+        batch_size, n_head, seq_len, head_dim = 2, 3, 40, 40
+        for causal in [False, True]:
+            q, k, v, grad_out = [
+                torch.randn(batch_size, n_head, seq_len, head_dim) for _ in range(4)
+            ]
+            # the dropped weights of the seed drawn after manual_seed
+            eye = torch.eye(seq_len).expand(batch_size, n_head, -1, -1)
+            torch.manual_seed(seed)
+            keep = (
+                torch.ops.torch_ipex.flash_attention(q, k, eye, dropout_p, causal)[0]
+                != 0
+            )
+
+            # SDPA with dropout saves the seed of the forward for the backward
+            q1, k1, v1 = [t.clone().requires_grad_() for t in (q, k, v)]
+            torch.manual_seed(seed)
+            out = torch.nn.functional.scaled_dot_product_attention(
+                q1, k1, v1, dropout_p=dropout_p, is_causal=causal
+            )
+            out.backward(grad_out)
+
+            q2, k2, v2 = [t.clone().requires_grad_() for t in (q, k, v)]
+            attn = q2 @ k2.transpose(-2, -1) / head_dim**0.5
+            if causal:
+                causal_mask = torch.ones(seq_len, seq_len).tril().bool()
+                attn = attn.masked_fill(~causal_mask, float("-inf"))
+            ref = (attn.softmax(-1) * keep / (1 - dropout_p)) @ v2
+            ref.backward(grad_out)
+            torch.testing.assert_close(out, ref, atol=1e-4, rtol=1e-4)
+            for grad, ref_grad in zip(
+                (q1.grad, k1.grad, v1.grad), (q2.grad, k2.grad, v2.grad)
+            ):
+                torch.testing.assert_close(grad, ref_grad, atol=1e-4, rtol=1e-4)
+
+            # the IPEX op itself is differentiable as well
+            q3, k3, v3 = [t.clone().requires_grad_() for t in (q, k, v)]
+            torch.manual_seed(seed)
+            out3, _ = torch.ops.torch_ipex.flash_attention(
+                q3, k3, v3, dropout_p, causal
+            )
+            out3.backward(grad_out)
+            self.assertEqual(out3, out)
+            for grad, ref_grad in zip(
+                (q3.grad, k3.grad, v3.grad), (q1.grad, k1.grad, v1.grad)
+            ):
+                self.assertEqual(grad, ref_grad)
+
+    def test_flash_attention_meta(self):
+        # the training graphs with SDPA dropout trace through the IPEX ops
+        from torch._subclasses.fake_tensor import FakeTensorMode
+
+        with FakeTensorMode():
+            q = torch.empty(2, 8, 33, 64, dtype=torch.bfloat16)
+            k, v = [torch.empty(2, 2, 40, 64, dtype=torch.bfloat16) for _ in range(2)]
+            out, lse = torch.ops.torch_ipex.flash_attention(q, k, v, 0.1)
+            self.assertEqual(out.shape, q.shape)
+            self.assertEqual(out.dtype, torch.bfloat16)
+            self.assertEqual(lse.shape, (2, 8, 33))
+            self.assertEqual(lse.dtype, torch.float)
+            grads = torch.ops.torch_ipex.flash_attention_backward(
+                out, q, k, v, out, lse, 0.1, dropout_seed=0
+            )
+            for grad, t in zip(grads, (q, k, v)):
+                self.assertEqual(grad.shape, t.shape)
+                self.assertEqual(grad.dtype, t.dtype)
+
+    def test_flash_attention_sparse_layout(self):
+        batch_size, n_head, head_dim, sparse_block = 2, 3, 16, 64
+        for dtype, causal, seq_len, window_size, use_block_mask in itertools.product(
+            [torch.float, torch.bfloat16],
+            [False, True],
+            [129, 1030],
+            [-1, 100],
+            [False, True],
+        ):
+            if window_size <= 0 and not use_block_mask:
+                continue
+            atol = rtol = 1e-4 if dtype is torch.float else 5e-2
+            q, k, v, grad_out = [
+                torch.randn(batch_size, n_head, seq_len, head_dim).to(dtype)
+                for _ in range(4)
+            ]
+            visible = torch.ones(n_head, seq_len, seq_len, dtype=torch.bool)
+            block_mask = None
+            if use_block_mask:
+                num_blocks = (seq_len - 1) // sparse_block + 1
+                block_mask = torch.rand(n_head, num_blocks, num_blocks) > 0.5
+                # keep the diagonal blocks so that every query sees a key
+                block_mask |= torch.eye(num_blocks, dtype=torch.bool)
+                dense = block_mask.repeat_interleave(sparse_block, 1)
+                dense = dense.repeat_interleave(sparse_block, 2)
+                visible &= dense[:, :seq_len, :seq_len]
+            if window_size > 0:
+                pos = torch.arange(seq_len)
+                visible &= (pos[:, None] - pos[None, :]).abs() < window_size
+            if causal:
+                visible &= torch.ones(seq_len, seq_len, dtype=torch.bool).tril()
+
+            layout = {
+                "window_size": window_size,
+                "block_mask": block_mask,
+                "block_size": sparse_block,
+            }
+            out, lse = torch.ops.torch_ipex.flash_attention(
+                q, k, v, is_causal=causal, **layout
+            )
+            grads = torch.ops.torch_ipex.flash_attention_backward(
+                grad_out, q, k, v, out, lse, is_causal=causal, **layout
+            )
+            q2, k2, v2 = [t.detach().float().requires_grad_() for t in (q, k, v)]
+            ref = torch._scaled_dot_product_attention_math(
+                q2, k2, v2, attn_mask=visible
+            )[0]
+            ref.backward(grad_out.float())
+            torch.testing.assert_close(out, ref.to(dtype), atol=atol, rtol=rtol)
+            for grad, ref_grad in zip(grads, (q2.grad, k2.grad, v2.grad)):
+                torch.testing.assert_close(
+                    grad, ref_grad.to(dtype), atol=atol, rtol=rtol
+                )
+
+        # the queries without any visible key output 0 and have no gradient
+        q, k, v = [torch.randn(1, 2, 300, 16) for _ in range(3)]
+        block_mask = torch.ones(3, 3, dtype=torch.bool)
+        block_mask[1] = False
+        out, lse = torch.ops.torch_ipex.flash_attention(
+            q, k, v, block_mask=block_mask, block_size=128
+        )
+        self.assertEqual(out[:, :, 128:256], torch.zeros(1, 2, 128, 16))
+        self.assertTrue(torch.isfinite(out).all())
+        grad_q = torch.ops.torch_ipex.flash_attention_backward(
+            torch.ones_like(out),
+            q,
+            k,
+            v,
+            out,
+            lse,
+            block_mask=block_mask,
+            block_size=128,
+        )[0]
+        self.assertEqual(grad_q[:, :, 128:256], torch.zeros(1, 2, 128, 16))
+
+        with self.assertRaises(RuntimeError):
+            torch.ops.torch_ipex.flash_attention(
+                q, k, v, block_mask=block_mask, block_size=64
+            )
+
+    def test_flash_attention_gqa(self):
+        batch_size, n_head, head_dim = 2, 8, 64
+        for dtype, causal, seq_len, n_kv_head in itertools.product(
+            [torch.float, torch.bfloat16],
+            [False, True],
+            [33, 1030],
+            [2, 1],
+        ):
+            atol = rtol = 1e-4 if dtype is torch.float else 5e-2
+            q, grad_out = [
+                torch.randn(batch_size, n_head, seq_len, head_dim).to(dtype)
+                for _ in range(2)
+            ]
+            k, v = [
+                torch.randn(batch_size, n_kv_head, seq_len, head_dim).to(dtype)
+                for _ in range(2)
+            ]
+            out, lse = torch.ops.torch_ipex.flash_attention(q, k, v, is_causal=causal)
+            grads = torch.ops.torch_ipex.flash_attention_backward(
+                grad_out, q, k, v, out, lse, is_causal=causal
+            )
+            self.assertEqual(grads[1].shape, k.shape)
+            self.assertEqual(grads[2].shape, v.shape)
+            # the reference expands k/v, autograd sums their grads over the group
+            q2, k2, v2 = [t.detach().float().requires_grad_() for t in (q, k, v)]
+            group_size = n_head // n_kv_head
+            ref = torch._scaled_dot_product_attention_math(
+                q2,
+                k2.repeat_interleave(group_size, 1),
+                v2.repeat_interleave(group_size, 1),
+                is_causal=causal,
+            )[0]
+            ref.backward(grad_out.float())
+            torch.testing.assert_close(out, ref.to(dtype), atol=atol, rtol=rtol)
+            for grad, ref_grad in zip(grads, (q2.grad, k2.grad, v2.grad)):
+                torch.testing.assert_close(
+                    grad, ref_grad.to(dtype), atol=atol, rtol=rtol
+                )
+
+        q = torch.randn(1, 6, 16, 16)
+        k, v = [torch.randn(1, 4, 16, 16) for _ in range(2)]
+        with self.assertRaises(RuntimeError):
+            torch.ops.torch_ipex.flash_attention(q, k, v)
+
+    def test_flash_attention_gqa_backward_split(self):
+        # a single kv head spans 3 kv blocks: the grad_k/grad_v pass cuts them
+        # into q-block-sized tiles to feed 4 threads and keeps them whole with
+        # 1 thread
+        batch_size, n_head, n_kv_head, seq_len, head_dim = 1, 8, 1, 1030, 32
+        num_threads = torch.get_num_threads()
+        try:
+            for threads, causal, window_size in itertools.product(
+                [1, 4], [False, True], [-1, 300]
+            ):
+                torch.set_num_threads(threads)
+                q, grad_out = [
+                    torch.randn(batch_size, n_head, seq_len, head_dim)
+                    for _ in range(2)
+                ]
+                k, v = [
+                    torch.randn(batch_size, n_kv_head, seq_len, head_dim)
+                    for _ in range(2)
+                ]
+                out, lse = torch.ops.torch_ipex.flash_attention(
+                    q, k, v, is_causal=causal, window_size=window_size
+                )
+                grads = torch.ops.torch_ipex.flash_attention_backward(
+                    grad_out,
+                    q,
+                    k,
+                    v,
+                    out,
+                    lse,
+                    is_causal=causal,
+                    window_size=window_size,
+                )
+                visible = torch.ones(seq_len, seq_len, dtype=torch.bool)
+                if window_size > 0:
+                    pos = torch.arange(seq_len)
+                    visible &= (pos[:, None] - pos[None, :]).abs() < window_size
+                if causal:
+                    visible &= visible.tril()
+                q2, k2, v2 = [t.detach().clone().requires_grad_() for t in (q, k, v)]
+                ref = torch._scaled_dot_product_attention_math(
+                    q2,
+                    k2.expand(-1, n_head, -1, -1),
+                    v2.expand(-1, n_head, -1, -1),
+                    attn_mask=visible,
+                )[0]
+                ref.backward(grad_out)
+                for grad, ref_grad in zip(grads, (q2.grad, k2.grad, v2.grad)):
+                    torch.testing.assert_close(grad, ref_grad, atol=1e-4, rtol=1e-4)
+        finally:
+            torch.set_num_threads(num_threads)
+
     def test_flash_attention_stride0(self):
         input_shape = (
             1,
@@ -148,6 +148,92 @@ class DistMergedEmbeddingTester(TestCase):
                         )
         dist.destroy_process_group()
 
+    def _rowwise_adam_ref(self, weight, grad, exp_avg, exp_avg_sq, rows, step, args):
+        lr, beta1, beta2, eps, weight_decay, use_lamb = args
+        g = grad[rows]
+        exp_avg[rows] = exp_avg[rows] * beta1 + g * (1 - beta1)
+        exp_avg_sq[rows] = exp_avg_sq[rows] * beta2 + g * g * (1 - beta2)
+        m_hat = exp_avg[rows] / (1 - beta1**step)
+        v_hat = exp_avg_sq[rows] / (1 - beta2**step)
+        update = m_hat / (v_hat.sqrt() + eps) + weight_decay * weight[rows]
+        step_size = torch.full((rows.numel(), 1), lr, dtype=weight.dtype)
+        if use_lamb:
+            w_norm = weight[rows].norm(dim=1, keepdim=True)
+            u_norm = update.norm(dim=1, keepdim=True)
+            trust = torch.where(
+                (w_norm > 0) & (u_norm > 0), w_norm / u_norm, torch.ones_like(w_norm)
+            )
+            step_size = step_size * trust
+        weight[rows] -= step_size * update
+
+    def test_rowwise_adam_update(self):
+        # With 1 rank the local grads are the merged grads, the all to all is
+        # not needed to check the fused backward merge and row-wise update
+        torch.manual_seed(0)
+        num_rows = [40, 70]
+        batch_size = 8
+        row_offset = [0, num_rows[0], num_rows[0] + num_rows[1]]
+        indices = [torch.randint(n, (batch_size * 3,)) for n in num_rows]
+        offsets = [torch.arange(0, batch_size * 3, 3) for _ in num_rows]
+        rows = torch.cat([idx + ofs for idx, ofs in zip(indices, row_offset)])
+        for dtype, emb_dim, use_lamb in [
+            (torch.float, 64, False),
+            (torch.float, 65, True),
+            (torch.double, 33, True),
+            (torch.bfloat16, 128, False),
+            (torch.bfloat16, 65, True),
+        ]:
+            weight = torch.randn(row_offset[-1], emb_dim)
+            ref_weight = weight.clone().double()
+            if dtype == torch.bfloat16:
+                weight, trail = torch.ops.torch_ipex.split_float_bfloat16(weight)
+                ref_weight = torch.ops.torch_ipex.cat_bfloat16_float(
+                    weight, trail
+                ).double()
+                state_dtype = torch.float
+            else:
+                weight = weight.to(dtype)
+                trail = torch.empty(0, dtype=torch.bfloat16)
+                state_dtype = dtype
+            exp_avg = torch.zeros(weight.shape, dtype=state_dtype)
+            exp_avg_sq = torch.zeros(weight.shape, dtype=state_dtype)
+            ref_exp_avg = torch.zeros(weight.shape, dtype=torch.double)
+            ref_exp_avg_sq = torch.zeros(weight.shape, dtype=torch.double)
+            args = (0.1, 0.9, 0.99, 1e-8, 0.01, use_lamb)
+            for step in range(1, 4):
+                grad = torch.randn(batch_size, len(num_rows), emb_dim).to(dtype)
+                (
+                    idx,
+                    val,
+                    ofs,
+                ) = torch.ops.torch_ipex.mergedemb_distribute_backward_local(
+                    grad, row_offset, indices, offsets, 0, 1, False
+                )
+                torch.ops.torch_ipex.mergedemb_distribute_backward_merge_adam_update(
+                    idx, val, ofs, weight, trail, exp_avg, exp_avg_sq, step, *args
+                )
+                # dense grad of the merged table for the reference
+                dense_grad = torch.zeros(ref_weight.shape, dtype=torch.double)
+                bag_grad = grad.double().transpose(0, 1).repeat_interleave(3, dim=1)
+                dense_grad.index_add_(0, rows, bag_grad.reshape(-1, emb_dim))
+                self._rowwise_adam_ref(
+                    ref_weight,
+                    dense_grad,
+                    ref_exp_avg,
+                    ref_exp_avg_sq,
+                    rows.unique(),
+                    step,
+                    args,
+                )
+            if dtype == torch.bfloat16:
+                weight = torch.ops.torch_ipex.cat_bfloat16_float(weight, trail)
+                prec = 2e-2
+            else:
+                prec = 1e-4
+            # untouched rows keep their weight and zero moments
+            self.assertEqual(weight.double(), ref_weight, atol=prec, rtol=prec)
+            self.assertEqual(exp_avg.double(), ref_exp_avg, atol=prec, rtol=prec)
+
 
 if __name__ == "__main__":
     test = unittest.main()
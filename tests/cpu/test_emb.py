@@ -154,6 +154,99 @@ class TestEMB(TestCase):
         out = script_emb(input, offsets)
         self.assertEqual(out, ref_out)
 
+    def test_emb_hot_row_cache(self):
+        num_rows, dim = 1000, 33
+        # skewed accesses: most of the lookups hit the first 50 rows
+        sample = torch.cat(
+            [torch.randint(0, 50, (900,)), torch.randint(0, num_rows, (100,))]
+        )
+        for dtype, include_last_offset in itertools.product(
+            [torch.float, torch.bfloat16], [True, False]
+        ):
+            emb = nn.EmbeddingBag(
+                num_rows, dim, mode="sum", include_last_offset=include_last_offset
+            ).to(dtype)
+            cached_emb = ipex.nn.modules.HotRowEmbeddingBag.from_embeddingbag(
+                emb, sample, capacity=50
+            )
+            self.assertEqual(cached_emb.get_cache_stats()["num_hot_rows"], 50)
+            input = sample[torch.randperm(sample.numel())]
+            offsets = torch.arange(0, input.numel(), 7)
+            if include_last_offset:
+                offsets = torch.cat([offsets, torch.tensor([input.numel()])])
+            with torch.no_grad():
+                ref_out = emb(input, offsets)
+                out = cached_emb(input, offsets)
+            self.assertEqual(out, ref_out)
+            stats = cached_emb.get_cache_stats()
+            self.assertEqual(stats["hits"] + stats["misses"], input.numel())
+            self.assertGreaterEqual(stats["hit_rate"], 0.9)
+            self.assertEqual(
+                stats["hit_bytes"], stats["hits"] * dim * emb.weight.element_size()
+            )
+
+            # an empty cache reads every row from the table
+            cached_emb.build_cache(sample, 0)
+            with torch.no_grad():
+                self.assertEqual(cached_emb(input, offsets), ref_out)
+            self.assertEqual(cached_emb.get_cache_stats()["hits"], 0)
+
+            if include_last_offset:
+                # as in ATen, the last offset ends the last bag and the
+                # indices after it are not looked up
+                cached_emb.build_cache(sample, 50)
+                offsets = torch.tensor([0, 3, 10])
+                with torch.no_grad():
+                    out = cached_emb(input[:20], offsets)
+                weight = emb.weight.detach().float()
+                ref_out = torch.stack(
+                    [weight[input[:3]].sum(0), weight[input[3:10]].sum(0)]
+                )
+                self.assertEqual(out.float(), ref_out, prec=1e-2)
+                stats = cached_emb.get_cache_stats()
+                self.assertEqual(stats["hits"] + stats["misses"], 10)
+
+    def _rowwise_dequantize(self, qweight, qtype, dim):
+        if qtype == torch.quint4x2:
+            packed_bytes = (dim + 1) // 2
+            packed = qweight[:, :packed_bytes]
+            q = torch.stack([packed & 0x0F, packed >> 4], dim=-1)
+            q = q.reshape(qweight.size(0), -1)[:, :dim].float()
+            params = qweight[:, packed_bytes:].contiguous().view(torch.float)
+            return q * params[:, :1] + params[:, 1:]
+        q = qweight[:, :dim].contiguous().view(torch.float8_e4m3fn).float()
+        return q * qweight[:, dim:].contiguous().view(torch.float)
+
+    def test_rowwise_quantized_emb(self):
+        num_rows = 100
+        indices = torch.randint(num_rows, (40,))
+        for qtype, dim, mode, include_last_offset in itertools.product(
+            [torch.quint4x2, torch.float8_e4m3fn], [64, 37], [0, 1], [True, False]
+        ):
+            weight = torch.randn(num_rows, dim)
+            qweight = torch.ops.torch_ipex.rowwise_quantized_embedding_pack(
+                weight, qtype
+            )
+            # int4 and fp8 keep the quantization error within a fraction of the
+            # row range
+            dequant = self._rowwise_dequantize(qweight, qtype, dim)
+            self.assertEqual(dequant, weight, atol=0.5, rtol=0.1)
+
+            offsets = torch.LongTensor([0, 1, 1, 7, 20, 40])
+            if not include_last_offset:
+                offsets = offsets[:-1]
+            out = torch.ops.torch_ipex.rowwise_quantized_embedding_bag(
+                qweight, indices, offsets, qtype, dim, mode, include_last_offset
+            )
+            ref_out = torch.nn.functional.embedding_bag(
+                indices,
+                dequant,
+                offsets,
+                mode="mean" if mode == 1 else "sum",
+                include_last_offset=include_last_offset,
+            )
+            self.assertEqual(out, ref_out, atol=1e-4, rtol=1e-4)
+
 
 if __name__ == "__main__":
     test = unittest.main()
@@ -0,0 +1,107 @@
+import torch
+import torch.nn.functional as F
+import intel_extension_for_pytorch as ipex
+from common_utils import TestCase
+import unittest
+
+MOE_BACKEND_TPP_FALLBACK = ipex._C.MOE_BACKEND_TPP_FALLBACK
+
+
+def moe_reference(hidden_states, topk_ids, topk_weights, gate, up, down):
+    # Per-expert loop of the original MixtralDecoderLayer forward
+    output = torch.zeros_like(hidden_states)
+    expert_mask = F.one_hot(topk_ids, num_classes=len(gate)).permute(2, 1, 0)
+    for e in range(len(gate)):
+        idx, top_x = torch.where(expert_mask[e])
+        if top_x.numel() == 0:
+            continue
+        x = hidden_states[top_x]
+        y = F.linear(F.silu(F.linear(x, gate[e])) * F.linear(x, up[e]), down[e])
+        output.index_add_(0, top_x, y * topk_weights[top_x, idx].unsqueeze(-1))
+    return output
+
+
+class FusedMoETester(TestCase):
+    def _test_fused_moe(
+        self, dtype, num_tokens, num_experts, top_k, prec, expert_parallel=False
+    ):
+        hidden_size, inter_size = 64, 96
+        hidden_states = torch.randn(num_tokens, hidden_size).to(dtype)
+
+        def expert_weights(out_features, in_features):
+            return [
+                (torch.randn(out_features, in_features) * 0.1).to(dtype)
+                for _ in range(num_experts)
+            ]
+
+        gate = expert_weights(inter_size, hidden_size)
+        up = expert_weights(inter_size, hidden_size)
+        down = expert_weights(hidden_size, inter_size)
+        router_logits = torch.randn(num_tokens, num_experts)
+        topk_weights, topk_ids = torch.topk(router_logits.softmax(-1), top_k, dim=-1)
+        topk_weights = (topk_weights / topk_weights.sum(-1, keepdim=True)).to(dtype)
+
+        ref = moe_reference(hidden_states, topk_ids, topk_weights, gate, up, down)
+        fused_moe = (
+            torch.ops.torch_ipex.fused_moe_ep
+            if expert_parallel
+            else torch.ops.torch_ipex.fused_moe
+        )
+        out = fused_moe(
+            hidden_states,
+            topk_ids,
+            topk_weights,
+            gate,
+            up,
+            down,
+            [],
+            [],
+            [],
+            MOE_BACKEND_TPP_FALLBACK,
+            num_experts if expert_parallel else False,
+        )
+        self.assertEqual(out, ref, prec=prec)
+
+    def test_fused_moe(self):
+        for num_tokens in [1, 5, 33]:
+            for num_experts, top_k in [(8, 2), (16, 4)]:
+                self._test_fused_moe(
+                    torch.float, num_tokens, num_experts, top_k, prec=1e-3
+                )
+                self._test_fused_moe(
+                    torch.bfloat16, num_tokens, num_experts, top_k, prec=0.5
+                )
+
+    def test_fused_moe_expert_parallel(self):
+        try:
+            world_size = ipex.cpu.comm.get_world_size()
+        except (AttributeError, RuntimeError):
+            self.skipTest("IPEX is not built with oneCCL")
+        if world_size != 1:
+            self.skipTest("only runs on a single rank")
+        for num_tokens in [0, 5, 33]:
+            self._test_fused_moe(
+                torch.float, num_tokens, 8, 2, prec=1e-3, expert_parallel=True
+            )
+
+    def test_fused_moe_invalid_expert(self):
+        hidden_states = torch.randn(2, 16)
+        weights = [torch.randn(16, 16) for _ in range(2)]
+        with self.assertRaises(RuntimeError):
+            torch.ops.torch_ipex.fused_moe(
+                hidden_states,
+                torch.tensor([[0], [2]]),
+                torch.ones(2, 1),
+                weights,
+                weights,
+                weights,
+                [],
+                [],
+                [],
+                MOE_BACKEND_TPP_FALLBACK,
+                False,
+            )
+
+
+if __name__ == "__main__":
+    test = unittest.main()
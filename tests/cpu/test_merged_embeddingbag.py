@@ -11,6 +11,9 @@ from bench.custom_op_bench.merged_embeddingbag import (
 )
 import intel_extension_for_pytorch as ipex
 import copy
+import itertools
+import os
+import tempfile
 
 
 class TestMergedEmbedding(TestCase):
@@ -160,6 +163,74 @@ class TestMergedEmbedding(TestCase):
                             dense = torch.randn(B, NUM_DIM, dtype=dtype)
                             self._test_inference(m, ref_m, (indices, offsets, dense))
 
+    def test_mmap_tables(self):
+        B, NUM_DIM = 64, 128
+        num_rows = [1000, 3000]
+        indices = [torch.randint(rows, (B * 3,)) for rows in num_rows]
+        offsets = [torch.arange(0, B * 3, 3) for _ in num_rows]
+        for dtype, readahead in itertools.product(
+            [torch.float32, torch.bfloat16, torch.float16], [False, True]
+        ):
+            emb_list = [
+                torch.nn.EmbeddingBag(rows, NUM_DIM, mode="sum").to(dtype)
+                for rows in num_rows
+            ]
+            ref_m = ipex.nn.modules.MergedEmbeddingBag.from_embeddingbag_list(emb_list)
+            with tempfile.TemporaryDirectory() as tmp_dir:
+                paths = [os.path.join(tmp_dir, str(i)) for i in range(len(num_rows))]
+                for emb, path in zip(emb_list, paths):
+                    ipex.nn.modules.save_embedding_table(emb.weight, path)
+                m = ipex.nn.modules.MergedEmbeddingBag.from_mmap_files(
+                    paths, num_rows, NUM_DIM, dtype, readahead=readahead
+                )
+                with torch.no_grad():
+                    self.assertEqual(m(indices, offsets), ref_m(indices, offsets))
+                # pinning is best effort, within the RLIMIT_MEMLOCK limit
+                pinned = m.pin_hot_rows(indices, 16)
+                self.assertTrue(all(0 <= p <= 16 for p in pinned))
+                with torch.no_grad():
+                    self.assertEqual(m(indices, offsets), ref_m(indices, offsets))
+                del m
+
+    def test_rowwise_quantized_merged_emb_cat(self):
+        B, NUM_DIM = 67, 128
+        num_rows = [1000, 3000]
+        for qtype, index_type in [
+            (torch.quint4x2, torch.int64),
+            (torch.float8_e4m3fn, torch.int32),
+        ]:
+            weights = [torch.randn(rows, NUM_DIM) for rows in num_rows]
+            qweights = [
+                torch.ops.torch_ipex.rowwise_quantized_embedding_pack(w, qtype)
+                for w in weights
+            ]
+            # the dequantized tables give the reference
+            dequants = [
+                torch.ops.torch_ipex.rowwise_quantized_embedding_bag(
+                    qw, torch.arange(rows), torch.arange(rows), qtype, NUM_DIM, 0, False
+                )
+                for qw, rows in zip(qweights, num_rows)
+            ]
+            indices = [torch.randint(rows, (B * 3,)) for rows in num_rows]
+            offsets = [torch.arange(0, B * 3, 3) for _ in num_rows]
+            dense = torch.randn(B, NUM_DIM)
+            out = torch.ops.torch_ipex.rowwise_quantized_merged_embeddingbag_cat(
+                qweights,
+                [i.to(index_type) for i in indices],
+                [o.to(index_type) for o in offsets],
+                dense,
+                qtype,
+            )
+            ref_out = torch.cat(
+                [dense]
+                + [
+                    torch.nn.functional.embedding_bag(i, w, o, mode="sum")
+                    for i, w, o in zip(indices, dequants, offsets)
+                ],
+                dim=1,
+            )
+            self.assertEqual(out, ref_out, atol=1e-4, rtol=1e-4)
+
     def test_training(self):
         B = 1029
         NUM_TABLE = 26
@@ -231,5 +302,29 @@ class TestMergedEmbedding(TestCase):
                             self._test_training(m, ref_m, (indices, offsets), opt=opt)
 
 
+    def test_adagrad_multi_steps(self):
+        # the hessian of the fused AdaGrad carries over the steps
+        B, NUM_TABLE, NUM_DIM = 16, 3, 128
+        indices = [torch.randint(1000, (B * 2,)) for _ in range(NUM_TABLE)]
+        offsets = [torch.arange(0, B * 2, 2) for _ in range(NUM_TABLE)]
+        emb_list = EmbeddingBagList(NUM_TABLE, NUM_DIM, torch.float32)
+        m = ipex.nn.modules.MergedEmbeddingBagWithAdaGrad.from_embeddingbag_list(
+            copy.deepcopy(emb_list).list, lr=0.01, eps=1e-10
+        )
+        ref_m = copy.deepcopy(emb_list)
+        opt = torch.optim.Adagrad(ref_m.parameters(), lr=0.01, eps=1e-10)
+        for _ in range(3):
+            out = m(indices, offsets)
+            ref_out = ref_m(indices, offsets)
+            self.assertEqual(out, ref_out)
+            sum(out).sum().backward()
+            opt.zero_grad()
+            sum(ref_out).sum().backward()
+            opt.step()
+            for i in range(NUM_TABLE):
+                self.assertEqual(
+                    m.weights[i], ref_m.list[i].weight, rtol=1e-5, atol=1e-5
+                )
+
 if __name__ == "__main__":
     test = unittest.main()
@@ -36,6 +36,19 @@ class PagedAttentionTest(TestCase):
             value_caches.append(value_cache)
         return key_caches, value_caches
 
+    def quantize_kv_cache(
+        self, cache: torch.Tensor, cache_dtype: torch.dtype
+    ) -> Tuple[torch.Tensor, torch.Tensor, torch.Tensor]:
+        # per-block/per-head scales of [num_blocks, num_heads]
+        qmax = 127.0 if cache_dtype == torch.int8 else 448.0
+        scale = cache.float().abs().amax(dim=(1, 3)) / qmax
+        q_cache = cache.float() / scale[:, None, :, None]
+        if cache_dtype == torch.int8:
+            q_cache = q_cache.round().clamp(-128, 127)
+        q_cache = q_cache.to(cache_dtype)
+        dq_cache = (q_cache.float() * scale[:, None, :, None]).to(cache.dtype)
+        return q_cache, scale, dq_cache
+
     def ref_masked_attention(
         self,
         query: torch.Tensor,
@@ -115,11 +128,12 @@ class PagedAttentionTest(TestCase):
         block_size: int,
         dtype: torch.dtype,
         seed: int,
+        max_seq_len: int = 1024,
+        kv_cache_dtype: Optional[torch.dtype] = None,
     ) -> None:
         random.seed(seed)
         torch.random.manual_seed(seed)
         torch.manual_seed(seed)
-        max_seq_len = 1024
         scale = float(1.0 / (head_size**0.5))
         num_query_heads, num_kv_head = num_head
         query = torch.empty(
@@ -156,13 +170,23 @@ class PagedAttentionTest(TestCase):
             num_blocks, block_size, 1, num_kv_head, head_size, dtype, seed
         )
         key_cache, value_cache = key_caches[0], value_caches[0]
+        k_scale, v_scale = None, None
+        kernel_key_cache, kernel_value_cache = key_cache, value_cache
+        if kv_cache_dtype is not None:
+            # the reference runs on the dequantized caches
+            kernel_key_cache, k_scale, key_cache = self.quantize_kv_cache(
+                key_cache, kv_cache_dtype
+            )
+            kernel_value_cache, v_scale, value_cache = self.quantize_kv_cache(
+                value_cache, kv_cache_dtype
+            )
         # Call the paged attention kernel.
         output = torch.empty_like(query)
         torch.ops.torch_ipex.single_query_cached_kv_attention(
             output,
             query,
-            key_cache,
-            value_cache,
+            kernel_key_cache,
+            kernel_value_cache,
             head_mapping,
             scale,
             block_tables,
@@ -170,6 +194,8 @@ class PagedAttentionTest(TestCase):
             block_size,
             max_context_len,
             alibi_slopes,
+            k_scale,
+            v_scale,
         )
 
         # Run the reference implementation.
@@ -224,6 +250,171 @@ class PagedAttentionTest(TestCase):
                 seed,
             )
 
+    def test_paged_attention_long_context(self):
+        # the context is split into several partitions per sequence
+        num_blocks = 512
+        for num_head, use_alibi, block_size, dtype in product(
+            [(32, 32), (32, 8)], [True, False], [16, 64], [torch.bfloat16, torch.float]
+        ):
+            self._test_paged_attention_func(
+                3,
+                num_head,
+                128,
+                use_alibi,
+                num_blocks,
+                block_size,
+                dtype,
+                0,
+                max_seq_len=4096,
+            )
+
+    def test_paged_attention_quantized_kv_cache(self):
+        num_blocks = 128
+        for num_head, head_size, use_alibi, dtype, kv_cache_dtype in product(
+            [(40, 40), (64, 16)],
+            [64, 80, 128],
+            [True, False],
+            [torch.bfloat16, torch.float],
+            [torch.int8, torch.float8_e4m3fn],
+        ):
+            self._test_paged_attention_func(
+                7,
+                num_head,
+                head_size,
+                use_alibi,
+                num_blocks,
+                16,
+                dtype,
+                0,
+                kv_cache_dtype=kv_cache_dtype,
+            )
+
+    def _test_paged_attention_varlen_func(
+        self,
+        num_head: Tuple[int, int],
+        head_size: int,
+        is_causal: bool,
+        block_size: int,
+        dtype: torch.dtype,
+        seed: int,
+        window_size: int = -1,
+    ) -> None:
+        random.seed(seed)
+        torch.manual_seed(seed)
+        num_blocks = 256
+        scale = float(1.0 / (head_size**0.5))
+        num_query_heads, num_kv_head = num_head
+        num_queries_per_kv = num_query_heads // num_kv_head
+        head_mapping = torch.repeat_interleave(
+            torch.arange(num_kv_head, dtype=torch.int32), num_queries_per_kv
+        )
+        # mix prefill chunks and single decode tokens
+        context_lens = [1, 37, 300, 700, 1024]
+        query_lens = [1, 37, 64, 1, 200]
+        cu_seqlens_q = [0]
+        for query_len in query_lens:
+            cu_seqlens_q.append(cu_seqlens_q[-1] + query_len)
+        query = torch.empty(cu_seqlens_q[-1], num_query_heads, head_size, dtype=dtype)
+        query.uniform_(-scale, scale)
+        max_context_len = max(context_lens)
+        max_num_blocks_per_seq = (max_context_len + block_size - 1) // block_size
+        block_tables = torch.randint(
+            0, num_blocks, (len(context_lens), max_num_blocks_per_seq), dtype=torch.int
+        )
+        key_caches, value_caches = self.create_kv_caches(
+            num_blocks, block_size, 1, num_kv_head, head_size, dtype, seed
+        )
+        key_cache, value_cache = key_caches[0], value_caches[0]
+        output = torch.empty_like(query)
+        torch.ops.torch_ipex.paged_attention_varlen(
+            output,
+            query,
+            key_cache,
+            value_cache,
+            head_mapping,
+            scale,
+            block_tables,
+            torch.tensor(cu_seqlens_q, dtype=torch.int),
+            torch.tensor(context_lens, dtype=torch.int),
+            block_size,
+            max_context_len,
+            is_causal,
+            None,
+            window_size=window_size,
+        )
+
+        for i, (context_len, query_len) in enumerate(zip(context_lens, query_lens)):
+            slots = torch.arange(context_len)
+            block_ids = block_tables[i][slots // block_size]
+            keys = key_cache[block_ids, slots % block_size]
+            values = value_cache[block_ids, slots % block_size]
+            keys = torch.repeat_interleave(keys, num_queries_per_kv, dim=1)
+            values = torch.repeat_interleave(values, num_queries_per_kv, dim=1)
+            attn_mask = None
+            if is_causal or window_size > 0:
+                # the query tokens are the last query_len tokens of the context
+                q_pos = torch.arange(context_len - query_len, context_len)
+                if not is_causal:
+                    q_pos = torch.full_like(q_pos, context_len - 1)
+                attn_mask = torch.zeros(query_len, context_len)
+                attn_mask.masked_fill_(slots[None, :] > q_pos[:, None], float("-inf"))
+                if window_size > 0:
+                    attn_mask.masked_fill_(
+                        slots[None, :] <= q_pos[:, None] - window_size, float("-inf")
+                    )
+            q = query[cu_seqlens_q[i] : cu_seqlens_q[i + 1]]
+            ref_out = self.ref_masked_attention(q, keys, values, scale, attn_mask)
+            assert torch.allclose(
+                output[cu_seqlens_q[i] : cu_seqlens_q[i + 1]],
+                ref_out,
+                atol=5e-3,
+                rtol=1e-3,
+            )
+
+    def test_paged_attention_varlen(self):
+        for num_head, head_size, is_causal, block_size, dtype in product(
+            [(40, 40), (64, 16)],
+            [64, 80, 128],
+            [True, False],
+            [16, 32],
+            [torch.bfloat16, torch.float],
+        ):
+            self._test_paged_attention_varlen_func(
+                num_head, head_size, is_causal, block_size, dtype, 0
+            )
+
+        # cu_seqlens_q must start at 0, the rows before it have no sequence
+        query = torch.randn(3, 4, 64)
+        key_caches, value_caches = self.create_kv_caches(4, 16, 1, 4, 64, torch.float, 0)
+        with self.assertRaises(RuntimeError):
+            torch.ops.torch_ipex.paged_attention_varlen(
+                torch.empty_like(query),
+                query,
+                key_caches[0],
+                value_caches[0],
+                torch.arange(4, dtype=torch.int32),
+                0.125,
+                torch.zeros(1, 4, dtype=torch.int),
+                torch.tensor([1, 3], dtype=torch.int),
+                torch.tensor([8], dtype=torch.int),
+                16,
+                8,
+                True,
+                None,
+            )
+
+    def test_paged_attention_sliding_window(self):
+        # the partitions out of the window are skipped
+        for num_head, is_causal, window_size, dtype in product(
+            [(40, 40), (64, 16)],
+            [True, False],
+            [1, 100, 600],
+            [torch.bfloat16, torch.float],
+        ):
+            self._test_paged_attention_varlen_func(
+                num_head, 64, is_causal, 16, dtype, 0, window_size=window_size
+            )
+
     def _test_reshape_and_cache_func(
         self,
         num_token: int,
@@ -300,6 +491,118 @@ class PagedAttentionTest(TestCase):
                 num_token, num_kv_head, head_size, block_size, num_blocks, dtype, seed
             )
 
+    def test_reshape_and_cache_quantized(self):
+        num_blocks = 128
+        num_kv_head = 8
+        block_size = 16
+        for num_token, head_size, dtype, kv_cache_dtype in product(
+            [1, 83],
+            [64, 128],
+            [torch.bfloat16, torch.float],
+            [torch.int8, torch.float8_e4m3fn],
+        ):
+            slot_mapping = random.sample(range(block_size * num_blocks), num_token)
+            slot_mapping = torch.tensor(slot_mapping, dtype=torch.int)
+            key = torch.randn(num_token, num_kv_head, head_size, dtype=dtype)
+            value = torch.randn(num_token, num_kv_head, head_size, dtype=dtype)
+            qmax = 127.0 if kv_cache_dtype == torch.int8 else 448.0
+            k_scale = torch.full((num_blocks, num_kv_head), 5.0 / qmax)
+            v_scale = torch.full((num_blocks, num_kv_head), 4.0 / qmax)
+            cache_shape = (num_blocks, block_size, num_kv_head, head_size)
+            key_cache = torch.zeros(cache_shape).to(kv_cache_dtype)
+            value_cache = torch.zeros(cache_shape).to(kv_cache_dtype)
+            torch.ops.torch_ipex.reshape_and_cache(
+                key, value, key_cache, value_cache, slot_mapping, k_scale, v_scale
+            )
+            block_indicies = torch.div(slot_mapping, block_size, rounding_mode="floor")
+            block_offsets = slot_mapping % block_size
+            for i in range(num_token):
+                block_idx = block_indicies[i]
+                block_offset = block_offsets[i]
+                for cache, state, cache_scale in [
+                    (key_cache, key, k_scale),
+                    (value_cache, value, v_scale),
+                ]:
+                    dq = cache[block_idx, block_offset].float() * cache_scale[
+                        block_idx
+                    ].unsqueeze(-1)
+                    ref = state[i].float().clamp(
+                        -qmax * cache_scale[block_idx].unsqueeze(-1),
+                        qmax * cache_scale[block_idx].unsqueeze(-1),
+                    )
+                    # int8 rounds to 1/2 step, e4m3 keeps 3 mantissa bits
+                    assert torch.allclose(
+                        dq, ref, atol=cache_scale.max().item(), rtol=0.07
+                    )
+
+    def test_copy_blocks(self):
+        num_blocks = 64
+        num_layer = 2
+        for block_size, dtype in product([16, 32], [torch.bfloat16, torch.int8]):
+            key_caches = [
+                torch.randn(num_blocks, block_size, 8, 64).to(dtype)
+                for _ in range(num_layer)
+            ]
+            value_caches = [
+                torch.randn(num_blocks, block_size, 8, 64).to(dtype)
+                for _ in range(num_layer)
+            ]
+            ref_key_caches = [cache.clone() for cache in key_caches]
+            ref_value_caches = [cache.clone() for cache in value_caches]
+            blocks = random.sample(range(num_blocks), 16)
+            block_mapping = torch.tensor(
+                list(zip(blocks[:8], blocks[8:])), dtype=torch.long
+            )
+            torch.ops.torch_ipex.copy_blocks(key_caches, value_caches, block_mapping)
+            for src, dst in block_mapping.tolist():
+                for cache in ref_key_caches + ref_value_caches:
+                    cache[dst].copy_(cache[src])
+            for cache, ref_cache in zip(
+                key_caches + value_caches, ref_key_caches + ref_value_caches
+            ):
+                assert torch.equal(cache, ref_cache)
+
+    def test_swap_blocks(self):
+        num_blocks = 64
+        num_host_blocks = 16
+        for block_size, dtype in product([16, 32], [torch.bfloat16, torch.float]):
+            cache = torch.randn(num_blocks, block_size, 8, 64, dtype=dtype)
+            host_buffer = torch.zeros(num_host_blocks, block_size, 8, 64, dtype=dtype)
+            blocks = random.sample(range(num_blocks), 8)
+            # swap out to the host buffer
+            swap_out = torch.tensor(
+                [[block, i] for i, block in enumerate(blocks)], dtype=torch.long
+            )
+            torch.ops.torch_ipex.swap_blocks(cache, host_buffer, swap_out)
+            for block, i in swap_out.tolist():
+                assert torch.equal(host_buffer[i], cache[block])
+            # swap in to other blocks of the cache
+            new_blocks = random.sample(range(num_blocks), 8)
+            swap_in = torch.tensor(
+                [[i, block] for i, block in enumerate(new_blocks)], dtype=torch.long
+            )
+            ref_cache = cache.clone()
+            for i, block in swap_in.tolist():
+                ref_cache[block].copy_(host_buffer[i])
+            torch.ops.torch_ipex.swap_blocks(host_buffer, cache, swap_in)
+            assert torch.equal(cache, ref_cache)
+
+    def test_copy_swap_blocks_invalid_mapping(self):
+        cache = torch.randn(4, 16, 8, 64)
+        host_buffer = torch.zeros(2, 16, 8, 64)
+        for block_mapping in [[[0, 4]], [[-1, 1]], [[1, 2], [3, 100]]]:
+            block_mapping = torch.tensor(block_mapping, dtype=torch.long)
+            with self.assertRaises(RuntimeError):
+                torch.ops.torch_ipex.copy_blocks([cache], [cache], block_mapping)
+        with self.assertRaises(RuntimeError):
+            torch.ops.torch_ipex.swap_blocks(
+                cache, host_buffer, torch.tensor([[3, 2]], dtype=torch.long)
+            )
+        with self.assertRaises(RuntimeError):
+            torch.ops.torch_ipex.swap_blocks(
+                host_buffer, cache, torch.tensor([[-1, 0]], dtype=torch.long)
+            )
+
 
 if __name__ == "__main__":
     test = unittest.main()
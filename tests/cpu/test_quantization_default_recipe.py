@@ -10,6 +10,9 @@ from torch.ao.quantization import (
     QConfigMapping,
 )
 import copy
+import os
+import subprocess
+import sys
 import unittest
 import numpy
 from common_utils import TestCase
@@ -962,6 +965,58 @@ class WeightOnlyQuantizationTester(TestCase):
         for shape, use_bias in cases:
             test(shape, use_bias)
 
+    def test_weight_only_quantization_autotune(self):
+        # The tuner reads its env vars once per process, so run in a subprocess.
+        # A second process must reuse the tuning file and give the same result.
+        script = """
+import sys, torch
+import intel_extension_for_pytorch as ipex
+from intel_extension_for_pytorch.quantization import prepare, convert
+from intel_extension_for_pytorch.quantization import WoqWeightDtype
+torch.manual_seed(0)
+m = torch.nn.Linear(256, 512).eval()
+qconfig = ipex.quantization.get_weight_only_quant_qconfig_mapping(
+    weight_dtype=WoqWeightDtype.INT4
+)
+with torch.no_grad():
+    woq_model = convert(prepare(m, qconfig, example_inputs=torch.rand(1, 256)))
+    for M in [1, 7, 64, 200]:
+        data = torch.rand(M, 256)
+        # the second call hits the tuned config of the first one
+        woq_model(data)
+        torch.save((data, woq_model(data)), sys.argv[1] + str(M))
+"""
+        with tempfile.TemporaryDirectory() as work_dir:
+            env = os.environ.copy()
+            env["IPEX_WOQ_AUTOTUNE"] = "1"
+            env["IPEX_WOQ_TUNING_FILE"] = os.path.join(work_dir, "woq_tuning.txt")
+            outputs = []
+            for run in range(2):
+                prefix = os.path.join(work_dir, "out" + str(run) + "_")
+                subprocess.check_call([sys.executable, "-c", script, prefix], env=env)
+                outputs.append(
+                    [torch.load(prefix + str(M)) for M in [1, 7, 64, 200]]
+                )
+                # one tuned config per M bucket: neither the repeated calls
+                # nor the second process, which loads the file, tune again
+                with open(env["IPEX_WOQ_TUNING_FILE"]) as f:
+                    keys = [line.split()[0] for line in f]
+                self.assertEqual(len(keys), 4)
+                self.assertEqual(len(set(keys)), 4)
+            # invalid entries of a stale file are skipped for the defaults
+            bad_values = ["4096 1 0", "0 1 0", "16 3 0", "16 1 7"]
+            with open(env["IPEX_WOQ_TUNING_FILE"], "w") as f:
+                for key, values in zip(keys, bad_values):
+                    f.write(key + " " + values + "\n")
+            env["IPEX_WOQ_AUTOTUNE"] = "0"
+            prefix = os.path.join(work_dir, "out_stale_")
+            subprocess.check_call([sys.executable, "-c", script, prefix], env=env)
+            outputs.append([torch.load(prefix + str(M)) for M in [1, 7, 64, 200]])
+            for (data0, y0), (data1, y1), (data2, y2) in zip(*outputs):
+                # different blocking only changes the accumulation order
+                torch.testing.assert_close(y0, y1, rtol=1e-2, atol=1e-2)
+                torch.testing.assert_close(y0, y2, rtol=1e-2, atol=1e-2)
+
     def test_weight_only_quantization_nf4_weight(self):
         class M(nn.Module):
             def __init__(self, input_channel, output_channel, has_bias):
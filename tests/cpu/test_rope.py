@@ -213,6 +213,64 @@ class FusedROPETester(TestCase):
                 ),
             )
 
+    def test_rope_paged_cache(self):
+        batch, seq_len, head_size, num_blocks, block_size = 3, 5, 64, 8, 4
+        position_ids_t = torch.arange(seq_len).unsqueeze(0).repeat(batch, 1)
+        position_ids_s = torch.tensor([7])
+        for (rotary_dim, offset, position_ids), kv_head, dtype in product(
+            [
+                (64, 1, position_ids_t),
+                (64, 32, position_ids_t),
+                (32, 1, position_ids_s),
+            ],
+            [self.num_heads, 2],
+            [torch.float32, torch.bfloat16, torch.float16],
+        ):
+            qkv = torch.rand(
+                batch, seq_len, (self.num_heads + 2 * kv_head) * head_size
+            ).to(dtype)
+            embed_positions = self.create_sinusoidal_positions(2048, rotary_dim)
+            (
+                query_ref,
+                key_ref,
+                value_ref,
+            ) = torch.ops.torch_ipex.rotary_position_embedding(
+                qkv,
+                embed_positions,
+                position_ids,
+                self.num_heads,
+                head_size,
+                offset,
+                rotary_dim,
+            )
+            key_cache, value_cache = [
+                torch.zeros(num_blocks, block_size, kv_head, head_size, dtype=dtype)
+                for _ in range(2)
+            ]
+            slots = torch.randperm(num_blocks * block_size)[: batch * seq_len]
+            # the padding token is not stored
+            slots[-1] = -1
+            query = torch.ops.torch_ipex.rotary_position_embedding_paged_cache(
+                qkv,
+                embed_positions,
+                position_ids,
+                self.num_heads,
+                head_size,
+                offset,
+                rotary_dim,
+                key_cache,
+                value_cache,
+                slots.to(torch.int32),
+            )
+            self.assertEqual(query, query_ref)
+            key_cache = key_cache.view(-1, kv_head, head_size)
+            value_cache = value_cache.view(-1, kv_head, head_size)
+            self.assertEqual(key_cache[slots[:-1]], key_ref.flatten(0, 1)[:-1])
+            self.assertEqual(value_cache[slots[:-1]], value_ref.flatten(0, 1)[:-1])
+            unused = torch.ones(num_blocks * block_size, dtype=torch.bool)
+            unused[slots[:-1]] = False
+            self.assertEqual(key_cache[unused], torch.zeros_like(key_cache[unused]))
+
 
 if __name__ == "__main__":
     test = unittest.main()
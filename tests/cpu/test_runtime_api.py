@@ -247,6 +247,61 @@ class TestRuntimeAPI(TestCase):
         self.assertEqual(y, y_runtime)
         self.assertEqual(y, y_runtime2)
 
+    @unittest.skipIf(
+        not ipex.cpu.runtime.is_runtime_ext_enabled(),
+        "Skip when IPEX Runtime extension is not enabled",
+    )
+    @runtime_thread_affinity_test_env
+    def test_task_dynamic_batching(self):
+        model = SimpleNet()
+        model.eval()
+        inputs = [torch.rand(bs, 64, 3, 3) for bs in [1, 2, 3, 1, 4, 5]]
+        # Calculate the reference result
+        ys = [model(x) for x in inputs]
+        traced_model = torch.jit.trace(model, inputs[0])
+        traced_model = torch.jit.freeze(traced_model)
+
+        cpu_pool = ipex.cpu.runtime.CPUPool(node_id=0)
+        for m in [model, traced_model]:
+            # Create task with batching, a long window makes the requests
+            # below coalesced into batches of at most 8 rows
+            task = ipex.cpu.runtime.Task(
+                m, cpu_pool, max_batch_size=8, batch_timeout_us=100000
+            )
+            y_runtime_futures = [task(x) for x in inputs]
+            for y, y_runtime_future in zip(ys, y_runtime_futures):
+                self.assertEqual(y, y_runtime_future.get())
+            # Inputs which can't be concatenated run separately
+            y_runtime_futures = [task(inputs[0]), task(torch.rand(2, 64, 5, 5))]
+            self.assertEqual(ys[0], y_runtime_futures[0].get())
+            self.assertEqual(y_runtime_futures[1].get().size(0), 2)
+
+
+    @unittest.skipIf(
+        not ipex.cpu.runtime.is_runtime_ext_enabled(),
+        "Skip when IPEX Runtime extension is not enabled",
+    )
+    @runtime_thread_affinity_test_env
+    def test_task_multi_workers(self):
+        model = SimpleNet()
+        model.eval()
+        inputs = [torch.rand(bs, 64, 3, 3) for bs in range(1, 9)]
+        # Calculate the reference result
+        ys = [model(x) for x in inputs]
+        traced_model = torch.jit.trace(model, inputs[0])
+        traced_model = torch.jit.freeze(traced_model)
+
+        cpu_pool = ipex.cpu.runtime.CPUPool(node_id=0)
+        num_cores = len(cpu_pool.core_ids)
+        for m in [model, traced_model]:
+            task = ipex.cpu.runtime.Task(
+                m, cpu_pool, num_workers=2, steal_across_executors=True
+            )
+            self.assertEqual(task.num_workers, min(2, num_cores))
+            # the concurrent calls keep their own arguments
+            y_runtime_futures = [task(x) for x in inputs]
+            for y, y_runtime_future in zip(ys, y_runtime_futures):
+                self.assertEqual(y, y_runtime_future.get())
 
 class TestMultiStreamModule(TestCase):
     @unittest.skipIf(
@@ -1,6 +1,9 @@
 import unittest
 import torch
+import os
 import random
+import shutil
+import tempfile
 import numpy
 import intel_extension_for_pytorch as ipex
 
@@ -186,6 +189,38 @@ class TPPOPsTester(TestCase):
             hf_res, tpp_res, hf_intermediate, tpp_intermediate, prec=0.01
         )
 
+    @unittest.skipIf(shutil.which("g++") is None, "g++ is required to JIT loops")
+    def test_tpp_loop_scheme_disk_cache(self):
+        # "CBa" isn't one of the pre-defined loop nests, so it's JIT compiled
+        # and the shared object lands in the on-disk cache
+        with tempfile.TemporaryDirectory() as cache_dir:
+            old_cache_dir = os.environ.get("IPEX_TPP_JIT_CACHE_DIR")
+            os.environ["IPEX_TPP_JIT_CACHE_DIR"] = cache_dir
+            try:
+                torch_ipex_cpp.tpp_prewarm_loop_schemes(["CBa"])
+            finally:
+                if old_cache_dir is None:
+                    del os.environ["IPEX_TPP_JIT_CACHE_DIR"]
+                else:
+                    os.environ["IPEX_TPP_JIT_CACHE_DIR"] = old_cache_dir
+            cached = [f for f in os.listdir(cache_dir) if f.endswith(".so")]
+            self.assertEqual(len(cached), 1)
+
+    def test_tpp_kernel_cache_stats(self):
+        torch_ipex_cpp.tpp_reset_kernel_cache_stats()
+        hidden_states = torch.randn(
+            self.batch * self.max_seq_len, self.config.hidden_size
+        )
+        tpp_intermediate = ipex.cpu.tpp.fused_bert.BertIntermediate(self.config)
+        tpp_intermediate(hidden_states)
+        stats = torch_ipex_cpp.tpp_get_kernel_cache_stats()["xsmm_kernels"]
+        self.assertGreater(stats["hits"] + stats["misses"], 0)
+        # running again only hits the cache
+        torch_ipex_cpp.tpp_reset_kernel_cache_stats()
+        tpp_intermediate(hidden_states)
+        stats = torch_ipex_cpp.tpp_get_kernel_cache_stats()["xsmm_kernels"]
+        self.assertEqual(stats["misses"], 0)
+
 
 if __name__ == "__main__":
     test = unittest.main()